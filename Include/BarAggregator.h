@@ -0,0 +1,157 @@
+#ifndef BARAGGREGATOR_H
+#define BARAGGREGATOR_H
+
+#include "Snapshot.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Per-bucket aggregates computed by BarAggregator.
+ *
+ * Names (as used by aggregateName()) in parentheses.
+ */
+enum class Aggregate : uint8_t {
+    Count,      ///< Snapshots in the bucket ("count").
+    MidOpen,    ///< First mid price of a two-sided book ("midOpen").
+    MidHigh,    ///< Highest mid price ("midHigh").
+    MidLow,     ///< Lowest mid price ("midLow").
+    MidClose,   ///< Last mid price ("midClose").
+    Open,       ///< First trade price ("open").
+    High,       ///< Highest trade price ("high").
+    Low,        ///< Lowest trade price ("low").
+    Close,      ///< Last trade price ("close").
+    Volume,     ///< Traded quantity ("volume").
+    Vwap,       ///< Volume-weighted average trade price ("vwap").
+    Spread,     ///< Time-weighted average best ask minus best bid ("spread").
+    BidDepth,   ///< Time-weighted average quantity on the 5 bid levels ("bidDepth").
+    AskDepth,   ///< Time-weighted average quantity on the 5 ask levels ("askDepth").
+    kCount
+};
+
+/**
+ * @brief Name of an aggregate, e.g. "midOpen".
+ */
+const char* aggregateName(Aggregate aggregate);
+
+/**
+ * @brief Looks up aggregates by name, in the given order.
+ *
+ * @param names Aggregate names; empty selects every aggregate.
+ * @param aggregates Receives the aggregates.
+ * @param err Receives an error per unknown name.
+ * @return false if a name is unknown.
+ */
+bool parseAggregates(const std::vector<std::string>& names, std::vector<Aggregate>& aggregates, std::ostream& err);
+
+/**
+ * @brief Columns (bit per SnapshotColumn) needed to compute the aggregates.
+ */
+uint32_t columnsForAggregates(const std::vector<Aggregate>& aggregates);
+
+/**
+ * @brief One bucket of one symbol.
+ *
+ * Prices are NaN when the bucket has none: the mid prices and the spread
+ * without a two-sided book, the trade prices and vwap without trades.
+ */
+struct Bar {
+    char symbol[8];
+    int64_t start;       ///< Bucket start epoch, a multiple of the bucket width.
+    int64_t count;
+    double midOpen, midHigh, midLow, midClose;
+    double open, high, low, close;
+    int64_t volume;
+    double vwap;
+    double spread;
+    double bidDepth, askDepth;
+
+    /**
+     * @brief Value of an aggregate as a double (count and volume converted).
+     */
+    double value(Aggregate aggregate) const;
+};
+
+/**
+ * @brief The BarAggregator class.
+ *
+ * Turns one symbol's epoch-ordered snapshots into bars of fixed-width time
+ * buckets. Each chunk is first reduced to columns of derived values (mid,
+ * spread, depths, trades) and then folded per bucket with branch-free loops
+ * over those columns, so the hot loops vectorize. A snapshot's book is taken
+ * to hold from its epoch until the next snapshot (or the end of the range)
+ * for the time-weighted averages. A trade is a snapshot whose last trade
+ * differs from the previous snapshot's; a trade repeating the previous one's
+ * price and quantity is not visible in the snapshots. Buckets without
+ * snapshots produce no bar.
+ */
+class BarAggregator {
+public:
+    /**
+     * @param bucketNanos Bucket width (positive).
+     * @param startEpoch Start of the range; earlier time is not weighted.
+     * @param endEpoch End of the range (inclusive); the last book is weighted up to it.
+     */
+    BarAggregator(int64_t bucketNanos, int64_t startEpoch, int64_t endEpoch);
+
+    /**
+     * @brief Sets the book in force before the first added snapshot (the last
+     * one before the range), so it is weighted from the range start and its
+     * last trade is not counted again.
+     */
+    void seed(const Snapshot& previous);
+
+    /**
+     * @brief Folds a chunk of snapshots, appending the bars it completes.
+     */
+    void add(const Snapshot* begin, const Snapshot* end, std::vector<Bar>& bars);
+
+    /**
+     * @brief Appends the bar still open, if any.
+     */
+    void finish(std::vector<Bar>& bars);
+
+private:
+    /// Derived values of one chunk, one column per value.
+    struct Columns {
+        std::vector<int64_t> epoch;
+        std::vector<double> mid;
+        std::vector<double> spread;
+        std::vector<double> bidDepth;
+        std::vector<double> askDepth;
+        std::vector<double> tradePrice;     ///< 0 where the snapshot is not a trade.
+        std::vector<double> tradeQuantity;  ///< 0 where the snapshot is not a trade.
+    };
+
+    /// The book last seen, weighted until the next snapshot.
+    struct State {
+        int64_t since = 0;
+        double spread = 0.0;
+        double bidDepth = 0.0;
+        double askDepth = 0.0;
+        double lastTradePrice = -1.0;
+        int32_t lastTradeQuantity = 0;
+        bool known = false;
+    };
+
+    int64_t bucketNanos_;
+    int64_t startEpoch_;
+    int64_t endLimit_;         ///< One past endEpoch (saturated).
+    Columns columns_;
+    State state_;
+    Bar bar_;                  ///< The bar being built.
+    bool open_;
+    double notional_;          ///< Sum of price * quantity of the bar's trades.
+    double spreadSum_, spreadNanos_;
+    double depthNanos_, bidDepthSum_, askDepthSum_;
+
+    void derive(const Snapshot* begin, size_t n);
+    void startBar(const char* symbol, int64_t start);
+    void closeBar(std::vector<Bar>& bars);
+    void foldRun(size_t a, size_t b);
+    void weightState(int64_t from, int64_t to);
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BOOKBENCHMARK_H
+#define BOOKBENCHMARK_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Benchmarks the order book implementations on real order logs.
+ *
+ * Every log file is parsed once into memory; each book implementation then
+ * replays the orders (processOrder + getSnapshot per event) several times.
+ * The best time per event is reported, and the snapshots of every
+ * implementation are checked against the std::map based OrderBook.
+ *
+ * @param files Order log files to replay (one symbol per file).
+ * @param repetitions Number of timed replays per implementation and file.
+ * @return true if every implementation produced identical snapshots.
+ */
+bool runBookBenchmark(const std::vector<std::string>& files, int repetitions);
+
+#endif
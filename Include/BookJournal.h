@@ -0,0 +1,172 @@
+#ifndef BOOKJOURNAL_H
+#define BOOKJOURNAL_H
+
+#include "Order.h"
+#include "OrderBookBase.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Book journal files of a symbol, written during ingestion with --journal:
+ *
+ * "<symbol>.events": a 16-byte header (kEventLogMagic, symbol[8]) followed by
+ * every order event applied to the symbol's book, in order. Each event is a
+ * flag byte (category in bits 0-1, SELL in bit 2, bit 7 for an absolute
+ * epoch), the varint zigzag epoch (the delta to the previous event unless
+ * absolute), the varint order ID length and bytes, the price as a raw double
+ * and the varint zigzag quantity.
+ *
+ * "<symbol>.ckpt": a 16-byte header (kCheckpointMagic, symbol[8]) followed by
+ * checkpoints of the full book: a CheckpointHeader, then the book state
+ * (appendBookState()). A checkpoint holds the book after every event up to
+ * eventOffset; the event at eventOffset has an absolute epoch, so decoding
+ * can start there. Each ingestion run starts with a checkpoint of its starting
+ * book: the empty book, or the book a resumed run carried over (see
+ * BookJournal::startFrom()), so replay never depends on an earlier run.
+ */
+constexpr char kEventLogMagic[8] = {'O', 'B', 'E', 'V', 'E', 'N', 'T', '\n'};
+constexpr char kCheckpointMagic[8] = {'O', 'B', 'C', 'K', 'P', 'T', 'S', '\n'};
+constexpr size_t kJournalHeaderBytes = 16;
+
+/**
+ * @brief Fixed part of a checkpoint record.
+ */
+struct CheckpointHeader {
+    int64_t epoch;        ///< Epoch of the last event included (first event's epoch - 1 for a run start).
+    int64_t eventOffset;  ///< Offset in "<symbol>.events" of the first event not included.
+    uint32_t bytes;       ///< Size of the book state that follows.
+    uint32_t reserved;
+};
+
+/**
+ * @brief Appends one event record.
+ *
+ * @param order The event.
+ * @param previousEpoch Epoch of the previous event, or nullptr for an absolute epoch.
+ * @param out Receives the record.
+ */
+void appendEvent(const Order& order, const int64_t* previousEpoch, std::vector<char>& out);
+
+/**
+ * @brief Decodes the event record at p and advances p past it.
+ *
+ * @param previousEpoch Epoch of the previous event (ignored for an absolute
+ *        epoch); receives the event's epoch.
+ * @param order Receives the event (all fields but the symbol).
+ * @return false on truncated or corrupt input.
+ */
+bool readEvent(const char*& p, const char* end, int64_t& previousEpoch, Order& order);
+
+/**
+ * @brief Appends a book state: the orders, then the bid and ask levels, then the last trade.
+ */
+void appendBookState(const BookState& state, std::vector<char>& out);
+
+/**
+ * @brief Decodes a book state written by appendBookState().
+ *
+ * @return false on truncated or corrupt input.
+ */
+bool readBookState(const char* data, size_t size, BookState& state);
+
+/**
+ * @brief The BookJournal class.
+ *
+ * Writes a symbol's event log and book checkpoints (see above) next to its
+ * snapshot files. record() is called with every event after the symbol's
+ * book applied it; every checkpointEvents events the book's full state is
+ * saved. Both files are opened in append mode and staged in memory, so the
+ * journal adds a buffer copy per event plus a periodic book copy.
+ */
+class BookJournal {
+public:
+    static constexpr size_t kDefaultCheckpointEvents = 100000;  ///< Events between checkpoints.
+    static constexpr size_t kBufferBytes = 1 << 20;             ///< Staged bytes before a file write.
+
+    /**
+     * @param symbol The symbol whose journal is written.
+     * @param checkpointEvents Events between checkpoints (0 = only the run-start checkpoint).
+     */
+    BookJournal(const std::string& symbol, size_t checkpointEvents = kDefaultCheckpointEvents);
+
+    /**
+     * @brief Writes out everything staged.
+     */
+    ~BookJournal();
+
+    BookJournal(const BookJournal&) = delete;
+    BookJournal& operator=(const BookJournal&) = delete;
+
+    /**
+     * @brief Returns true if both files were opened successfully.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Appends an event, and a checkpoint of the book when one is due.
+     *
+     * @param order The event, already applied to book.
+     * @param book The symbol's book.
+     */
+    void record(const Order& order, const OrderBookBase& book);
+
+    /**
+     * @brief Starts this run from a book carried over from an earlier run
+     * (ProcessorOptions::resume) instead of the empty book; call before the
+     * first record().
+     *
+     * @param book The restored book.
+     * @param epoch Epoch of the last event the book includes.
+     */
+    void startFrom(const OrderBookBase& book, int64_t epoch);
+
+    /**
+     * @brief Writes the staged events and checkpoints to the files.
+     */
+    void flush();
+
+private:
+    std::string symbol_;
+    std::ofstream events_;
+    std::ofstream checkpoints_;
+    std::vector<char> eventBuffer_;
+    std::vector<char> checkpointBuffer_;
+    int64_t eventOffset_;        ///< Logical size of the event log including staged bytes.
+    int64_t previousEpoch_;      ///< Epoch of the last recorded event.
+    size_t checkpointEvents_;
+    size_t sinceCheckpoint_;     ///< Events recorded since the last checkpoint.
+    bool started_;               ///< True once this run's first event was recorded.
+    BookState state_;            ///< Scratch state for checkpoints.
+
+    void appendCheckpoint(int64_t epoch, const BookState& state);
+};
+
+/**
+ * @brief Rebuilds a symbol's full book at an epoch from its journal.
+ *
+ * Loads the latest checkpoint at or before the epoch and replays the events
+ * after it up to the epoch (inclusive). Before the first event the book is
+ * empty.
+ *
+ * @param symbol The symbol.
+ * @param epoch The time of the book.
+ * @param state Receives the book.
+ * @param err Receives a message if the journal is missing or broken.
+ * @param replayed If not null, receives the number of events replayed after the checkpoint.
+ * @return false if the journal cannot be read.
+ */
+bool rebuildBook(const std::string& symbol, int64_t epoch, BookState& state, std::ostream& err,
+                 size_t* replayed = nullptr);
+
+/**
+ * @brief Prints a rebuilt book: a summary row, every level per side (best
+ * first) with its order count and, if orders is set, every resting order.
+ */
+void printBookState(const std::string& symbol, int64_t epoch, const BookState& state, bool orders,
+                    std::ostream& out);
+
+#endif
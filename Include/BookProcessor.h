@@ -1,12 +1,73 @@
 #ifndef BOOKPROCESSOR_H
 #define BOOKPROCESSOR_H
 
+#include "BookJournal.h"
 #include "OrderBook.h"
+#include "OrderBookBase.h"
 #include "Snapshot.h"
 #include "Order.h"
+#include "PriceScale.h"
+#include "SnapshotWriter.h"
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+/**
+ * @brief Input parser used by BookProcessor.
+ */
+enum class ParserMode {
+    Stream,  ///< std::getline + std::istringstream per line (original parser).
+    Mapped   ///< Memory-mapped input tokenized in place without per-line allocation.
+};
+
+/**
+ * @brief Tuning options for BookProcessor.
+ */
+struct ProcessorOptions {
+    /// How input files are read and tokenized; the pipeline (parseThreads) and
+    /// the symbol shards always use the in-place tokenizer.
+    ParserMode parserMode = ParserMode::Mapped;
+    /// Parser threads per file. When non-zero, each file runs through a staged
+    /// pipeline (chunked read -> parallel parse -> in-order apply -> background
+    /// write) using the in-place tokenizer; 0 parses on the file's own thread.
+    size_t parseThreads = 0;
+    size_t chunkBytes = 1 << 20;  ///< Read size of the pipeline's chunk stage.
+    /// Symbol shards. When non-zero, every parsed order is routed by symbol hash
+    /// to one of shardThreads workers, each owning the books and writers of its
+    /// symbols, so input files may interleave any number of symbols. A symbol
+    /// found in several files gets their events file by file, in input order
+    /// (within a file, in line order). 0 keeps the original one-book-per-file behavior.
+    size_t shardThreads = 0;
+    BookType bookType = BookType::Map;  ///< Order book implementation used for every symbol.
+    /// Key resting orders by their numeric 64-bit ID in a flat OrderTable instead
+    /// of by ID string; orders with non-numeric IDs are reported and skipped.
+    OrderIdMode orderIdMode = OrderIdMode::String;
+    /// Write a snapshot only for events that changed the visible top levels or
+    /// the last trade (see OrderBookBase::visibleChanged); false writes one per event.
+    bool changedSnapshotsOnly = false;
+    StorageOptions storage;  ///< Encoding of the snapshot files (fixed records or keyframes + deltas).
+    /// Fixed-point price scale of each symbol: its books hold prices as ticks
+    /// and refuse orders off the grid, and the ticks format stores them (which
+    /// needs a default scale, so that every symbol has one).
+    PriceScales priceScales;
+    /// Also write each symbol's event log and periodic full-book checkpoints
+    /// ("<symbol>.events", "<symbol>.ckpt"; see BookJournal).
+    bool journal = false;
+    size_t checkpointEvents = BookJournal::kDefaultCheckpointEvents;  ///< Events between book checkpoints.
+    /// Continue each input file from its resume checkpoint (see ResumePoint.h):
+    /// output written after the checkpoint is cut off, the book is restored
+    /// and only the input after it is read. Checkpoints are saved every
+    /// resumeBytes of input and at the end of the file; a last line without a
+    /// newline is left for the next run. A file is skipped if the first or the
+    /// last 64 KiB of its processed part changed (inputFingerprint()); other
+    /// edits of that part are not detected. Needs one book per file
+    /// (shardThreads == 0) and input files that write distinct symbols.
+    bool resume = false;
+    size_t resumeBytes = 16 << 20;  ///< Input bytes between resume checkpoints.
+};
+
 /**
  * @brief The BookProcessor class
  * 
@@ -19,8 +80,12 @@ public:
      * @brief Construct a new BookProcessor object
      * 
      * @param filePaths A vector of file paths containing raw order data.
+     * @param options Processing options (parser mode, ...).
      */
-    explicit BookProcessor(const std::vector<std::string>& filePaths);
+    explicit BookProcessor(const std::vector<std::string>& filePaths,
+                           const ProcessorOptions& options = ProcessorOptions());
+
+    ~BookProcessor();
 
     /**
      * @brief Processes all provided files concurrently.
@@ -29,16 +94,143 @@ public:
 
 private:
     std::vector<std::string> filePaths_;  // List of raw data file paths.
+    ProcessorOptions options_;            // Processing options.
+
+    static constexpr size_t kShardBatchOrders = 4096;  ///< Orders per routed batch.
+    static constexpr size_t kShardQueueBatches = 64;   ///< Batches queued per shard and file before routing blocks.
+
+    struct ShardBatch;
+    struct Shard;
+    std::vector<std::unique_ptr<Shard>> shards_;  // Symbol shards (sharded mode only).
+
+    // Per-symbol snapshot writers; each symbol's files stay open for the whole run.
+    std::mutex writersMutex_;
+    std::unordered_map<std::string, std::unique_ptr<SnapshotWriter>> writers_;
 
     /**
      * @brief Processes a single file.
      * 
-     * Reads the file line-by-line, parses orders, updates the order book,
-     * and writes snapshots to disk.
+     * Reads the file line-by-line (using the configured parser mode), parses
+     * orders, updates the order book, and writes snapshots to disk.
+     * 
+     * @param filePath The path of the file to process.
+     * @param fileIndex The file's position in the input list (selects its shard queues).
+     */
+    void processFile(const std::string &filePath, size_t fileIndex);
+
+    struct FileState;
+
+    /**
+     * @brief Reads a file with std::getline and parses each line with parseLine.
+     * 
+     * @param filePath The path of the file to process.
+     * @param state Per-file book and writer state.
+     * @return true if the file could be opened.
+     */
+    bool processStreamFile(const std::string &filePath, FileState &state);
+
+    /**
+     * @brief Memory-maps a file and parses each line in place with parseOrderView.
      * 
      * @param filePath The path of the file to process.
+     * @param state Per-file book and writer state.
+     * @return true if the file could be opened.
+     */
+    bool processMappedFile(const std::string &filePath, FileState &state);
+
+    /**
+     * @brief Applies a parsed order to the file's book and writes the resulting snapshot.
+     * 
+     * @param order The parsed order.
+     * @param state Per-file book and writer state.
+     */
+    void handleOrder(const Order &order, FileState &state);
+
+    /**
+     * @brief Takes the book's snapshot at the configured depth (StorageOptions::depth)
+     * and hands it to the writer.
+     */
+    void writeSnapshot(const OrderBookBase &book, const Order &order, SnapshotWriter &writer) const;
+
+    /**
+     * @brief With options.resume: restores the file's book and outputs from its
+     * resume checkpoint and sets the input offset to continue from.
+     * 
+     * @param filePath The path of the file to process.
+     * @param state Per-file book and writer state.
+     * @return false (reported) if the checkpoint no longer matches the input or the outputs.
+     */
+    bool resumeFile(const std::string &filePath, FileState &state);
+
+    /**
+     * @brief With options.resume: flushes the file's outputs and saves a
+     * checkpoint at the state's input offset, once resumeBytes passed since
+     * the last one (or always, if final).
+     * 
+     * @param filePath The path of the file being processed.
+     * @param state Per-file book and writer state.
+     * @param final Save even if the interval has not passed.
+     */
+    void checkpointFile(const std::string &filePath, FileState &state, bool final = false);
+
+    /**
+     * @brief With options.resume: adds output files the file is about to write
+     * for the first time to its last checkpoint, with their current lengths,
+     * and saves it again.
+     * 
+     * @param state Per-file book and writer state.
+     * @param paths The output files.
+     */
+    void addResumeOutputs(FileState &state, const std::vector<std::string> &paths);
+
+    /**
+     * @brief Runs a file through the staged ingestion pipeline.
+     * 
+     * A reader thread cuts the file into line-aligned chunks, parseThreads workers
+     * tokenize chunks in parallel, and the calling thread applies them to the book
+     * strictly in file order, so book updates stay deterministic. Bounded queues
+     * and a fixed chunk pool connect the stages.
+     * 
+     * @param filePath The path of the file to process.
+     * @param state Per-file book and writer state.
+     * @return true if the file could be opened.
+     */
+    bool processPipelinedFile(const std::string &filePath, FileState &state);
+
+    struct Chunk;
+
+    /**
+     * @brief Shard worker body: applies routed orders to the shard's per-symbol books.
+     * 
+     * Books and writers are created on first sight of a symbol and are only ever
+     * touched by this shard's thread.
+     * 
+     * @param shard The shard to run.
+     */
+    void runShard(Shard &shard);
+
+    /**
+     * @brief Appends a parsed order to the batch of the shard owning its symbol.
+     * 
+     * @param view The parsed order.
+     * @param keepAlive Owner of the buffer the view points into.
+     * @param state Per-file routing state.
+     */
+    void routeOrder(const OrderView &view, const std::shared_ptr<const void> &keepAlive, FileState &state);
+
+    /**
+     * @brief Sends all partially filled batches of a file to their shards.
+     * 
+     * @param state Per-file routing state.
+     */
+    void flushRoutes(FileState &state);
+
+    /**
+     * @brief Pipeline parse stage: tokenizes every line of a chunk into its order list.
+     * 
+     * @param chunk The chunk to parse.
      */
-    void processFile(const std::string &filePath);
+    static void parseChunk(Chunk &chunk);
 
     /**
      * @brief Parses a single line of the log file into an Order object.
@@ -52,15 +244,15 @@ private:
     bool parseLine(const std::string &line, Order &order);
 
     /**
-     * @brief Writes the snapshot to a binary file and updates the index file.
+     * @brief Returns the writer owning "<symbol>.snap" and "<symbol>.idx", creating it on first use.
      * 
-     * The snapshot is appended to a file named "<symbol>.snap" and an index
-     * entry is added to "<symbol>.idx" for fast retrieval.
+     * Only the lookup is synchronized; the returned writer buffers snapshots and
+     * flushes them from its own background thread.
      * 
-     * @param snapshot The snapshot to write.
-     * @param symbol The symbol corresponding to the snapshot.
+     * @param symbol The symbol whose writer is requested.
+     * @return SnapshotWriter& The writer for the symbol.
      */
-    void writeSnapshotBinary(const Snapshot &snapshot, const std::string &symbol);
+    SnapshotWriter &writerFor(const std::string &symbol);
 };
 
 #endif
@@ -0,0 +1,135 @@
+#ifndef DEPTHSTORE_H
+#define DEPTHSTORE_H
+
+#include "MappedFile.h"
+#include "QueryEngine.h"
+#include "Snapshot.h"
+#include "SnapshotIndex.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The DepthFiles class.
+ *
+ * A symbol's mapped snapshot and index files of a given depth, for stores
+ * written with StorageOptions::depth (see the depth format in SnapshotCodec.h).
+ * Everything here depends on the depth only through the record size, so it
+ * is shared by every instantiation of queryDepth().
+ */
+class DepthFiles {
+public:
+    DepthFiles();
+
+    /**
+     * @brief Maps "<symbol>.snap" and "<symbol>.idx" and checks that they hold snapshots of the depth.
+     *
+     * @return false (with a message on err) if a file cannot be opened or holds another depth.
+     */
+    bool open(const std::string& symbol, int depth, std::ostream& err);
+
+    /**
+     * @brief Record positions of an epoch range, found through the index as in
+     * QueryEngine::mappedSnapshots().
+     *
+     * The range runs from the first record at or after startEpoch up to the
+     * first one past endEpoch, in file order, so with out-of-order epochs it
+     * may hold a few earlier ones.
+     *
+     * @param first Receives the position of the first record.
+     * @param last Receives one past the position of the last record.
+     * @return false (with a message on err) if the index does not match the snapshot file.
+     */
+    bool range(int64_t startEpoch, int64_t endEpoch, size_t& first, size_t& last, std::ostream& err) const;
+
+    /**
+     * @brief The first record; records are recordBytes() apart and suitably aligned.
+     */
+    const char* records() const { return snap_.data() + dataOffset_; }
+    size_t recordCount() const { return recordCount_; }
+    size_t recordBytes() const { return recordBytes_; }
+
+private:
+    std::string symbol_;
+    MappedFile snap_;
+    SnapshotIndex index_;
+    size_t dataOffset_;   ///< Size of the file header.
+    size_t recordBytes_;  ///< sizeof(BasicSnapshot<depth>).
+    size_t recordCount_;
+
+    int64_t epochAt(size_t position) const;
+};
+
+/**
+ * @brief Detects the common depth of the symbols' snapshot files (see detectSnapshotDepth()).
+ *
+ * @return The depth, or 0 (with a message on err) if a file has a broken
+ *         depth header or the symbols were written with different depths.
+ */
+int detectQueryDepth(const std::vector<std::string>& symbols, std::ostream& err);
+
+/**
+ * @brief Runs a query over snapshot files of the given depth.
+ *
+ * The symbols' snapshots in the epoch range are read in place from the
+ * mapped files and merged in epoch order; equal epochs come out in the order
+ * of criteria.symbols, as with QueryEngine::query(). Filters need snapshots
+ * of kDefaultDepth, so criteria.filter must be empty. Stops after
+ * criteria.limit snapshots or once the sink returns false.
+ *
+ * @param criteria Query criteria.
+ * @param sink Receives the snapshots.
+ * @param err Receives a message for every symbol that cannot be read.
+ * @return size_t Number of snapshots passed to the sink.
+ */
+template <int Depth>
+size_t queryDepth(const QueryCriteria& criteria, const std::function<bool(const BasicSnapshot<Depth>&)>& sink,
+                  std::ostream& err) {
+    using Record = BasicSnapshot<Depth>;
+    if (!criteria.filter.empty()) {
+        err << "Error: Filters need snapshots of depth " << kDefaultDepth << "." << std::endl;
+        return 0;
+    }
+
+    // One cursor per readable symbol, over its records in the range.
+    struct Cursor {
+        const Record* current;
+        const Record* end;
+    };
+    std::vector<std::unique_ptr<DepthFiles>> files;
+    std::vector<Cursor> cursors;
+    for (const auto& symbol : criteria.symbols) {
+        std::unique_ptr<DepthFiles> symbolFiles(new DepthFiles());
+        size_t first = 0, last = 0;
+        if (!symbolFiles->open(symbol, Depth, err) ||
+            !symbolFiles->range(criteria.startEpoch, criteria.endEpoch, first, last, err))
+            continue;
+        const Record* records = reinterpret_cast<const Record*>(symbolFiles->records());
+        cursors.push_back({records + first, records + last});
+        files.push_back(std::move(symbolFiles));
+    }
+
+    // Merge: a handful of symbols, so a linear pick of the earliest cursor.
+    size_t count = 0;
+    while (criteria.limit == 0 || count < criteria.limit) {
+        Cursor* next = nullptr;
+        for (Cursor& cursor : cursors) {
+            while (cursor.current < cursor.end && cursor.current->epoch < criteria.startEpoch)
+                ++cursor.current;
+            if (cursor.current < cursor.end && (next == nullptr || cursor.current->epoch < next->current->epoch))
+                next = &cursor;
+        }
+        if (next == nullptr)
+            break;
+        ++count;
+        if (!sink(*next->current++))
+            break;
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef LOGPARSER_H
+#define LOGPARSER_H
+
+#include "Order.h"
+
+/**
+ * Zero-allocation tokenizer for raw order log lines.
+ *
+ * Works directly on a character buffer (typically a memory-mapped log file):
+ * fields are located in place, numbers are converted with std::from_chars and
+ * the result is an OrderView that points back into the buffer. Whitespace
+ * skipping uses SSE2 when available, which pays off on the padded, mixed
+ * tab/space columns of the exchange logs; newlines are found with memchr.
+ */
+
+/**
+ * @brief Finds the end of the current line.
+ *
+ * @param begin Start of the scan.
+ * @param end End of the buffer.
+ * @return const char* Pointer to the first '\n' in [begin, end), or end if there is none.
+ */
+const char *findLineEnd(const char *begin, const char *end);
+
+/**
+ * @brief Parses one log line into an OrderView without allocating.
+ *
+ * Expected format: epoch order_id symbol order_side order_category price quantity,
+ * separated by any mix of spaces and tabs. Extra trailing fields are ignored.
+ *
+ * @param begin Start of the line.
+ * @param end End of the line (exclusive, without the '\n').
+ * @param view The view to populate; its string fields point into [begin, end).
+ * @return true if all seven fields were present and valid; false otherwise.
+ */
+bool parseOrderView(const char *begin, const char *end, OrderView &view);
+
+/**
+ * @brief Copies a view into an owning Order.
+ *
+ * The string members are assigned in place, so reusing the same Order across
+ * lines does not allocate once its buffers have grown to fit.
+ *
+ * In OrderIdMode::Integer a decimal 64-bit order ID is converted here, once,
+ * into numericId and orderId is left empty; any other ID is copied to orderId
+ * so that the book reports it.
+ *
+ * @param view The parsed view.
+ * @param order The Order to populate.
+ * @param idMode How the receiving book keys its orders.
+ */
+void assignOrder(const OrderView &view, Order &order, OrderIdMode idMode = OrderIdMode::String);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief The MappedFile class.
+ *
+ * Read-only memory mapping of a whole file (POSIX mmap or Win32 file mapping).
+ * The mapping is released when the object is destroyed. An empty file is
+ * reported as open with size 0 and a null data pointer.
+ */
+class MappedFile {
+public:
+    MappedFile();
+
+    /**
+     * @brief Maps the given file; check isOpen() for success.
+     *
+     * @param path Path of the file to map.
+     */
+    explicit MappedFile(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /**
+     * @brief Maps a file, releasing any previous mapping.
+     *
+     * @param path Path of the file to map.
+     * @return true if the file was opened (and mapped, when non-empty).
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Releases the mapping.
+     */
+    void close();
+
+    bool isOpen() const { return open_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+    bool open_;
+#ifdef _WIN32
+    void* fileHandle_;
+    void* mappingHandle_;
+#endif
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define ORDER_H
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 
 /**
@@ -21,11 +22,21 @@ enum class OrderCategory {
     TRADE
 };
 
+/**
+ * @brief How order books key their resting orders.
+ */
+enum class OrderIdMode {
+    String,  ///< Hash maps keyed on the order ID text.
+    Integer  ///< Flat open-addressing OrderTable keyed on the numeric 64-bit order ID.
+};
+
 /**
  * @brief Represents a single order from the log file.
  *
  * Contains the order's timestamp (epoch in nanoseconds), unique order ID, 
  * associated symbol, side (BUY/SELL), category (NEW/CANCEL/TRADE), price, and quantity.
+ * In OrderIdMode::Integer the parser stores a numeric ID in numericId only and
+ * leaves orderId empty; an order with a non-empty orderId is keyed on that text.
  */
 struct Order {
     int64_t epoch;         
@@ -35,6 +46,30 @@ struct Order {
     OrderCategory category;
     double price;
     int quantity;
+    uint64_t numericId = 0;  ///< The order ID when orderId is empty (OrderIdMode::Integer).
+};
+
+/**
+ * @brief The order ID as text, also when the parser stored it in numericId only.
+ */
+inline std::string orderIdText(const Order& order) {
+    return order.orderId.empty() ? std::to_string(order.numericId) : order.orderId;
+}
+
+/**
+ * @brief Compact, non-owning view of a parsed order line.
+ *
+ * Produced by the zero-allocation parser: the order ID and symbol point into the
+ * input buffer (e.g. a memory-mapped log file), so the buffer must outlive the view.
+ */
+struct OrderView {
+    int64_t epoch;
+    std::string_view orderId;
+    std::string_view symbol;
+    OrderSide side;
+    OrderCategory category;
+    double price;
+    int quantity;
 };
 
 #endif
@@ -3,17 +3,20 @@
 
 #include "Order.h"
 #include "Snapshot.h"
+#include "OrderBookBase.h"
+#include "OrderTable.h"
+#include <cstdint>
 #include <map>
 #include <unordered_map>
 #include <string>
 
 /**
- * @brief Comparator for sorting prices in descending order.
+ * @brief Comparator for sorting price keys in descending order.
  * 
  * Used for the buy side to ensure the highest price appears first.
  */
 struct DescendingComparator {
-    bool operator()(double lhs, double rhs) const {
+    bool operator()(int64_t lhs, int64_t rhs) const {
         return lhs > rhs;
     }
 };
@@ -24,15 +27,23 @@ struct DescendingComparator {
  * Maintains the current order book for a specific symbol by processing orders
  * (NEW, CANCEL, and TRADE) and aggregates orders into bid and ask levels.
  * Provides snapshots representing the order book state at a given epoch.
+ *
+ * Levels are keyed on 64-bit integers: in fixed-point mode the price in ticks
+ * (see PriceScale.h), where a price off the tick grid is reported and the
+ * order skipped; otherwise the bits of the double price, mapped so that they
+ * sort like the prices.
  */
-class OrderBook {
+class OrderBook : public OrderBookBase {
 public:
     /**
      * @brief Construct a new OrderBook object for a given symbol.
      * 
      * @param symbol The symbol associated with this order book.
+     * @param idMode How resting orders are keyed (order ID text or 64-bit integer).
+     * @param ticksPerUnit Fixed-point price scale; 0 for floating-point prices.
      */
-    explicit OrderBook(const std::string& symbol);
+    explicit OrderBook(const std::string& symbol, OrderIdMode idMode = OrderIdMode::String,
+                       int64_t ticksPerUnit = 0);
 
     /**
      * @brief Process an order update.
@@ -41,7 +52,7 @@ public:
      * 
      * @param order The order to process.
      */
-    void processOrder(const Order& order);
+    void processOrder(const Order& order) override;
 
     /**
      * @brief Get a snapshot of the current order book state.
@@ -52,22 +63,63 @@ public:
      * @param epoch The snapshot time in nanoseconds.
      * @return Snapshot The order book snapshot in fixed format.
      */
-    Snapshot getSnapshot(int64_t epoch) const;
+    Snapshot getSnapshot(int64_t epoch) const override;
+
+    bool visibleChanged() const override { return visibleChanged_; }
+    int topLevels(OrderSide side, int count, double* prices, int32_t* quantities) const override;
+    const std::string& symbol() const override { return symbol_; }
+    double lastTradePrice() const override { return lastTradePrice_; }
+    int lastTradeQuantity() const override { return lastTradeQuantity_; }
+    void saveState(BookState& state) const override;
+    void loadState(const BookState& state) override;
 
 private:
     std::string symbol_; ///< The symbol for this order book.
 
-    // Maps to track individual orders.
+    OrderIdMode idMode_; ///< Selects which of the order containers below is used.
+    int64_t ticksPerUnit_; ///< Fixed-point scale of the level keys; 0 for floating-point prices.
+
+    // Maps to track individual orders (OrderIdMode::String).
     std::unordered_map<std::string, Order> buyOrders_;
     std::unordered_map<std::string, Order> sellOrders_;
 
+    /**
+     * @brief Compact record of a resting order (OrderIdMode::Integer).
+     */
+    struct RestingOrder {
+        int64_t key;
+        int quantity;
+    };
+
+    // Flat tables keyed on the numeric order ID (OrderIdMode::Integer).
+    OrderTable<RestingOrder> buyTable_;
+    OrderTable<RestingOrder> sellTable_;
+
     // Aggregated bid levels (sorted in descending order) and ask levels (sorted in ascending order).
-    std::map<double, int, DescendingComparator> buyLevels_;
-    std::map<double, int> sellLevels_;
+    std::map<int64_t, int, DescendingComparator> buyLevels_;
+    std::map<int64_t, int> sellLevels_;
 
     double lastTradePrice_; ///< Last trade price (if any).
     int lastTradeQuantity_; ///< Last trade quantity (if any).
 
+    bool visibleChanged_;          ///< Set when the last order changed the visible state.
+    mutable Snapshot cached_;      ///< Snapshot of the visible state (epoch excluded).
+    mutable bool cacheValid_;      ///< False once the visible state changed after cached_ was built.
+    // Worst visible bid/ask key of cached_ (INT64_MIN/INT64_MAX while a side has fewer than 5 levels).
+    mutable int64_t bidBoundary_;
+    mutable int64_t askBoundary_;
+
+    /**
+     * @brief Level key of a price; throws std::invalid_argument for a price off the tick grid.
+     */
+    int64_t toKey(double price) const;
+    double toPrice(int64_t key) const;
+
+    /**
+     * @brief Records a change at a price level, flagging it if the level is visible.
+     */
+    void noteLevelChange(OrderSide side, int64_t key);
+
     /**
      * @brief Add a new order to the order book.
      * 
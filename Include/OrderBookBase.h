@@ -0,0 +1,178 @@
+#ifndef ORDERBOOKBASE_H
+#define ORDERBOOKBASE_H
+
+#include "Order.h"
+#include "Snapshot.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Order book implementations selectable at ingestion time.
+ */
+enum class BookType {
+    Map,    ///< OrderBook: std::map price levels keyed on the exact price (or its ticks).
+    Ladder  ///< PriceLadderBook: tick-indexed contiguous price ladder.
+};
+
+/**
+ * @brief The full state of a book, independent of its implementation.
+ *
+ * Used for checkpoints (see BookJournal.h) and for full-depth reconstruction.
+ */
+struct BookState {
+    /**
+     * @brief A resting order.
+     */
+    struct RestingOrder {
+        std::string orderId;
+        OrderSide side;
+        double price;
+        int quantity;  ///< Remaining quantity.
+    };
+
+    std::vector<RestingOrder> orders;              ///< In no particular order.
+    std::vector<std::pair<double, int64_t>> bids;  ///< Every bid level (price, quantity), best first.
+    std::vector<std::pair<double, int64_t>> asks;  ///< Every ask level (price, quantity), best first.
+    double lastTradePrice = -1.0;                  ///< -1 if none.
+    int lastTradeQuantity = 0;
+};
+
+/**
+ * @brief Common interface of the order book implementations.
+ *
+ * BookProcessor only needs to apply orders and take snapshots, so it works
+ * against this interface and lets ProcessorOptions pick the implementation.
+ */
+class OrderBookBase {
+public:
+    static constexpr int kVisibleLevels = kDefaultDepth;  ///< Levels per side carried in a Snapshot.
+
+    virtual ~OrderBookBase() = default;
+
+    /**
+     * @brief Levels per side that visibleChanged() watches (kVisibleLevels by default).
+     *
+     * Set it to the depth of the snapshots taken from the book, so that
+     * --snapshots=changed neither misses deeper levels nor reacts to them.
+     */
+    void setVisibleLevels(int levels) { visibleLevels_ = levels; }
+    int visibleLevels() const { return visibleLevels_; }
+
+    /**
+     * @brief Process an order update (NEW, CANCEL or TRADE).
+     *
+     * @param order The order to process.
+     */
+    virtual void processOrder(const Order& order) = 0;
+
+    /**
+     * @brief Get a snapshot of the current order book state.
+     *
+     * @param epoch The snapshot time in nanoseconds.
+     * @return Snapshot The order book snapshot in fixed format.
+     */
+    virtual Snapshot getSnapshot(int64_t epoch) const = 0;
+
+    /**
+     * @brief Get a snapshot carrying the Depth best levels per side.
+     *
+     * The default depth is getSnapshot(); other depths are filled from
+     * topLevels(), and the empty levels are padded with price -1 and quantity 0.
+     *
+     * @param epoch The snapshot time in nanoseconds.
+     */
+    template <int Depth>
+    BasicSnapshot<Depth> getDepthSnapshot(int64_t epoch) const;
+
+    /**
+     * @brief Copies the best levels of one side, best first.
+     *
+     * @param side The side to copy.
+     * @param count Maximum number of levels.
+     * @param prices Receives up to count prices.
+     * @param quantities Receives the matching quantities.
+     * @return int Number of levels copied.
+     */
+    virtual int topLevels(OrderSide side, int count, double* prices, int32_t* quantities) const = 0;
+
+    virtual const std::string& symbol() const = 0;
+    virtual double lastTradePrice() const = 0;      ///< -1 if none.
+    virtual int lastTradeQuantity() const = 0;      ///< 0 if none.
+
+    /**
+     * @brief Whether the last processOrder() changed what a snapshot shows.
+     *
+     * True when the order touched one of the top visibleLevels() levels of
+     * its side or changed the last trade; false for deep-book updates and for
+     * cancels/trades of unknown order IDs.
+     */
+    virtual bool visibleChanged() const = 0;
+
+    /**
+     * @brief Copies the full book: every resting order and level, and the last trade.
+     *
+     * @param state Receives the state (replacing its contents).
+     */
+    virtual void saveState(BookState& state) const = 0;
+
+    /**
+     * @brief Replaces the book with a saved state (from any implementation).
+     *
+     * Levels are taken as saved rather than summed from the orders, so a
+     * restored book continues exactly like the one that was saved. With
+     * OrderIdMode::Integer the order IDs must be numeric.
+     *
+     * @param state The state to restore.
+     */
+    virtual void loadState(const BookState& state) = 0;
+
+protected:
+    int visibleLevels_ = kVisibleLevels;
+};
+
+template <int Depth>
+BasicSnapshot<Depth> OrderBookBase::getDepthSnapshot(int64_t epoch) const {
+    if constexpr (Depth == kDefaultDepth) {
+        return getSnapshot(epoch);
+    } else {
+        BasicSnapshot<Depth> snap;
+        std::memset(snap.symbol, 0, sizeof(snap.symbol));
+        std::strncpy(snap.symbol, symbol().c_str(), sizeof(snap.symbol) - 1);
+        snap.epoch = epoch;
+        // Levels past the book's last one are padded up to the compile-time depth.
+        for (int i = topLevels(OrderSide::BUY, Depth, snap.bidPrices, snap.bidQuantities); i < Depth; ++i) {
+            snap.bidPrices[i] = -1.0;
+            snap.bidQuantities[i] = 0;
+        }
+        for (int i = topLevels(OrderSide::SELL, Depth, snap.askPrices, snap.askQuantities); i < Depth; ++i) {
+            snap.askPrices[i] = -1.0;
+            snap.askQuantities[i] = 0;
+        }
+        snap.lastTradePrice = lastTradePrice();
+        snap.lastTradeQuantity = lastTradeQuantity();
+        return snap;
+    }
+}
+
+/**
+ * @brief Creates an order book of the requested implementation.
+ *
+ * @param type The implementation to create.
+ * @param symbol The symbol associated with the book.
+ * @param idMode How the book keys its resting orders.
+ * @param visibleLevels Levels per side watched by visibleChanged() (the snapshot depth).
+ * @param ticksPerUnit Fixed-point price scale (see PriceScale.h): prices are
+ *        held as ticks and prices off the grid are refused; 0 keeps each
+ *        implementation's own price handling.
+ * @return std::unique_ptr<OrderBookBase> The new, empty book.
+ */
+std::unique_ptr<OrderBookBase> makeOrderBook(BookType type, const std::string& symbol,
+                                             OrderIdMode idMode = OrderIdMode::String,
+                                             int visibleLevels = OrderBookBase::kVisibleLevels,
+                                             int64_t ticksPerUnit = 0);
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef ORDERTABLE_H
+#define ORDERTABLE_H
+
+#include "Order.h"
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Converts a decimal order ID (e.g. "7374421476721609047") to an integer key.
+ *
+ * @param orderId The order ID text.
+ * @return uint64_t The numeric order ID.
+ * @throws std::invalid_argument if the ID is not a decimal 64-bit unsigned integer.
+ */
+inline uint64_t numericOrderId(const std::string& orderId) {
+    uint64_t id = 0;
+    const char* last = orderId.data() + orderId.size();
+    auto result = std::from_chars(orderId.data(), last, id);
+    if (result.ec != std::errc() || result.ptr != last)
+        throw std::invalid_argument("order ID is not a 64-bit integer");
+    return id;
+}
+
+/**
+ * @brief The integer key of an order: numericId as converted by the parser, or
+ * the converted orderId for an order that carries its ID as text.
+ *
+ * @throws std::invalid_argument if orderId is set and is not a 64-bit integer.
+ */
+inline uint64_t numericOrderId(const Order& order) {
+    return order.orderId.empty() ? order.numericId : numericOrderId(order.orderId);
+}
+
+/**
+ * @brief Flat open-addressing hash table from 64-bit order IDs to pooled records.
+ *
+ * Slots hold only the key and a 32-bit index into a record pool, so probing
+ * walks a dense array of 16-byte slots. Collisions use linear probing and
+ * deletions use backward shifting, so there are no tombstones. Records live in
+ * one contiguous pool whose freed entries are recycled through a free list;
+ * no per-order heap allocation happens once the pool has grown.
+ *
+ * @tparam Record Compact per-order payload (e.g. price and remaining quantity).
+ */
+template <typename Record>
+class OrderTable {
+public:
+    OrderTable() : size_(0), mask_(0) {}
+
+    /**
+     * @brief Returns the record of an order, or nullptr if the ID is unknown.
+     */
+    Record* find(uint64_t id) {
+        if (slots_.empty())
+            return nullptr;
+        for (size_t i = slotFor(id); slots_[i].index != kEmpty; i = (i + 1) & mask_) {
+            if (slots_[i].key == id)
+                return &pool_[slots_[i].index];
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Inserts an order, overwriting the record if the ID already exists.
+     *
+     * @return Record& The stored record.
+     */
+    Record& insert(uint64_t id, const Record& record) {
+        if ((size_ + 1) * 2 > slots_.size())
+            grow();
+        size_t i = slotFor(id);
+        for (; slots_[i].index != kEmpty; i = (i + 1) & mask_) {
+            if (slots_[i].key == id)
+                return pool_[slots_[i].index] = record;
+        }
+        uint32_t index;
+        if (!freeList_.empty()) {
+            index = freeList_.back();
+            freeList_.pop_back();
+            pool_[index] = record;
+        } else {
+            index = static_cast<uint32_t>(pool_.size());
+            pool_.push_back(record);
+        }
+        slots_[i] = Slot{id, index};
+        ++size_;
+        return pool_[index];
+    }
+
+    /**
+     * @brief Removes an order and returns its record to the pool.
+     *
+     * @return true if the ID was present.
+     */
+    bool erase(uint64_t id) {
+        if (slots_.empty())
+            return false;
+        size_t i = slotFor(id);
+        for (; slots_[i].index != kEmpty; i = (i + 1) & mask_) {
+            if (slots_[i].key == id)
+                break;
+        }
+        if (slots_[i].index == kEmpty)
+            return false;
+        freeList_.push_back(slots_[i].index);
+        // Backward-shift deletion: pull later members of the probe run into the hole.
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask_; slots_[j].index != kEmpty; j = (j + 1) & mask_) {
+            size_t home = slotFor(slots_[j].key);
+            // Move j into the hole unless its home lies cyclically in (hole, j].
+            if (((j - home) & mask_) >= ((j - hole) & mask_)) {
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+        slots_[hole].index = kEmpty;
+        --size_;
+        return true;
+    }
+
+    /**
+     * @brief Number of orders in the table.
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Calls fn(id, record) for every order, in unspecified order.
+     */
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (const auto& slot : slots_) {
+            if (slot.index != kEmpty)
+                fn(slot.key, pool_[slot.index]);
+        }
+    }
+
+    /**
+     * @brief Bytes held by the slot array, record pool and free list.
+     */
+    size_t memoryBytes() const {
+        return slots_.capacity() * sizeof(Slot) + pool_.capacity() * sizeof(Record) +
+               freeList_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    static constexpr uint32_t kEmpty = 0xFFFFFFFFu;
+    static constexpr size_t kInitialSlots = 1024;
+
+    struct Slot {
+        uint64_t key;
+        uint32_t index;  ///< Pool index, or kEmpty.
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<Record> pool_;
+    std::vector<uint32_t> freeList_;
+    size_t size_;
+    size_t mask_;
+
+    // Exchange IDs are often sequential, so mix the bits before masking.
+    size_t slotFor(uint64_t id) const {
+        id ^= id >> 33;
+        id *= 0xff51afd7ed558ccdULL;
+        id ^= id >> 33;
+        return static_cast<size_t>(id) & mask_;
+    }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.assign(old.empty() ? kInitialSlots : old.size() * 2, Slot{0, kEmpty});
+        mask_ = slots_.size() - 1;
+        for (const auto& slot : old) {
+            if (slot.index == kEmpty)
+                continue;
+            size_t i = slotFor(slot.key);
+            while (slots_[i].index != kEmpty)
+                i = (i + 1) & mask_;
+            slots_[i] = slot;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef PRICELADDERBOOK_H
+#define PRICELADDERBOOK_H
+
+#include "OrderBookBase.h"
+#include "OrderTable.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The PriceLadderBook class.
+ *
+ * Alternative to OrderBook that converts prices to integer ticks and keeps each
+ * side's aggregated levels in a contiguous array indexed by tick. Level identity
+ * is exact integer equality, adding and removing quantity touches a single array
+ * slot, the best bid/ask index is maintained incrementally, and the top 5 levels
+ * are found by a short linear scan outward from the touch.
+ *
+ * The ladder window grows to cover the live prices up to kMaxLadderTicks; levels
+ * even farther away are kept in a small ordered overflow map. Orders priced off
+ * the tick grid are refused and reported rather than merged into a neighbouring
+ * level.
+ */
+class PriceLadderBook : public OrderBookBase {
+public:
+    static constexpr int64_t kDefaultTicksPerUnit = 100;  ///< Tick size 0.01.
+    static constexpr int64_t kInitialLadderTicks = 1024;  ///< Initial window size per side.
+    static constexpr int64_t kMaxLadderTicks = 1 << 16;   ///< Largest window size per side.
+
+    /**
+     * @brief Construct a new PriceLadderBook for a given symbol.
+     *
+     * @param symbol The symbol associated with this order book.
+     * @param ticksPerUnit Number of ticks per price unit (100 means a 0.01 tick).
+     * @param idMode How resting orders are keyed (order ID text or 64-bit integer).
+     */
+    explicit PriceLadderBook(const std::string& symbol, int64_t ticksPerUnit = kDefaultTicksPerUnit,
+                             OrderIdMode idMode = OrderIdMode::String);
+
+    void processOrder(const Order& order) override;
+    Snapshot getSnapshot(int64_t epoch) const override;
+
+    bool visibleChanged() const override { return visibleChanged_; }
+    int topLevels(OrderSide side, int count, double* prices, int32_t* quantities) const override;
+    const std::string& symbol() const override { return symbol_; }
+    double lastTradePrice() const override { return lastTradePrice_; }
+    int lastTradeQuantity() const override { return lastTradeQuantity_; }
+    void saveState(BookState& state) const override;
+    void loadState(const BookState& state) override;
+
+private:
+    /**
+     * @brief One side of the book: level quantities indexed by tick.
+     */
+    class Ladder {
+    public:
+        explicit Ladder(bool isBid);
+
+        /**
+         * @brief Adds quantity at a tick.
+         */
+        void add(int64_t tick, int64_t quantity);
+
+        /**
+         * @brief Removes quantity at a tick; the level disappears once it reaches zero.
+         */
+        void remove(int64_t tick, int64_t quantity);
+
+        /**
+         * @brief Copies up to maxLevels best levels, best first.
+         *
+         * @return int The number of levels written.
+         */
+        int top(int maxLevels, int64_t* ticks, int64_t* quantities) const;
+
+        /**
+         * @brief True if fewer than levels non-empty levels are strictly better than tick.
+         */
+        bool isVisible(int64_t tick, int levels) const;
+
+        /**
+         * @brief Number of non-empty levels, in the window and in overflow.
+         */
+        size_t levelCount() const { return live_ + overflow_.size(); }
+
+    private:
+        bool isBid_;                          ///< Bids: best is the highest tick; asks: the lowest.
+        int64_t base_;                        ///< Tick of levels_[0].
+        std::vector<int64_t> levels_;         ///< Aggregated quantity per tick (0 = empty).
+        int64_t best_;                        ///< Index of the best non-empty level, or -1.
+        size_t live_;                         ///< Number of non-empty levels in levels_.
+        std::map<int64_t, int64_t> overflow_; ///< Levels outside the window.
+
+        bool inWindow(int64_t tick) const;
+        int64_t indexFor(int64_t tick);       ///< Index after growing the window, or -1 for overflow.
+        void rebase(int64_t newBase, size_t newSize);
+        void findBest(int64_t from);
+    };
+
+    /**
+     * @brief Compact record of a resting order.
+     */
+    struct RestingOrder {
+        int64_t tick;
+        int quantity;
+    };
+
+    std::string symbol_;                     ///< The symbol for this order book.
+    int64_t ticksPerUnit_;                   ///< Price scale: tick = price * ticksPerUnit_ (see priceToTicks).
+
+    OrderIdMode idMode_;                     ///< Selects the order containers below.
+    std::unordered_map<std::string, RestingOrder> buyOrders_;   ///< OrderIdMode::String.
+    std::unordered_map<std::string, RestingOrder> sellOrders_;
+    OrderTable<RestingOrder> buyTable_;                         ///< OrderIdMode::Integer.
+    OrderTable<RestingOrder> sellTable_;
+    Ladder bids_;
+    Ladder asks_;
+
+    double lastTradePrice_;                  ///< Last trade price (if any).
+    int lastTradeQuantity_;                  ///< Last trade quantity (if any).
+
+    bool visibleChanged_;                    ///< Set when the last order changed the visible state.
+    mutable Snapshot cached_;                ///< Snapshot of the visible state (epoch excluded).
+    mutable bool cacheValid_;                ///< False once the visible state changed after cached_ was built.
+    mutable int64_t bidBoundary_;            ///< Worst visible bid tick of cached_ (INT64_MIN if < 5 levels).
+    mutable int64_t askBoundary_;            ///< Worst visible ask tick of cached_ (INT64_MAX if < 5 levels).
+
+    int64_t toTicks(double price) const;  ///< Throws std::invalid_argument for a price off the grid.
+    double toPrice(int64_t tick) const;
+    void addOrder(const Order& order);
+    void removeOrder(const Order& order, int quantityToRemove);
+    void noteLevelChange(const Ladder& ladder, int64_t tick);
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef PRICESCALE_H
+#define PRICESCALE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Fixed-point prices: a price is held as a whole number of ticks, and a
+ * symbol's scale (ticks per price unit) sets its tick size, e.g. 100 for
+ * 0.01. Log prices are decimal text, so a price on the tick grid parses to
+ * the double nearest to an exact tick count; priceToTicks() recovers that
+ * count and refuses every price that is not on the grid.
+ */
+
+/**
+ * @brief Converts a price to ticks of the given scale.
+ *
+ * @param price The price.
+ * @param ticksPerUnit Ticks per price unit (> 0).
+ * @param ticks Receives the tick count.
+ * @return false if the price is not a whole number of ticks, not finite, or
+ *         too large to be represented exactly.
+ */
+bool priceToTicks(double price, int64_t ticksPerUnit, int64_t& ticks);
+
+/**
+ * @brief The price of a tick count; exact up to the rounding of the division.
+ */
+inline double ticksToPrice(int64_t ticks, int64_t ticksPerUnit) {
+    return static_cast<double>(ticks) / static_cast<double>(ticksPerUnit);
+}
+
+/**
+ * @brief Decimals that print every price of the scale exactly (e.g. 2 for 100,
+ * 3 for 1000, 2 for 20); 9 for scales without an exact decimal form.
+ */
+int priceDecimals(int64_t ticksPerUnit);
+
+/**
+ * @brief Price scale of each symbol for the fixed-point mode.
+ */
+struct PriceScales {
+    int64_t defaultTicksPerUnit = 0;                   ///< Unlisted symbols; 0 keeps floating-point prices.
+    std::unordered_map<std::string, int64_t> symbols;  ///< Per-symbol scales.
+
+    /**
+     * @brief The scale of a symbol; 0 for floating-point prices.
+     */
+    int64_t forSymbol(const std::string& symbol) const;
+
+    /**
+     * @brief True if no symbol uses fixed-point prices.
+     */
+    bool empty() const { return defaultTicksPerUnit == 0 && symbols.empty(); }
+
+    /**
+     * @brief Parses comma-separated entries: "<n>" sets the default scale,
+     * "<symbol>:<n>" the scale of one symbol.
+     *
+     * @return false (with a message on err) on a malformed entry or a scale <= 0.
+     */
+    bool parse(const std::string& spec, std::ostream& err);
+};
+
+#endif
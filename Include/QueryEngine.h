@@ -2,10 +2,24 @@
 #define QUERYENGINE_H
 
 #include "Snapshot.h"
+#include "BarAggregator.h"
+#include "SnapshotCodec.h"
+#include "SnapshotFilter.h"
+#include "MappedFile.h"
+#include "SnapshotIndex.h"
+#include "SnapshotMerger.h"
+#include "ZoneMap.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <unordered_set>
 
+class WorkerPool;
+
 /**
  * @brief Structure representing query criteria.
  *
@@ -16,6 +30,76 @@ struct QueryCriteria {
     int64_t endEpoch;                            ///< End of the epoch range (inclusive).
     std::vector<std::string> symbols;            ///< List of symbols to query. If empty, use all known symbols.
     std::unordered_set<std::string> selectedFields;  ///< Set of fields to output. If empty, output default grouped view.
+    size_t limit = 0;                            ///< Maximum number of snapshots returned; 0 for no limit.
+    SnapshotFilter filter;                       ///< Rows must also pass it (evaluated during the scan); empty for all.
+};
+
+/**
+ * @brief Receives query results one snapshot at a time, in epoch order.
+ *
+ * Returns false to stop the query early.
+ */
+using SnapshotSink = std::function<bool(const Snapshot&)>;
+
+/**
+ * @brief Criteria of a point-in-time (as-of) query.
+ */
+struct AsOfCriteria {
+    std::vector<int64_t> epochs;                     ///< Lookup times, in ascending order.
+    std::vector<std::string> symbols;                ///< List of symbols to look up. If empty, use all known symbols.
+    std::unordered_set<std::string> selectedFields;  ///< Fields needed (columnar files read only these); empty for all.
+};
+
+/**
+ * @brief One answer of an as-of query.
+ */
+struct AsOfMatch {
+    size_t symbol;      ///< Position in AsOfCriteria::symbols (or the engine's symbols).
+    size_t time;        ///< Position in AsOfCriteria::epochs.
+    Snapshot snapshot;  ///< Latest snapshot at or before epochs[time].
+};
+
+/**
+ * @brief Receives as-of answers (symbol position, time position, snapshot); returns false to stop.
+ */
+using AsOfSink = std::function<bool(size_t symbol, size_t time, const Snapshot&)>;
+
+/**
+ * @brief Criteria of a time-bucketed aggregation (see BarAggregator).
+ */
+struct AggregateCriteria {
+    int64_t startEpoch;                  ///< Start of the epoch range (inclusive).
+    int64_t endEpoch;                    ///< End of the epoch range (inclusive).
+    std::vector<std::string> symbols;    ///< List of symbols to aggregate. If empty, use all known symbols.
+    int64_t bucketNanos;                 ///< Bucket width; buckets start at multiples of it.
+    std::vector<Aggregate> aggregates;   ///< Aggregates needed (columnar files read only their fields); empty for all.
+};
+
+/**
+ * @brief Receives bars one at a time; returns false to stop.
+ */
+using BarSink = std::function<bool(const Bar&)>;
+
+/**
+ * @brief How QueryEngine reads the snapshot and index files.
+ */
+enum class ReaderMode {
+    Stream,  ///< Opens and reads the files with ifstream on every query.
+    Mapped   ///< Maps each symbol's files once and reads them in place.
+};
+
+/**
+ * @brief Zero-copy view of consecutive snapshots inside a mapped snapshot file.
+ */
+struct SnapshotSpan {
+    const Snapshot* first = nullptr;
+    size_t count = 0;
+
+    const Snapshot* begin() const { return first; }
+    const Snapshot* end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Snapshot& operator[](size_t i) const { return first[i]; }
 };
 
 /**
@@ -30,19 +114,106 @@ public:
      * @brief Constructs a QueryEngine with a list of symbols.
      *
      * @param symbolList List of symbols for which snapshot files exist.
+     * @param mode Stream reads the files on every query; Mapped maps each
+     *        symbol's files on first use and keeps the mapping (and with it the
+     *        index) for later queries.
+     * @param queryThreads Threads a query reads its symbols on; 1 (or 0) reads
+     *        them one after another on the calling thread. The engine starts
+     *        the other queryThreads - 1 once and shares them among its queries.
      */
-    QueryEngine(const std::vector<std::string>& symbolList);
+    QueryEngine(const std::vector<std::string>& symbolList, ReaderMode mode = ReaderMode::Stream,
+                size_t queryThreads = 1);
+
+    ~QueryEngine();
 
     /**
      * @brief Queries snapshots based on the given criteria.
      *
-     * Uses an index file for each symbol to perform a binary search for fast retrieval.
+     * Collects the rows of query(criteria, sink) into a vector, so the whole
+     * result is in memory at once; prefer the sink overload for large results.
+     * For columnar files only the selected fields (plus the epoch and the fields
+     * the filter reads) are read; the other fields of the returned snapshots are zero.
      *
      * @param criteria Query criteria.
-     * @return std::vector<Snapshot> Filtered and sorted snapshots.
+     * @return std::vector<Snapshot> Filtered snapshots in epoch order.
      */
     std::vector<Snapshot> query(const QueryCriteria &criteria);
 
+    /**
+     * @brief Streams the snapshots matching the criteria to a sink.
+     *
+     * Uses an index file for each symbol to perform a binary search for fast retrieval,
+     * then merges the per-symbol results by epoch (see openQuery()). Memory stays
+     * bounded by a few chunks per symbol, and the first snapshot reaches the
+     * sink as soon as every symbol has been read up to it. criteria.filter is
+     * applied to each chunk as it is read, before the merge; where a symbol has
+     * a zone map, zones that cannot hold a passing row are not read at all.
+     * Stops after criteria.limit snapshots or once the sink returns false.
+     *
+     * @param criteria Query criteria.
+     * @param sink Receives the snapshots.
+     * @return size_t Number of snapshots passed to the sink.
+     */
+    size_t query(const QueryCriteria &criteria, const SnapshotSink &sink);
+
+    /**
+     * @brief Opens a query as an incremental merge of the per-symbol results.
+     *
+     * Each symbol is read a chunk at a time as the merger advances, so rows come
+     * out in epoch order (ties in criteria.symbols order) before the symbols
+     * have been read in full. With several query threads, whenever the merge
+     * runs out of a symbol's rows the next chunk of every symbol is read in
+     * parallel. A symbol that fails is reported and stops contributing rows.
+     * The merger stops after criteria.limit rows and must not outlive the engine.
+     *
+     * @param criteria Query criteria.
+     * @return SnapshotMerger The epoch-ordered rows.
+     */
+    SnapshotMerger openQuery(const QueryCriteria &criteria);
+
+    /**
+     * @brief Finds the latest snapshot at or before each of many epochs, per symbol.
+     *
+     * Makes one forward pass over each symbol: the lookup epochs are merged with
+     * the index by galloping search (cost grows with the log of the distance
+     * between consecutive lookups), the file is read forward from the entry
+     * holding the first answer, and a gap of more than one chunk of entries is
+     * skipped by seeking instead of reading. Answers come symbol by symbol, in
+     * epoch order within a symbol; lookups before a symbol's first snapshot have
+     * none. Assumes each file is in epoch order; among equal epochs the last
+     * one in the file is the latest.
+     *
+     * @param criteria Lookup epochs and symbols.
+     * @param sink Receives the answers.
+     * @return size_t Number of answers passed to the sink.
+     */
+    size_t asOf(const AsOfCriteria &criteria, const AsOfSink &sink);
+
+    /**
+     * @brief Collects the answers of asOf(criteria, sink).
+     */
+    std::vector<AsOfMatch> asOf(const AsOfCriteria &criteria);
+
+    /**
+     * @brief Aggregates each symbol's snapshots into bars of fixed-width time buckets.
+     *
+     * Each symbol is scanned once, chunk by chunk, through a BarAggregator;
+     * the scan starts at the last snapshot before startEpoch so the book in
+     * force at the start is known. Bars come symbol by symbol, in bucket order
+     * within a symbol; buckets without snapshots have none. With several query
+     * threads the symbols are aggregated in parallel.
+     *
+     * @param criteria Range, symbols, bucket width and aggregates.
+     * @param sink Receives the bars.
+     * @return size_t Number of bars passed to the sink.
+     */
+    size_t aggregate(const AggregateCriteria &criteria, const BarSink &sink);
+
+    /**
+     * @brief Collects the bars of aggregate(criteria, sink).
+     */
+    std::vector<Bar> aggregate(const AggregateCriteria &criteria);
+
     /**
      * @brief Prints the snapshots based on the query criteria.
      *
@@ -54,18 +225,323 @@ public:
      */
     void printSnapshots(const std::vector<Snapshot>& snapshots, const QueryCriteria &criteria) const;
 
+    /**
+     * @brief Prints the snapshots to the given streams instead of std::cout/std::cerr.
+     *
+     * @param snapshots The snapshots to print.
+     * @param criteria The query criteria (including any selected fields).
+     * @param out Receives the table.
+     * @param err Receives field validation errors.
+     */
+    void printSnapshots(const std::vector<Snapshot>& snapshots, const QueryCriteria &criteria,
+                        std::ostream& out, std::ostream& err) const;
+
+    /**
+     * @brief Maps the files and loads the indexes of every known symbol now
+     * rather than on first use (ReaderMode::Mapped only).
+     *
+     * @return size_t Number of symbols whose files were loaded.
+     */
+    size_t preload();
+
+    /**
+     * @brief Returns a symbol's snapshots in an epoch range without copying them.
+     *
+     * Requires ReaderMode::Mapped and a fixed-format snapshot file. The span
+     * runs from the first snapshot at or after startEpoch up to the first one
+     * past endEpoch, in file order (so with out-of-order epochs it may hold a
+     * few earlier ones, which query() filters out). It points into the mapping
+     * and stays valid until refresh() or destruction.
+     *
+     * @param symbol The symbol to read.
+     * @param startEpoch The start epoch (inclusive).
+     * @param endEpoch The end epoch (inclusive).
+     * @param span Receives the snapshots (empty if none are in range).
+     * @return false if the files cannot be mapped or are not in fixed format.
+     */
+    bool mappedSnapshots(const std::string& symbol, int64_t startEpoch, int64_t endEpoch, SnapshotSpan& span);
+
+    /**
+     * @brief Drops the cached mappings so the next query sees rewritten files.
+     *
+     * Invalidates every SnapshotSpan handed out before.
+     */
+    void refresh();
+
 private:
+    /**
+     * @brief A symbol's mapped snapshot file and its loaded index.
+     */
+    struct MappedSymbol {
+        MappedFile snap;
+        SnapshotIndex index;
+        ZoneMap zones;  ///< Empty without a (usable) "<symbol>.zmap".
+        SnapshotFormat format = SnapshotFormat::Fixed;
+    };
+
     std::vector<std::string> symbolList_;  ///< List of symbols for which snapshot files exist.
+    ReaderMode mode_;                      ///< How the files are read.
+    size_t queryThreads_;                  ///< Threads a query reads its symbols on.
+    std::unique_ptr<WorkerPool> pool_;     ///< The query threads besides the caller's (queryThreads_ > 1).
+    std::unordered_map<std::string, std::unique_ptr<MappedSymbol>> mapped_;  ///< ReaderMode::Mapped cache.
+    std::mutex mappedMutex_;               ///< Guards mapped_.
+
+    /**
+     * @brief A symbol's index and snapshot format, resolved once for any number of streams.
+     */
+    struct SymbolFiles {
+        const MappedSymbol* mapped = nullptr;  ///< ReaderMode::Mapped: the cached mapping.
+        SnapshotIndex ownIndex;                ///< ReaderMode::Stream: the index read from disk.
+        SnapshotFormat format = SnapshotFormat::Fixed;
+
+        const SnapshotIndex& index() const { return mapped ? mapped->index : ownIndex; }
+    };
+
+    /**
+     * @brief Maps a symbol's files on first use.
+     *
+     * @return const MappedSymbol* The cached mapping, or nullptr if a file cannot be opened.
+     */
+    const MappedSymbol* mappedFiles(const std::string& symbol);
 
     /**
-     * @brief Reads snapshots for a given symbol from the corresponding binary file using an index file for fast lookup.
+     * @brief Opens a symbol's snapshots in an epoch range as a stream, using the
+     * index file for fast lookup.
+     *
+     * Fixed-format files are served from the mapping (Mapped) or read in chunks
+     * (Stream); delta files are decoded from the keyframe preceding startEpoch,
+     * columnar files one row group at a time.
      *
      * @param symbol The symbol for which to read the snapshots.
      * @param startEpoch The start epoch for filtering.
      * @param endEpoch The end epoch for filtering.
-     * @return std::vector<Snapshot> All snapshots for the symbol within the epoch range.
+     * @param columns Columns (bit per SnapshotColumn) the caller needs; only the
+     *        columnar format uses it to skip the others, which are left zero.
+     * @return std::unique_ptr<SnapshotStream> The stream, or nullptr if nothing can be read.
+     */
+    std::unique_ptr<SnapshotStream> openSymbolStream(const std::string& symbol, int64_t startEpoch, int64_t endEpoch,
+                                                     uint32_t columns = kAllColumns);
+
+    /**
+     * @brief Loads a symbol's index (or finds its mapping) and detects the file format.
+     *
+     * @return false if the files cannot be opened.
+     */
+    bool openSymbolFiles(const std::string& symbol, SymbolFiles& files);
+
+    /**
+     * @brief Opens a stream over files already resolved by openSymbolFiles().
+     */
+    std::unique_ptr<SnapshotStream> openSymbolStream(const std::string& symbol, const SymbolFiles& files,
+                                                     int64_t startEpoch, int64_t endEpoch, uint32_t columns);
+
+    /**
+     * @brief Opens a symbol's rows in an epoch range that pass a filter.
+     *
+     * With a non-empty filter and a zone map, only the candidate ranges of the
+     * zone map (see ZoneMap::candidateRanges()) are read, one after another;
+     * otherwise the whole range is. The filter is applied to every row read.
+     */
+    std::unique_ptr<SnapshotStream> openFilteredStream(const std::string& symbol, int64_t startEpoch,
+                                                       int64_t endEpoch, uint32_t columns,
+                                                       const SnapshotFilter& filter);
+
+    /**
+     * @brief Appends the bars of one symbol (see aggregate()).
+     */
+    void aggregateSymbol(const std::string& symbol, const AggregateCriteria& criteria, uint32_t columns,
+                         std::vector<Bar>& bars);
+};
+
+/**
+ * @brief Output format of SnapshotPrinter.
+ */
+enum class OutputFormat {
+    Text,   ///< Comma-separated text, as printed by QueryEngine::printSnapshots.
+    Binary  ///< Self-describing header followed by fixed-width row structs (see kBinaryResultMagic).
+};
+
+/**
+ * Binary result format:
+ *
+ *   magic       kBinaryResultMagic (8 bytes)
+ *   headerBytes uint32, little-endian
+ *   header      headerBytes of JSON, space-padded so the rows start at a multiple of 8:
+ *               {"fields": [["symbol", "S8"], ["epoch", "<i8"], ["bid1p", "<f8"], ...],
+ *                "row_bytes": n}
+ *               The field list is a numpy dtype description of one row.
+ *   rows        packed row structs with the fields in that order, until the end.
+ *
+ * Values are stored raw: an empty level has price -1 and quantity 0, where the
+ * text format prints N.A. In Python:
+ *   header = json.loads(buf[12:12 + headerBytes]); dtype = numpy.dtype([tuple(f) for f in header["fields"]])
+ *   rows = numpy.frombuffer(buf, dtype, offset=12 + headerBytes)
+ */
+constexpr char kBinaryResultMagic[8] = {'O', 'B', 'Q', 'R', 'E', 'S', '1', '\n'};
+
+/**
+ * @brief The SnapshotPrinter class.
+ *
+ * Prints query results as they arrive, in the same format as
+ * QueryEngine::printSnapshots: the default grouped view, or only the selected
+ * fields (with prices rounded to two decimals, or to the decimals set by
+ * setPriceDecimals()). printHeader() compiles the
+ * view into a plan of cells read straight from the record offsets of the
+ * snapshot depth (see SnapshotLayout); rows are formatted with std::to_chars
+ * into a buffer that reaches the output stream kBufferBytes at a time. In OutputFormat::Binary the same plan copies the raw
+ * field values into row structs instead, all fields if none are selected.
+ */
+class SnapshotPrinter {
+public:
+    static constexpr size_t kBufferBytes = 1 << 18;
+
+    /**
+     * @brief What a cell of the output prints.
+     */
+    enum class CellKind : uint8_t {
+        Symbol,
+        Epoch,
+        Price,     ///< The double at price, or N.A if negative.
+        Quantity,  ///< The int32_t at quantity, or N.A if zero.
+        Level,     ///< "quantity@price", or N.A if the price is negative.
+        Marker,    ///< The "X" between the bid and ask levels of the default view.
+        AsOf       ///< The lookup epoch an as-of answer belongs to.
+    };
+
+    /**
+     * @brief One output column; price and quantity are byte offsets into Snapshot.
+     */
+    struct Cell {
+        CellKind kind;
+        uint16_t price;
+        uint16_t quantity;
+    };
+
+    /**
+     * @param criteria The query criteria (only the selected fields are used).
+     * @param out Receives the table.
+     * @param err Receives field validation errors.
+     * @param format Text, or binary row structs (out must then be a binary stream).
+     * @param depth Levels per side of the snapshots printed (one of kSupportedDepths).
+     */
+    SnapshotPrinter(const QueryCriteria& criteria, std::ostream& out, std::ostream& err,
+                    OutputFormat format = OutputFormat::Text, int depth = kDefaultDepth);
+
+    /**
+     * @brief Writes out whatever is still buffered.
+     */
+    ~SnapshotPrinter();
+
+    SnapshotPrinter(const SnapshotPrinter&) = delete;
+    SnapshotPrinter& operator=(const SnapshotPrinter&) = delete;
+
+    /**
+     * @brief Validates the selected fields, builds the plan and prints the header
+     * (the header line, or the binary header).
+     *
+     * @param asOfColumn Put an "asOf" column (the lookup epoch of as-of answers) first.
+     * @return false (with the errors printed to err) if a selected field is unknown.
+     */
+    bool printHeader(bool asOfColumn = false);
+
+    /**
+     * @brief Prints text prices with the given number of decimals (2 by default);
+     * see queryPriceDecimals().
+     */
+    void setPriceDecimals(int decimals) { priceDecimals_ = decimals; }
+
+    /**
+     * @brief Prints one snapshot; printHeader() must have succeeded.
+     *
+     * Snapshots of another depth than the printer's are skipped.
+     *
+     * @param asOf Value of the "asOf" column, if printHeader() added one.
      */
-    std::vector<Snapshot> readSnapshotsForSymbol(const std::string& symbol, int64_t startEpoch, int64_t endEpoch);
+    template <int Depth>
+    void print(const BasicSnapshot<Depth>& snap, int64_t asOf = 0) {
+        if (Depth == layout_.depth)
+            printRecord(reinterpret_cast<const char*>(&snap), asOf);
+    }
+
+    /**
+     * @brief Writes the buffered text to the output stream.
+     */
+    void flush();
+
+    /**
+     * @brief Bytes printed but not yet written to the output stream.
+     */
+    size_t buffered() const { return used_; }
+
+private:
+    std::unordered_set<std::string> selectedFields_;
+    OutputFormat format_;
+    SnapshotLayout layout_;     ///< Field offsets of the printed depth (depth 0 if unsupported).
+    std::vector<Cell> plan_;    ///< Output columns in order.
+    size_t rowBytes_;           ///< Size of a binary row struct.
+    int priceDecimals_;         ///< Decimals of text prices.
+    std::vector<char> buffer_;
+    size_t used_;               ///< Bytes of buffer_ not yet written.
+    std::ostream& out_;
+    std::ostream& err_;
+
+    void append(const std::string& text);
+    void printRecord(const char* record, int64_t asOf);  ///< Prints the record at record by the plan.
+    void appendBinaryHeader(const std::vector<std::string>& names);  ///< names[i] is the field of plan_[i].
+};
+
+/**
+ * @brief Decimals that print the prices of the symbols exactly: two, or more
+ * if a symbol's ticks-format file has a finer tick size (see priceDecimals()).
+ */
+int queryPriceDecimals(const std::vector<std::string>& symbols);
+
+/**
+ * @brief The BarPrinter class.
+ *
+ * Prints bars as "symbol, start" followed by the selected aggregates: counts
+ * and volumes as integers, prices and averages with four decimals, N.A where
+ * a bucket has no value. OutputFormat::Binary writes the binary result format
+ * instead, with count and volume as int64 and the others as double (NaN where
+ * the text prints N.A).
+ */
+class BarPrinter {
+public:
+    /**
+     * @param aggregates Aggregates printed, in order.
+     * @param out Receives the table.
+     * @param format Text, or binary row structs (out must then be a binary stream).
+     */
+    BarPrinter(const std::vector<Aggregate>& aggregates, std::ostream& out, OutputFormat format = OutputFormat::Text);
+
+    /**
+     * @brief Writes out whatever is still buffered.
+     */
+    ~BarPrinter();
+
+    BarPrinter(const BarPrinter&) = delete;
+    BarPrinter& operator=(const BarPrinter&) = delete;
+
+    /**
+     * @brief Prints the header line, or the binary header.
+     */
+    void printHeader();
+
+    /**
+     * @brief Prints one bar.
+     */
+    void print(const Bar& bar);
+
+    /**
+     * @brief Writes the buffered text to the output stream.
+     */
+    void flush();
+
+private:
+    std::vector<Aggregate> aggregates_;
+    OutputFormat format_;
+    std::string buffer_;
+    std::ostream& out_;
 };
 
 #endif
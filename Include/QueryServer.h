@@ -0,0 +1,161 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include "QueryEngine.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Query server protocol (Unix domain stream socket, integers are little-endian uint32):
+ *
+ *   request:  length, then length bytes of text. The text holds the arguments
+ *             of the query command, separated by spaces:
+ *             "<symbols> <startEpoch> <endEpoch> [<fields>] [--limit=<n>]
+ *             [--where=<filter>]" (a filter without spaces); or
+ *             "refresh" to remap files that were rewritten since the server started.
+ *   response: status (kResponseOk or kResponseError), then chunks of length
+ *             followed by length bytes, ended by a chunk of length 0. The chunks
+ *             together hold the query output exactly as "orderbook query" prints
+ *             it, or the error message. Query output is sent while the query
+ *             runs, so large results start arriving at once; a client that
+ *             disconnects mid-response stops the query.
+ *
+ * A connection may carry any number of requests; they are answered in order.
+ */
+
+constexpr uint32_t kResponseOk = 0;
+constexpr uint32_t kResponseError = 1;
+
+/**
+ * @brief The QueryServer class.
+ *
+ * Long-lived query service: keeps one memory-mapped QueryEngine with every
+ * symbol's files mapped and indexes loaded, and answers framed requests from
+ * any number of local clients, one thread per connection. POSIX only; on
+ * Windows start() reports that serve mode is unsupported.
+ */
+class QueryServer {
+public:
+    static constexpr uint32_t kMaxRequestBytes = 1 << 16;  ///< Longer requests close the connection.
+    static constexpr int kPollMillis = 200;                ///< How often blocked waits check for stop().
+    static constexpr size_t kResponseChunkBytes = 1 << 16; ///< Query output is sent in pieces of about this size.
+
+    /**
+     * @brief Receives a response piece by piece, each time with the response
+     * status; returns false to abandon the rest of the response.
+     */
+    using ResponseWriter = std::function<bool(uint32_t status, const std::string& text)>;
+
+    /**
+     * @param symbols Symbols served (and used for "ALL").
+     * @param queryThreads Threads each query reads its symbols on (see QueryEngine).
+     */
+    explicit QueryServer(const std::vector<std::string>& symbols, size_t queryThreads = 1);
+
+    /**
+     * @brief Stops serving, joins the connection threads and removes the socket file.
+     */
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    /**
+     * @brief Loads every symbol's files and starts listening on the socket path.
+     *
+     * A stale socket file at the path (one no server accepts on) is replaced.
+     *
+     * @return false if the socket cannot be created, another server is
+     *         listening on the path, or on Windows.
+     */
+    bool start(const std::string& socketPath);
+
+    /**
+     * @brief Accepts and serves connections until stop() is called.
+     */
+    void run();
+
+    /**
+     * @brief Makes run() return; safe to call from a signal handler.
+     */
+    void stop();
+
+    /**
+     * @brief Answers one request text.
+     *
+     * @param request The request text (see the protocol above).
+     * @param response Receives the query output or the error message.
+     * @return uint32_t kResponseOk or kResponseError.
+     */
+    uint32_t handleRequest(const std::string& request, std::string& response);
+
+    /**
+     * @brief Answers one request text, streaming the query output to a writer
+     * as the query runs.
+     *
+     * @param request The request text (see the protocol above).
+     * @param write Receives the query output or the error message in pieces.
+     * @return uint32_t kResponseOk or kResponseError.
+     */
+    uint32_t handleRequest(const std::string& request, const ResponseWriter& write);
+
+private:
+    std::vector<std::string> symbols_;
+    QueryEngine engine_;
+    std::shared_mutex engineMutex_;   ///< Queries share it; "refresh" takes it exclusively.
+    std::atomic<bool> stopping_;
+    std::string socketPath_;
+    int listenFd_;
+    std::mutex connectionsMutex_;
+    std::condition_variable connectionsDone_;
+    size_t activeConnections_;        ///< Connection threads still running.
+
+    /**
+     * @brief Serves the requests of one connection until it closes or the server stops.
+     */
+    void serveConnection(int fd);
+};
+
+/**
+ * @brief The QueryClient class.
+ *
+ * Minimal client for QueryServer, used by the tests and as a reference for
+ * other clients.
+ */
+class QueryClient {
+public:
+    QueryClient();
+    ~QueryClient();
+
+    QueryClient(const QueryClient&) = delete;
+    QueryClient& operator=(const QueryClient&) = delete;
+
+    /**
+     * @brief Connects to a server's socket.
+     */
+    bool connect(const std::string& socketPath);
+
+    /**
+     * @brief Sends one request and waits for its complete response.
+     *
+     * @param request The request text.
+     * @param response Receives the response text.
+     * @param status Receives kResponseOk or kResponseError.
+     * @return false if the connection failed.
+     */
+    bool request(const std::string& request, std::string& response, uint32_t& status);
+
+    void close();
+
+private:
+    int fd_;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef RESUMEPOINT_H
+#define RESUMEPOINT_H
+
+#include "OrderBookBase.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Resume checkpoint of an input file, written during ingestion with
+ * ProcessorOptions::resume to "<input file name>.resume" in the working
+ * directory (next to the snapshot files):
+ *
+ * a 40-byte header (kResumeMagic, uint64 input offset, uint64 input
+ * fingerprint, int64 epoch of the last order, uint32 output count, uint32
+ * book flag), then each output file as the varint path length, the path and
+ * its int64 length, then with the book flag set the varint book symbol length,
+ * the symbol and the book state (appendBookState()).
+ *
+ * The checkpoint holds the book after every line before the input offset,
+ * and the length every output file had once those lines were written. The
+ * file is replaced as a whole, so a crash leaves either the old or the new
+ * checkpoint.
+ */
+constexpr char kResumeMagic[8] = {'O', 'B', 'R', 'E', 'S', 'U', 'M', '\n'};
+constexpr size_t kResumeHeaderBytes = 40;
+constexpr size_t kFingerprintBytes = 1 << 16;  ///< Bytes of each end of the processed input in the fingerprint.
+
+/**
+ * @brief How far ingestion of an input file got.
+ */
+struct ResumePoint {
+    uint64_t inputOffset = 0;  ///< Input bytes processed; always a line end.
+    uint64_t fingerprint = 0;  ///< inputFingerprint() of the processed bytes.
+    int64_t lastEpoch = 0;     ///< Epoch of the last order applied.
+    std::vector<std::pair<std::string, int64_t>> outputs;  ///< Output files and their lengths.
+    bool hasBook = false;      ///< False until the file's first order created its book.
+    std::string bookSymbol;
+    BookState book;
+};
+
+/**
+ * @brief Path of the resume checkpoint of an input file: its file name plus ".resume".
+ */
+std::string resumePointPath(const std::string& inputPath);
+
+/**
+ * @brief FNV-1a hash of the first and of the last min(bytes, kFingerprintBytes)
+ * bytes of the first bytes of a file. A change between the two windows of a
+ * longer prefix goes unnoticed.
+ *
+ * @return false if the file cannot be read or is shorter than bytes.
+ */
+bool inputFingerprint(const std::string& inputPath, uint64_t bytes, uint64_t& hash);
+
+/**
+ * @brief Writes a checkpoint, replacing the previous one.
+ *
+ * @return false if the file cannot be written.
+ */
+bool saveResumePoint(const std::string& path, const ResumePoint& point);
+
+/**
+ * @brief Reads a checkpoint.
+ *
+ * @param point Receives the checkpoint; a missing file is the empty one (offset 0).
+ * @param err Receives a message if the file is broken.
+ * @return false if the file exists but cannot be decoded.
+ */
+bool loadResumePoint(const std::string& path, ResumePoint& point, std::ostream& err);
+
+/**
+ * @brief Cuts every output file back to the length the checkpoint recorded,
+ * dropping whatever a later, unfinished run appended.
+ *
+ * @param err Receives a message for a file shorter than recorded (or one that cannot be cut).
+ * @return false if the outputs no longer hold what the checkpoint describes.
+ */
+bool restoreOutputs(const ResumePoint& point, std::ostream& err);
+
+#endif
@@ -1,34 +1,98 @@
 #ifndef SNAPSHOT_H
 #define SNAPSHOT_H
 
+#include <cstddef>
 #include <cstdint>
 #include <fstream>
 #include <cstring>
+#include <type_traits>
 
 // A fixed order book snapshot structure for efficient storage and retrieval.
-// This structure uses fixed arrays for bid and ask levels (5 levels each).
-struct Snapshot {
-    char symbol[8];            // Fixed-length symbol (zero-terminated if possible)
-    int64_t epoch;             // Timestamp in nanoseconds
+// This structure uses fixed arrays for the Depth best bid and ask levels.
+template <int Depth>
+struct BasicSnapshot {
+    static_assert(Depth > 0, "A snapshot holds at least one level per side");
+    static constexpr int kDepth = Depth;
 
-    double bidPrices[5];       // 5 best bid prices (highest first)
-    int32_t bidQuantities[5];  // Corresponding bid quantities
+    char symbol[8];                // Fixed-length symbol (zero-terminated if possible)
+    int64_t epoch;                 // Timestamp in nanoseconds
 
-    double askPrices[5];       // 5 best ask prices (lowest first)
-    int32_t askQuantities[5];  // Corresponding ask quantities
+    double bidPrices[Depth];       // Depth best bid prices (highest first)
+    int32_t bidQuantities[Depth];  // Corresponding bid quantities
 
-    double lastTradePrice;     // Last trade price (or -1 if none)
-    int32_t lastTradeQuantity; // Last trade quantity (or 0 if none)
+    double askPrices[Depth];       // Depth best ask prices (lowest first)
+    int32_t askQuantities[Depth];  // Corresponding ask quantities
+
+    double lastTradePrice;         // Last trade price (or -1 if none)
+    int32_t lastTradeQuantity;     // Last trade quantity (or 0 if none)
+};
+
+// Depth of the original snapshot files, which carry no header; every query
+// format (delta, columnar, filters, zone maps, bars) works on this depth.
+constexpr int kDefaultDepth = 5;
+using Snapshot = BasicSnapshot<kDefaultDepth>;
+static_assert(sizeof(Snapshot) == 160, "The default snapshot record layout is fixed on disk");
+
+// Depths a snapshot store may be written with (see StorageOptions::depth).
+constexpr int kSupportedDepths[] = {1, 5, 10, 20};
+constexpr int kMaxDepth = 20;
+
+// Calls fn(std::integral_constant<int, depth>()) for a supported depth, so
+// that a depth read at run time selects the matching template instantiation.
+// Returns false (without calling fn) for any other depth.
+template <typename Fn>
+bool withDepth(int depth, Fn &&fn) {
+    switch (depth) {
+    case 1: fn(std::integral_constant<int, 1>()); return true;
+    case 5: fn(std::integral_constant<int, 5>()); return true;
+    case 10: fn(std::integral_constant<int, 10>()); return true;
+    case 20: fn(std::integral_constant<int, 20>()); return true;
+    default: return false;
+    }
+}
+
+// Byte offsets of the fields of BasicSnapshot<depth>, for code that reads
+// records of a depth chosen at run time.
+struct SnapshotLayout {
+    int depth;
+    size_t recordBytes;
+    size_t bidPrices;
+    size_t bidQuantities;
+    size_t askPrices;
+    size_t askQuantities;
+    size_t lastTradePrice;
+    size_t lastTradeQuantity;
+};
+
+template <int Depth>
+constexpr SnapshotLayout snapshotLayout() {
+    using Record = BasicSnapshot<Depth>;
+    return {Depth, sizeof(Record), offsetof(Record, bidPrices), offsetof(Record, bidQuantities),
+            offsetof(Record, askPrices), offsetof(Record, askQuantities), offsetof(Record, lastTradePrice),
+            offsetof(Record, lastTradeQuantity)};
+}
+
+// Layout of a supported depth; false for any other depth.
+inline bool snapshotLayout(int depth, SnapshotLayout &layout) {
+    return withDepth(depth, [&layout](auto d) { layout = snapshotLayout<decltype(d)::value>(); });
+}
+
+// Index entry stored in "<symbol>.idx": snapshot epoch and its byte offset in "<symbol>.snap".
+struct IndexEntry {
+    int64_t epoch;
+    int64_t offset;
 };
 
 // Write a Snapshot to a binary stream in fixed format.
-inline bool writeBinarySnapshot(std::ofstream &ofs, const Snapshot &snap) {
+template <int Depth>
+inline bool writeBinarySnapshot(std::ofstream &ofs, const BasicSnapshot<Depth> &snap) {
     ofs.write(reinterpret_cast<const char*>(&snap), sizeof(snap));
     return ofs.good();
 }
 
 // Read a Snapshot from a binary stream in fixed format.
-inline bool readBinarySnapshot(std::ifstream &ifs, Snapshot &snap) {
+template <int Depth>
+inline bool readBinarySnapshot(std::ifstream &ifs, BasicSnapshot<Depth> &snap) {
     ifs.read(reinterpret_cast<char*>(&snap), sizeof(snap));
     return ifs.gcount() == sizeof(snap);
 }
@@ -0,0 +1,400 @@
+#ifndef SNAPSHOTCODEC_H
+#define SNAPSHOTCODEC_H
+
+#include "Snapshot.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Encodings of the "<symbol>.snap" file.
+ *
+ * Fixed:  a plain array of Snapshot records (the original format, no header).
+ *         The index is a block index with one fence per block of records, or
+ *         one entry per record (see SnapshotIndex.h).
+ * Delta:  a 16-byte header (kDeltaMagic + the 8-byte symbol) followed by
+ *         variable-length records. A keyframe stores every field; the records
+ *         between keyframes store the epoch as a varint delta plus only the
+ *         fields that differ from the previous record. The index has one entry
+ *         per keyframe, so readers seek to a keyframe and roll forward.
+ * Columnar: a 16-byte header (kColumnarMagic + the 8-byte symbol) followed by
+ *         row groups. A row group is an 8-byte header (uint32 row count, 4
+ *         reserved bytes) and one contiguous array per column, 8-byte columns
+ *         first, padded to a multiple of 8 bytes. The index has one entry per
+ *         row group (first epoch, group offset), so a projected query reads the
+ *         epoch column plus only the columns it selects.
+ * Depth:  fixed records of another depth than kDefaultDepth (see
+ *         StorageOptions::depth): a 16-byte header (kDepthMagic, uint32 depth,
+ *         uint32 record size) followed by a plain array of BasicSnapshot<depth>.
+ *         The index is a fixed-format index whose offsets start after the
+ *         header. Files of the default depth keep the header-less layout, so
+ *         the other formats and existing files are unaffected.
+ * Ticks:  fixed-point records (see PriceScale.h): a 16-byte header (kTicksMagic,
+ *         int64 ticks per price unit) followed by a plain array of
+ *         TickSnapshot, whose prices are int32 tick counts. The index is a
+ *         fixed-format index whose offsets start after the header.
+ *
+ * The last byte of each magic is non-zero while byte 7 of a fixed record (the
+ * symbol terminator) is always zero, so the formats cannot be confused.
+ */
+
+/**
+ * @brief On-disk encoding of snapshot files.
+ */
+enum class SnapshotFormat {
+    Fixed,    ///< One fixed-size Snapshot per record.
+    Delta,    ///< Keyframes plus field-level deltas.
+    Columnar, ///< Row groups with one contiguous array per field.
+    Ticks     ///< One fixed-size TickSnapshot per record.
+};
+
+/**
+ * @brief How SnapshotWriter encodes the snapshot files.
+ */
+struct StorageOptions {
+    SnapshotFormat format = SnapshotFormat::Fixed;
+    /// Delta format: write a keyframe after this many records (0 = no count limit).
+    size_t keyframeRecords = 1024;
+    /// Delta format: write a keyframe once this many nanoseconds passed since the last one (0 = no time limit).
+    int64_t keyframeNanos = 1000000000;
+    /// Columnar format: rows per row group.
+    size_t rowGroupRows = 4096;
+    /// Fixed format: snapshots per block of the block index (0 = one index entry per snapshot).
+    uint32_t indexBlockRecords = 128;
+    /// Snapshots per zone of the "<symbol>.zmap" min/max statistics (0 = no zone map; see ZoneMap.h).
+    uint32_t zoneRecords = 1024;
+    /// Levels per side of each snapshot (one of kSupportedDepths). Depths other
+    /// than kDefaultDepth need the fixed format and are written without a zone map.
+    int depth = kDefaultDepth;
+    /// Ticks format: ticks per price unit of the symbol (see PriceScale.h).
+    int64_t ticksPerUnit = 0;
+};
+
+constexpr char kDeltaMagic[8] = {'O', 'B', 'D', 'E', 'L', 'T', 'A', '\n'};
+constexpr char kColumnarMagic[8] = {'O', 'B', 'C', 'O', 'L', 'M', 'N', '\n'};
+constexpr size_t kDeltaHeaderBytes = 16;
+constexpr size_t kColumnarHeaderBytes = 16;
+constexpr size_t kRowGroupHeaderBytes = 8;
+constexpr char kDepthMagic[8] = {'O', 'B', 'D', 'E', 'P', 'T', 'H', '\n'};
+constexpr size_t kDepthHeaderBytes = 16;
+constexpr char kTicksMagic[8] = {'O', 'B', 'T', 'I', 'C', 'K', 'S', '\n'};
+constexpr size_t kTicksHeaderBytes = 16;
+
+/**
+ * @brief A Snapshot with its prices as int32 tick counts (the ticks format).
+ *
+ * An empty level keeps the -1 price of Snapshot, as -ticksPerUnit ticks.
+ */
+struct TickSnapshot {
+    char symbol[8];
+    int64_t epoch;
+    int32_t bidTicks[kDefaultDepth];
+    int32_t bidQuantities[kDefaultDepth];
+    int32_t askTicks[kDefaultDepth];
+    int32_t askQuantities[kDefaultDepth];
+    int32_t lastTradeTicks;
+    int32_t lastTradeQuantity;
+};
+static_assert(sizeof(TickSnapshot) == 104, "The ticks record layout is fixed on disk");
+
+/**
+ * @brief Columns of the columnar format, in on-disk order within a row group.
+ *
+ * Names match the query field names; the symbol is stored once in the file header.
+ */
+enum SnapshotColumn {
+    ColEpoch,
+    ColBid1p, ColBid2p, ColBid3p, ColBid4p, ColBid5p,
+    ColAsk1p, ColAsk2p, ColAsk3p, ColAsk4p, ColAsk5p,
+    ColLastTradePrice,
+    ColBid1q, ColBid2q, ColBid3q, ColBid4q, ColBid5q,
+    ColAsk1q, ColAsk2q, ColAsk3q, ColAsk4q, ColAsk5q,
+    ColLastTradeQuantity,
+    kSnapshotColumns
+};
+
+constexpr uint32_t kAllColumns = (1u << kSnapshotColumns) - 1;
+
+/**
+ * @brief Query field name of a column (e.g. "bid1p").
+ */
+const char* columnName(int column);
+
+/**
+ * @brief Byte width of one value of a column (8 or 4).
+ */
+size_t columnWidth(int column);
+
+/**
+ * @brief Byte offset of a column's field inside Snapshot.
+ */
+size_t columnFieldOffset(int column);
+
+/**
+ * @brief Byte offset of a column inside a row group with the given row count,
+ * relative to the end of the row group header.
+ */
+size_t columnOffset(int column, uint32_t rows);
+
+/**
+ * @brief Total size of a row group with the given row count, header and padding included.
+ */
+size_t rowGroupBytes(uint32_t rows);
+
+/**
+ * @brief Copies one value of a column from raw bytes into a snapshot.
+ */
+void setColumnValue(Snapshot& snap, int column, const char* value);
+
+/**
+ * @brief Appends the columnar file header for a symbol.
+ */
+void appendColumnarHeader(const std::string& symbol, std::vector<char>& out);
+
+/**
+ * @brief Parses the columnar file header (same layout as readDeltaHeader).
+ */
+bool readColumnarHeader(const char* data, size_t size, char (&symbol)[8]);
+
+/**
+ * @brief Appends one row group holding the given snapshots.
+ */
+void appendRowGroup(const std::vector<Snapshot>& rows, std::vector<char>& out);
+
+/**
+ * @brief Detects the format of a snapshot file from its first bytes.
+ *
+ * @param snapPath Path of the ".snap" file.
+ * @return SnapshotFormat Delta, Columnar or Ticks if the file starts with the matching
+ *         magic; Fixed otherwise (including missing and empty files).
+ */
+SnapshotFormat detectSnapshotFormat(const std::string& snapPath);
+
+/**
+ * @brief Detects the format of snapshot file contents already in memory.
+ */
+SnapshotFormat detectSnapshotFormat(const char* data, size_t size);
+
+/**
+ * @brief Appends the header of a depth-format file (depth != kDefaultDepth).
+ */
+void appendDepthHeader(int depth, std::vector<char>& out);
+
+/**
+ * @brief Reads the depth of snapshot file contents already in memory.
+ *
+ * @return The depth from a depth-format header; kDefaultDepth for every other
+ *         file (including empty ones); 0 for a depth header with an unsupported
+ *         depth or a record size that does not match it.
+ */
+int readSnapshotDepth(const char* data, size_t size);
+
+/**
+ * @brief Reads the depth of a snapshot file (see readSnapshotDepth); kDefaultDepth if it is missing.
+ */
+int detectSnapshotDepth(const std::string& snapPath);
+
+/**
+ * @brief Offset of the first record of a fixed-format file of the given depth.
+ */
+inline size_t snapshotDataOffset(int depth) {
+    return depth == kDefaultDepth ? 0 : kDepthHeaderBytes;
+}
+
+/**
+ * @brief Appends the header of a ticks-format file.
+ */
+void appendTicksHeader(int64_t ticksPerUnit, std::vector<char>& out);
+
+/**
+ * @brief Reads the scale of ticks-format file contents already in memory.
+ *
+ * @return Ticks per price unit; 0 if the data does not start with a valid ticks header.
+ */
+int64_t readTicksPerUnit(const char* data, size_t size);
+
+/**
+ * @brief Reads the scale of a ticks-format file (see readTicksPerUnit); 0 for other or missing files.
+ */
+int64_t detectTicksPerUnit(const std::string& snapPath);
+
+/**
+ * @brief Converts a snapshot to ticks of the given scale.
+ *
+ * @return false if a price is off the tick grid or its tick count does not fit in 32 bits.
+ */
+bool encodeTicks(const Snapshot& snap, int64_t ticksPerUnit, TickSnapshot& out);
+
+/**
+ * @brief Converts a ticks record back to the snapshot it was encoded from.
+ */
+void decodeTicks(const TickSnapshot& record, int64_t ticksPerUnit, Snapshot& out);
+
+/**
+ * @brief Number of complete snapshots in a snapshot file.
+ *
+ * Fixed, ticks and columnar files are counted from their size and row group
+ * headers. A delta file has to be decoded record by record, so it is counted
+ * only when decodeDeltas is set.
+ *
+ * @return The count, or -1 for a delta file without decodeDeltas.
+ */
+int64_t countSnapshotRecords(const char* data, size_t size, bool decodeDeltas);
+
+/**
+ * @brief Epoch of the last complete snapshot in a snapshot file.
+ *
+ * A delta file is decoded from keyframeOffset (the last keyframe's offset,
+ * or 0 for the first record) to its end.
+ *
+ * @return false if the file holds no complete snapshot.
+ */
+bool lastSnapshotEpoch(const char* data, size_t size, int64_t keyframeOffset, int64_t& epoch);
+
+/**
+ * @brief Appends the delta file header for a symbol.
+ */
+void appendDeltaHeader(const std::string& symbol, std::vector<char>& out);
+
+/**
+ * @brief Parses the delta file header.
+ *
+ * @param data Start of the file.
+ * @param size Bytes available.
+ * @param symbol Receives the zero-terminated symbol.
+ * @return true if the header is present and valid.
+ */
+bool readDeltaHeader(const char* data, size_t size, char (&symbol)[8]);
+
+// LEB128 varints, with zigzag mapping for signed values.
+inline void appendVarint(std::vector<char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline bool readVarint(const char*& p, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Raw bytes and varint-length strings, shared by the snapshot, journal and resume files.
+inline void appendRaw(std::vector<char>& out, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+inline bool readRaw(const char*& p, const char* end, void* data, size_t size) {
+    if (static_cast<size_t>(end - p) < size)
+        return false;
+    std::memcpy(data, p, size);
+    p += size;
+    return true;
+}
+
+template <typename T>
+inline void appendRaw(std::vector<char>& out, const T& value) {
+    appendRaw(out, &value, sizeof(value));
+}
+
+template <typename T>
+inline bool readRaw(const char*& p, const char* end, T& value) {
+    return readRaw(p, end, &value, sizeof(value));
+}
+
+inline void appendString(std::vector<char>& out, const std::string& text) {
+    appendVarint(out, text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+inline bool readString(const char*& p, const char* end, std::string& text) {
+    uint64_t length;
+    if (!readVarint(p, end, length) || length > static_cast<uint64_t>(end - p))
+        return false;
+    text.assign(p, static_cast<size_t>(length));
+    p += length;
+    return true;
+}
+
+/**
+ * @brief Returns the current size of a file, or 0 if it does not exist.
+ */
+int64_t existingFileSize(const std::string& path);
+
+/**
+ * @brief Encodes a symbol's snapshot sequence into delta-format records.
+ */
+class DeltaEncoder {
+public:
+    DeltaEncoder();
+
+    /**
+     * @brief True once a keyframe was written, i.e. deltas can be encoded.
+     */
+    bool hasKeyframe() const { return hasKeyframe_; }
+
+    /**
+     * @brief Appends a keyframe record holding every field of the snapshot.
+     */
+    void encodeKeyframe(const Snapshot& snap, std::vector<char>& out);
+
+    /**
+     * @brief Appends a record holding only what changed since the previous snapshot.
+     *
+     * Requires hasKeyframe().
+     */
+    void encodeDelta(const Snapshot& snap, std::vector<char>& out);
+
+private:
+    Snapshot previous_;
+    bool hasKeyframe_;
+};
+
+/**
+ * @brief Decodes delta-format records back into snapshots.
+ */
+class DeltaDecoder {
+public:
+    /**
+     * @param symbol The symbol from the file header; copied into every snapshot.
+     */
+    explicit DeltaDecoder(const char (&symbol)[8]);
+
+    /**
+     * @brief Decodes the record starting at p and advances p past it.
+     *
+     * @return false on truncated or corrupt input, or a delta record that is not
+     *         preceded by a keyframe.
+     */
+    bool decode(const char*& p, const char* end, Snapshot& snap);
+
+    /**
+     * @brief True if the most recently decoded record was a keyframe.
+     */
+    bool lastWasKeyframe() const { return lastWasKeyframe_; }
+
+private:
+    Snapshot previous_;
+    bool hasKeyframe_;
+    bool lastWasKeyframe_;
+};
+
+#endif
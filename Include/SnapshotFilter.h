@@ -0,0 +1,111 @@
+#ifndef SNAPSHOTFILTER_H
+#define SNAPSHOTFILTER_H
+
+#include "Snapshot.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct ZoneStats;
+
+/**
+ * @brief The SnapshotFilter class.
+ *
+ * A conjunction of comparisons between a snapshot field (or the sum or
+ * difference of two fields) and a constant, for example
+ *
+ *   ask1p - bid1p > 0.05 && bid1q > 10, lastTradeQuantity >= 5
+ *
+ * Comparisons are joined by "&&", "and" or ","; the operators are <, <=, >,
+ * >=, == and !=. Fields are the query field names except symbol and epoch.
+ * The price of an empty level (or of a missing last trade) has no value, so
+ * every comparison involving it is false; quantities compare as stored (0 for
+ * an empty level).
+ *
+ * select() evaluates the filter over blocks of 64 snapshots: each operand is
+ * gathered into a column, and the comparisons run over the column with SSE2
+ * where available (two rows per instruction, scalar code elsewhere),
+ * producing one selection bit per row. A block stops being evaluated as soon
+ * as its mask is empty.
+ *
+ * mayMatch() evaluates the filter over the value ranges of a zone map zone
+ * (see ZoneMap.h) instead, so a scan can skip zones no row of which can pass.
+ */
+class SnapshotFilter {
+public:
+    static constexpr size_t kBlockRows = 64;  ///< Rows per selection mask word.
+
+    /**
+     * @brief Comparison operators.
+     */
+    enum class Op : uint8_t { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual };
+
+    /**
+     * @brief Parses an expression; an empty (or all-blank) one selects every row.
+     *
+     * @param expression The filter text.
+     * @param err Receives a message describing the first error.
+     * @return false (leaving the filter empty) if the expression is invalid.
+     */
+    bool parse(const std::string& expression, std::ostream& err);
+
+    /**
+     * @brief True if the filter selects every row.
+     */
+    bool empty() const { return predicates_.empty(); }
+
+    /**
+     * @brief Columns (bit per SnapshotColumn) the filter reads.
+     */
+    uint32_t columns() const;
+
+    /**
+     * @brief Computes the selection masks of consecutive snapshots.
+     *
+     * @param rows The snapshots.
+     * @param n Number of snapshots.
+     * @param masks Receives (n + 63) / 64 words; bit j of word k selects row 64k + j.
+     * @return size_t Number of selected rows.
+     */
+    size_t select(const Snapshot* rows, size_t n, uint64_t* masks) const;
+
+    /**
+     * @brief True if the filter selects a single snapshot.
+     */
+    bool matches(const Snapshot& snap) const;
+
+    /**
+     * @brief False if no snapshot within a zone's statistics can pass the filter.
+     *
+     * Each comparison is checked against the interval its operand takes in the
+     * zone (the zone's spread for ask1p - bid1p, interval arithmetic for other
+     * sums and differences), so true does not promise a match.
+     */
+    bool mayMatch(const ZoneStats& zone) const;
+
+private:
+    /// A field, by byte offset into Snapshot.
+    struct Operand {
+        uint16_t offset = 0;
+        uint8_t column = 0;  ///< SnapshotColumn of the field.
+        bool price = false;  ///< A double whose negative values mean "no value"; else an int32_t.
+    };
+
+    /// left [+|- right] op value
+    struct Predicate {
+        Operand left;
+        Operand right;
+        int sign = 0;        ///< 0 without a right operand, else +1 or -1.
+        Op op = Op::Equal;
+        double value = 0.0;
+        uint32_t columns = 0;
+    };
+
+    std::vector<Predicate> predicates_;
+
+    uint64_t evaluate(const Predicate& predicate, const Snapshot* rows, size_t n) const;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef SNAPSHOTMERGER_H
+#define SNAPSHOTMERGER_H
+
+#include "Snapshot.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief One symbol's query result, produced in epoch order a chunk at a time.
+ */
+class SnapshotStream {
+public:
+    virtual ~SnapshotStream() = default;
+
+    /**
+     * @brief Produces the next non-empty chunk of snapshots.
+     *
+     * @param begin Receives the first snapshot of the chunk.
+     * @param end Receives one past the last snapshot of the chunk.
+     * @return false once the stream is exhausted. The chunk stays valid until
+     *         the next call.
+     */
+    virtual bool nextChunk(const Snapshot*& begin, const Snapshot*& end) = 0;
+};
+
+/**
+ * @brief The SnapshotMerger class.
+ *
+ * K-way merge of epoch-ordered streams into one epoch-ordered sequence, using
+ * a binary heap of the streams' current snapshots. Streams are pulled only as
+ * far as the merge has progressed, so the first rows are available after one
+ * chunk of each stream. Equal epochs come out in the order the streams were
+ * added.
+ */
+class SnapshotMerger {
+public:
+    SnapshotMerger();
+
+    SnapshotMerger(SnapshotMerger&&) = default;
+    SnapshotMerger& operator=(SnapshotMerger&&) = default;
+
+    /**
+     * @brief Adds a stream; must be called before the first next().
+     */
+    void add(std::unique_ptr<SnapshotStream> stream);
+
+    /**
+     * @brief Stops the merge after limit snapshots; 0 (the default) for no limit.
+     */
+    void setLimit(size_t limit);
+
+    /**
+     * @brief Returns the next snapshot in epoch order, or nullptr when all streams are exhausted.
+     *
+     * The pointer stays valid until the next call.
+     */
+    const Snapshot* next();
+
+private:
+    struct Run {
+        std::unique_ptr<SnapshotStream> stream;
+        const Snapshot* current;
+        const Snapshot* end;
+    };
+
+    std::vector<Run> runs_;
+    std::vector<size_t> heap_;  ///< Runs with a current snapshot; heap_[0] holds the smallest.
+    size_t last_;               ///< Run of the snapshot returned by the previous next().
+    size_t limit_;
+    size_t returned_;
+    bool started_;
+
+    bool refill(Run& run);
+    bool after(size_t a, size_t b) const;  ///< Heap order: true if run a's snapshot comes after run b's.
+};
+
+#endif
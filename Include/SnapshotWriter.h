@@ -0,0 +1,235 @@
+#ifndef SNAPSHOTWRITER_H
+#define SNAPSHOTWRITER_H
+
+#include "Snapshot.h"
+#include "SnapshotCodec.h"
+#include "ZoneMap.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The SnapshotWriter class.
+ *
+ * Owns the "<symbol>.snap" and "<symbol>.idx" files of a single symbol for the
+ * whole ingestion run. Snapshots and index entries are appended to in-memory
+ * buffers; full buffers are handed to a background thread owned by this writer,
+ * which performs the actual file writes. Each symbol has its own writer, buffers
+ * and flush thread, so writers of different symbols never contend.
+ *
+ * Records are encoded as selected by StorageOptions (see SnapshotCodec.h); in
+ * the fixed format the index receives one fence per block of records (see
+ * SnapshotIndex.h), in the delta format one entry per keyframe, in the columnar
+ * format one per row group.
+ *
+ * Snapshots of a depth other than kDefaultDepth (StorageOptions::depth) go
+ * to a fixed-format file that starts with a depth header (see SnapshotCodec.h)
+ * and are written with the write() template of that depth.
+ *
+ * The ticks format (StorageOptions::ticksPerUnit) stores the snapshots with
+ * int32 tick prices after a header holding the scale, indexed like the fixed
+ * format; snapshots with prices off the grid are reported and skipped.
+ *
+ * Unless disabled, "<symbol>.zmap" receives the min/max statistics of every
+ * zone of StorageOptions::zoneRecords snapshots (see ZoneMap.h). A zone map
+ * is only started together with a new snapshot file, so it never misses
+ * records before its first zone; an existing one is continued in its own
+ * zone size.
+ *
+ * Files are kept in epoch order: a snapshot older than the last one in the
+ * file (as when two logs of one symbol are ingested together) is reported
+ * and skipped, so readers can stream every file without sorting it.
+ */
+class SnapshotWriter {
+public:
+    static constexpr size_t kDefaultBufferBytes = 1 << 20;  ///< Capacity of each staging buffer.
+    static constexpr size_t kMaxPendingBuffers = 8;         ///< Full buffers queued before write() blocks.
+
+    /**
+     * @brief Opens (in append mode) the snapshot and index files for a symbol.
+     *
+     * @param symbol The symbol whose files are written.
+     * @param bufferBytes Size of the staging buffer for each file.
+     */
+    explicit SnapshotWriter(const std::string& symbol, size_t bufferBytes = kDefaultBufferBytes);
+
+    /**
+     * @brief Opens the files of a symbol for the given storage format.
+     *
+     * Appending to an existing snapshot file of a different format or depth is
+     * refused (reported, and the writer stays closed), as is a ticks-format
+     * file of another price scale. A fixed-format index is continued in the
+     * layout it already has.
+     *
+     * @param symbol The symbol whose files are written.
+     * @param storage Record encoding and keyframe policy.
+     * @param bufferBytes Size of the staging buffer for each file.
+     */
+    SnapshotWriter(const std::string& symbol, const StorageOptions& storage, size_t bufferBytes = kDefaultBufferBytes);
+
+    /**
+     * @brief Flushes all buffered data and stops the background thread.
+     */
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    /**
+     * @brief Returns true if both files were opened successfully.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Appends a snapshot and its index entry to the staging buffers.
+     *
+     * The index entry offset is computed from the running size of the snapshot file.
+     * Fixed-format snapshots add a fence only at the start of a block, delta-format
+     * deltas add no index entry; columnar rows are collected until their row group
+     * is full (or flush() is called).
+     *
+     * @param snapshot The snapshot to write.
+     */
+    void write(const Snapshot& snapshot);
+
+    /**
+     * @brief Appends a snapshot of another depth to a depth-format file.
+     *
+     * Depth must be the StorageOptions::depth the writer was opened with.
+     */
+    template <int Depth>
+    void write(const BasicSnapshot<Depth>& snapshot) {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        if (acceptsDepthLocked(Depth) && acceptsEpochLocked(snapshot.epoch))
+            appendFixedLocked(&snapshot, sizeof(snapshot), snapshot.epoch);
+    }
+
+    /**
+     * @brief Hands all staged data to the background thread and waits until it is written.
+     */
+    void flush();
+
+private:
+    // One output file plus the buffer currently being filled for it.
+    struct Stream {
+        std::string path;
+        std::ofstream ofs;
+        std::vector<char> buffer;
+    };
+
+    // A full buffer waiting to be written by the background thread.
+    struct FlushJob {
+        Stream* stream;
+        std::vector<char> data;
+    };
+
+    std::string symbol_;
+    size_t bufferBytes_;
+    Stream snap_;
+    Stream idx_;
+    Stream zmap_;
+    int64_t snapOffset_;        ///< Logical size of the snapshot file including staged bytes.
+
+    StorageOptions storage_;
+    DeltaEncoder encoder_;      ///< Delta format: state of the previous record.
+    size_t sinceKeyframe_;      ///< Delta format: records written since the last keyframe.
+    int64_t keyframeEpoch_;     ///< Delta format: epoch of the last keyframe.
+    std::vector<char> record_;  ///< Scratch buffer for one encoded record.
+    std::vector<Snapshot> rowGroup_;  ///< Columnar format: rows of the open row group.
+    uint32_t indexBlockRecords_;  ///< Fixed format: snapshots per index block (0 = entry per snapshot).
+    int64_t records_;           ///< Fixed format: snapshots in the file including staged ones.
+    int64_t lastFence_;         ///< Fixed format: epoch of the last block fence.
+    uint32_t zoneRecords_;      ///< Snapshots per zone map zone (0 = no zone map).
+    ZoneBuilder zone_;          ///< Statistics of the open zone.
+    bool wrongDepthReported_;   ///< Set once a snapshot of the wrong depth was refused.
+    bool offGridReported_;      ///< Ticks format: set once a snapshot off the tick grid was refused.
+    int64_t lastEpoch_;         ///< Epoch of the last snapshot in the file including staged ones.
+    bool hasLastEpoch_;         ///< Set once the file holds a snapshot.
+    bool outOfOrderReported_;   ///< Set once a snapshot older than lastEpoch_ was refused.
+
+    std::mutex writeMutex_;     ///< Serializes producers of the same symbol (uncontended in practice).
+
+    std::mutex queueMutex_;
+    std::condition_variable queueCv_;
+    std::deque<FlushJob> pending_;
+    std::vector<std::vector<char>> freeBuffers_;  ///< Recycled buffers returned by the flush thread.
+    bool writing_;
+    bool stopping_;
+    std::thread flusher_;
+
+    /**
+     * @brief Copies raw bytes into a stream's staging buffer, submitting it when full.
+     */
+    void append(Stream& stream, const void* data, size_t size);
+
+    /**
+     * @brief Fixed and ticks formats: picks up the index layout and last fence of existing files,
+     * or starts a new block index. An index that does not cover every record
+     * on disk (missing or cut short) is rebuilt from the records' epochs.
+     */
+    void openFixedIndex();
+
+    /**
+     * @brief Fixed and ticks formats: the index fence or entry of the next record.
+     */
+    void indexRecordLocked(int64_t epoch, int64_t offset);
+
+    /**
+     * @brief Starts the zone map of a new snapshot file or continues an existing
+     * one; without either there is no zone map.
+     */
+    void openZoneMap();
+
+    /**
+     * @brief Picks up the epoch of the last snapshot of an existing file.
+     */
+    void openLastEpoch();
+
+    /**
+     * @brief True if snapshots of the given depth belong in this file; reports the first refusal.
+     */
+    bool acceptsDepthLocked(int depth);
+
+    /**
+     * @brief True unless the epoch precedes the file's last snapshot; reports the first refusal.
+     */
+    bool acceptsEpochLocked(int64_t epoch);
+
+    /**
+     * @brief Fixed format: appends one record and its index fence or entry.
+     */
+    void appendFixedLocked(const void* record, size_t bytes, int64_t epoch);
+
+    /**
+     * @brief Adds a snapshot to the open zone, writing the zone out when full.
+     */
+    void noteZoneLocked(const Snapshot& snapshot);
+
+    /**
+     * @brief Writes the open zone's statistics, if it has any snapshots.
+     */
+    void appendZoneLocked();
+
+    /**
+     * @brief Columnar format: encodes the open row group and its index entry.
+     */
+    void appendRowGroupLocked();
+
+    /**
+     * @brief Queues a stream's staging buffer for the background thread and installs a fresh one.
+     */
+    void submit(Stream& stream);
+
+    /**
+     * @brief Background thread body: writes queued buffers in FIFO order.
+     */
+    void flusherLoop();
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of threads that runs batches of indexed tasks.
+ *
+ * run(n, task) calls task(0) ... task(n - 1), handing the indexes out one at a
+ * time to the pool's threads and to the calling thread, and returns once all
+ * of them have finished. The threads live as long as the pool, so a batch
+ * costs a few lock round trips rather than thread starts. Several threads may
+ * run batches at once; their indexes are handed out in arrival order, and each
+ * caller keeps working on its own batch, so a batch never waits for a free
+ * thread. Tasks must not throw.
+ */
+class WorkerPool {
+public:
+    /**
+     * @brief Starts the given number of threads (0 runs every batch on its caller).
+     */
+    explicit WorkerPool(size_t threads) : stopping_(false) {
+        for (size_t t = 0; t < threads; ++t)
+            workers_.emplace_back(&WorkerPool::workerLoop, this);
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        work_.notify_all();
+        for (auto &worker : workers_)
+            worker.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief Runs task(0) ... task(count - 1) and waits until all have finished.
+     */
+    void run(size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0)
+            return;
+        Batch batch{&task, count, 0, 0};
+        std::unique_lock<std::mutex> lock(mutex_);
+        batches_.push_back(&batch);
+        work_.notify_all();
+        while (batch.next < batch.count)
+            runNext(batch, lock);
+        done_.wait(lock, [&batch]() { return batch.finished == batch.count; });
+    }
+
+private:
+    // A run() call; lives on its caller's stack until every index has finished.
+    struct Batch {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        size_t next;      ///< Next index to hand out.
+        size_t finished;  ///< Indexes whose task has returned.
+    };
+
+    std::vector<std::thread> workers_;
+    std::deque<Batch*> batches_;  ///< Batches with indexes left to hand out.
+    std::mutex mutex_;
+    std::condition_variable work_;
+    std::condition_variable done_;
+    bool stopping_;
+
+    // Takes the next index of a batch and runs its task without the lock,
+    // which is held on entry and on return.
+    void runNext(Batch& batch, std::unique_lock<std::mutex>& lock) {
+        const size_t index = batch.next++;
+        if (batch.next == batch.count)
+            batches_.erase(std::find(batches_.begin(), batches_.end(), &batch));
+        lock.unlock();
+        (*batch.task)(index);
+        lock.lock();
+        if (++batch.finished == batch.count)
+            done_.notify_all();
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            work_.wait(lock, [this]() { return stopping_ || !batches_.empty(); });
+            if (batches_.empty())
+                return;
+            runNext(*batches_.front(), lock);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include "Snapshot.h"
+#include "SnapshotCodec.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class SnapshotFilter;
+
+/**
+ * "<symbol>.zmap" layout: a 16-byte header (kZoneMapMagic, uint32_t records
+ * per zone, uint32_t reserved) followed by one ZoneStats per zone of
+ * consecutive snapshots, in file order. The last zone of a writer run may be
+ * shorter. The file sits next to "<symbol>.snap" and "<symbol>.idx" and is
+ * the same for every snapshot format.
+ */
+constexpr char kZoneMapMagic[8] = {'O', 'B', 'Z', 'O', 'N', 'E', 'S', '\n'};
+constexpr size_t kZoneMapHeaderBytes = 16;
+
+/// ZoneStats slot of the best-level spread (ask1p - bid1p); the epoch range has its own fields.
+constexpr int kZoneSpread = ColEpoch;
+
+/**
+ * @brief Min/max statistics of one zone of snapshots.
+ *
+ * min and max are indexed by SnapshotColumn. Prices cover only the rows
+ * where the price is set (not negative), and the spread only the rows with
+ * both a best bid and a best ask, so a column without values has
+ * min = +inf and max = -inf. Quantities cover every row.
+ */
+struct ZoneStats {
+    int64_t firstEpoch;  ///< Smallest epoch in the zone.
+    int64_t lastEpoch;   ///< Largest epoch in the zone.
+    uint32_t records;    ///< Snapshots in the zone.
+    uint32_t reserved;
+    double min[kSnapshotColumns];
+    double max[kSnapshotColumns];
+};
+
+/**
+ * @brief Appends the zone map file header.
+ */
+void appendZoneMapHeader(uint32_t zoneRecords, std::vector<char>& out);
+
+/**
+ * @brief Accumulates the statistics of the zone being written.
+ */
+class ZoneBuilder {
+public:
+    ZoneBuilder();
+
+    void add(const Snapshot& snap);
+
+    /**
+     * @brief Snapshots added since the last take().
+     */
+    uint32_t records() const { return zone_.records; }
+
+    /**
+     * @brief Returns the statistics of the zone and starts a new one.
+     */
+    ZoneStats take();
+
+private:
+    ZoneStats zone_;
+
+    void reset();
+};
+
+/**
+ * @brief The ZoneMap class.
+ *
+ * A loaded "<symbol>.zmap". candidateRanges() turns it into the epoch
+ * ranges a filtered scan has to read: zones whose statistics show that no
+ * row can pass the filter are left out.
+ */
+class ZoneMap {
+public:
+    /**
+     * @brief Loads a zone map from memory.
+     *
+     * A map whose zones are not in epoch order (or overlap) cannot tell a
+     * skipped zone's rows apart from its neighbours' and is rejected.
+     *
+     * @return false (leaving the map empty) if the data is not a usable zone map.
+     */
+    bool load(const char* data, size_t size);
+
+    /**
+     * @brief Loads "<symbol>.zmap" from disk.
+     *
+     * @return false if the file is missing or not a usable zone map.
+     */
+    bool readFile(const std::string& path);
+
+    /**
+     * @brief Drops the map unless its zones add up to the snapshot file's record count.
+     *
+     * A map that misses rows in the middle of the file (an interrupted writer
+     * run followed by another one) would skip them, so a map that does not
+     * cover exactly the file's rows is not used. A negative count (not known)
+     * keeps the map.
+     */
+    void matchRecords(int64_t records);
+
+    /**
+     * @brief Snapshots covered by all zones together.
+     */
+    int64_t records() const;
+
+    bool empty() const { return zones_.empty(); }
+    size_t size() const { return zones_.size(); }
+    const ZoneStats& operator[](size_t i) const { return zones_[i]; }
+
+    /**
+     * @brief Epoch ranges within [startEpoch, endEpoch] that may hold rows passing the filter.
+     *
+     * Adjacent candidate zones are joined into one range, and rows after the
+     * last zone (appended without a zone map, or not yet in it) are always
+     * included. The ranges are ascending and disjoint.
+     */
+    std::vector<std::pair<int64_t, int64_t>> candidateRanges(const SnapshotFilter& filter, int64_t startEpoch,
+                                                             int64_t endEpoch) const;
+
+private:
+    std::vector<ZoneStats> zones_;
+};
+
+#endif
@@ -0,0 +1,311 @@
+#include "BarAggregator.h"
+#include "SnapshotCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+static const char *const kAggregateNames[] = {
+    "count", "midOpen", "midHigh", "midLow", "midClose", "open", "high", "low", "close",
+    "volume", "vwap", "spread", "bidDepth", "askDepth"};
+static_assert(sizeof(kAggregateNames) / sizeof(kAggregateNames[0]) == static_cast<size_t>(Aggregate::kCount),
+              "every aggregate needs a name");
+
+static constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+static constexpr double kInf = std::numeric_limits<double>::infinity();
+
+const char *aggregateName(Aggregate aggregate) {
+    return kAggregateNames[static_cast<size_t>(aggregate)];
+}
+
+bool parseAggregates(const std::vector<std::string> &names, std::vector<Aggregate> &aggregates, std::ostream &err) {
+    aggregates.clear();
+    const size_t count = static_cast<size_t>(Aggregate::kCount);
+    if (names.empty()) {
+        for (size_t i = 0; i < count; ++i)
+            aggregates.push_back(static_cast<Aggregate>(i));
+        return true;
+    }
+    bool valid = true;
+    for (const auto &name : names) {
+        const char *const *found = std::find(kAggregateNames, kAggregateNames + count, name);
+        if (found == kAggregateNames + count) {
+            err << "Error: Unknown aggregate \"" << name << "\"." << std::endl;
+            valid = false;
+        } else {
+            aggregates.push_back(static_cast<Aggregate>(found - kAggregateNames));
+        }
+    }
+    return valid;
+}
+
+uint32_t columnsForAggregates(const std::vector<Aggregate> &aggregates) {
+    uint32_t columns = 1u << ColEpoch;
+    for (Aggregate aggregate : aggregates) {
+        switch (aggregate) {
+        case Aggregate::Count:
+            break;
+        case Aggregate::MidOpen:
+        case Aggregate::MidHigh:
+        case Aggregate::MidLow:
+        case Aggregate::MidClose:
+        case Aggregate::Spread:
+            columns |= (1u << ColBid1p) | (1u << ColAsk1p);
+            break;
+        case Aggregate::BidDepth:
+            for (int c = ColBid1q; c <= ColBid5q; ++c)
+                columns |= 1u << c;
+            break;
+        case Aggregate::AskDepth:
+            for (int c = ColAsk1q; c <= ColAsk5q; ++c)
+                columns |= 1u << c;
+            break;
+        default:
+            columns |= (1u << ColLastTradePrice) | (1u << ColLastTradeQuantity);
+            break;
+        }
+    }
+    return columns;
+}
+
+double Bar::value(Aggregate aggregate) const {
+    switch (aggregate) {
+    case Aggregate::Count: return static_cast<double>(count);
+    case Aggregate::MidOpen: return midOpen;
+    case Aggregate::MidHigh: return midHigh;
+    case Aggregate::MidLow: return midLow;
+    case Aggregate::MidClose: return midClose;
+    case Aggregate::Open: return open;
+    case Aggregate::High: return high;
+    case Aggregate::Low: return low;
+    case Aggregate::Close: return close;
+    case Aggregate::Volume: return static_cast<double>(volume);
+    case Aggregate::Vwap: return vwap;
+    case Aggregate::Spread: return spread;
+    case Aggregate::BidDepth: return bidDepth;
+    case Aggregate::AskDepth: return askDepth;
+    default: return kNaN;
+    }
+}
+
+// Helper: Start of the bucket holding epoch (rounding down for negative epochs too).
+static int64_t bucketStart(int64_t epoch, int64_t width) {
+    int64_t q = epoch / width;
+    if (epoch % width < 0)
+        --q;
+    return q * width;
+}
+
+// Helper: a + b, saturated at the largest epoch.
+static int64_t addEpoch(int64_t a, int64_t b) {
+    return a > std::numeric_limits<int64_t>::max() - b ? std::numeric_limits<int64_t>::max() : a + b;
+}
+
+BarAggregator::BarAggregator(int64_t bucketNanos, int64_t startEpoch, int64_t endEpoch)
+    : bucketNanos_(std::max<int64_t>(bucketNanos, 1)), startEpoch_(startEpoch), endLimit_(addEpoch(endEpoch, 1)),
+      bar_(), open_(false), notional_(0.0), spreadSum_(0.0), spreadNanos_(0.0), depthNanos_(0.0),
+      bidDepthSum_(0.0), askDepthSum_(0.0) {}
+
+void BarAggregator::seed(const Snapshot &previous) {
+    derive(&previous, 1);
+    state_.since = startEpoch_;
+    state_.spread = columns_.spread[0];
+    state_.bidDepth = columns_.bidDepth[0];
+    state_.askDepth = columns_.askDepth[0];
+    state_.lastTradePrice = previous.lastTradePrice;
+    state_.lastTradeQuantity = previous.lastTradeQuantity;
+    state_.known = true;
+}
+
+// Pass 1: one row of derived values per snapshot. Every iteration is
+// independent (a trade compares against the previous row only), so the loop
+// vectorizes.
+void BarAggregator::derive(const Snapshot *rows, size_t n) {
+    Columns &c = columns_;
+    c.epoch.resize(n);
+    c.mid.resize(n);
+    c.spread.resize(n);
+    c.bidDepth.resize(n);
+    c.askDepth.resize(n);
+    c.tradePrice.resize(n);
+    c.tradeQuantity.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const Snapshot &s = rows[i];
+        const double bid = s.bidPrices[0];
+        const double ask = s.askPrices[0];
+        const bool twoSided = bid >= 0.0 && ask >= 0.0;
+        c.epoch[i] = s.epoch;
+        c.mid[i] = twoSided ? 0.5 * (bid + ask) : kNaN;
+        c.spread[i] = twoSided ? ask - bid : kNaN;
+        c.bidDepth[i] = static_cast<double>(s.bidQuantities[0] + s.bidQuantities[1] + s.bidQuantities[2] +
+                                            s.bidQuantities[3] + s.bidQuantities[4]);
+        c.askDepth[i] = static_cast<double>(s.askQuantities[0] + s.askQuantities[1] + s.askQuantities[2] +
+                                            s.askQuantities[3] + s.askQuantities[4]);
+        const double previousPrice = i ? rows[i - 1].lastTradePrice : state_.lastTradePrice;
+        const int32_t previousQuantity = i ? rows[i - 1].lastTradeQuantity : state_.lastTradeQuantity;
+        const bool trade = s.lastTradeQuantity > 0 &&
+                           (s.lastTradePrice != previousPrice || s.lastTradeQuantity != previousQuantity);
+        c.tradePrice[i] = trade ? s.lastTradePrice : 0.0;
+        c.tradeQuantity[i] = trade ? static_cast<double>(s.lastTradeQuantity) : 0.0;
+    }
+}
+
+void BarAggregator::add(const Snapshot *begin, const Snapshot *end, std::vector<Bar> &bars) {
+    const size_t n = static_cast<size_t>(end - begin);
+    if (n == 0)
+        return;
+    derive(begin, n);
+    const std::vector<int64_t> &epoch = columns_.epoch;
+    // Pass 2: epochs ascend, so each bucket is a run of rows.
+    size_t i = 0;
+    while (i < n) {
+        const int64_t start = bucketStart(epoch[i], bucketNanos_);
+        const int64_t stop = addEpoch(start, bucketNanos_);
+        size_t j = i + 1;
+        while (j < n && epoch[j] < stop)
+            ++j;
+        if (!open_ || bar_.start != start) {
+            if (open_)
+                closeBar(bars);
+            startBar(begin[i].symbol, start);
+        }
+        weightState(state_.since, epoch[i]);
+        foldRun(i, j);
+        i = j;
+    }
+    state_.lastTradePrice = begin[n - 1].lastTradePrice;
+    state_.lastTradeQuantity = begin[n - 1].lastTradeQuantity;
+}
+
+void BarAggregator::finish(std::vector<Bar> &bars) {
+    if (open_)
+        closeBar(bars);
+}
+
+void BarAggregator::startBar(const char *symbol, int64_t start) {
+    bar_ = Bar();
+    std::memcpy(bar_.symbol, symbol, sizeof(bar_.symbol));
+    bar_.start = start;
+    bar_.midOpen = bar_.midClose = bar_.open = bar_.close = kNaN;
+    bar_.midHigh = bar_.high = -kInf;
+    bar_.midLow = bar_.low = kInf;
+    notional_ = spreadSum_ = spreadNanos_ = depthNanos_ = bidDepthSum_ = askDepthSum_ = 0.0;
+    open_ = true;
+}
+
+void BarAggregator::closeBar(std::vector<Bar> &bars) {
+    weightState(state_.since, addEpoch(bar_.start, bucketNanos_));
+    if (bar_.midHigh == -kInf)
+        bar_.midHigh = bar_.midLow = kNaN;
+    if (bar_.high == -kInf)
+        bar_.high = bar_.low = kNaN;
+    bar_.vwap = bar_.volume > 0 ? notional_ / static_cast<double>(bar_.volume) : kNaN;
+    bar_.spread = spreadNanos_ > 0.0 ? spreadSum_ / spreadNanos_ : kNaN;
+    bar_.bidDepth = depthNanos_ > 0.0 ? bidDepthSum_ / depthNanos_ : kNaN;
+    bar_.askDepth = depthNanos_ > 0.0 ? askDepthSum_ / depthNanos_ : kNaN;
+    bars.push_back(bar_);
+    open_ = false;
+}
+
+// Weights the last seen book over [from, to), clipped to the open bar and the range.
+void BarAggregator::weightState(int64_t from, int64_t to) {
+    if (!state_.known)
+        return;
+    from = std::max(from, std::max(bar_.start, startEpoch_));
+    to = std::min(to, std::min(addEpoch(bar_.start, bucketNanos_), endLimit_));
+    if (to <= from)
+        return;
+    const double nanos = static_cast<double>(to - from);
+    if (!std::isnan(state_.spread)) {
+        spreadSum_ += state_.spread * nanos;
+        spreadNanos_ += nanos;
+    }
+    bidDepthSum_ += state_.bidDepth * nanos;
+    askDepthSum_ += state_.askDepth * nanos;
+    depthNanos_ += nanos;
+}
+
+// Folds rows [a, b) of the current chunk, all in the open bar's bucket. The
+// reductions are branch-free selects over the columns (NaN fails every
+// comparison, so an undefined mid never wins a max or min).
+void BarAggregator::foldRun(size_t a, size_t b) {
+    const Columns &c = columns_;
+    const int64_t *epoch = c.epoch.data();
+    const double *mid = c.mid.data();
+    const double *spread = c.spread.data();
+    const double *bidDepth = c.bidDepth.data();
+    const double *askDepth = c.askDepth.data();
+    const double *price = c.tradePrice.data();
+    const double *quantity = c.tradeQuantity.data();
+
+    double midHigh = bar_.midHigh, midLow = bar_.midLow;
+    double high = bar_.high, low = bar_.low;
+    double volume = 0.0, notional = 0.0;
+    for (size_t i = a; i < b; ++i) {
+        midHigh = mid[i] > midHigh ? mid[i] : midHigh;
+        midLow = mid[i] < midLow ? mid[i] : midLow;
+        const double tradeHigh = quantity[i] > 0.0 ? price[i] : -kInf;
+        const double tradeLow = quantity[i] > 0.0 ? price[i] : kInf;
+        high = tradeHigh > high ? tradeHigh : high;
+        low = tradeLow < low ? tradeLow : low;
+        volume += quantity[i];
+        notional += price[i] * quantity[i];
+    }
+
+    // Each row's book holds until the next row; the last one's is weighted
+    // once the next row (or the bucket end) is known.
+    double spreadSum = 0.0, spreadNanos = 0.0, bidDepthSum = 0.0, askDepthSum = 0.0;
+    for (size_t i = a; i + 1 < b; ++i) {
+        const double nanos = static_cast<double>(epoch[i + 1] - epoch[i]);
+        const bool defined = spread[i] == spread[i];
+        spreadSum += defined ? spread[i] * nanos : 0.0;
+        spreadNanos += defined ? nanos : 0.0;
+        bidDepthSum += bidDepth[i] * nanos;
+        askDepthSum += askDepth[i] * nanos;
+    }
+
+    // Opens and closes: the first and last defined rows, usually found at once.
+    if (std::isnan(bar_.midOpen)) {
+        for (size_t i = a; i < b && std::isnan(bar_.midOpen); ++i)
+            bar_.midOpen = mid[i];
+    }
+    for (size_t i = b; i > a; --i) {
+        if (!std::isnan(mid[i - 1])) {
+            bar_.midClose = mid[i - 1];
+            break;
+        }
+    }
+    if (std::isnan(bar_.open)) {
+        for (size_t i = a; i < b; ++i) {
+            if (quantity[i] > 0.0) {
+                bar_.open = price[i];
+                break;
+            }
+        }
+    }
+    for (size_t i = b; i > a; --i) {
+        if (quantity[i - 1] > 0.0) {
+            bar_.close = price[i - 1];
+            break;
+        }
+    }
+
+    bar_.count += static_cast<int64_t>(b - a);
+    bar_.midHigh = midHigh;
+    bar_.midLow = midLow;
+    bar_.high = high;
+    bar_.low = low;
+    bar_.volume += static_cast<int64_t>(volume);
+    notional_ += notional;
+    spreadSum_ += spreadSum;
+    spreadNanos_ += spreadNanos;
+    bidDepthSum_ += bidDepthSum;
+    askDepthSum_ += askDepthSum;
+    depthNanos_ += static_cast<double>(epoch[b - 1] - epoch[a]);
+
+    state_.since = epoch[b - 1];
+    state_.spread = spread[b - 1];
+    state_.bidDepth = bidDepth[b - 1];
+    state_.askDepth = askDepth[b - 1];
+    state_.known = true;
+}
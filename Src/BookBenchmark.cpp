@@ -0,0 +1,116 @@
+#include "BookBenchmark.h"
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "OrderBookBase.h"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+// A book implementation under test.
+struct BenchmarkCase {
+    const char *name;
+    BookType type;
+    OrderIdMode idMode;
+    int64_t ticksPerUnit;  // Fixed-point price scale (0 = floating-point prices).
+};
+
+// Helper: Field-wise snapshot equality (ignores struct padding).
+static bool sameSnapshot(const Snapshot &a, const Snapshot &b) {
+    if (std::strncmp(a.symbol, b.symbol, sizeof(a.symbol)) != 0 || a.epoch != b.epoch ||
+        a.lastTradePrice != b.lastTradePrice || a.lastTradeQuantity != b.lastTradeQuantity)
+        return false;
+    for (int i = 0; i < 5; ++i) {
+        if (a.bidPrices[i] != b.bidPrices[i] || a.bidQuantities[i] != b.bidQuantities[i] ||
+            a.askPrices[i] != b.askPrices[i] || a.askQuantities[i] != b.askQuantities[i])
+            return false;
+    }
+    return true;
+}
+
+// Helper: Parses a whole log file into memory, with order IDs as the given book mode takes them.
+static std::vector<Order> loadOrders(const std::string &path, OrderIdMode idMode) {
+    std::vector<Order> orders;
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        std::cerr << "Error: Failed to open file: " << path << std::endl;
+        return orders;
+    }
+    OrderView view;
+    const char *end = file.end();
+    for (const char *p = file.begin(); p < end; ) {
+        const char *lineEnd = findLineEnd(p, end);
+        if (parseOrderView(p, lineEnd, view)) {
+            orders.emplace_back();
+            assignOrder(view, orders.back(), idMode);
+        }
+        p = (lineEnd < end) ? lineEnd + 1 : end;
+    }
+    return orders;
+}
+
+// Helper: Replays orders into a fresh book; returns nanoseconds per event.
+// Optionally records every snapshot and counts the events that changed the visible state.
+static double replay(const BenchmarkCase &bench, const std::vector<Order> &orders, std::vector<Snapshot> *snapshots,
+                     size_t *changed = nullptr) {
+    std::unique_ptr<OrderBookBase> book = makeOrderBook(bench.type, orders.front().symbol, bench.idMode,
+                                                        OrderBookBase::kVisibleLevels, bench.ticksPerUnit);
+    Snapshot snap;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &order : orders) {
+        book->processOrder(order);
+        snap = book->getSnapshot(order.epoch);
+        if (snapshots)
+            snapshots->push_back(snap);
+        if (changed && book->visibleChanged())
+            ++*changed;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    // Keep the last snapshot observable so the loop cannot be optimized away.
+    volatile int64_t sink = snap.epoch;
+    (void)sink;
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / orders.size();
+}
+
+bool runBookBenchmark(const std::vector<std::string> &files, int repetitions) {
+    const BenchmarkCase cases[] = {
+        {"map", BookType::Map, OrderIdMode::String, 0},
+        {"map+int", BookType::Map, OrderIdMode::Integer, 0},
+        {"map+ticks", BookType::Map, OrderIdMode::String, 100},
+        {"ladder", BookType::Ladder, OrderIdMode::String, 0},
+        {"ladder+int", BookType::Ladder, OrderIdMode::Integer, 0},
+    };
+    bool allMatch = true;
+    std::cout << std::left << std::setw(28) << "file" << std::setw(12) << "book"
+              << std::right << std::setw(10) << "events" << std::setw(14) << "ns/event" << std::setw(10) << "changed" << std::setw(10) << "match" << "\n";
+    for (const auto &path : files) {
+        std::vector<Order> orders = loadOrders(path, OrderIdMode::String);
+        if (orders.empty())
+            continue;
+        std::vector<Order> integerOrders = loadOrders(path, OrderIdMode::Integer);
+        std::vector<Snapshot> reference;
+        replay(cases[0], orders, &reference);
+        for (const auto &bench : cases) {
+            const std::vector<Order> &events = (bench.idMode == OrderIdMode::Integer) ? integerOrders : orders;
+            // Verification pass (untimed), then the timed replays.
+            std::vector<Snapshot> snapshots;
+            snapshots.reserve(orders.size());
+            size_t changed = 0;
+            replay(bench, events, &snapshots, &changed);
+            bool match = snapshots.size() == reference.size();
+            for (size_t i = 0; match && i < snapshots.size(); ++i)
+                match = sameSnapshot(snapshots[i], reference[i]);
+            allMatch = allMatch && match;
+            double best = std::numeric_limits<double>::max();
+            for (int r = 0; r < repetitions; ++r)
+                best = std::min(best, replay(bench, events, nullptr));
+            std::cout << std::left << std::setw(28) << path << std::setw(12) << bench.name
+                      << std::right << std::setw(10) << orders.size()
+                      << std::setw(14) << std::fixed << std::setprecision(1) << best
+                      << std::setw(9) << (100.0 * changed / orders.size()) << "%"
+                      << std::setw(10) << (match ? "yes" : "NO") << "\n";
+        }
+    }
+    return allMatch;
+}
@@ -0,0 +1,322 @@
+#include "BookJournal.h"
+#include "MappedFile.h"
+#include "OrderBook.h"
+#include "SnapshotCodec.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+// Global mutex to synchronize console output (defined in BookProcessor.cpp).
+extern std::mutex coutMutex;
+
+static constexpr uint8_t kSellFlag = 0x04;
+static constexpr uint8_t kAbsoluteEpochFlag = 0x80;
+
+// Helper: Appends the 16-byte header shared by the event log and the checkpoint file.
+static void appendJournalHeader(const char (&magic)[8], const std::string &symbol, std::vector<char> &out) {
+    char fileSymbol[8] = {};
+    std::strncpy(fileSymbol, symbol.c_str(), sizeof(fileSymbol) - 1);
+    out.insert(out.end(), magic, magic + sizeof(magic));
+    out.insert(out.end(), fileSymbol, fileSymbol + sizeof(fileSymbol));
+}
+
+static bool hasJournalHeader(const MappedFile &file, const char (&magic)[8]) {
+    return file.size() >= kJournalHeaderBytes && std::memcmp(file.data(), magic, sizeof(magic)) == 0;
+}
+
+void appendEvent(const Order &order, const int64_t *previousEpoch, std::vector<char> &out) {
+    uint8_t flags = static_cast<uint8_t>(order.category);
+    if (order.side == OrderSide::SELL)
+        flags |= kSellFlag;
+    if (previousEpoch == nullptr)
+        flags |= kAbsoluteEpochFlag;
+    out.push_back(static_cast<char>(flags));
+    appendVarint(out, zigzagEncode(previousEpoch ? order.epoch - *previousEpoch : order.epoch));
+    if (order.orderId.empty()) {
+        // Integer mode: the parser kept only the numeric ID; log its digits.
+        char digits[20];
+        char *last = std::to_chars(digits, digits + sizeof(digits), order.numericId).ptr;
+        appendVarint(out, static_cast<uint64_t>(last - digits));
+        out.insert(out.end(), digits, last);
+    } else {
+        appendString(out, order.orderId);
+    }
+    appendRaw(out, order.price);
+    appendVarint(out, zigzagEncode(order.quantity));
+}
+
+bool readEvent(const char *&p, const char *end, int64_t &previousEpoch, Order &order) {
+    if (p >= end)
+        return false;
+    const uint8_t flags = static_cast<uint8_t>(*p++);
+    const uint8_t category = flags & 0x03;
+    if (category > static_cast<uint8_t>(OrderCategory::TRADE))
+        return false;
+    uint64_t epoch, quantity;
+    if (!readVarint(p, end, epoch) || !readString(p, end, order.orderId) || !readRaw(p, end, order.price) ||
+        !readVarint(p, end, quantity))
+        return false;
+    order.epoch = zigzagDecode(epoch) + ((flags & kAbsoluteEpochFlag) ? 0 : previousEpoch);
+    order.category = static_cast<OrderCategory>(category);
+    order.side = (flags & kSellFlag) ? OrderSide::SELL : OrderSide::BUY;
+    order.quantity = static_cast<int>(zigzagDecode(quantity));
+    previousEpoch = order.epoch;
+    return true;
+}
+
+void appendBookState(const BookState &state, std::vector<char> &out) {
+    appendVarint(out, state.orders.size());
+    for (const auto &order : state.orders) {
+        out.push_back(static_cast<char>(order.side == OrderSide::SELL ? kSellFlag : 0));
+        appendString(out, order.orderId);
+        appendRaw(out, order.price);
+        appendVarint(out, zigzagEncode(order.quantity));
+    }
+    for (const auto *levels : {&state.bids, &state.asks}) {
+        appendVarint(out, levels->size());
+        for (const auto &level : *levels) {
+            appendRaw(out, level.first);
+            appendVarint(out, zigzagEncode(level.second));
+        }
+    }
+    appendRaw(out, state.lastTradePrice);
+    appendVarint(out, zigzagEncode(state.lastTradeQuantity));
+}
+
+bool readBookState(const char *data, size_t size, BookState &state) {
+    const char *p = data;
+    const char *end = data + size;
+    uint64_t count, value;
+    // Every entry takes more than one byte, so a count beyond the bytes left is corrupt.
+    if (!readVarint(p, end, count) || count > size)
+        return false;
+    state.orders.resize(static_cast<size_t>(count));
+    for (auto &order : state.orders) {
+        if (p >= end)
+            return false;
+        order.side = (static_cast<uint8_t>(*p++) & kSellFlag) ? OrderSide::SELL : OrderSide::BUY;
+        if (!readString(p, end, order.orderId) || !readRaw(p, end, order.price) || !readVarint(p, end, value))
+            return false;
+        order.quantity = static_cast<int>(zigzagDecode(value));
+    }
+    for (auto *levels : {&state.bids, &state.asks}) {
+        if (!readVarint(p, end, count) || count > size)
+            return false;
+        levels->resize(static_cast<size_t>(count));
+        for (auto &level : *levels) {
+            if (!readRaw(p, end, level.first) || !readVarint(p, end, value))
+                return false;
+            level.second = zigzagDecode(value);
+        }
+    }
+    if (!readRaw(p, end, state.lastTradePrice) || !readVarint(p, end, value))
+        return false;
+    state.lastTradeQuantity = static_cast<int>(zigzagDecode(value));
+    return p == end;
+}
+
+BookJournal::BookJournal(const std::string &symbol, size_t checkpointEvents)
+    : symbol_(symbol), eventOffset_(0), previousEpoch_(0), checkpointEvents_(checkpointEvents),
+      sinceCheckpoint_(0), started_(false)
+{
+    const std::string eventsPath = symbol + ".events";
+    const std::string checkpointsPath = symbol + ".ckpt";
+    // Checkpoints point at absolute event offsets, so continue from whatever is already on disk.
+    eventOffset_ = existingFileSize(eventsPath);
+    const bool newCheckpoints = existingFileSize(checkpointsPath) == 0;
+    events_.open(eventsPath, std::ios::binary | std::ios::app);
+    checkpoints_.open(checkpointsPath, std::ios::binary | std::ios::app);
+    if (!isOpen()) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Failed to open journal files for symbol: " << symbol << std::endl;
+        return;
+    }
+    eventBuffer_.reserve(kBufferBytes);
+    if (eventOffset_ == 0) {
+        appendJournalHeader(kEventLogMagic, symbol, eventBuffer_);
+        eventOffset_ = static_cast<int64_t>(eventBuffer_.size());
+    }
+    if (newCheckpoints)
+        appendJournalHeader(kCheckpointMagic, symbol, checkpointBuffer_);
+}
+
+BookJournal::~BookJournal() {
+    flush();
+}
+
+bool BookJournal::isOpen() const {
+    return events_.is_open() && checkpoints_.is_open();
+}
+
+void BookJournal::record(const Order &order, const OrderBookBase &book) {
+    if (!isOpen())
+        return;
+    const bool absolute = !started_ || sinceCheckpoint_ == 0;
+    if (!started_) {
+        // This run's books start empty, whatever the journal held before.
+        started_ = true;
+        state_ = BookState();
+        appendCheckpoint(order.epoch - 1, state_);
+    }
+    const size_t before = eventBuffer_.size();
+    appendEvent(order, absolute ? nullptr : &previousEpoch_, eventBuffer_);
+    eventOffset_ += static_cast<int64_t>(eventBuffer_.size() - before);
+    previousEpoch_ = order.epoch;
+    if (checkpointEvents_ > 0 && ++sinceCheckpoint_ >= checkpointEvents_) {
+        book.saveState(state_);
+        appendCheckpoint(order.epoch, state_);
+    }
+    if (eventBuffer_.size() >= kBufferBytes)
+        flush();
+}
+
+void BookJournal::startFrom(const OrderBookBase &book, int64_t epoch) {
+    if (!isOpen() || started_)
+        return;
+    started_ = true;
+    book.saveState(state_);
+    appendCheckpoint(epoch, state_);
+}
+
+void BookJournal::appendCheckpoint(int64_t epoch, const BookState &state) {
+    CheckpointHeader header;
+    header.epoch = epoch;
+    header.eventOffset = eventOffset_;
+    header.reserved = 0;
+    const size_t start = checkpointBuffer_.size();
+    appendRaw(checkpointBuffer_, header);
+    appendBookState(state, checkpointBuffer_);
+    header.bytes = static_cast<uint32_t>(checkpointBuffer_.size() - start - sizeof(header));
+    std::memcpy(checkpointBuffer_.data() + start, &header, sizeof(header));
+    sinceCheckpoint_ = 0;
+    if (checkpointBuffer_.size() >= kBufferBytes)
+        flush();
+}
+
+void BookJournal::flush() {
+    if (!isOpen())
+        return;
+    // Events first: a checkpoint must never point past the events on disk.
+    std::pair<std::ofstream*, std::vector<char>*> files[] = {{&events_, &eventBuffer_},
+                                                             {&checkpoints_, &checkpointBuffer_}};
+    for (auto &file : files) {
+        if (file.second->empty())
+            continue;
+        if (!(file.first->write(file.second->data(), static_cast<std::streamsize>(file.second->size())) &&
+              file.first->flush())) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error writing journal files for symbol: " << symbol_ << std::endl;
+            file.first->clear();
+        }
+        file.second->clear();
+    }
+}
+
+bool rebuildBook(const std::string &symbol, int64_t epoch, BookState &state, std::ostream &err, size_t *replayed) {
+    state = BookState();
+    if (replayed)
+        *replayed = 0;
+    MappedFile events(symbol + ".events");
+    MappedFile checkpoints(symbol + ".ckpt");
+    if (!hasJournalHeader(events, kEventLogMagic) || !hasJournalHeader(checkpoints, kCheckpointMagic)) {
+        err << "Error: No book journal for symbol: " << symbol << " (ingest with --journal)" << std::endl;
+        return false;
+    }
+    // The latest checkpoint at or before epoch, in file order.
+    const char *p = checkpoints.data() + kJournalHeaderBytes;
+    const char *end = checkpoints.end();
+    const char *chosen = nullptr;
+    CheckpointHeader header, chosenHeader;
+    while (end - p >= static_cast<std::ptrdiff_t>(sizeof(header))) {
+        std::memcpy(&header, p, sizeof(header));
+        if (header.bytes > static_cast<uint64_t>(end - p) - sizeof(header))
+            break;  // A torn last checkpoint (interrupted run) is ignored.
+        if (header.epoch <= epoch) {
+            chosen = p + sizeof(header);
+            chosenHeader = header;
+        }
+        p += sizeof(header) + header.bytes;
+    }
+    if (chosen == nullptr)
+        return true;  // Before the first event: the book is empty.
+    if (!readBookState(chosen, chosenHeader.bytes, state) || chosenHeader.eventOffset < 0 ||
+        chosenHeader.eventOffset > static_cast<int64_t>(events.size())) {
+        err << "Error: Corrupt checkpoint file for symbol: " << symbol << std::endl;
+        return false;
+    }
+
+    OrderBook book(symbol);
+    book.loadState(state);
+    Order order;
+    order.symbol = symbol;
+    int64_t previousEpoch = chosenHeader.epoch;
+    size_t count = 0;
+    const char *q = events.data() + chosenHeader.eventOffset;
+    while (q < events.end()) {
+        // A torn last event (the writer was interrupted) ends the log.
+        if (!readEvent(q, events.end(), previousEpoch, order) || order.epoch > epoch)
+            break;
+        book.processOrder(order);
+        ++count;
+    }
+    book.saveState(state);
+    if (replayed)
+        *replayed = count;
+    return true;
+}
+
+// Helper: Prints a price with two decimals, or N.A if it is not set.
+static void printPrice(std::ostream &out, double price) {
+    if (price < 0)
+        out << "N.A";
+    else
+        out << std::fixed << std::setprecision(2) << price;
+}
+
+void printBookState(const std::string &symbol, int64_t epoch, const BookState &state, bool orders,
+                    std::ostream &out) {
+    out << "symbol, epoch, lastTradePrice, lastTradeQuantity, bidLevels, askLevels, orders\n";
+    out << symbol << ", " << epoch << ", ";
+    printPrice(out, state.lastTradePrice);
+    out << ", " << state.lastTradeQuantity << ", " << state.bids.size() << ", " << state.asks.size() << ", "
+        << state.orders.size() << "\n";
+
+    std::map<double, size_t> bidOrders, askOrders;
+    for (const auto &order : state.orders)
+        ++(order.side == OrderSide::BUY ? bidOrders : askOrders)[order.price];
+    out << "side, level, price, quantity, orders\n";
+    for (int side = 0; side < 2; ++side) {
+        const auto &levels = side == 0 ? state.bids : state.asks;
+        const auto &counts = side == 0 ? bidOrders : askOrders;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            auto it = counts.find(levels[i].first);
+            out << (side == 0 ? "BID" : "ASK") << ", " << (i + 1) << ", ";
+            printPrice(out, levels[i].first);
+            out << ", " << levels[i].second << ", " << (it == counts.end() ? 0 : it->second) << "\n";
+        }
+    }
+    if (orders) {
+        // Best price first per side, then by order ID; the books do not keep arrival order.
+        std::vector<const BookState::RestingOrder*> sorted;
+        for (const auto &order : state.orders)
+            sorted.push_back(&order);
+        std::sort(sorted.begin(), sorted.end(), [](const BookState::RestingOrder *a, const BookState::RestingOrder *b) {
+            if (a->side != b->side)
+                return a->side == OrderSide::BUY;
+            if (a->price != b->price)
+                return a->side == OrderSide::BUY ? a->price > b->price : a->price < b->price;
+            return a->orderId < b->orderId;
+        });
+        out << "side, price, quantity, orderId\n";
+        for (const auto *order : sorted) {
+            out << (order->side == OrderSide::BUY ? "BID" : "ASK") << ", ";
+            printPrice(out, order->price);
+            out << ", " << order->quantity << ", " << order->orderId << "\n";
+        }
+    }
+    out.flush();
+}
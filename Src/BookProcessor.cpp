@@ -2,7 +2,17 @@
 #include "Order.h"
 #include "OrderBook.h"
 #include "Snapshot.h"
+#include "SnapshotWriter.h"
 #include "Progress.h"
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "BoundedQueue.h"
+#include "ResumePoint.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <functional>
+#include <string_view>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -13,14 +23,6 @@
 
 // Global mutex to synchronize console output.
 std::mutex coutMutex;
-// Global mutex to synchronize file writes for snapshot and index files.
-std::mutex fileWriteMutex;
-
-// Structure for index entry (epoch, offset)
-struct IndexEntry {
-    int64_t epoch;
-    int64_t offset;
-};
 
 bool BookProcessor::parseLine(const std::string &line, Order &order) {
     std::istringstream iss(line);
@@ -50,55 +52,196 @@ bool BookProcessor::parseLine(const std::string &line, Order &order) {
     return true;
 }
 
-void BookProcessor::writeSnapshotBinary(const Snapshot &snapshot, const std::string &symbol) {
-    std::string snapFilename = symbol + ".snap";
-    std::string idxFilename = symbol + ".idx";
+// Helper: The storage options of one symbol, with its price scale.
+static StorageOptions symbolStorage(const ProcessorOptions &options, const std::string &symbol) {
+    StorageOptions storage = options.storage;
+    storage.ticksPerUnit = options.priceScales.forSymbol(symbol);
+    return storage;
+}
 
-    // Write snapshot and index entry with thread-safe file access.
-    {
-        std::lock_guard<std::mutex> lock(fileWriteMutex);
-        // Open snapshot file in append mode.
-        std::ofstream ofs(snapFilename, std::ios::binary | std::ios::app);
-        if (!ofs.is_open()) {
-            std::lock_guard<std::mutex> lockOut(coutMutex);
-            std::cerr << "Error: Failed to open snapshot file: " << snapFilename << std::endl;
-            return;
+SnapshotWriter &BookProcessor::writerFor(const std::string &symbol) {
+    std::lock_guard<std::mutex> lock(writersMutex_);
+    std::unique_ptr<SnapshotWriter> &writer = writers_[symbol];
+    if (!writer)
+        writer.reset(new SnapshotWriter(symbol, symbolStorage(options_, symbol)));
+    return *writer;
+}
+
+// Orders for one shard cut from one input buffer; keepAlive owns the bytes the views point into.
+struct BookProcessor::ShardBatch {
+    std::shared_ptr<const void> keepAlive;
+    std::vector<OrderView> orders;
+};
+
+// Per-file ingestion state shared by the stream and mapped readers.
+struct BookProcessor::FileState {
+    std::unique_ptr<OrderBookBase> orderBook;
+    std::unique_ptr<BookJournal> journal;  // With options.journal: the book's event log and checkpoints.
+    // Cache the writer of the most recent symbol to skip the shared lookup per line.
+    std::string writerSymbol;
+    SnapshotWriter *writer = nullptr;
+    // Sharded mode: the file's position on the command line and the batch being filled for each shard.
+    size_t fileIndex = 0;
+    std::vector<std::unique_ptr<ShardBatch>> pending;
+    // Resume mode: input processed so far and what the file's checkpoint covers.
+    uint64_t inputOffset = 0;                // Input bytes processed; always a line end.
+    uint64_t checkpointOffset = 0;           // Input offset of the last checkpoint.
+    int64_t lastEpoch = 0;                   // Epoch of the last order applied.
+    std::vector<std::string> outputSymbols;  // Symbols whose snapshot files this file wrote.
+    std::string resumePath;
+    ResumePoint checkpoint;                  // The checkpoint on disk.
+};
+
+// A symbol shard: its worker thread exclusively owns the books and writers of its symbols.
+// Each input file feeds it through its own queue, and the queues are drained in
+// file order, so a symbol spread over several files sees their events file by file.
+struct BookProcessor::Shard {
+    // Book and snapshot files of one symbol.
+    struct SymbolBook {
+        std::unique_ptr<OrderBookBase> orderBook;
+        std::unique_ptr<SnapshotWriter> writer;
+        std::unique_ptr<BookJournal> journal;
+        SymbolBook(const ProcessorOptions &options, const std::string &symbol)
+            : orderBook(makeOrderBook(options.bookType, symbol, options.orderIdMode, options.storage.depth,
+                                      options.priceScales.forSymbol(symbol))),
+              writer(new SnapshotWriter(symbol, symbolStorage(options, symbol))),
+              journal(options.journal ? new BookJournal(symbol, options.checkpointEvents) : nullptr) {}
+    };
+
+    Shard(size_t files, size_t queueCapacity) {
+        for (size_t i = 0; i < files; ++i)
+            queues.emplace_back(new BoundedQueue<std::unique_ptr<ShardBatch>>(queueCapacity));
+    }
+
+    std::vector<std::unique_ptr<BoundedQueue<std::unique_ptr<ShardBatch>>>> queues;  // One per input file.
+    std::unordered_map<std::string, std::unique_ptr<SymbolBook>> books;
+    std::thread worker;
+};
+
+void BookProcessor::runShard(Shard &shard) {
+    Order order;
+    std::string lastSymbol;
+    Shard::SymbolBook *book = nullptr;
+    std::unique_ptr<ShardBatch> batch;
+    for (auto &queue : shard.queues) {
+        while (queue->pop(batch)) {
+            for (const auto &view : batch->orders) {
+                if (book == nullptr || view.symbol != lastSymbol) {
+                    lastSymbol.assign(view.symbol.data(), view.symbol.size());
+                    std::unique_ptr<Shard::SymbolBook> &entry = shard.books[lastSymbol];
+                    if (!entry)
+                        entry.reset(new Shard::SymbolBook(options_, lastSymbol));
+                    book = entry.get();
+                }
+                assignOrder(view, order, options_.orderIdMode);
+                try {
+                    book->orderBook->processOrder(order);
+                    if (book->journal)
+                        book->journal->record(order, *book->orderBook);
+                    if (options_.changedSnapshotsOnly && !book->orderBook->visibleChanged())
+                        continue;
+                    writeSnapshot(*book->orderBook, order, *book->writer);
+                } catch (const std::exception &ex) {
+                    std::lock_guard<std::mutex> lock(coutMutex);
+                    std::cerr << "Error processing order " << orderIdText(order) << ": " << ex.what() << std::endl;
+                }
+            }
+            // Releasing the batch may release the input buffer it points into.
+            batch.reset();
         }
-        // Get current offset.
-        std::streampos offset = ofs.tellp();
-        if (!writeBinarySnapshot(ofs, snapshot)) {
-            std::lock_guard<std::mutex> lockOut(coutMutex);
-            std::cerr << "Error writing snapshot to file: " << snapFilename << std::endl;
+    }
+    // Destroying the writers flushes this shard's snapshot and index files.
+    shard.books.clear();
+}
+
+void BookProcessor::routeOrder(const OrderView &view, const std::shared_ptr<const void> &keepAlive, FileState &state) {
+    size_t shardIndex = std::hash<std::string_view>()(view.symbol) % shards_.size();
+    std::unique_ptr<ShardBatch> &batch = state.pending[shardIndex];
+    if (batch && (batch->keepAlive != keepAlive || batch->orders.size() >= kShardBatchOrders))
+        shards_[shardIndex]->queues[state.fileIndex]->push(std::move(batch));
+    if (!batch) {
+        batch.reset(new ShardBatch());
+        batch->keepAlive = keepAlive;
+        batch->orders.reserve(kShardBatchOrders);
+    }
+    batch->orders.push_back(view);
+}
+
+void BookProcessor::flushRoutes(FileState &state) {
+    for (size_t i = 0; i < state.pending.size(); ++i) {
+        if (state.pending[i])
+            shards_[i]->queues[state.fileIndex]->push(std::move(state.pending[i]));
+    }
+}
+
+void BookProcessor::writeSnapshot(const OrderBookBase &book, const Order &order, SnapshotWriter &writer) const {
+    withDepth(options_.storage.depth, [&](auto depth) {
+        auto snap = book.getDepthSnapshot<decltype(depth)::value>(order.epoch);
+        // Ensure symbol is fixed length
+        std::strncpy(snap.symbol, order.symbol.c_str(), sizeof(snap.symbol)-1);
+        snap.symbol[sizeof(snap.symbol)-1] = '\0';
+        writer.write(snap);
+    });
+}
+
+void BookProcessor::handleOrder(const Order &order, FileState &state) {
+    if (!state.orderBook) {
+        state.orderBook = makeOrderBook(options_.bookType, order.symbol, options_.orderIdMode, options_.storage.depth,
+                                        options_.priceScales.forSymbol(order.symbol));
+        if (options_.journal) {
+            addResumeOutputs(state, {order.symbol + ".events", order.symbol + ".ckpt"});
+            state.journal.reset(new BookJournal(order.symbol, options_.checkpointEvents));
         }
-        ofs.close();
-
-        // Write index entry.
-        std::ofstream idxOfs(idxFilename, std::ios::binary | std::ios::app);
-        if (!idxOfs.is_open()) {
-            std::lock_guard<std::mutex> lockOut(coutMutex);
-            std::cerr << "Error: Failed to open index file: " << idxFilename << std::endl;
-            return;
+    }
+    state.lastEpoch = order.epoch;
+    try {
+        state.orderBook->processOrder(order);
+        if (state.journal)
+            state.journal->record(order, *state.orderBook);
+    } catch (const std::exception &ex) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error processing order " << orderIdText(order) << ": " << ex.what() << std::endl;
+        return;
+    }
+    if (options_.changedSnapshotsOnly && !state.orderBook->visibleChanged())
+        return;
+    // Get the snapshot and write it.
+    try {
+        if (state.writer == nullptr || order.symbol != state.writerSymbol) {
+            if (std::find(state.outputSymbols.begin(), state.outputSymbols.end(), order.symbol) ==
+                state.outputSymbols.end()) {
+                addResumeOutputs(state, {order.symbol + ".snap", order.symbol + ".idx", order.symbol + ".zmap"});
+                state.outputSymbols.push_back(order.symbol);
+            }
+            state.writer = &writerFor(order.symbol);
+            state.writerSymbol = order.symbol;
         }
-        // Create index entry.
-        IndexEntry entry;
-        entry.epoch = snapshot.epoch;
-        entry.offset = static_cast<int64_t>(offset);
-        idxOfs.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
-        idxOfs.close();
+        writeSnapshot(*state.orderBook, order, *state.writer);
+    } catch (const std::exception &ex) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error generating snapshot at epoch " << order.epoch << ": " << ex.what() << std::endl;
     }
 }
 
-void BookProcessor::processFile(const std::string &filePath) {
-    std::ifstream ifs(filePath);
+bool BookProcessor::processStreamFile(const std::string &filePath, FileState &state) {
+    // Resume offsets count raw bytes, so line ends must not be translated.
+    std::ifstream ifs(filePath, options_.resume ? std::ios::in | std::ios::binary : std::ios::in);
     if (!ifs.is_open()) {
         std::lock_guard<std::mutex> lock(coutMutex);
         std::cerr << "Error: Failed to open file: " << filePath << std::endl;
-        return;
+        return false;
     }
+    if (state.inputOffset > 0)
+        ifs.seekg(static_cast<std::streamoff>(state.inputOffset), std::ios::beg);
     std::string line;
-    OrderBook orderBook("");
-    bool orderBookInitialized = false;
     while (std::getline(ifs, line)) {
+        // A last line without a newline may still be being written; the next run reads it.
+        if (options_.resume && ifs.eof())
+            break;
+        // The checkpoint describes the book before this line.
+        if (options_.resume)
+            checkpointFile(filePath, state);
+        state.inputOffset += line.size() + 1;
         if (line.empty())
             continue;
         // Update global processed bytes counter.
@@ -109,30 +252,358 @@ void BookProcessor::processFile(const std::string &filePath) {
             std::cerr << "Warning: Failed to parse line: " << line << std::endl;
             continue;
         }
-        if (!orderBookInitialized) {
-            orderBook = OrderBook(order.symbol);
-            orderBookInitialized = true;
+        handleOrder(order, state);
+    }
+    ifs.close();
+    return true;
+}
+
+bool BookProcessor::processMappedFile(const std::string &filePath, FileState &state) {
+    // Shared so that routed batches can keep the mapping alive after this function returns.
+    std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>(filePath);
+    const MappedFile &file = *mapped;
+    if (!file.isOpen()) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Failed to open file: " << filePath << std::endl;
+        return false;
+    }
+    // A single Order is reused so its strings keep their capacity across lines.
+    Order order;
+    OrderView view;
+    const char *end = file.end();
+    // A last line without a newline may still be being written; the next run reads it.
+    if (options_.resume) {
+        while (end > file.begin() && end[-1] != '\n')
+            --end;
+    }
+    for (const char *p = file.begin() + state.inputOffset; p < end; ) {
+        const char *lineEnd = findLineEnd(p, end);
+        const char *next = (lineEnd < end) ? lineEnd + 1 : end;
+        size_t length = static_cast<size_t>(lineEnd - p);
+        if (options_.resume) {
+            // The checkpoint describes the book before this line.
+            checkpointFile(filePath, state);
+            state.inputOffset = static_cast<uint64_t>(next - file.begin());
         }
-        try {
-            orderBook.processOrder(order);
-        } catch (const std::exception &ex) {
-            std::lock_guard<std::mutex> lock(coutMutex);
-            std::cerr << "Error processing order " << order.orderId << ": " << ex.what() << std::endl;
-            continue;
+        if (length > 0) {
+            // Update global processed bytes counter.
+            g_bytesProcessed += static_cast<uint64_t>(length + 1);
+            if (!parseOrderView(p, lineEnd, view)) {
+                std::lock_guard<std::mutex> lock(coutMutex);
+                std::cerr << "Warning: Failed to parse line: " << std::string(p, length) << std::endl;
+            } else if (!shards_.empty()) {
+                routeOrder(view, mapped, state);
+            } else {
+                assignOrder(view, order, options_.orderIdMode);
+                handleOrder(order, state);
+            }
         }
-        // Get the snapshot and write it.
-        try {
-            Snapshot snap = orderBook.getSnapshot(order.epoch);
-            // Ensure symbol is fixed length
-            std::strncpy(snap.symbol, order.symbol.c_str(), sizeof(snap.symbol)-1);
-            snap.symbol[sizeof(snap.symbol)-1] = '\0';
-            writeSnapshotBinary(snap, order.symbol);
-        } catch (const std::exception &ex) {
-            std::lock_guard<std::mutex> lock(coutMutex);
-            std::cerr << "Error generating snapshot at epoch " << order.epoch << ": " << ex.what() << std::endl;
+        p = next;
+    }
+    flushRoutes(state);
+    return true;
+}
+
+// A line-aligned block of input travelling through the ingestion pipeline.
+struct BookProcessor::Chunk {
+    uint64_t sequence = 0;                   // Position of the chunk in the file.
+    uint64_t end = 0;                        // File offset just past the chunk.
+    std::vector<char> text;                  // Raw bytes, ending on a line boundary.
+    std::vector<OrderView> orders;           // Parsed orders; views point into text.
+    std::vector<std::string_view> rejected;  // Lines that failed to parse.
+    uint64_t bytes = 0;                      // Bytes of non-empty lines (for progress).
+};
+
+void BookProcessor::parseChunk(Chunk &chunk) {
+    chunk.orders.clear();
+    chunk.rejected.clear();
+    chunk.bytes = 0;
+    const char *end = chunk.text.data() + chunk.text.size();
+    OrderView view;
+    for (const char *p = chunk.text.data(); p < end; ) {
+        const char *lineEnd = findLineEnd(p, end);
+        size_t length = static_cast<size_t>(lineEnd - p);
+        if (length > 0) {
+            chunk.bytes += length + 1;
+            if (parseOrderView(p, lineEnd, view))
+                chunk.orders.push_back(view);
+            else
+                chunk.rejected.emplace_back(p, length);
         }
+        p = (lineEnd < end) ? lineEnd + 1 : end;
     }
-    ifs.close();
+}
+
+bool BookProcessor::processPipelinedFile(const std::string &filePath, FileState &state) {
+    std::ifstream ifs(filePath, std::ios::binary);
+    if (!ifs.is_open()) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Failed to open file: " << filePath << std::endl;
+        return false;
+    }
+    const size_t workers = options_.parseThreads;
+    const size_t chunkBytes = std::max<size_t>(options_.chunkBytes, 1);
+    // Chunks are recycled through a fixed pool, which bounds memory and every queue.
+    const size_t poolSize = 2 * workers + 2;
+    // Shared with the chunks routed to the shards, which may still return them
+    // after this function has left early.
+    auto freeChunksOwner = std::make_shared<BoundedQueue<std::unique_ptr<Chunk>>>(poolSize);
+    BoundedQueue<std::unique_ptr<Chunk>> &freeChunks = *freeChunksOwner;
+    BoundedQueue<std::unique_ptr<Chunk>> toParse(poolSize);
+    BoundedQueue<std::unique_ptr<Chunk>> parsed(poolSize);
+    for (size_t i = 0; i < poolSize; ++i)
+        freeChunks.push(std::unique_ptr<Chunk>(new Chunk()));
+
+    // Stage 1: chunked read, cut at the last complete line.
+    ifs.seekg(static_cast<std::streamoff>(state.inputOffset), std::ios::beg);
+    std::thread reader([&]() {
+        std::vector<char> carry;
+        uint64_t sequence = 0;
+        uint64_t position = state.inputOffset;
+        bool eof = false;
+        std::unique_ptr<Chunk> chunk;
+        while (!eof && freeChunks.pop(chunk)) {
+            chunk->text.assign(carry.begin(), carry.end());
+            carry.clear();
+            while (true) {
+                size_t old = chunk->text.size();
+                chunk->text.resize(old + chunkBytes);
+                ifs.read(chunk->text.data() + old, static_cast<std::streamsize>(chunkBytes));
+                size_t got = static_cast<size_t>(ifs.gcount());
+                chunk->text.resize(old + got);
+                if (got < chunkBytes) {
+                    eof = true;
+                    break;
+                }
+                // Keep reading into the same chunk until it holds at least one full line.
+                auto lastNewline = std::find(chunk->text.rbegin(), chunk->text.rend() - old, '\n');
+                if (lastNewline != chunk->text.rend() - old) {
+                    auto cut = lastNewline.base();
+                    carry.assign(cut, chunk->text.end());
+                    chunk->text.erase(cut, chunk->text.end());
+                    break;
+                }
+            }
+            if (eof && options_.resume) {
+                // A last line without a newline may still be being written; the next run reads it.
+                auto lastNewline = std::find(chunk->text.rbegin(), chunk->text.rend(), '\n');
+                chunk->text.erase(lastNewline.base(), chunk->text.end());
+            }
+            if (chunk->text.empty()) {
+                freeChunks.push(std::move(chunk));
+                break;
+            }
+            position += chunk->text.size();
+            chunk->end = position;
+            chunk->sequence = sequence++;
+            toParse.push(std::move(chunk));
+        }
+        toParse.close();
+    });
+
+    // Stage 2: parallel parse.
+    std::atomic<size_t> activeWorkers(workers);
+    std::vector<std::thread> parsers;
+    // Joins the reader and the parsers however this function ends. If stage 3
+    // throws, closing the queues first releases every stage blocked on them.
+    struct StageJoiner {
+        std::thread &reader;
+        std::vector<std::thread> &parsers;
+        std::vector<BoundedQueue<std::unique_ptr<Chunk>>*> queues;
+        void join() {
+            if (reader.joinable())
+                reader.join();
+            for (auto &t : parsers) {
+                if (t.joinable())
+                    t.join();
+            }
+        }
+        ~StageJoiner() {
+            if (reader.joinable()) {
+                for (auto *queue : queues)
+                    queue->close();
+            }
+            join();
+        }
+    } joiner{reader, parsers, {&freeChunks, &toParse, &parsed}};
+    for (size_t i = 0; i < workers; ++i) {
+        parsers.emplace_back([&]() {
+            std::unique_ptr<Chunk> chunk;
+            while (toParse.pop(chunk)) {
+                parseChunk(*chunk);
+                parsed.push(std::move(chunk));
+            }
+            if (--activeWorkers == 0)
+                parsed.close();
+        });
+    }
+
+    // Stage 3: apply chunks to the book in file order (or route them to the symbol
+    // shards); the writer flushes in the background.
+    std::map<uint64_t, std::unique_ptr<Chunk>> reorder;
+    uint64_t nextSequence = 0;
+    Order order;
+    std::unique_ptr<Chunk> chunk;
+    while (parsed.pop(chunk)) {
+        uint64_t sequence = chunk->sequence;
+        reorder.emplace(sequence, std::move(chunk));
+        for (auto it = reorder.find(nextSequence); it != reorder.end(); it = reorder.find(nextSequence)) {
+            Chunk &ready = *it->second;
+            g_bytesProcessed += ready.bytes;
+            for (const auto &line : ready.rejected) {
+                std::lock_guard<std::mutex> lock(coutMutex);
+                std::cerr << "Warning: Failed to parse line: " << line << std::endl;
+            }
+            if (!shards_.empty()) {
+                // The chunk returns to the pool once every shard has released its batch.
+                std::shared_ptr<const void> shared(it->second.release(), [freeChunksOwner](const void *p) {
+                    freeChunksOwner->push(std::unique_ptr<Chunk>(static_cast<Chunk*>(const_cast<void*>(p))));
+                });
+                for (const auto &view : ready.orders)
+                    routeOrder(view, shared, state);
+                flushRoutes(state);
+            } else {
+                for (const auto &view : ready.orders) {
+                    assignOrder(view, order, options_.orderIdMode);
+                    handleOrder(order, state);
+                }
+                state.inputOffset = ready.end;
+                if (options_.resume)
+                    checkpointFile(filePath, state);
+                freeChunks.push(std::move(it->second));
+            }
+            reorder.erase(it);
+            ++nextSequence;
+        }
+    }
+    joiner.join();
+    // Wait for the shards to hand back every chunk, so that none is still being
+    // applied when the file is reported complete.
+    if (!shards_.empty()) {
+        for (size_t i = 0; i < poolSize; ++i)
+            freeChunks.pop(chunk);
+    }
+    return true;
+}
+
+bool BookProcessor::resumeFile(const std::string &filePath, FileState &state) {
+    state.resumePath = resumePointPath(filePath);
+    ResumePoint point;
+    std::ostringstream err;
+    bool resumed = loadResumePoint(state.resumePath, point, err);
+    uint64_t fingerprint = 0;
+    if (resumed && point.inputOffset > 0 &&
+        (!inputFingerprint(filePath, point.inputOffset, fingerprint) || fingerprint != point.fingerprint)) {
+        err << "Error: " << filePath << " changed in the part its resume checkpoint covers." << std::endl;
+        resumed = false;
+    }
+    if (!resumed || !restoreOutputs(point, err)) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << err.str() << "Skipping " << filePath << "; delete " << state.resumePath
+                  << " to process it from the start." << std::endl;
+        return false;
+    }
+    if (point.hasBook) {
+        state.orderBook = makeOrderBook(options_.bookType, point.bookSymbol, options_.orderIdMode,
+                                        options_.storage.depth, options_.priceScales.forSymbol(point.bookSymbol));
+        state.orderBook->loadState(point.book);
+        if (options_.journal) {
+            state.journal.reset(new BookJournal(point.bookSymbol, options_.checkpointEvents));
+            state.journal->startFrom(*state.orderBook, point.lastEpoch);
+        }
+    }
+    const std::string snapExtension = ".snap";
+    for (const auto &output : point.outputs) {
+        const std::string &path = output.first;
+        if (path.size() > snapExtension.size() &&
+            path.compare(path.size() - snapExtension.size(), snapExtension.size(), snapExtension) == 0)
+            state.outputSymbols.push_back(path.substr(0, path.size() - snapExtension.size()));
+    }
+    state.lastEpoch = point.lastEpoch;
+    state.inputOffset = state.checkpointOffset = point.inputOffset;
+    state.checkpoint = point;
+    if (point.inputOffset > 0) {
+        g_bytesProcessed += point.inputOffset;
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cout << "Resuming " << filePath << " at byte " << point.inputOffset << std::endl;
+    }
+    return true;
+}
+
+void BookProcessor::checkpointFile(const std::string &filePath, FileState &state, bool final) {
+    if (!final && state.inputOffset - state.checkpointOffset < std::max<size_t>(options_.resumeBytes, 1))
+        return;
+    ResumePoint point;
+    point.inputOffset = state.inputOffset;
+    point.lastEpoch = state.lastEpoch;
+    bool saved = inputFingerprint(filePath, point.inputOffset, point.fingerprint);
+    // Everything written for the input so far must be on disk before the checkpoint covers it.
+    for (const auto &symbol : state.outputSymbols) {
+        writerFor(symbol).flush();
+        for (const char *extension : {".snap", ".idx", ".zmap"})
+            point.outputs.emplace_back(symbol + extension, existingFileSize(symbol + extension));
+    }
+    if (state.orderBook) {
+        if (state.journal) {
+            state.journal->flush();
+            for (const char *extension : {".events", ".ckpt"}) {
+                const std::string path = state.orderBook->symbol() + extension;
+                point.outputs.emplace_back(path, existingFileSize(path));
+            }
+        }
+        point.hasBook = true;
+        point.bookSymbol = state.orderBook->symbol();
+        state.orderBook->saveState(point.book);
+    }
+    saved = saved && saveResumePoint(state.resumePath, point);
+    if (!saved) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Failed to write resume checkpoint: " << state.resumePath << std::endl;
+    } else {
+        state.checkpoint = std::move(point);
+    }
+    state.checkpointOffset = state.inputOffset;
+}
+
+void BookProcessor::addResumeOutputs(FileState &state, const std::vector<std::string> &paths) {
+    if (!options_.resume)
+        return;
+    // Nothing was written to these files since the last checkpoint, so their
+    // current lengths belong to it; a run stopped before its next checkpoint is
+    // then cut back to them instead of appending a second copy.
+    bool added = false;
+    for (const auto &path : paths) {
+        auto &outputs = state.checkpoint.outputs;
+        if (std::find_if(outputs.begin(), outputs.end(),
+                         [&path](const std::pair<std::string, int64_t> &output) { return output.first == path; }) !=
+            outputs.end())
+            continue;
+        outputs.emplace_back(path, existingFileSize(path));
+        added = true;
+    }
+    if (added && !saveResumePoint(state.resumePath, state.checkpoint)) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Failed to write resume checkpoint: " << state.resumePath << std::endl;
+    }
+}
+
+void BookProcessor::processFile(const std::string &filePath, size_t fileIndex) {
+    FileState state;
+    state.fileIndex = fileIndex;
+    state.pending.resize(shards_.size());
+    if (options_.resume && !resumeFile(filePath, state))
+        return;
+    bool completed;
+    if (options_.parseThreads > 0)
+        completed = processPipelinedFile(filePath, state);
+    else if (options_.parserMode == ParserMode::Mapped || !shards_.empty())
+        completed = processMappedFile(filePath, state);
+    else
+        completed = processStreamFile(filePath, state);
+    if (!completed)
+        return;
+    if (options_.resume)
+        checkpointFile(filePath, state, true);
     {
         std::lock_guard<std::mutex> lock(coutMutex);
         std::cout << "Completed processing file: " << filePath << std::endl;
@@ -140,18 +611,46 @@ void BookProcessor::processFile(const std::string &filePath) {
 }
 
 void BookProcessor::process() {
+    if (options_.resume && options_.shardThreads > 0) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Resuming needs one book per file; it cannot be combined with symbol shards." << std::endl;
+        return;
+    }
+    // Checked up front: a symbol without a scale would only be refused once its writer opens.
+    if (options_.storage.format == SnapshotFormat::Ticks && options_.priceScales.defaultTicksPerUnit <= 0) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: The ticks format needs a default price scale for every symbol." << std::endl;
+        return;
+    }
+    // Sharded mode: start the shard workers that own the per-symbol books.
+    for (size_t i = 0; i < options_.shardThreads; ++i) {
+        shards_.emplace_back(new Shard(filePaths_.size(), kShardQueueBatches));
+        Shard &shard = *shards_.back();
+        shard.worker = std::thread([this, &shard]() { runShard(shard); });
+    }
     std::vector<std::thread> threads;
-    for (const auto &filePath : filePaths_) {
-        threads.emplace_back([this, filePath]() {
-            this->processFile(filePath);
+    for (size_t i = 0; i < filePaths_.size(); ++i) {
+        threads.emplace_back([this, i]() {
+            this->processFile(filePaths_[i], i);
+            // Lets the shards move on to the next file's events.
+            for (auto &shard : shards_)
+                shard->queues[i]->close();
         });
     }
     for (auto &t : threads) {
         if (t.joinable())
             t.join();
     }
+    for (auto &shard : shards_)
+        shard->worker.join();
+    shards_.clear();
+    // Destroying the writers flushes every buffered snapshot and index entry to disk.
+    std::lock_guard<std::mutex> lock(writersMutex_);
+    writers_.clear();
 }
 
-BookProcessor::BookProcessor(const std::vector<std::string>& filePaths)
-    : filePaths_(filePaths)
+BookProcessor::BookProcessor(const std::vector<std::string>& filePaths, const ProcessorOptions& options)
+    : filePaths_(filePaths), options_(options)
 {}
+
+BookProcessor::~BookProcessor() = default;
@@ -0,0 +1,99 @@
+#include "DepthStore.h"
+#include "SnapshotCodec.h"
+#include <algorithm>
+#include <cstring>
+
+DepthFiles::DepthFiles() : dataOffset_(0), recordBytes_(sizeof(Snapshot)), recordCount_(0) {}
+
+bool DepthFiles::open(const std::string &symbol, int depth, std::ostream &err) {
+    SnapshotLayout layout;
+    if (!snapshotLayout(depth, layout)) {
+        err << "Error: Unsupported snapshot depth: " << depth << std::endl;
+        return false;
+    }
+    symbol_ = symbol;
+    MappedFile idx;
+    if (!idx.open(symbol + ".idx") || !index_.load(idx.data(), idx.size())) {
+        err << "Error: Failed to open index file for symbol: " << symbol << std::endl;
+        return false;
+    }
+    if (!snap_.open(symbol + ".snap")) {
+        err << "Error: Failed to open snapshot file for symbol: " << symbol << std::endl;
+        return false;
+    }
+    if (detectSnapshotFormat(snap_.data(), snap_.size()) != SnapshotFormat::Fixed ||
+        readSnapshotDepth(snap_.data(), snap_.size()) != depth) {
+        err << "Error: Snapshot file of symbol " << symbol << " does not hold depth-" << depth << " snapshots."
+            << std::endl;
+        return false;
+    }
+    dataOffset_ = snapshotDataOffset(depth);
+    recordBytes_ = layout.recordBytes;
+    recordCount_ = snap_.size() > dataOffset_ ? (snap_.size() - dataOffset_) / recordBytes_ : 0;
+    index_.setRecordLayout(static_cast<int64_t>(dataOffset_), recordBytes_);
+    return true;
+}
+
+int64_t DepthFiles::epochAt(size_t position) const {
+    // The epoch follows the symbol at every depth.
+    int64_t epoch;
+    std::memcpy(&epoch, records() + position * recordBytes_ + offsetof(Snapshot, epoch), sizeof(epoch));
+    return epoch;
+}
+
+bool DepthFiles::range(int64_t startEpoch, int64_t endEpoch, size_t &first, size_t &last, std::ostream &err) const {
+    first = last = 0;
+    // A block or keyframe entry holds records up to the next fence, and epochs
+    // may repeat across it, so the search steps back one entry.
+    size_t entry = index_.lowerBound(startEpoch);
+    if (index_.blockRecords() > 0 && entry > 0)
+        --entry;
+    if (entry == index_.size())
+        return true;
+    const int64_t offset = index_.offset(entry) - static_cast<int64_t>(dataOffset_);
+    if (offset < 0 || offset % static_cast<int64_t>(recordBytes_) != 0 ||
+        static_cast<size_t>(offset) / recordBytes_ > recordCount_) {
+        err << "Error: Index does not match snapshot file for symbol: " << symbol_ << std::endl;
+        return false;
+    }
+    first = static_cast<size_t>(offset) / recordBytes_;
+    if (index_.blockRecords() > 0) {
+        // Second level: binary search the block's own records, then step over
+        // any stragglers left by out-of-order epochs.
+        size_t low = first;
+        size_t high = first + std::min<size_t>(index_.blockRecords(), recordCount_ - first);
+        while (low < high) {
+            const size_t middle = low + (high - low) / 2;
+            if (epochAt(middle) < startEpoch)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        first = low;
+        while (first < recordCount_ && epochAt(first) < startEpoch)
+            ++first;
+    }
+    // Stop at the first record past endEpoch.
+    last = first;
+    while (last < recordCount_ && epochAt(last) <= endEpoch)
+        ++last;
+    return true;
+}
+
+int detectQueryDepth(const std::vector<std::string> &symbols, std::ostream &err) {
+    int depth = kDefaultDepth;
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const int symbolDepth = detectSnapshotDepth(symbols[i] + ".snap");
+        if (symbolDepth == 0) {
+            err << "Error: Snapshot file of symbol " << symbols[i] << " has a broken depth header." << std::endl;
+            return 0;
+        }
+        if (i > 0 && symbolDepth != depth) {
+            err << "Error: Symbols " << symbols[0] << " (depth " << depth << ") and " << symbols[i] << " (depth "
+                << symbolDepth << ") cannot be queried together." << std::endl;
+            return 0;
+        }
+        depth = symbolDepth;
+    }
+    return depth;
+}
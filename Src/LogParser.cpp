@@ -0,0 +1,134 @@
+#include "LogParser.h"
+#include <charconv>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LOGPARSER_SSE2 1
+#endif
+
+// Helper: Same whitespace set as std::istringstream (space, \t, \n, \v, \f, \r).
+static inline bool isBlank(char c) {
+    return c == ' ' || (static_cast<unsigned char>(c) - 9u) <= 4u;
+}
+
+#ifdef LOGPARSER_SSE2
+// Helper: Bitmask of the whitespace bytes in a 16-byte block.
+static inline unsigned blankMask(__m128i block) {
+    const __m128i spaces = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    const __m128i shifted = _mm_sub_epi8(block, _mm_set1_epi8(9));
+    const __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(spaces, controls)));
+}
+
+static inline unsigned lowestBit(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+    unsigned index = 0;
+    while (!(mask & 1u)) { mask >>= 1; ++index; }
+    return index;
+#endif
+}
+#endif
+
+// Helper: Skips whitespace; returns the first non-blank position or end.
+static inline const char *skipBlanks(const char *p, const char *end) {
+#ifdef LOGPARSER_SSE2
+    while (end - p >= 16) {
+        unsigned nonBlank = ~blankMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) & 0xFFFFu;
+        if (nonBlank)
+            return p + lowestBit(nonBlank);
+        p += 16;
+    }
+#endif
+    while (p < end && isBlank(*p))
+        ++p;
+    return p;
+}
+
+// Helper: Returns the end of the token starting at p.
+static inline const char *tokenEnd(const char *p, const char *end) {
+#ifdef LOGPARSER_SSE2
+    while (end - p >= 16) {
+        unsigned blanks = blankMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        if (blanks)
+            return p + lowestBit(blanks);
+        p += 16;
+    }
+#endif
+    while (p < end && !isBlank(*p))
+        ++p;
+    return p;
+}
+
+// Helper: Extracts the next whitespace-separated token; false if none is left.
+static inline bool nextToken(const char *&p, const char *end, std::string_view &token) {
+    p = skipBlanks(p, end);
+    if (p == end)
+        return false;
+    const char *tokEnd = tokenEnd(p, end);
+    token = std::string_view(p, static_cast<size_t>(tokEnd - p));
+    p = tokEnd;
+    return true;
+}
+
+// Helper: Converts a whole token to a number; fails on trailing garbage.
+template <typename T>
+static inline bool toNumber(std::string_view token, T &value) {
+    const char *first = token.data();
+    const char *last = first + token.size();
+    auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() && result.ptr == last;
+}
+
+const char *findLineEnd(const char *begin, const char *end) {
+    const void *newline = std::memchr(begin, '\n', static_cast<size_t>(end - begin));
+    return newline ? static_cast<const char*>(newline) : end;
+}
+
+bool parseOrderView(const char *begin, const char *end, OrderView &view) {
+    std::string_view epochTok, idTok, symbolTok, sideTok, categoryTok, priceTok, quantityTok;
+    const char *p = begin;
+    if (!nextToken(p, end, epochTok) || !nextToken(p, end, idTok) || !nextToken(p, end, symbolTok) ||
+        !nextToken(p, end, sideTok) || !nextToken(p, end, categoryTok) || !nextToken(p, end, priceTok) ||
+        !nextToken(p, end, quantityTok))
+        return false;
+
+    if (!toNumber(epochTok, view.epoch))
+        return false;
+    view.orderId = idTok;
+    view.symbol = symbolTok;
+    view.side = (sideTok == "BUY") ? OrderSide::BUY : OrderSide::SELL;
+    if (categoryTok == "NEW")
+        view.category = OrderCategory::NEW;
+    else if (categoryTok == "CANCEL")
+        view.category = OrderCategory::CANCEL;
+    else if (categoryTok == "TRADE")
+        view.category = OrderCategory::TRADE;
+    else
+        return false;
+    // Accept an explicit leading '+', which std::stod/stoi allowed but from_chars does not.
+    if (!priceTok.empty() && priceTok.front() == '+')
+        priceTok.remove_prefix(1);
+    if (!quantityTok.empty() && quantityTok.front() == '+')
+        quantityTok.remove_prefix(1);
+    return toNumber(priceTok, view.price) && toNumber(quantityTok, view.quantity);
+}
+
+void assignOrder(const OrderView &view, Order &order, OrderIdMode idMode) {
+    order.epoch = view.epoch;
+    const char *idEnd = view.orderId.data() + view.orderId.size();
+    std::from_chars_result id{};
+    if (idMode == OrderIdMode::Integer)
+        id = std::from_chars(view.orderId.data(), idEnd, order.numericId);
+    if (idMode == OrderIdMode::Integer && id.ec == std::errc() && id.ptr == idEnd)
+        order.orderId.clear();
+    else
+        order.orderId.assign(view.orderId.data(), view.orderId.size());
+    order.symbol.assign(view.symbol.data(), view.symbol.size());
+    order.side = view.side;
+    order.category = view.category;
+    order.price = view.price;
+    order.quantity = view.quantity;
+}
@@ -1,47 +1,169 @@
 #include "OrderBook.h"
+#include "PriceScale.h"
 #include <algorithm>
+#include <limits>
 #include <iostream>
 #include <cstring>
+#include <stdexcept>
+#include <string>
 
-OrderBook::OrderBook(const std::string &symbol)
-    : symbol_(symbol), lastTradePrice_(-1.0), lastTradeQuantity_(0) {}
+OrderBook::OrderBook(const std::string &symbol, OrderIdMode idMode, int64_t ticksPerUnit)
+    : symbol_(symbol), idMode_(idMode), ticksPerUnit_(ticksPerUnit), lastTradePrice_(-1.0), lastTradeQuantity_(0),
+      visibleChanged_(false), cacheValid_(false),
+      bidBoundary_(std::numeric_limits<int64_t>::min()),
+      askBoundary_(std::numeric_limits<int64_t>::max()) {}
+
+// Helper: Maps the bits of a double to an integer that sorts like the double
+// (negative values have their magnitude bits flipped); its own inverse.
+static int64_t orderedBits(int64_t bits) {
+    return bits >= 0 ? bits : bits ^ std::numeric_limits<int64_t>::max();
+}
+
+int64_t OrderBook::toKey(double price) const {
+    if (ticksPerUnit_ > 0) {
+        int64_t ticks;
+        if (!priceToTicks(price, ticksPerUnit_, ticks))
+            throw std::invalid_argument("price " + std::to_string(price) + " is not on the 1/" +
+                                        std::to_string(ticksPerUnit_) + " tick grid");
+        return ticks;
+    }
+    if (price == 0)
+        price = 0.0;  // One level for -0.0 and 0.0.
+    int64_t bits;
+    std::memcpy(&bits, &price, sizeof(bits));
+    return orderedBits(bits);
+}
+
+double OrderBook::toPrice(int64_t key) const {
+    if (ticksPerUnit_ > 0)
+        return ticksToPrice(key, ticksPerUnit_);
+    const int64_t bits = orderedBits(key);
+    double price;
+    std::memcpy(&price, &bits, sizeof(price));
+    return price;
+}
+
+// Helper: True if fewer than visible levels are strictly better than key,
+// i.e. a level at that price is (or, just removed, was) part of the snapshot.
+template <typename Levels>
+static bool isVisibleLevel(const Levels &levels, int64_t key, int visible) {
+    int better = 0;
+    for (auto it = levels.begin(); it != levels.end() && levels.key_comp()(it->first, key); ++it) {
+        if (++better >= visible)
+            return false;
+    }
+    return true;
+}
+
+// Helper: Copies up to count levels, best first.
+template <typename Levels, typename ToPrice>
+static int copyLevels(const Levels &levels, int count, double *prices, int32_t *quantities, ToPrice toPrice) {
+    int copied = 0;
+    for (auto it = levels.begin(); it != levels.end() && copied < count; ++it, ++copied) {
+        prices[copied] = toPrice(it->first);
+        quantities[copied] = it->second;
+    }
+    return copied;
+}
+
+// Helper: Removes quantity from an aggregated level, erasing the level once it is empty.
+template <typename Levels>
+static void reduceLevel(Levels &levels, int64_t key, int quantity) {
+    auto it = levels.find(key);
+    if (it == levels.end())
+        return;
+    it->second -= quantity;
+    if (it->second <= 0)
+        levels.erase(it);
+}
 
 void OrderBook::processOrder(const Order &order) {
+    visibleChanged_ = false;
     try {
         if (order.category == OrderCategory::NEW) {
             addOrderToBook(order);
         } else if (order.category == OrderCategory::CANCEL) {
             removeOrderFromBook(order, order.quantity);
         } else if (order.category == OrderCategory::TRADE) {
+            // On the tick grid, the trade price is the exact price of its tick.
+            const double price = ticksPerUnit_ > 0 ? toPrice(toKey(order.price)) : order.price;
             removeOrderFromBook(order, order.quantity);
-            lastTradePrice_ = order.price;
+            if (lastTradePrice_ != price || lastTradeQuantity_ != order.quantity)
+                visibleChanged_ = true;
+            lastTradePrice_ = price;
             lastTradeQuantity_ = order.quantity;
         }
     } catch (const std::exception &ex) {
         std::cerr << "Error processing order " << order.orderId << ": " << ex.what() << std::endl;
     }
+    if (visibleChanged_)
+        cacheValid_ = false;
+}
+
+void OrderBook::noteLevelChange(OrderSide side, int64_t key) {
+    if (visibleChanged_)
+        return;
+    // A change at price cannot alter which levels are better than it, so the
+    // boundary of the last built snapshot answers without walking the levels
+    // (for the default depth only, which is what the snapshot holds).
+    if (cacheValid_ && visibleLevels_ == kVisibleLevels)
+        visibleChanged_ = (side == OrderSide::BUY) ? key >= bidBoundary_ : key <= askBoundary_;
+    else
+        visibleChanged_ = (side == OrderSide::BUY) ? isVisibleLevel(buyLevels_, key, visibleLevels_)
+                                                   : isVisibleLevel(sellLevels_, key, visibleLevels_);
 }
 
 void OrderBook::addOrderToBook(const Order &order) {
+    const int64_t key = toKey(order.price);
+    if (idMode_ == OrderIdMode::Integer) {
+        uint64_t id = numericOrderId(order);
+        if (order.side == OrderSide::BUY) {
+            buyTable_.insert(id, RestingOrder{key, order.quantity});
+            buyLevels_[key] += order.quantity;
+        } else {
+            sellTable_.insert(id, RestingOrder{key, order.quantity});
+            sellLevels_[key] += order.quantity;
+        }
+        noteLevelChange(order.side, key);
+        return;
+    }
     if (order.side == OrderSide::BUY) {
         buyOrders_[order.orderId] = order;
-        buyLevels_[order.price] += order.quantity;
+        buyLevels_[key] += order.quantity;
     } else {
         sellOrders_[order.orderId] = order;
-        sellLevels_[order.price] += order.quantity;
+        sellLevels_[key] += order.quantity;
     }
+    noteLevelChange(order.side, key);
 }
 
 void OrderBook::removeOrderFromBook(const Order &order, int quantityToRemove) {
+    if (idMode_ == OrderIdMode::Integer) {
+        uint64_t id = numericOrderId(order);
+        OrderTable<RestingOrder> &table = (order.side == OrderSide::BUY) ? buyTable_ : sellTable_;
+        RestingOrder *existing = table.find(id);
+        if (existing == nullptr)
+            return;
+        int removeQty = std::min(existing->quantity, quantityToRemove);
+        existing->quantity -= removeQty;
+        if (order.side == OrderSide::BUY)
+            reduceLevel(buyLevels_, existing->key, removeQty);
+        else
+            reduceLevel(sellLevels_, existing->key, removeQty);
+        noteLevelChange(order.side, existing->key);
+        if (existing->quantity <= 0)
+            table.erase(id);
+        return;
+    }
     if (order.side == OrderSide::BUY) {
         auto it = buyOrders_.find(order.orderId);
         if (it != buyOrders_.end()) {
             Order &existing = it->second;
+            const int64_t key = toKey(existing.price);
             int removeQty = std::min(existing.quantity, quantityToRemove);
             existing.quantity -= removeQty;
-            buyLevels_[existing.price] -= removeQty;
-            if (buyLevels_[existing.price] <= 0)
-                buyLevels_.erase(existing.price);
+            reduceLevel(buyLevels_, key, removeQty);
+            noteLevelChange(order.side, key);
             if (existing.quantity <= 0)
                 buyOrders_.erase(it);
         }
@@ -49,19 +171,83 @@ void OrderBook::removeOrderFromBook(const Order &order, int quantityToRemove) {
         auto it = sellOrders_.find(order.orderId);
         if (it != sellOrders_.end()) {
             Order &existing = it->second;
+            const int64_t key = toKey(existing.price);
             int removeQty = std::min(existing.quantity, quantityToRemove);
             existing.quantity -= removeQty;
-            sellLevels_[existing.price] -= removeQty;
-            if (sellLevels_[existing.price] <= 0)
-                sellLevels_.erase(existing.price);
+            reduceLevel(sellLevels_, key, removeQty);
+            noteLevelChange(order.side, key);
             if (existing.quantity <= 0)
                 sellOrders_.erase(it);
         }
     }
 }
 
+void OrderBook::saveState(BookState &state) const {
+    state.orders.clear();
+    if (idMode_ == OrderIdMode::Integer) {
+        buyTable_.forEach([this, &state](uint64_t id, const RestingOrder &order) {
+            state.orders.push_back({std::to_string(id), OrderSide::BUY, toPrice(order.key), order.quantity});
+        });
+        sellTable_.forEach([this, &state](uint64_t id, const RestingOrder &order) {
+            state.orders.push_back({std::to_string(id), OrderSide::SELL, toPrice(order.key), order.quantity});
+        });
+    } else {
+        for (const auto &entry : buyOrders_)
+            state.orders.push_back({entry.first, OrderSide::BUY, entry.second.price, entry.second.quantity});
+        for (const auto &entry : sellOrders_)
+            state.orders.push_back({entry.first, OrderSide::SELL, entry.second.price, entry.second.quantity});
+    }
+    state.bids.clear();
+    state.asks.clear();
+    for (const auto &level : buyLevels_)
+        state.bids.emplace_back(toPrice(level.first), level.second);
+    for (const auto &level : sellLevels_)
+        state.asks.emplace_back(toPrice(level.first), level.second);
+    state.lastTradePrice = lastTradePrice_;
+    state.lastTradeQuantity = lastTradeQuantity_;
+}
+
+void OrderBook::loadState(const BookState &state) {
+    buyOrders_.clear();
+    sellOrders_.clear();
+    buyTable_ = OrderTable<RestingOrder>();
+    sellTable_ = OrderTable<RestingOrder>();
+    for (const auto &order : state.orders) {
+        if (idMode_ == OrderIdMode::Integer) {
+            OrderTable<RestingOrder> &table = (order.side == OrderSide::BUY) ? buyTable_ : sellTable_;
+            table.insert(numericOrderId(order.orderId), RestingOrder{toKey(order.price), order.quantity});
+        } else {
+            auto &orders = (order.side == OrderSide::BUY) ? buyOrders_ : sellOrders_;
+            orders[order.orderId] = Order{0, order.orderId, symbol_, order.side, OrderCategory::NEW, order.price,
+                                          order.quantity};
+        }
+    }
+    buyLevels_.clear();
+    sellLevels_.clear();
+    for (const auto &level : state.bids)
+        buyLevels_[toKey(level.first)] = static_cast<int>(level.second);
+    for (const auto &level : state.asks)
+        sellLevels_[toKey(level.first)] = static_cast<int>(level.second);
+    lastTradePrice_ = state.lastTradePrice;
+    lastTradeQuantity_ = state.lastTradeQuantity;
+    visibleChanged_ = true;
+    cacheValid_ = false;
+}
+
+int OrderBook::topLevels(OrderSide side, int count, double *prices, int32_t *quantities) const {
+    auto toPrice = [this](int64_t key) { return this->toPrice(key); };
+    return side == OrderSide::BUY ? copyLevels(buyLevels_, count, prices, quantities, toPrice)
+                                  : copyLevels(sellLevels_, count, prices, quantities, toPrice);
+}
+
 Snapshot OrderBook::getSnapshot(int64_t epoch) const {
-    Snapshot snap;
+    // Most events leave the top levels untouched; reuse the last build for those.
+    if (cacheValid_) {
+        Snapshot snap = cached_;
+        snap.epoch = epoch;
+        return snap;
+    }
+    Snapshot &snap = cached_;
     // Fill symbol: use fixed size char array
     std::memset(snap.symbol, 0, sizeof(snap.symbol));
     std::strncpy(snap.symbol, symbol_.c_str(), sizeof(snap.symbol)-1);
@@ -70,34 +256,40 @@ Snapshot OrderBook::getSnapshot(int64_t epoch) const {
     snap.lastTradeQuantity = lastTradeQuantity_;
 
     // Fill bid levels: iterate over buyLevels_ (descending order)
+    constexpr int depth = Snapshot::kDepth;
     int count = 0;
+    bidBoundary_ = std::numeric_limits<int64_t>::min();
     for (const auto &level : buyLevels_) {
-        if (count >= 5)
+        if (count >= depth)
             break;
-        snap.bidPrices[count] = level.first;
+        snap.bidPrices[count] = toPrice(level.first);
         snap.bidQuantities[count] = level.second;
-        count++;
+        if (++count == depth)
+            bidBoundary_ = level.first;
     }
     // Fill remaining bid levels with N.A (price -1 and quantity 0)
-    for (int i = count; i < 5; ++i) {
+    for (int i = count; i < depth; ++i) {
         snap.bidPrices[i] = -1.0;
         snap.bidQuantities[i] = 0;
     }
 
     // Fill ask levels: iterate over sellLevels_ (ascending order)
     count = 0;
+    askBoundary_ = std::numeric_limits<int64_t>::max();
     for (const auto &level : sellLevels_) {
-        if (count >= 5)
+        if (count >= depth)
             break;
-        snap.askPrices[count] = level.first;
+        snap.askPrices[count] = toPrice(level.first);
         snap.askQuantities[count] = level.second;
-        count++;
+        if (++count == depth)
+            askBoundary_ = level.first;
     }
     // Fill remaining ask levels with N.A
-    for (int i = count; i < 5; ++i) {
+    for (int i = count; i < depth; ++i) {
         snap.askPrices[i] = -1.0;
         snap.askQuantities[i] = 0;
     }
 
+    cacheValid_ = true;
     return snap;
 }
@@ -0,0 +1,15 @@
+#include "OrderBookBase.h"
+#include "OrderBook.h"
+#include "PriceLadderBook.h"
+
+std::unique_ptr<OrderBookBase> makeOrderBook(BookType type, const std::string &symbol, OrderIdMode idMode,
+                                             int visibleLevels, int64_t ticksPerUnit) {
+    std::unique_ptr<OrderBookBase> book;
+    if (type == BookType::Ladder)
+        book.reset(new PriceLadderBook(symbol, ticksPerUnit > 0 ? ticksPerUnit : PriceLadderBook::kDefaultTicksPerUnit,
+                                       idMode));
+    else
+        book.reset(new OrderBook(symbol, idMode, ticksPerUnit));
+    book->setVisibleLevels(visibleLevels);
+    return book;
+}
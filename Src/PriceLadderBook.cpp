@@ -0,0 +1,356 @@
+#include "PriceLadderBook.h"
+#include "PriceScale.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+PriceLadderBook::Ladder::Ladder(bool isBid)
+    : isBid_(isBid), base_(0), best_(-1), live_(0) {}
+
+bool PriceLadderBook::Ladder::inWindow(int64_t tick) const {
+    return tick >= base_ && tick - base_ < static_cast<int64_t>(levels_.size());
+}
+
+void PriceLadderBook::Ladder::rebase(int64_t newBase, size_t newSize) {
+    std::vector<int64_t> resized(newSize, 0);
+    for (size_t i = 0; i < levels_.size(); ++i) {
+        if (levels_[i] == 0)
+            continue;
+        int64_t tick = base_ + static_cast<int64_t>(i);
+        int64_t index = tick - newBase;
+        if (index >= 0 && index < static_cast<int64_t>(newSize))
+            resized[static_cast<size_t>(index)] = levels_[i];
+        else
+            overflow_[tick] += levels_[i];
+    }
+    levels_.swap(resized);
+    base_ = newBase;
+    // Overflow levels that now fall inside the window move into the ladder.
+    auto it = overflow_.lower_bound(base_);
+    while (it != overflow_.end() && inWindow(it->first)) {
+        levels_[static_cast<size_t>(it->first - base_)] = it->second;
+        it = overflow_.erase(it);
+    }
+    live_ = static_cast<size_t>(std::count_if(levels_.begin(), levels_.end(), [](int64_t q) { return q > 0; }));
+    findBest(isBid_ ? static_cast<int64_t>(levels_.size()) - 1 : 0);
+}
+
+void PriceLadderBook::Ladder::findBest(int64_t from) {
+    const int64_t size = static_cast<int64_t>(levels_.size());
+    if (isBid_) {
+        for (int64_t i = std::min(from, size - 1); i >= 0; --i) {
+            if (levels_[static_cast<size_t>(i)] > 0) {
+                best_ = i;
+                return;
+            }
+        }
+    } else {
+        for (int64_t i = std::max<int64_t>(from, 0); i < size; ++i) {
+            if (levels_[static_cast<size_t>(i)] > 0) {
+                best_ = i;
+                return;
+            }
+        }
+    }
+    best_ = -1;
+}
+
+int64_t PriceLadderBook::Ladder::indexFor(int64_t tick) {
+    const int64_t size = static_cast<int64_t>(levels_.size());
+    if (live_ == 0) {
+        // Nothing rests in the ladder: re-centre it on the new price instead of growing.
+        int64_t newSize = (size == 0) ? kInitialLadderTicks : size;
+        rebase(tick - newSize / 2, static_cast<size_t>(newSize));
+        return tick - base_;
+    }
+    if (inWindow(tick))
+        return tick - base_;
+    int64_t low = std::min(base_, tick);
+    int64_t high = std::max(base_ + size, tick + 1);
+    int64_t span = high - low;
+    if (span > kMaxLadderTicks)
+        return -1;
+    int64_t newSize = std::min(std::max(span, 2 * size), static_cast<int64_t>(kMaxLadderTicks));
+    // Put the spare room on the side the book is growing towards.
+    int64_t newBase = (tick < base_) ? high - newSize : low;
+    rebase(newBase, static_cast<size_t>(newSize));
+    return tick - base_;
+}
+
+void PriceLadderBook::Ladder::add(int64_t tick, int64_t quantity) {
+    if (quantity <= 0)
+        return;
+    int64_t index = indexFor(tick);
+    if (index < 0) {
+        overflow_[tick] += quantity;
+        return;
+    }
+    int64_t &level = levels_[static_cast<size_t>(index)];
+    if (level == 0)
+        ++live_;
+    level += quantity;
+    if (best_ < 0 || (isBid_ ? index > best_ : index < best_))
+        best_ = index;
+}
+
+void PriceLadderBook::Ladder::remove(int64_t tick, int64_t quantity) {
+    if (quantity <= 0)
+        return;
+    if (inWindow(tick)) {
+        int64_t index = tick - base_;
+        int64_t &level = levels_[static_cast<size_t>(index)];
+        if (level <= 0)
+            return;
+        level -= quantity;
+        if (level <= 0) {
+            level = 0;
+            --live_;
+            if (index == best_)
+                findBest(isBid_ ? index - 1 : index + 1);
+        }
+        return;
+    }
+    auto it = overflow_.find(tick);
+    if (it != overflow_.end()) {
+        it->second -= quantity;
+        if (it->second <= 0)
+            overflow_.erase(it);
+    }
+}
+
+int PriceLadderBook::Ladder::top(int maxLevels, int64_t *ticks, int64_t *quantities) const {
+    int count = 0;
+    auto emit = [&](int64_t tick, int64_t quantity) {
+        ticks[count] = tick;
+        quantities[count] = quantity;
+        ++count;
+    };
+    const int64_t size = static_cast<int64_t>(levels_.size());
+    const int64_t windowEnd = base_ + size;
+    if (isBid_) {
+        // Overflow above the window, then the ladder downwards, then overflow below it.
+        for (auto it = overflow_.rbegin(); it != overflow_.rend() && count < maxLevels && it->first >= windowEnd; ++it)
+            emit(it->first, it->second);
+        for (int64_t i = best_; i >= 0 && count < maxLevels; --i) {
+            if (levels_[static_cast<size_t>(i)] > 0)
+                emit(base_ + i, levels_[static_cast<size_t>(i)]);
+        }
+        for (auto it = std::map<int64_t, int64_t>::const_reverse_iterator(overflow_.lower_bound(base_));
+             it != overflow_.rend() && count < maxLevels; ++it)
+            emit(it->first, it->second);
+    } else {
+        // Overflow below the window, then the ladder upwards, then overflow above it.
+        for (auto it = overflow_.begin(); it != overflow_.end() && count < maxLevels && it->first < base_; ++it)
+            emit(it->first, it->second);
+        for (int64_t i = (best_ < 0 ? size : best_); i < size && count < maxLevels; ++i) {
+            if (levels_[static_cast<size_t>(i)] > 0)
+                emit(base_ + i, levels_[static_cast<size_t>(i)]);
+        }
+        for (auto it = overflow_.lower_bound(windowEnd); it != overflow_.end() && count < maxLevels; ++it)
+            emit(it->first, it->second);
+    }
+    return count;
+}
+
+bool PriceLadderBook::Ladder::isVisible(int64_t tick, int levels) const {
+    int64_t ticks[kMaxDepth];
+    int64_t quantities[kMaxDepth];
+    levels = std::min(levels, kMaxDepth);
+    int count = top(levels, ticks, quantities);
+    if (count < levels)
+        return true;
+    return isBid_ ? tick >= ticks[levels - 1] : tick <= ticks[levels - 1];
+}
+
+PriceLadderBook::PriceLadderBook(const std::string &symbol, int64_t ticksPerUnit, OrderIdMode idMode)
+    : symbol_(symbol), ticksPerUnit_(ticksPerUnit), idMode_(idMode), bids_(true), asks_(false),
+      lastTradePrice_(-1.0), lastTradeQuantity_(0), visibleChanged_(false), cacheValid_(false),
+      bidBoundary_(std::numeric_limits<int64_t>::min()), askBoundary_(std::numeric_limits<int64_t>::max()) {}
+
+int64_t PriceLadderBook::toTicks(double price) const {
+    int64_t ticks;
+    if (!priceToTicks(price, ticksPerUnit_, ticks))
+        throw std::invalid_argument("price " + std::to_string(price) + " is not on the 1/" +
+                                    std::to_string(ticksPerUnit_) + " tick grid");
+    return ticks;
+}
+
+double PriceLadderBook::toPrice(int64_t tick) const {
+    // Dividing by the integer scale gives the same double as parsing the decimal price.
+    return static_cast<double>(tick) / static_cast<double>(ticksPerUnit_);
+}
+
+void PriceLadderBook::processOrder(const Order &order) {
+    visibleChanged_ = false;
+    try {
+        if (order.category == OrderCategory::NEW) {
+            addOrder(order);
+        } else if (order.category == OrderCategory::CANCEL) {
+            removeOrder(order, order.quantity);
+        } else if (order.category == OrderCategory::TRADE) {
+            // On the tick grid, the trade price is the exact price of its tick.
+            const double price = toPrice(toTicks(order.price));
+            removeOrder(order, order.quantity);
+            if (lastTradePrice_ != price || lastTradeQuantity_ != order.quantity)
+                visibleChanged_ = true;
+            lastTradePrice_ = price;
+            lastTradeQuantity_ = order.quantity;
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error processing order " << order.orderId << ": " << ex.what() << std::endl;
+    }
+    if (visibleChanged_)
+        cacheValid_ = false;
+}
+
+void PriceLadderBook::addOrder(const Order &order) {
+    RestingOrder record{toTicks(order.price), order.quantity};
+    if (idMode_ == OrderIdMode::Integer)
+        (order.side == OrderSide::BUY ? buyTable_ : sellTable_).insert(numericOrderId(order), record);
+    else
+        (order.side == OrderSide::BUY ? buyOrders_ : sellOrders_)[order.orderId] = record;
+    Ladder &ladder = (order.side == OrderSide::BUY) ? bids_ : asks_;
+    ladder.add(record.tick, record.quantity);
+    noteLevelChange(ladder, record.tick);
+}
+
+void PriceLadderBook::removeOrder(const Order &order, int quantityToRemove) {
+    Ladder &ladder = (order.side == OrderSide::BUY) ? bids_ : asks_;
+    if (idMode_ == OrderIdMode::Integer) {
+        OrderTable<RestingOrder> &table = (order.side == OrderSide::BUY) ? buyTable_ : sellTable_;
+        uint64_t id = numericOrderId(order);
+        RestingOrder *existing = table.find(id);
+        if (existing == nullptr)
+            return;
+        int removeQty = std::min(existing->quantity, quantityToRemove);
+        existing->quantity -= removeQty;
+        ladder.remove(existing->tick, removeQty);
+        noteLevelChange(ladder, existing->tick);
+        if (existing->quantity <= 0)
+            table.erase(id);
+        return;
+    }
+    auto &orders = (order.side == OrderSide::BUY) ? buyOrders_ : sellOrders_;
+    auto it = orders.find(order.orderId);
+    if (it == orders.end())
+        return;
+    RestingOrder &existing = it->second;
+    int removeQty = std::min(existing.quantity, quantityToRemove);
+    existing.quantity -= removeQty;
+    ladder.remove(existing.tick, removeQty);
+    noteLevelChange(ladder, existing.tick);
+    if (existing.quantity <= 0)
+        orders.erase(it);
+}
+
+void PriceLadderBook::noteLevelChange(const Ladder &ladder, int64_t tick) {
+    if (visibleChanged_)
+        return;
+    // The levels better than tick are unaffected by a change at tick, so the
+    // boundary of the last built snapshot still decides visibility.
+    // The cached boundaries are those of the default depth.
+    if (cacheValid_ && visibleLevels_ == kVisibleLevels)
+        visibleChanged_ = (&ladder == &bids_) ? tick >= bidBoundary_ : tick <= askBoundary_;
+    else
+        visibleChanged_ = ladder.isVisible(tick, visibleLevels_);
+}
+
+void PriceLadderBook::saveState(BookState &state) const {
+    state.orders.clear();
+    auto addOrders = [this, &state](OrderSide side, const std::unordered_map<std::string, RestingOrder> &orders,
+                                    const OrderTable<RestingOrder> &table) {
+        if (idMode_ == OrderIdMode::Integer) {
+            table.forEach([&](uint64_t id, const RestingOrder &order) {
+                state.orders.push_back({std::to_string(id), side, toPrice(order.tick), order.quantity});
+            });
+        } else {
+            for (const auto &entry : orders)
+                state.orders.push_back({entry.first, side, toPrice(entry.second.tick), entry.second.quantity});
+        }
+    };
+    addOrders(OrderSide::BUY, buyOrders_, buyTable_);
+    addOrders(OrderSide::SELL, sellOrders_, sellTable_);
+    auto addLevels = [this](const Ladder &ladder, std::vector<std::pair<double, int64_t>> &levels) {
+        std::vector<int64_t> ticks(ladder.levelCount());
+        std::vector<int64_t> quantities(ticks.size());
+        int count = ladder.top(static_cast<int>(ticks.size()), ticks.data(), quantities.data());
+        levels.clear();
+        for (int i = 0; i < count; ++i)
+            levels.emplace_back(toPrice(ticks[i]), quantities[i]);
+    };
+    addLevels(bids_, state.bids);
+    addLevels(asks_, state.asks);
+    state.lastTradePrice = lastTradePrice_;
+    state.lastTradeQuantity = lastTradeQuantity_;
+}
+
+void PriceLadderBook::loadState(const BookState &state) {
+    buyOrders_.clear();
+    sellOrders_.clear();
+    buyTable_ = OrderTable<RestingOrder>();
+    sellTable_ = OrderTable<RestingOrder>();
+    for (const auto &order : state.orders) {
+        RestingOrder record{toTicks(order.price), order.quantity};
+        if (idMode_ == OrderIdMode::Integer)
+            (order.side == OrderSide::BUY ? buyTable_ : sellTable_).insert(numericOrderId(order.orderId), record);
+        else
+            (order.side == OrderSide::BUY ? buyOrders_ : sellOrders_)[order.orderId] = record;
+    }
+    bids_ = Ladder(true);
+    asks_ = Ladder(false);
+    for (const auto &level : state.bids)
+        bids_.add(toTicks(level.first), level.second);
+    for (const auto &level : state.asks)
+        asks_.add(toTicks(level.first), level.second);
+    lastTradePrice_ = state.lastTradePrice;
+    lastTradeQuantity_ = state.lastTradeQuantity;
+    visibleChanged_ = true;
+    cacheValid_ = false;
+}
+
+int PriceLadderBook::topLevels(OrderSide side, int count, double *prices, int32_t *quantities) const {
+    int64_t ticks[kMaxDepth];
+    int64_t levelQuantities[kMaxDepth];
+    int copied = (side == OrderSide::BUY ? bids_ : asks_).top(std::min(count, kMaxDepth), ticks, levelQuantities);
+    for (int i = 0; i < copied; ++i) {
+        prices[i] = toPrice(ticks[i]);
+        quantities[i] = static_cast<int32_t>(levelQuantities[i]);
+    }
+    return copied;
+}
+
+Snapshot PriceLadderBook::getSnapshot(int64_t epoch) const {
+    if (cacheValid_) {
+        Snapshot snap = cached_;
+        snap.epoch = epoch;
+        return snap;
+    }
+    Snapshot &snap = cached_;
+    // Fill symbol: use fixed size char array
+    std::memset(snap.symbol, 0, sizeof(snap.symbol));
+    std::strncpy(snap.symbol, symbol_.c_str(), sizeof(snap.symbol)-1);
+    snap.epoch = epoch;
+    snap.lastTradePrice = lastTradePrice_;
+    snap.lastTradeQuantity = lastTradeQuantity_;
+
+    constexpr int depth = Snapshot::kDepth;
+    int64_t ticks[depth];
+    int64_t quantities[depth];
+    int count = bids_.top(depth, ticks, quantities);
+    bidBoundary_ = (count == depth) ? ticks[depth - 1] : std::numeric_limits<int64_t>::min();
+    for (int i = 0; i < depth; ++i) {
+        snap.bidPrices[i] = (i < count) ? toPrice(ticks[i]) : -1.0;
+        snap.bidQuantities[i] = (i < count) ? static_cast<int32_t>(quantities[i]) : 0;
+    }
+    count = asks_.top(depth, ticks, quantities);
+    askBoundary_ = (count == depth) ? ticks[depth - 1] : std::numeric_limits<int64_t>::max();
+    for (int i = 0; i < depth; ++i) {
+        snap.askPrices[i] = (i < count) ? toPrice(ticks[i]) : -1.0;
+        snap.askQuantities[i] = (i < count) ? static_cast<int32_t>(quantities[i]) : 0;
+    }
+    cacheValid_ = true;
+    return snap;
+}
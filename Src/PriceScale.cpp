@@ -0,0 +1,60 @@
+#include "PriceScale.h"
+#include <charconv>
+#include <cmath>
+
+// Largest magnitude of price * ticksPerUnit whose tick count is still exact (2^53).
+static constexpr double kMaxExactTicks = 9007199254740992.0;
+
+// Relative distance from a whole tick accepted as rounding of the decimal
+// text; a price off the grid is at least a fraction of a tick away.
+static constexpr double kTickTolerance = 1e-12;
+
+bool priceToTicks(double price, int64_t ticksPerUnit, int64_t &ticks) {
+    const double scaled = price * static_cast<double>(ticksPerUnit);
+    if (!(std::fabs(scaled) < kMaxExactTicks))
+        return false;
+    const double rounded = std::nearbyint(scaled);
+    if (std::fabs(scaled - rounded) > kTickTolerance * std::fmax(1.0, std::fabs(scaled)))
+        return false;
+    ticks = static_cast<int64_t>(rounded);
+    return true;
+}
+
+int priceDecimals(int64_t ticksPerUnit) {
+    int64_t power = 1;
+    for (int decimals = 0; decimals < 9; ++decimals, power *= 10) {
+        if (power % ticksPerUnit == 0)
+            return decimals;
+    }
+    return 9;
+}
+
+int64_t PriceScales::forSymbol(const std::string &symbol) const {
+    auto it = symbols.find(symbol);
+    return it != symbols.end() ? it->second : defaultTicksPerUnit;
+}
+
+bool PriceScales::parse(const std::string &spec, std::ostream &err) {
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos)
+            end = spec.size();
+        const std::string entry = spec.substr(start, end - start);
+        const size_t colon = entry.find(':');
+        const std::string number = colon == std::string::npos ? entry : entry.substr(colon + 1);
+        int64_t scale = 0;
+        auto result = std::from_chars(number.data(), number.data() + number.size(), scale);
+        if (result.ec != std::errc() || result.ptr != number.data() + number.size() || scale <= 0 || colon == 0) {
+            err << "Error: Invalid price scale \"" << entry << "\" (expected <ticks per unit> or <symbol>:<ticks per unit>)."
+                << std::endl;
+            return false;
+        }
+        if (colon == std::string::npos)
+            defaultTicksPerUnit = scale;
+        else
+            symbols[entry.substr(0, colon)] = scale;
+        start = end + 1;
+    }
+    return true;
+}
@@ -1,223 +1,1491 @@
 #include "QueryEngine.h"
 #include "Snapshot.h"
+#include "SnapshotCodec.h"
+#include "PriceScale.h"
+#include "WorkerPool.h"
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <functional>
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
 #include <iomanip>
 #include <vector>
 #include <string>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-// Structure for index entry in the index file.
-struct IndexEntry {
-    int64_t epoch;
-    int64_t offset;
+// Global mutex to synchronize console output (defined in BookProcessor.cpp).
+extern std::mutex coutMutex;
+
+// Reads byte ranges of a snapshot file, straight from its mapping when the engine has one.
+class SnapshotFileReader {
+public:
+    SnapshotFileReader(const std::string &path, const MappedFile *mapped) : mapped_(mapped), size_(0) {
+        if (mapped_) {
+            size_ = mapped_->isOpen() ? static_cast<int64_t>(mapped_->size()) : 0;
+        } else {
+            ifs_.open(path, std::ios::binary | std::ios::ate);
+            if (ifs_.is_open())
+                size_ = static_cast<int64_t>(ifs_.tellg());
+        }
+    }
+
+    bool isOpen() const { return mapped_ ? mapped_->isOpen() : ifs_.is_open(); }
+    int64_t size() const { return size_; }
+
+    // Returns n (> 0) bytes at offset: a pointer into the mapping, or into scratch
+    // after reading them. nullptr if the range lies outside the file.
+    const char *view(int64_t offset, size_t n, std::vector<char> &scratch) {
+        if (offset < 0 || n == 0 || offset + static_cast<int64_t>(n) > size_)
+            return nullptr;
+        if (mapped_)
+            return mapped_->data() + offset;
+        scratch.resize(n);
+        ifs_.seekg(offset, std::ios::beg);
+        if (!ifs_.read(scratch.data(), static_cast<std::streamsize>(n)))
+            return nullptr;
+        return scratch.data();
+    }
+
+private:
+    const MappedFile *mapped_;
+    std::ifstream ifs_;
+    int64_t size_;
 };
 
-// Comparator used in binary search.
-bool compareIndexEntry(const IndexEntry &a, const IndexEntry &b) {
-    return a.epoch < b.epoch;
+QueryEngine::QueryEngine(const std::vector<std::string>& symbolList, ReaderMode mode, size_t queryThreads)
+    : symbolList_(symbolList), mode_(mode), queryThreads_(std::max<size_t>(queryThreads, 1))
+{
+    if (queryThreads_ > 1)
+        pool_.reset(new WorkerPool(queryThreads_ - 1));
+}
+
+QueryEngine::~QueryEngine() = default;
+
+void QueryEngine::refresh() {
+    std::lock_guard<std::mutex> lock(mappedMutex_);
+    mapped_.clear();
+}
+
+size_t QueryEngine::preload() {
+    size_t loaded = 0;
+    if (mode_ != ReaderMode::Mapped)
+        return loaded;
+    for (const auto &symbol : symbolList_) {
+        if (mappedFiles(symbol) != nullptr)
+            ++loaded;
+    }
+    return loaded;
+}
+
+// Helper: True if a symbol's snapshot file has the default depth; files of
+// other depths are read through DepthStore.h instead.
+static bool isDefaultDepth(const std::string &symbol, int depth) {
+    if (depth == kDefaultDepth)
+        return true;
+    std::lock_guard<std::mutex> lock(coutMutex);
+    if (depth == 0)
+        std::cerr << "Error: Snapshot file of symbol " << symbol << " has a broken depth header." << std::endl;
+    else
+        std::cerr << "Error: Snapshot file of symbol " << symbol << " holds depth-" << depth
+                  << " snapshots; only the query command reads them." << std::endl;
+    return false;
+}
+
+// Helper: Reads a symbol's zone map, unless it does not cover the snapshot file's
+// rows. Delta files are not decoded to count them; their writer refuses to extend
+// a map that does not cover the file.
+static void loadZoneMap(const std::string &symbol, const MappedFile &snap, ZoneMap &zones) {
+    if (zones.readFile(symbol + ".zmap"))
+        zones.matchRecords(countSnapshotRecords(snap.data(), snap.size(), false));
+}
+
+const QueryEngine::MappedSymbol *QueryEngine::mappedFiles(const std::string &symbol) {
+    std::lock_guard<std::mutex> lock(mappedMutex_);
+    std::unique_ptr<MappedSymbol> &entry = mapped_[symbol];
+    if (!entry) {
+        std::unique_ptr<MappedSymbol> files(new MappedSymbol());
+        MappedFile idx;
+        if (!idx.open(symbol + ".idx") || !files->index.load(idx.data(), idx.size())) {
+            mapped_.erase(symbol);
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Failed to open index file for symbol: " << symbol << std::endl;
+            return nullptr;
+        }
+        if (!files->snap.open(symbol + ".snap")) {
+            mapped_.erase(symbol);
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Failed to open snapshot file for symbol: " << symbol << std::endl;
+            return nullptr;
+        }
+        files->format = detectSnapshotFormat(files->snap.data(), files->snap.size());
+        if (!isDefaultDepth(symbol, readSnapshotDepth(files->snap.data(), files->snap.size()))) {
+            mapped_.erase(symbol);
+            return nullptr;
+        }
+        if (files->format == SnapshotFormat::Ticks)
+            files->index.setRecordLayout(kTicksHeaderBytes, sizeof(TickSnapshot));
+        // The zone map is optional: without it filtered queries read the whole range.
+        loadZoneMap(symbol, files->snap, files->zones);
+        entry = std::move(files);
+    }
+    return entry.get();
+}
+
+// Helper: First index entry whose records may include startEpoch. A block or
+// keyframe entry holds records up to the next fence, and epochs may repeat
+// across it, so the search steps back one entry; a per-snapshot entry does not.
+static size_t firstEntryFor(const SnapshotIndex &index, int64_t startEpoch, bool perSnapshot) {
+    size_t first = index.lowerBound(startEpoch);
+    if (!perSnapshot && first > 0)
+        --first;
+    return first;
+}
+
+bool QueryEngine::mappedSnapshots(const std::string &symbol, int64_t startEpoch, int64_t endEpoch, SnapshotSpan &span) {
+    span = SnapshotSpan();
+    if (mode_ != ReaderMode::Mapped) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Zero-copy snapshot access requires the mapped reader." << std::endl;
+        return false;
+    }
+    const MappedSymbol *files = mappedFiles(symbol);
+    if (files == nullptr)
+        return false;
+    if (files->format != SnapshotFormat::Fixed) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Zero-copy snapshot access requires fixed-format files: " << symbol << std::endl;
+        return false;
+    }
+    const SnapshotIndex &index = files->index;
+    size_t entry = firstEntryFor(index, startEpoch, index.blockRecords() == 0);
+    if (entry == index.size())
+        return true;
+    // The mapping is page aligned and records sit at multiples of sizeof(Snapshot),
+    // so records can be used in place.
+    const int64_t offset = index.offset(entry);
+    const size_t records = files->snap.size() / sizeof(Snapshot);
+    if (offset < 0 || offset % static_cast<int64_t>(sizeof(Snapshot)) != 0 ||
+        static_cast<size_t>(offset) / sizeof(Snapshot) > records) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Index does not match snapshot file for symbol: " << symbol << std::endl;
+        return false;
+    }
+    const Snapshot *first = reinterpret_cast<const Snapshot*>(files->snap.data()) + offset / sizeof(Snapshot);
+    const Snapshot *last = reinterpret_cast<const Snapshot*>(files->snap.data()) + records;
+    if (index.blockRecords() > 0) {
+        // Second level: binary search the block's own records, then step over
+        // any stragglers left by out-of-order epochs.
+        const Snapshot *blockEnd = first + std::min<size_t>(index.blockRecords(), static_cast<size_t>(last - first));
+        first = std::lower_bound(first, blockEnd, startEpoch,
+                                 [](const Snapshot &snap, int64_t epoch) { return snap.epoch < epoch; });
+        while (first < last && first->epoch < startEpoch)
+            ++first;
+    }
+    // Same scan as the stream reader: stop at the first snapshot past endEpoch.
+    const Snapshot *stop = first;
+    while (stop < last && stop->epoch <= endEpoch)
+        ++stop;
+    span.first = first;
+    span.count = static_cast<size_t>(stop - first);
+    return true;
 }
 
-QueryEngine::QueryEngine(const std::vector<std::string>& symbolList)
-    : symbolList_(symbolList)
-{}
+// Rows per chunk for the streams that read or decode records.
+static constexpr size_t kStreamChunkRows = 1024;
+
+// Fixed-format rows already in memory (a mapped file); rows before startEpoch
+// left by out-of-order epochs are skipped.
+class SpanStream : public SnapshotStream {
+public:
+    SpanStream(const Snapshot *begin, const Snapshot *end, int64_t startEpoch)
+        : current_(begin), end_(end), startEpoch_(startEpoch) {}
+
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        while (current_ < end_ && current_->epoch < startEpoch_)
+            ++current_;
+        if (current_ == end_)
+            return false;
+        begin = current_;
+        while (current_ < end_ && current_->epoch >= startEpoch_)
+            ++current_;
+        end = current_;
+        return true;
+    }
+
+private:
+    const Snapshot *current_;
+    const Snapshot *end_;
+    int64_t startEpoch_;
+};
+
+// Fixed-format file read through ifstream a chunk of records at a time.
+class FixedFileStream : public SnapshotStream {
+public:
+    FixedFileStream(const std::string &path, int64_t offset, int64_t startEpoch, int64_t endEpoch)
+        : ifs_(path, std::ios::binary), startEpoch_(startEpoch), endEpoch_(endEpoch), started_(false), done_(false) {
+        // Seek to the offset of the first relevant snapshot (or its block).
+        ifs_.seekg(offset, std::ios::beg);
+    }
+
+    bool isOpen() const { return ifs_.is_open(); }
+
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        while (!done_) {
+            buffer_.resize(kStreamChunkRows);
+            ifs_.read(reinterpret_cast<char*>(buffer_.data()),
+                      static_cast<std::streamsize>(buffer_.size() * sizeof(Snapshot)));
+            size_t got = static_cast<size_t>(ifs_.gcount()) / sizeof(Snapshot);
+            if (got < buffer_.size())
+                done_ = true;
+            // Skip to the first snapshot at or after startEpoch, then keep rows until epoch > endEpoch.
+            size_t kept = 0;
+            for (size_t i = 0; i < got; ++i) {
+                const Snapshot &snap = buffer_[i];
+                if (!started_ && snap.epoch < startEpoch_)
+                    continue;
+                started_ = true;
+                if (snap.epoch > endEpoch_) {
+                    done_ = true;
+                    break;
+                }
+                if (snap.epoch >= startEpoch_)
+                    buffer_[kept++] = snap;
+            }
+            if (kept > 0) {
+                begin = buffer_.data();
+                end = begin + kept;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::ifstream ifs_;
+    std::vector<Snapshot> buffer_;
+    int64_t startEpoch_;
+    int64_t endEpoch_;
+    bool started_;
+    bool done_;
+};
+
+// Delta-format file: seeks to the keyframe preceding startEpoch and decodes
+// forward a chunk at a time until endEpoch.
+class DeltaStream : public SnapshotStream {
+public:
+    DeltaStream(const std::string &symbol, const SnapshotIndex &keyframes, const MappedFile *snapMap,
+                int64_t startEpoch, int64_t endEpoch)
+        : symbol_(symbol), p_(nullptr), end_(nullptr), decoder_(kNoSymbol), endEpoch_(endEpoch),
+          startEpoch_(startEpoch), valid_(false) {
+        // Records before the first keyframe at or after startEpoch may still be in range
+        // (epochs repeat), so roll forward from the keyframe before it.
+        size_t first = firstEntryFor(keyframes, startEpoch, false);
+        // Everything from the first keyframe after endEpoch onwards is out of range.
+        size_t last = keyframes.upperBound(endEpoch);
+
+        SnapshotFileReader reader(symbol + ".snap", snapMap);
+        const char *header = reader.view(0, kDeltaHeaderBytes, bytes_);
+        char fileSymbol[8];
+        if (header == nullptr || !readDeltaHeader(header, kDeltaHeaderBytes, fileSymbol)) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Invalid snapshot file header for symbol: " << symbol << std::endl;
+            return;
+        }
+        int64_t begin = keyframes.offset(first);
+        int64_t end = (last == keyframes.size()) ? reader.size() : keyframes.offset(last);
+        if (begin < static_cast<int64_t>(kDeltaHeaderBytes) || end > reader.size() || begin > end) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Index does not match snapshot file for symbol: " << symbol << std::endl;
+            return;
+        }
+        valid_ = true;
+        decoder_ = DeltaDecoder(fileSymbol);
+        if (begin == end)
+            return;
+        p_ = reader.view(begin, static_cast<size_t>(end - begin), bytes_);
+        if (p_ == nullptr) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Failed to read snapshot file for symbol: " << symbol << std::endl;
+            valid_ = false;
+            return;
+        }
+        end_ = p_ + (end - begin);
+    }
+
+    bool isValid() const { return valid_; }
+
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        buffer_.clear();
+        Snapshot snap;
+        while (p_ < end_ && buffer_.size() < kStreamChunkRows) {
+            if (!decoder_.decode(p_, end_, snap)) {
+                std::lock_guard<std::mutex> lock(coutMutex);
+                std::cerr << "Error: Corrupt snapshot record for symbol: " << symbol_ << std::endl;
+                p_ = end_;
+                break;
+            }
+            if (snap.epoch > endEpoch_) {
+                p_ = end_;
+                break;
+            }
+            if (snap.epoch >= startEpoch_)
+                buffer_.push_back(snap);
+        }
+        if (buffer_.empty())
+            return false;
+        begin = buffer_.data();
+        end = begin + buffer_.size();
+        return true;
+    }
+
+private:
+    static constexpr char kNoSymbol[8] = {};
+
+    std::string symbol_;
+    std::vector<char> bytes_;   ///< The encoded range when the file is not mapped.
+    const char *p_;
+    const char *end_;
+    DeltaDecoder decoder_;
+    std::vector<Snapshot> buffer_;
+    int64_t endEpoch_;
+    int64_t startEpoch_;
+    bool valid_;
+};
+
+// Ticks-format file: reads the records from the index entry preceding
+// startEpoch a chunk at a time and converts their prices back to doubles
+// until endEpoch.
+class TickStream : public SnapshotStream {
+public:
+    TickStream(const std::string &symbol, const MappedFile *snapMap, int64_t offset, int64_t startEpoch,
+               int64_t endEpoch)
+        : reader_(symbol + ".snap", snapMap), ticksPerUnit_(0), offset_(offset), startEpoch_(startEpoch),
+          endEpoch_(endEpoch), started_(false), valid_(false) {
+        const char *header = reader_.view(0, kTicksHeaderBytes, bytes_);
+        ticksPerUnit_ = header ? readTicksPerUnit(header, kTicksHeaderBytes) : 0;
+        if (ticksPerUnit_ == 0) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Invalid snapshot file header for symbol: " << symbol << std::endl;
+            return;
+        }
+        if (offset_ < static_cast<int64_t>(kTicksHeaderBytes) ||
+            (offset_ - static_cast<int64_t>(kTicksHeaderBytes)) % static_cast<int64_t>(sizeof(TickSnapshot)) != 0) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Index does not match snapshot file for symbol: " << symbol << std::endl;
+            return;
+        }
+        valid_ = true;
+    }
 
-std::vector<Snapshot> QueryEngine::readSnapshotsForSymbol(const std::string &symbol, int64_t startEpoch, int64_t endEpoch) {
-    std::vector<Snapshot> snapshots;
-    std::string snapFilename = symbol + ".snap";
-    std::string idxFilename = symbol + ".idx";
+    bool isValid() const { return valid_; }
 
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        buffer_.clear();
+        while (buffer_.empty() && offset_ < reader_.size()) {
+            const size_t rows = std::min<size_t>(
+                kStreamChunkRows, static_cast<size_t>(reader_.size() - offset_) / sizeof(TickSnapshot));
+            const char *p = rows ? reader_.view(offset_, rows * sizeof(TickSnapshot), bytes_) : nullptr;
+            if (p == nullptr)
+                break;
+            offset_ += static_cast<int64_t>(rows * sizeof(TickSnapshot));
+            // Skip to the first snapshot at or after startEpoch, then keep rows until epoch > endEpoch.
+            TickSnapshot record;
+            Snapshot snap;
+            for (size_t i = 0; i < rows; ++i) {
+                std::memcpy(&record, p + i * sizeof(TickSnapshot), sizeof(record));
+                if (!started_ && record.epoch < startEpoch_)
+                    continue;
+                started_ = true;
+                if (record.epoch > endEpoch_) {
+                    offset_ = reader_.size();
+                    break;
+                }
+                if (record.epoch >= startEpoch_) {
+                    decodeTicks(record, ticksPerUnit_, snap);
+                    buffer_.push_back(snap);
+                }
+            }
+        }
+        if (buffer_.empty())
+            return false;
+        begin = buffer_.data();
+        end = begin + buffer_.size();
+        return true;
+    }
+
+private:
+    SnapshotFileReader reader_;
+    std::vector<char> bytes_;   ///< The records of a chunk when the file is not mapped.
+    std::vector<Snapshot> buffer_;
+    int64_t ticksPerUnit_;
+    int64_t offset_;            ///< File offset of the next record to read.
+    int64_t startEpoch_;
+    int64_t endEpoch_;
+    bool started_;
+    bool valid_;
+};
+
+// Columnar file: for each row group overlapping the range, reads the epoch
+// column and then only the selected columns of the matching rows; one chunk
+// per row group.
+class ColumnarStream : public SnapshotStream {
+public:
+    ColumnarStream(const std::string &symbol, const SnapshotIndex &rowGroups, const MappedFile *snapMap,
+                   int64_t startEpoch, int64_t endEpoch, uint32_t columns)
+        : symbol_(symbol), reader_(symbol + ".snap", snapMap), startEpoch_(startEpoch), endEpoch_(endEpoch),
+          columns_(columns & ~(1u << ColEpoch)), valid_(false) {
+        // Same range logic as the delta reader: epochs may repeat across a group boundary.
+        size_t first = firstEntryFor(rowGroups, startEpoch, false);
+        size_t last = rowGroups.upperBound(endEpoch);
+        for (size_t group = first; group < last; ++group)
+            groupOffsets_.push_back(rowGroups.offset(group));
+        next_ = 0;
+
+        const char *header = reader_.view(0, kColumnarHeaderBytes, scratch_);
+        char fileSymbol[8];
+        if (header == nullptr || !readColumnarHeader(header, kColumnarHeaderBytes, fileSymbol)) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Failed to open snapshot file for symbol: " << symbol << std::endl;
+            return;
+        }
+        std::memset(&blank_, 0, sizeof(blank_));
+        std::memcpy(blank_.symbol, fileSymbol, sizeof(blank_.symbol));
+        valid_ = true;
+    }
+
+    bool isValid() const { return valid_; }
+
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        while (next_ < groupOffsets_.size()) {
+            const int64_t offset = groupOffsets_[next_++];
+            if (!readGroup(offset)) {
+                next_ = groupOffsets_.size();
+                return false;
+            }
+            if (!buffer_.empty()) {
+                begin = buffer_.data();
+                end = begin + buffer_.size();
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::string symbol_;
+    SnapshotFileReader reader_;
+    std::vector<int64_t> groupOffsets_;
+    size_t next_;
+    Snapshot blank_;
+    std::vector<char> scratch_;
+    std::vector<int64_t> epochs_;
+    std::vector<Snapshot> buffer_;
+    int64_t startEpoch_;
+    int64_t endEpoch_;
+    uint32_t columns_;
+    bool valid_;
+
+    // Decodes the rows of one group inside [startEpoch, endEpoch]; false on a broken file.
+    bool readGroup(int64_t offset) {
+        buffer_.clear();
+        uint32_t rows = 0;
+        const char *rowCount = reader_.view(offset, sizeof(rows), scratch_);
+        if (rowCount == nullptr) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Index does not match snapshot file for symbol: " << symbol_ << std::endl;
+            return false;
+        }
+        std::memcpy(&rows, rowCount, sizeof(rows));
+        if (rows == 0)
+            return true;
+        const int64_t payload = offset + static_cast<int64_t>(kRowGroupHeaderBytes);
+        const char *epochColumn = reader_.view(payload + static_cast<int64_t>(columnOffset(ColEpoch, rows)),
+                                               rows * sizeof(int64_t), scratch_);
+        if (epochColumn == nullptr) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Truncated row group in snapshot file for symbol: " << symbol_ << std::endl;
+            return false;
+        }
+        epochs_.resize(rows);
+        std::memcpy(epochs_.data(), epochColumn, rows * sizeof(int64_t));
+        // Rows of the group inside [startEpoch, endEpoch].
+        size_t begin = std::lower_bound(epochs_.begin(), epochs_.end(), startEpoch_) - epochs_.begin();
+        size_t end = std::upper_bound(epochs_.begin(), epochs_.end(), endEpoch_) - epochs_.begin();
+        if (begin >= end)
+            return true;
+        buffer_.assign(end - begin, blank_);
+        for (size_t row = begin; row < end; ++row)
+            buffer_[row - begin].epoch = epochs_[row];
+        for (int column = 0; column < kSnapshotColumns; ++column) {
+            if ((columns_ & (1u << column)) == 0)
+                continue;
+            size_t width = columnWidth(column);
+            const char *values = reader_.view(payload + static_cast<int64_t>(columnOffset(column, rows) + begin * width),
+                                              (end - begin) * width, scratch_);
+            if (values == nullptr) {
+                std::lock_guard<std::mutex> lock(coutMutex);
+                std::cerr << "Error: Truncated row group in snapshot file for symbol: " << symbol_ << std::endl;
+                buffer_.clear();
+                return false;
+            }
+            for (size_t row = 0; row < end - begin; ++row)
+                setColumnValue(buffer_[row], column, values + row * width);
+        }
+        return true;
+    }
+};
+
+bool QueryEngine::openSymbolFiles(const std::string &symbol, SymbolFiles &files) {
+    files.mapped = nullptr;
+    if (mode_ == ReaderMode::Mapped) {
+        files.mapped = mappedFiles(symbol);
+        if (files.mapped == nullptr)
+            return false;
+        files.format = files.mapped->format;
+        return true;
+    }
     // Read the index file.
-    std::ifstream idxIfs(idxFilename, std::ios::binary);
-    if (!idxIfs.is_open()) {
+    if (!files.ownIndex.readFile(symbol + ".idx")) {
+        std::lock_guard<std::mutex> lock(coutMutex);
         std::cerr << "Error: Failed to open index file for symbol: " << symbol << std::endl;
-        return snapshots;
-    }
-    std::vector<IndexEntry> indexEntries;
-    IndexEntry entry;
-    while (idxIfs.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
-        indexEntries.push_back(entry);
+        return false;
     }
-    idxIfs.close();
+    if (!isDefaultDepth(symbol, detectSnapshotDepth(symbol + ".snap")))
+        return false;
+    if (!files.ownIndex.empty())
+        files.format = detectSnapshotFormat(symbol + ".snap");
+    if (files.format == SnapshotFormat::Ticks)
+        files.ownIndex.setRecordLayout(kTicksHeaderBytes, sizeof(TickSnapshot));
+    return true;
+}
 
-    if (indexEntries.empty())
-        return snapshots;
+std::unique_ptr<SnapshotStream> QueryEngine::openSymbolStream(const std::string &symbol, int64_t startEpoch,
+                                                              int64_t endEpoch, uint32_t columns) {
+    SymbolFiles files;
+    if (!openSymbolFiles(symbol, files))
+        return nullptr;
+    return openSymbolStream(symbol, files, startEpoch, endEpoch, columns);
+}
 
-    // Use binary search to find the first index entry with epoch >= startEpoch.
-    IndexEntry searchKey;
-    searchKey.epoch = startEpoch;
-    searchKey.offset = 0;
-    auto it = std::lower_bound(indexEntries.begin(), indexEntries.end(), searchKey, compareIndexEntry);
-    if (it == indexEntries.end())
-        return snapshots; // No snapshot in range
+std::unique_ptr<SnapshotStream> QueryEngine::openSymbolStream(const std::string &symbol, const SymbolFiles &files,
+                                                              int64_t startEpoch, int64_t endEpoch, uint32_t columns) {
+    const SnapshotIndex &index = files.index();
+    if (index.empty())
+        return nullptr;
+    const MappedFile *snapMap = files.mapped ? &files.mapped->snap : nullptr;
+    if (files.mapped && files.format == SnapshotFormat::Fixed) {
+        SnapshotSpan span;
+        if (!mappedSnapshots(symbol, startEpoch, endEpoch, span))
+            return nullptr;
+        return std::unique_ptr<SnapshotStream>(new SpanStream(span.begin(), span.end(), startEpoch));
+    }
 
-    // Open snapshot file.
-    std::ifstream snapIfs(snapFilename, std::ios::binary);
-    if (!snapIfs.is_open()) {
+    if (files.format == SnapshotFormat::Delta) {
+        std::unique_ptr<DeltaStream> stream(new DeltaStream(symbol, index, snapMap, startEpoch, endEpoch));
+        return stream->isValid() ? std::move(stream) : nullptr;
+    }
+    if (files.format == SnapshotFormat::Columnar) {
+        std::unique_ptr<ColumnarStream> stream(
+            new ColumnarStream(symbol, index, snapMap, startEpoch, endEpoch, columns));
+        return stream->isValid() ? std::move(stream) : nullptr;
+    }
+    // Find the first index entry that may hold epoch >= startEpoch.
+    size_t entry = firstEntryFor(index, startEpoch, index.blockRecords() == 0);
+    if (entry == index.size())
+        return nullptr; // No snapshot in range
+    if (files.format == SnapshotFormat::Ticks) {
+        std::unique_ptr<TickStream> stream(new TickStream(symbol, snapMap, index.offset(entry), startEpoch, endEpoch));
+        return stream->isValid() ? std::move(stream) : nullptr;
+    }
+    std::unique_ptr<FixedFileStream> stream(new FixedFileStream(symbol + ".snap", index.offset(entry), startEpoch, endEpoch));
+    if (!stream->isOpen()) {
+        std::lock_guard<std::mutex> lock(coutMutex);
         std::cerr << "Error: Failed to open snapshot file for symbol: " << symbol << std::endl;
-        return snapshots;
+        return nullptr;
     }
-    // Seek to the offset of the first relevant snapshot.
-    snapIfs.seekg(it->offset, std::ios::beg);
-    // Read snapshots until epoch > endEpoch.
-    while (snapIfs.good() && !snapIfs.eof()) {
-        Snapshot snap;
-        if (!readBinarySnapshot(snapIfs, snap))
-            break;
-        if (snap.epoch > endEpoch)
-            break;
-        if (snap.epoch >= startEpoch && snap.epoch <= endEpoch) {
-            snapshots.push_back(snap);
+    return std::move(stream);
+}
+
+// Rows of another stream that pass a filter. The filter's selection masks are
+// computed per chunk; a fully selected chunk is passed through as is, otherwise
+// only the selected rows are copied out, so rejected rows go no further.
+class FilteredStream : public SnapshotStream {
+public:
+    FilteredStream(std::unique_ptr<SnapshotStream> source, const SnapshotFilter &filter)
+        : source_(std::move(source)), filter_(filter) {}
+
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        const Snapshot *rows;
+        const Snapshot *rowsEnd;
+        while (source_->nextChunk(rows, rowsEnd)) {
+            const size_t n = static_cast<size_t>(rowsEnd - rows);
+            masks_.resize((n + SnapshotFilter::kBlockRows - 1) / SnapshotFilter::kBlockRows);
+            const size_t selected = filter_.select(rows, n, masks_.data());
+            if (selected == 0)
+                continue;
+            if (selected == n) {
+                begin = rows;
+                end = rowsEnd;
+                return true;
+            }
+            selectedRows_.resize(selected);
+            Snapshot *out = selectedRows_.data();
+            for (size_t k = 0; k < masks_.size(); ++k) {
+                const Snapshot *block = rows + k * SnapshotFilter::kBlockRows;
+                for (uint64_t mask = masks_[k]; mask != 0; mask &= mask - 1)
+                    *out++ = block[lowestBit(mask)];
+            }
+            begin = selectedRows_.data();
+            end = out;
+            return true;
         }
+        return false;
     }
-    snapIfs.close();
-    return snapshots;
+
+private:
+    std::unique_ptr<SnapshotStream> source_;
+    SnapshotFilter filter_;
+    std::vector<uint64_t> masks_;
+    std::vector<Snapshot> selectedRows_;
+
+    static unsigned lowestBit(uint64_t mask) {
+#if defined(_MSC_VER)
+        unsigned long bit;
+        _BitScanForward64(&bit, mask);
+        return static_cast<unsigned>(bit);
+#else
+        return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+    }
+};
+
+// Helper: Wraps a stream in the query's filter, if it has one.
+static std::unique_ptr<SnapshotStream> filterStream(std::unique_ptr<SnapshotStream> stream,
+                                                    const SnapshotFilter &filter) {
+    if (!stream || filter.empty())
+        return stream;
+    return std::unique_ptr<SnapshotStream>(new FilteredStream(std::move(stream), filter));
 }
 
-std::vector<Snapshot> QueryEngine::query(const QueryCriteria &criteria) {
-    std::vector<Snapshot> results;
+// The candidate epoch ranges of a zone map, read one after another through
+// streams opened as each range is reached.
+class ZoneSkipStream : public SnapshotStream {
+public:
+    using Opener = std::function<std::unique_ptr<SnapshotStream>(int64_t, int64_t)>;
+
+    ZoneSkipStream(std::vector<std::pair<int64_t, int64_t>> ranges, Opener open)
+        : ranges_(std::move(ranges)), open_(std::move(open)), next_(0) {}
+
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        while (true) {
+            if (stream_ && stream_->nextChunk(begin, end))
+                return true;
+            stream_.reset();
+            if (next_ == ranges_.size())
+                return false;
+            const auto &range = ranges_[next_++];
+            stream_ = open_(range.first, range.second);
+        }
+    }
+
+private:
+    std::vector<std::pair<int64_t, int64_t>> ranges_;
+    Opener open_;
+    size_t next_;
+    std::unique_ptr<SnapshotStream> stream_;
+};
+
+std::unique_ptr<SnapshotStream> QueryEngine::openFilteredStream(const std::string &symbol, int64_t startEpoch,
+                                                                int64_t endEpoch, uint32_t columns,
+                                                                const SnapshotFilter &filter) {
+    if (filter.empty())
+        return openSymbolStream(symbol, startEpoch, endEpoch, columns);
+    auto files = std::make_shared<SymbolFiles>();
+    if (!openSymbolFiles(symbol, *files))
+        return nullptr;
+    ZoneMap ownZones;
+    if (!files->mapped)
+        loadZoneMap(symbol, MappedFile(symbol + ".snap"), ownZones);
+    const ZoneMap &zones = files->mapped ? files->mapped->zones : ownZones;
+    if (zones.empty())
+        return filterStream(openSymbolStream(symbol, *files, startEpoch, endEpoch, columns), filter);
+    auto ranges = zones.candidateRanges(filter, startEpoch, endEpoch);
+    if (ranges.size() == 1 && ranges.front().first == startEpoch && ranges.front().second == endEpoch)
+        return filterStream(openSymbolStream(symbol, *files, startEpoch, endEpoch, columns), filter);
+    std::unique_ptr<SnapshotStream> stream(new ZoneSkipStream(
+        std::move(ranges), [this, symbol, files, columns](int64_t from, int64_t to) {
+            return openSymbolStream(symbol, *files, from, to, columns);
+        }));
+    return filterStream(std::move(stream), filter);
+}
+
+// Helper: Columns needed to print the selected fields (all columns for the default view).
+static uint32_t columnsForFields(const std::unordered_set<std::string> &selectedFields) {
+    if (selectedFields.empty())
+        return kAllColumns;
+    uint32_t columns = 1u << ColEpoch;
+    for (int column = 0; column < kSnapshotColumns; ++column) {
+        if (selectedFields.count(columnName(column)))
+            columns |= 1u << column;
+    }
+    return columns;
+}
+
+// Rows read ahead per symbol in each refill round of a parallel query; a
+// symbol holds at most two rounds (the merge's and the next) in memory.
+static constexpr size_t kReadAheadRows = kStreamChunkRows;
+
+// The symbols of one parallel query. When the merge runs out of rows of a
+// symbol, every symbol whose next rows have been taken is refilled in one round
+// on the engine's worker pool, so the threads stay busy while the merge waits
+// for one.
+class ReadAheadGroup {
+public:
+    using Opener = std::function<std::unique_ptr<SnapshotStream>(const std::string&)>;
+
+    ReadAheadGroup(const std::vector<std::string> &symbols, WorkerPool &pool, Opener open)
+        : sources_(symbols.size()), pool_(pool), open_(std::move(open)) {
+        for (size_t i = 0; i < symbols.size(); ++i)
+            sources_[i].symbol = symbols[i];
+    }
+
+    // Swaps the next rows of a symbol into rows; false once the symbol is exhausted.
+    bool take(size_t i, std::vector<Snapshot> &rows) {
+        Source &source = sources_[i];
+        if (!source.filled)
+            fillRound();
+        source.filled = false;
+        if (source.ahead.empty())
+            return false;
+        rows.swap(source.ahead);
+        source.ahead.clear();
+        return true;
+    }
+
+private:
+    struct Source {
+        std::string symbol;
+        std::unique_ptr<SnapshotStream> stream;
+        const Snapshot *pending = nullptr;     ///< Rest of the stream's current chunk.
+        const Snapshot *pendingEnd = nullptr;
+        std::vector<Snapshot> ahead;           ///< Rows read for the merge's next take().
+        bool opened = false;
+        bool filled = false;
+    };
+
+    std::vector<Source> sources_;
+    WorkerPool &pool_;
+    Opener open_;
+
+    void fill(Source &source) {
+        // A failing symbol is reported and stops contributing rows; the others are unaffected.
+        try {
+            if (!source.opened) {
+                source.opened = true;
+                source.stream = open_(source.symbol);
+            }
+            while (source.stream && source.ahead.size() < kReadAheadRows) {
+                if (source.pending == source.pendingEnd && !source.stream->nextChunk(source.pending, source.pendingEnd)) {
+                    source.stream.reset();
+                    break;
+                }
+                size_t n = std::min(kReadAheadRows - source.ahead.size(),
+                                    static_cast<size_t>(source.pendingEnd - source.pending));
+                source.ahead.insert(source.ahead.end(), source.pending, source.pending + n);
+                source.pending += n;
+            }
+        } catch (const std::exception &ex) {
+            source.stream.reset();
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error processing symbol " << source.symbol << ": " << ex.what() << std::endl;
+        }
+        source.filled = true;
+    }
+
+    void fillRound() {
+        std::vector<size_t> pending;
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            if (!sources_[i].filled)
+                pending.push_back(i);
+        }
+        // Symbols are handed out one at a time, so a slow symbol does not hold
+        // up a thread's share of fast ones; the calling thread works too.
+        pool_.run(pending.size(), [this, &pending](size_t k) { fill(sources_[pending[k]]); });
+    }
+};
+
+// One symbol of a ReadAheadGroup.
+class ReadAheadStream : public SnapshotStream {
+public:
+    ReadAheadStream(std::shared_ptr<ReadAheadGroup> group, size_t source) : group_(std::move(group)), source_(source) {}
+
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        if (!group_->take(source_, rows_))
+            return false;
+        begin = rows_.data();
+        end = rows_.data() + rows_.size();
+        return true;
+    }
+
+private:
+    std::shared_ptr<ReadAheadGroup> group_;
+    size_t source_;
+    std::vector<Snapshot> rows_;
+};
+
+SnapshotMerger QueryEngine::openQuery(const QueryCriteria &criteria) {
+    SnapshotMerger merger;
+    merger.setLimit(criteria.limit);
     if (criteria.startEpoch > criteria.endEpoch) {
+        std::lock_guard<std::mutex> lock(coutMutex);
         std::cerr << "Error: startEpoch is greater than endEpoch." << std::endl;
-        return results;
+        return merger;
+    }
+    const std::vector<std::string> &symbolsToQuery = criteria.symbols.empty() ? symbolList_ : criteria.symbols;
+    const int64_t startEpoch = criteria.startEpoch;
+    const int64_t endEpoch = criteria.endEpoch;
+    const SnapshotFilter &filter = criteria.filter;
+    const uint32_t columns = columnsForFields(criteria.selectedFields) | filter.columns();
+    if (queryThreads_ > 1 && symbolsToQuery.size() > 1) {
+        // The filter runs on the query threads, as part of reading ahead.
+        auto group = std::make_shared<ReadAheadGroup>(
+            symbolsToQuery, *pool_,
+            [this, startEpoch, endEpoch, columns, filter](const std::string &symbol) {
+                return openFilteredStream(symbol, startEpoch, endEpoch, columns, filter);
+            });
+        for (size_t i = 0; i < symbolsToQuery.size(); ++i)
+            merger.add(std::unique_ptr<SnapshotStream>(new ReadAheadStream(group, i)));
+        return merger;
     }
-    std::vector<std::string> symbolsToQuery = criteria.symbols.empty() ? symbolList_ : criteria.symbols;
     for (const auto &symbol : symbolsToQuery) {
         try {
-            std::vector<Snapshot> snaps = readSnapshotsForSymbol(symbol, criteria.startEpoch, criteria.endEpoch);
-            results.insert(results.end(), snaps.begin(), snaps.end());
+            merger.add(openFilteredStream(symbol, startEpoch, endEpoch, columns, filter));
         } catch (const std::exception &ex) {
+            std::lock_guard<std::mutex> lock(coutMutex);
             std::cerr << "Error processing symbol " << symbol << ": " << ex.what() << std::endl;
         }
     }
-    std::sort(results.begin(), results.end(), [](const Snapshot &a, const Snapshot &b) {
-        return a.epoch < b.epoch;
+    return merger;
+}
+
+size_t QueryEngine::query(const QueryCriteria &criteria, const SnapshotSink &sink) {
+    size_t delivered = 0;
+    SnapshotMerger merger = openQuery(criteria);
+    while (const Snapshot *snap = merger.next()) {
+        ++delivered;
+        if (!sink(*snap))
+            break;
+    }
+    return delivered;
+}
+
+std::vector<Snapshot> QueryEngine::query(const QueryCriteria &criteria) {
+    std::vector<Snapshot> results;
+    query(criteria, [&results](const Snapshot &snap) {
+        results.push_back(snap);
+        return true;
     });
     return results;
 }
 
-// Helper: Formats a double to two decimal places.
-std::string formatDouble(double value) {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(2) << value;
-    return oss.str();
+// Helper: First position at or after from whose key exceeds value, for keys
+// ascending from from. Gallops ahead 1, 2, 4, ... positions and then bisects,
+// so the cost grows with the log of the distance moved rather than of n.
+template <typename KeyAt>
+static size_t gallopPast(size_t from, size_t n, int64_t value, KeyAt keyAt) {
+    if (from >= n || keyAt(from) > value)
+        return from;
+    size_t lo = from;  // keyAt(lo) <= value throughout.
+    size_t step = 1;
+    size_t hi = from + step;
+    while (hi < n && keyAt(hi) <= value) {
+        lo = hi;
+        step *= 2;
+        hi = from + step;
+    }
+    hi = std::min(hi, n);
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (keyAt(mid) <= value)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return hi;
 }
 
-// Helper: Formats a price level as "quantity@price".
-std::string formatPriceLevel(int32_t quantity, double price) {
-    if (price < 0)
-        return "N.A";
-    return std::to_string(quantity) + "@" + formatDouble(price);
+size_t QueryEngine::asOf(const AsOfCriteria &criteria, const AsOfSink &sink) {
+    const std::vector<int64_t> &epochs = criteria.epochs;
+    if (!std::is_sorted(epochs.begin(), epochs.end())) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: As-of epochs must be sorted in ascending order." << std::endl;
+        return 0;
+    }
+    if (epochs.empty())
+        return 0;
+    const std::vector<std::string> &symbolsToQuery = criteria.symbols.empty() ? symbolList_ : criteria.symbols;
+    const uint32_t columns = columnsForFields(criteria.selectedFields);
+    size_t delivered = 0;
+    for (size_t s = 0; s < symbolsToQuery.size(); ++s) {
+        const std::string &symbol = symbolsToQuery[s];
+        try {
+            SymbolFiles files;
+            if (!openSymbolFiles(symbol, files))
+                continue;
+            const SnapshotIndex &index = files.index();
+            auto fence = [&index](size_t i) { return index.epoch(i); };
+            // Skipping fewer entries than one chunk holds is cheaper by reading on
+            // than by reopening the stream further ahead.
+            const size_t reopenEntries = index.blockRecords() ? std::max<size_t>(1, kStreamChunkRows / index.blockRecords())
+                                                               : kStreamChunkRows;
+            std::unique_ptr<SnapshotStream> stream;
+            const Snapshot *current = nullptr;
+            const Snapshot *end = nullptr;
+            bool exhausted = false;
+            Snapshot latest;
+            bool found = false;
+            size_t entry = 0;  // First index entry past the previous lookup epoch.
+            for (size_t t = 0; t < epochs.size(); ++t) {
+                const int64_t at = epochs[t];
+                size_t next = gallopPast(entry, index.size(), at, fence);
+                if (next == 0)
+                    continue; // Nothing at or before this epoch.
+                // The answer lies in entry next - 1 or later; jump there if that skips enough.
+                if (!stream || next - entry > reopenEntries) {
+                    stream = openSymbolStream(symbol, files, index.epoch(next - 1), epochs.back(), columns);
+                    current = end = nullptr;
+                    exhausted = !stream;
+                }
+                entry = next;
+                // Read forward to the last row at or before this epoch, galloping within each chunk.
+                while (!exhausted) {
+                    if (current == end) {
+                        exhausted = !stream->nextChunk(current, end);
+                        continue;
+                    }
+                    if ((end - 1)->epoch <= at) {
+                        latest = *(end - 1);
+                        found = true;
+                        current = end;
+                        continue;
+                    }
+                    size_t past = gallopPast(0, static_cast<size_t>(end - current), at,
+                                             [current](size_t i) { return current[i].epoch; });
+                    if (past > 0) {
+                        latest = current[past - 1];
+                        found = true;
+                        current += past;
+                    }
+                    break;
+                }
+                if (found) {
+                    ++delivered;
+                    if (!sink(s, t, latest))
+                        return delivered;
+                }
+            }
+        } catch (const std::exception &ex) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error processing symbol " << symbol << ": " << ex.what() << std::endl;
+        }
+    }
+    return delivered;
 }
 
-// Helper: Formats a price field.
-std::string formatPrice(double price) {
-    if (price < 0)
-        return "N.A";
-    return formatDouble(price);
+std::vector<AsOfMatch> QueryEngine::asOf(const AsOfCriteria &criteria) {
+    std::vector<AsOfMatch> matches;
+    asOf(criteria, [&matches](size_t symbol, size_t time, const Snapshot &snap) {
+        matches.push_back({symbol, time, snap});
+        return true;
+    });
+    return matches;
 }
 
-void QueryEngine::printSnapshots(const std::vector<Snapshot> &snapshots, const QueryCriteria &criteria) const {
-    // Allowed field names for selective output.
-    const std::vector<std::string> allowedFields = {
-        "symbol", "epoch",
-        "bid1p", "bid1q", "bid2p", "bid2q", "bid3p", "bid3q", "bid4p", "bid4q", "bid5p", "bid5q",
-        "ask1p", "ask1q", "ask2p", "ask2q", "ask3p", "ask3q", "ask4p", "ask4q", "ask5p", "ask5q",
-        "lastTradePrice", "lastTradeQuantity"
+void QueryEngine::aggregateSymbol(const std::string &symbol, const AggregateCriteria &criteria, uint32_t columns,
+                                  std::vector<Bar> &bars) {
+    SymbolFiles files;
+    if (!openSymbolFiles(symbol, files))
+        return;
+    // Start at the index entry holding the last snapshot before the range; the
+    // rows before startEpoch only seed the book in force at the start.
+    const SnapshotIndex &index = files.index();
+    const size_t first = index.lowerBound(criteria.startEpoch);
+    const int64_t from = first > 0 ? index.epoch(first - 1) : criteria.startEpoch;
+    std::unique_ptr<SnapshotStream> stream = openSymbolStream(symbol, files, from, criteria.endEpoch, columns);
+    BarAggregator aggregator(criteria.bucketNanos, criteria.startEpoch, criteria.endEpoch);
+    const Snapshot *begin = nullptr;
+    const Snapshot *end = nullptr;
+    while (stream && stream->nextChunk(begin, end)) {
+        if (begin->epoch < criteria.startEpoch) {
+            const Snapshot *inRange = std::partition_point(
+                begin, end, [&criteria](const Snapshot &snap) { return snap.epoch < criteria.startEpoch; });
+            aggregator.seed(*(inRange - 1));
+            begin = inRange;
+        }
+        aggregator.add(begin, end, bars);
+    }
+    aggregator.finish(bars);
+}
+
+size_t QueryEngine::aggregate(const AggregateCriteria &criteria, const BarSink &sink) {
+    if (criteria.startEpoch > criteria.endEpoch) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: startEpoch is greater than endEpoch." << std::endl;
+        return 0;
+    }
+    if (criteria.bucketNanos <= 0) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: The bucket width must be positive." << std::endl;
+        return 0;
+    }
+    const std::vector<std::string> &symbolsToQuery = criteria.symbols.empty() ? symbolList_ : criteria.symbols;
+    std::vector<Aggregate> aggregates = criteria.aggregates;
+    if (aggregates.empty())
+        parseAggregates({}, aggregates, std::cerr);
+    const uint32_t columns = columnsForAggregates(aggregates);
+
+    std::vector<std::vector<Bar>> bars(symbolsToQuery.size());
+    auto run = [&](size_t k) {
+        // A failing symbol is reported and yields no bars; the others are unaffected.
+        try {
+            aggregateSymbol(symbolsToQuery[k], criteria, columns, bars[k]);
+        } catch (const std::exception &ex) {
+            bars[k].clear();
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error processing symbol " << symbolsToQuery[k] << ": " << ex.what() << std::endl;
+        }
     };
+    const bool parallel = queryThreads_ > 1 && symbolsToQuery.size() > 1;
+    if (parallel) {
+        // Bars are few, so every symbol is aggregated up front; symbols are
+        // handed out one at a time and the calling thread works too.
+        pool_->run(symbolsToQuery.size(), run);
+    }
+    size_t delivered = 0;
+    for (size_t k = 0; k < symbolsToQuery.size(); ++k) {
+        if (!parallel)
+            run(k);
+        for (const Bar &bar : bars[k]) {
+            ++delivered;
+            if (!sink(bar))
+                return delivered;
+        }
+        std::vector<Bar>().swap(bars[k]);
+    }
+    return delivered;
+}
+
+std::vector<Bar> QueryEngine::aggregate(const AggregateCriteria &criteria) {
+    std::vector<Bar> bars;
+    aggregate(criteria, [&bars](const Bar &bar) {
+        bars.push_back(bar);
+        return true;
+    });
+    return bars;
+}
+
+void QueryEngine::printSnapshots(const std::vector<Snapshot> &snapshots, const QueryCriteria &criteria) const {
+    printSnapshots(snapshots, criteria, std::cout, std::cerr);
+}
+
+void QueryEngine::printSnapshots(const std::vector<Snapshot> &snapshots, const QueryCriteria &criteria,
+                                 std::ostream &out, std::ostream &err) const {
+    SnapshotPrinter printer(criteria, out, err);
+    if (!printer.printHeader())
+        return;
+    for (const auto &snap : snapshots)
+        printer.print(snap);
+    printer.flush();
+}
+
+// Longest text of one cell: a quantity, '@' and a fixed-point double of up to 309 integer digits.
+static constexpr size_t kMaxCellBytes = 512;
+
+// Helper: Cell that prints the price at byte offset price (or N.A if negative).
+static SnapshotPrinter::Cell priceCell(size_t price) {
+    return {SnapshotPrinter::CellKind::Price, static_cast<uint16_t>(price), 0};
+}
+
+// Helper: Cell that prints the quantity at byte offset quantity (or N.A if zero).
+static SnapshotPrinter::Cell quantityCell(size_t quantity) {
+    return {SnapshotPrinter::CellKind::Quantity, 0, static_cast<uint16_t>(quantity)};
+}
+
+// Helper: Cell that prints a price level as "quantity@price" (or N.A if the price is negative).
+static SnapshotPrinter::Cell levelCell(size_t price, size_t quantity) {
+    return {SnapshotPrinter::CellKind::Level, static_cast<uint16_t>(price), static_cast<uint16_t>(quantity)};
+}
+
+static size_t bidPrice(const SnapshotLayout &layout, int level) { return layout.bidPrices + level * sizeof(double); }
+static size_t bidQuantity(const SnapshotLayout &layout, int level) { return layout.bidQuantities + level * sizeof(int32_t); }
+static size_t askPrice(const SnapshotLayout &layout, int level) { return layout.askPrices + level * sizeof(double); }
+static size_t askQuantity(const SnapshotLayout &layout, int level) { return layout.askQuantities + level * sizeof(int32_t); }
+
+static char *putText(char *p, const char *text, size_t n) {
+    std::memcpy(p, text, n);
+    return p + n;
+}
+
+static char *putPrice(char *p, double price, int decimals) {
+    if (price < 0)
+        return putText(p, "N.A", 3);
+    return std::to_chars(p, p + kMaxCellBytes, price, std::chars_format::fixed, decimals).ptr;
+}
+
+SnapshotPrinter::SnapshotPrinter(const QueryCriteria &criteria, std::ostream &out, std::ostream &err,
+                                 OutputFormat format, int depth)
+    : selectedFields_(criteria.selectedFields), format_(format), layout_(), rowBytes_(0), priceDecimals_(2),
+      buffer_(kBufferBytes),
+      used_(0), out_(out), err_(err) {
+    if (!snapshotLayout(depth, layout_))
+        layout_.depth = 0;
+}
+
+SnapshotPrinter::~SnapshotPrinter() {
+    flush();
+}
+
+void SnapshotPrinter::flush() {
+    if (used_ > 0)
+        out_.write(buffer_.data(), static_cast<std::streamsize>(used_));
+    used_ = 0;
+}
+
+void SnapshotPrinter::append(const std::string &text) {
+    if (buffer_.size() - used_ < text.size())
+        flush();
+    if (text.size() > buffer_.size()) {
+        out_ << text;
+        return;
+    }
+    std::memcpy(buffer_.data() + used_, text.data(), text.size());
+    used_ += text.size();
+}
 
-    // Default grouped view if no selective fields provided.
-    if (criteria.selectedFields.empty()) {
-        std::vector<std::string> outputHeaders = {
-            "symbol", "epoch",
-            "bid5q@bid5p", "bid4q@bid4p", "bid3q@bid3p", "bid2q@bid2p", "bid1q@bid1p",
-            "X",
-            "ask1q@ask1p", "ask2q@ask2p", "ask3q@ask3p", "ask4q@ask4p", "ask5q@ask5p",
-            "lastTradePrice", "lastTradeQuantity"
-        };
-
-        // Print header.
-        for (size_t i = 0; i < outputHeaders.size(); ++i)
-            std::cout << outputHeaders[i] << (i < outputHeaders.size()-1 ? ", " : "\n");
-
-        // Print each snapshot.
-        for (const auto &snap : snapshots) {
-            std::cout << snap.symbol << ", " << snap.epoch << ", ";
-            // Print bid levels in reverse order (bid5 first)
-            for (int i = 4; i >= 0; --i) {
-                std::cout << formatPriceLevel(snap.bidQuantities[i], snap.bidPrices[i]);
-                std::cout << (i > 0 ? ", " : ", ");
-            }
-            std::cout << "X, ";
-            // Print ask levels in natural order.
-            for (int i = 0; i < 5; ++i) {
-                std::cout << formatPriceLevel(snap.askQuantities[i], snap.askPrices[i]);
-                std::cout << (i < 4 ? ", " : ", ");
-            }
-            // Print last trade info.
-            std::cout << (snap.lastTradePrice < 0 ? "N.A" : formatPrice(snap.lastTradePrice)) << ", ";
-            std::cout << (snap.lastTradeQuantity == 0 ? "N.A" : std::to_string(snap.lastTradeQuantity)) << "\n";
+bool SnapshotPrinter::printHeader(bool asOfColumn) {
+    if (layout_.depth == 0) {
+        err_ << "Error: Unsupported snapshot depth." << std::endl;
+        return false;
+    }
+    // Allowed field names for selective output, with the cell each one prints:
+    // symbol, epoch, bid1p, bid1q, ..., ask1p, ask1q, ..., lastTradePrice, lastTradeQuantity.
+    const int depth = layout_.depth;
+    std::vector<std::pair<std::string, Cell>> allowedFields = {
+        {"symbol", {CellKind::Symbol, 0, 0}}, {"epoch", {CellKind::Epoch, 0, 0}}};
+    for (int i = 0; i < depth; ++i) {
+        const std::string level = std::to_string(i + 1);
+        allowedFields.push_back({"bid" + level + "p", priceCell(bidPrice(layout_, i))});
+        allowedFields.push_back({"bid" + level + "q", quantityCell(bidQuantity(layout_, i))});
+    }
+    for (int i = 0; i < depth; ++i) {
+        const std::string level = std::to_string(i + 1);
+        allowedFields.push_back({"ask" + level + "p", priceCell(askPrice(layout_, i))});
+        allowedFields.push_back({"ask" + level + "q", quantityCell(askQuantity(layout_, i))});
+    }
+    allowedFields.push_back({"lastTradePrice", priceCell(layout_.lastTradePrice)});
+    allowedFields.push_back({"lastTradeQuantity", quantityCell(layout_.lastTradeQuantity)});
+    std::string header;
+    plan_.clear();
+
+    // Default grouped view if no selective fields provided: bid levels in
+    // reverse order (bid5 first), then ask levels in natural order.
+    if (selectedFields_.empty() && format_ == OutputFormat::Text) {
+        header = "symbol, epoch, ";
+        plan_.push_back({CellKind::Symbol, 0, 0});
+        plan_.push_back({CellKind::Epoch, 0, 0});
+        for (int i = depth - 1; i >= 0; --i) {
+            const std::string level = std::to_string(i + 1);
+            header += "bid" + level + "q@bid" + level + "p, ";
+            plan_.push_back(levelCell(bidPrice(layout_, i), bidQuantity(layout_, i)));
         }
-    } else {
-        // Validate selected fields.
-        std::unordered_set<std::string> validFields(allowedFields.begin(), allowedFields.end());
-        bool errorFound = false;
-        for (const auto &field : criteria.selectedFields) {
-            if (validFields.find(field) == validFields.end()) {
-                std::cerr << "Error: Unknown field \"" << field << "\" in query criteria." << std::endl;
-                std::cerr << "Allowed fields -> symbol, epoch, bid1p, bid1q, bid2p, bid2q, bid3p, bid3q, bid4p, bid4q, bid5p, bid5q, ask1p, ask1q, ask2p, ask2q, ask3p, ask3q, ask4p, ask4q, ask5p, ask5q, lastTradePrice, lastTradeQuantity" << std::endl;
-                errorFound = true;
-            }
-        }
-        if (errorFound) {
-            std::cerr << "Please check your selected fields and try again." << std::endl;
-            return;
+        header += "X, ";
+        plan_.push_back({CellKind::Marker, 0, 0});
+        for (int i = 0; i < depth; ++i) {
+            const std::string level = std::to_string(i + 1);
+            header += "ask" + level + "q@ask" + level + "p, ";
+            plan_.push_back(levelCell(askPrice(layout_, i), askQuantity(layout_, i)));
+        }
+        header += "lastTradePrice, lastTradeQuantity\n";
+        plan_.push_back(priceCell(layout_.lastTradePrice));
+        plan_.push_back(quantityCell(layout_.lastTradeQuantity));
+        if (asOfColumn) {
+            plan_.insert(plan_.begin(), Cell{CellKind::AsOf, 0, 0});
+            header = "asOf, " + header;
         }
+        append(header);
+        return true;
+    }
 
-        // Build header from allowedFields that appear in selectedFields.
-        std::vector<std::string> headerToPrint;
-        for (const auto &field : allowedFields) {
-            if (criteria.selectedFields.find(field) != criteria.selectedFields.end())
-                headerToPrint.push_back(field);
+    // Validate selected fields.
+    bool errorFound = false;
+    for (const auto &field : selectedFields_) {
+        auto known = std::find_if(allowedFields.begin(), allowedFields.end(),
+                                  [&field](const std::pair<std::string, Cell> &allowed) { return allowed.first == field; });
+        if (known == allowedFields.end()) {
+            err_ << "Error: Unknown field \"" << field << "\" in query criteria." << std::endl;
+            err_ << "Allowed fields -> ";
+            for (size_t i = 0; i < allowedFields.size(); ++i)
+                err_ << (i == 0 ? "" : ", ") << allowedFields[i].first;
+            err_ << std::endl;
+            errorFound = true;
         }
-        if (headerToPrint.empty()) {
-            std::cerr << "Error: No valid fields selected." << std::endl;
-            return;
+    }
+    if (errorFound) {
+        err_ << "Please check your selected fields and try again." << std::endl;
+        return false;
+    }
+
+    // Build the header and the plan from allowedFields that appear in selectedFields
+    // (all of them for binary output without a selection).
+    std::vector<std::string> names;
+    for (const auto &allowed : allowedFields) {
+        if (selectedFields_.empty() || selectedFields_.find(allowed.first) != selectedFields_.end()) {
+            header += (plan_.empty() ? "" : ", ") + allowed.first;
+            names.push_back(allowed.first);
+            plan_.push_back(allowed.second);
         }
-        for (size_t i = 0; i < headerToPrint.size(); ++i) {
-            std::cout << headerToPrint[i] << (i < headerToPrint.size() - 1 ? ", " : "\n");
+    }
+    if (plan_.empty()) {
+        err_ << "Error: No valid fields selected." << std::endl;
+        return false;
+    }
+    if (asOfColumn) {
+        plan_.insert(plan_.begin(), Cell{CellKind::AsOf, 0, 0});
+        names.insert(names.begin(), "asOf");
+        header = "asOf, " + header;
+    }
+    if (format_ == OutputFormat::Binary) {
+        appendBinaryHeader(names);
+        return true;
+    }
+    append(header + "\n");
+    return true;
+}
+
+// Helper: numpy byte order character of the host; binary rows are copied in host byte order.
+static char hostByteOrder() {
+    const uint16_t probe = 1;
+    return (*reinterpret_cast<const char*>(&probe) == 1) ? '<' : '>';
+}
+
+// Helper: Magic, header length and JSON header of the binary result format,
+// for fields given as (name, numpy type) pairs.
+static std::string binaryResultHeader(const std::vector<std::pair<std::string, std::string>> &fields, size_t rowBytes) {
+    std::string json = "{\"fields\": [";
+    for (size_t i = 0; i < fields.size(); ++i)
+        json += (i == 0 ? "[\"" : ", [\"") + fields[i].first + "\", \"" + fields[i].second + "\"]";
+    json += "], \"row_bytes\": " + std::to_string(rowBytes) + "}\n";
+    // Pad so that the rows start 8-byte aligned (for mmap and numpy views).
+    const size_t prefixBytes = sizeof(kBinaryResultMagic) + sizeof(uint32_t);
+    while ((prefixBytes + json.size()) % 8 != 0)
+        json += ' ';
+    std::string header(kBinaryResultMagic, sizeof(kBinaryResultMagic));
+    const uint32_t headerBytes = static_cast<uint32_t>(json.size());
+    for (int i = 0; i < 4; ++i)
+        header += static_cast<char>((headerBytes >> (8 * i)) & 0xFF);
+    return header + json;
+}
+
+void SnapshotPrinter::appendBinaryHeader(const std::vector<std::string> &names) {
+    const char order = hostByteOrder();
+    std::vector<std::pair<std::string, std::string>> fields;
+    rowBytes_ = 0;
+    for (size_t i = 0; i < plan_.size(); ++i) {
+        std::string type;
+        switch (plan_[i].kind) {
+        case CellKind::Symbol:
+            type = "S" + std::to_string(sizeof(Snapshot::symbol));
+            rowBytes_ += sizeof(Snapshot::symbol);
+            break;
+        case CellKind::Epoch:
+        case CellKind::AsOf:
+            type = std::string(1, order) + "i8";
+            rowBytes_ += sizeof(int64_t);
+            break;
+        case CellKind::Price:
+            type = std::string(1, order) + "f8";
+            rowBytes_ += sizeof(double);
+            break;
+        default:
+            type = std::string(1, order) + "i4";
+            rowBytes_ += sizeof(int32_t);
+            break;
         }
+        fields.emplace_back(names[i], type);
+    }
+    append(binaryResultHeader(fields, rowBytes_));
+}
 
-        // Print each snapshot with only the selected fields.
-        for (const auto &snap : snapshots) {
-            std::unordered_map<std::string, std::string> fieldMap;
-            fieldMap["symbol"] = snap.symbol;
-            fieldMap["epoch"] = std::to_string(snap.epoch);
-            // Map bid fields.
-            for (int i = 0; i < 5; ++i) {
-                std::string bidPriceKey = "bid" + std::to_string(i+1) + "p";
-                std::string bidQtyKey = "bid" + std::to_string(i+1) + "q";
-                fieldMap[bidPriceKey] = (snap.bidPrices[i] < 0 ? "N.A" : formatPrice(snap.bidPrices[i]));
-                fieldMap[bidQtyKey] = (snap.bidQuantities[i] == 0 ? "N.A" : std::to_string(snap.bidQuantities[i]));
+void SnapshotPrinter::printRecord(const char *base, int64_t asOf) {
+    // The symbol and epoch lead the record at every depth.
+    const char *symbol = base + offsetof(Snapshot, symbol);
+    const size_t symbolBytes = sizeof(Snapshot::symbol);
+    if (format_ == OutputFormat::Binary) {
+        if (buffer_.size() - used_ < rowBytes_)
+            flush();
+        char *p = buffer_.data() + used_;
+        for (const Cell &cell : plan_) {
+            switch (cell.kind) {
+            case CellKind::Symbol: {
+                // Zero-filled past the name, whatever the file held there.
+                size_t n = strnlen(symbol, symbolBytes);
+                std::memcpy(p, symbol, n);
+                std::memset(p + n, 0, symbolBytes - n);
+                p += symbolBytes;
+                break;
             }
-            // Map ask fields.
-            for (int i = 0; i < 5; ++i) {
-                std::string askPriceKey = "ask" + std::to_string(i+1) + "p";
-                std::string askQtyKey = "ask" + std::to_string(i+1) + "q";
-                fieldMap[askPriceKey] = (snap.askPrices[i] < 0 ? "N.A" : formatPrice(snap.askPrices[i]));
-                fieldMap[askQtyKey] = (snap.askQuantities[i] == 0 ? "N.A" : std::to_string(snap.askQuantities[i]));
+            case CellKind::Epoch:
+                p = putText(p, base + offsetof(Snapshot, epoch), sizeof(int64_t));
+                break;
+            case CellKind::AsOf:
+                p = putText(p, reinterpret_cast<const char*>(&asOf), sizeof(asOf));
+                break;
+            case CellKind::Price:
+                p = putText(p, base + cell.price, sizeof(double));
+                break;
+            default:
+                p = putText(p, base + cell.quantity, sizeof(int32_t));
+                break;
+            }
+        }
+        used_ = static_cast<size_t>(p - buffer_.data());
+        return;
+    }
+
+    if (buffer_.size() - used_ < plan_.size() * (kMaxCellBytes + 2) + 1)
+        flush();
+    char *p = buffer_.data() + used_;
+    for (size_t i = 0; i < plan_.size(); ++i) {
+        const Cell &cell = plan_[i];
+        if (i > 0)
+            p = putText(p, ", ", 2);
+        double price;
+        int32_t quantity;
+        switch (cell.kind) {
+        case CellKind::Symbol:
+            p = putText(p, symbol, strnlen(symbol, symbolBytes));
+            break;
+        case CellKind::Epoch: {
+            int64_t epoch;
+            std::memcpy(&epoch, base + offsetof(Snapshot, epoch), sizeof(epoch));
+            p = std::to_chars(p, p + kMaxCellBytes, epoch).ptr;
+            break;
+        }
+        case CellKind::Price:
+            std::memcpy(&price, base + cell.price, sizeof(price));
+            p = putPrice(p, price, priceDecimals_);
+            break;
+        case CellKind::Quantity:
+            std::memcpy(&quantity, base + cell.quantity, sizeof(quantity));
+            p = quantity == 0 ? putText(p, "N.A", 3) : std::to_chars(p, p + kMaxCellBytes, quantity).ptr;
+            break;
+        case CellKind::Level:
+            std::memcpy(&price, base + cell.price, sizeof(price));
+            std::memcpy(&quantity, base + cell.quantity, sizeof(quantity));
+            if (price < 0) {
+                p = putText(p, "N.A", 3);
+            } else {
+                p = std::to_chars(p, p + kMaxCellBytes, quantity).ptr;
+                *p++ = '@';
+                p = putPrice(p, price, priceDecimals_);
             }
-            fieldMap["lastTradePrice"] = (snap.lastTradePrice < 0 ? "N.A" : formatPrice(snap.lastTradePrice));
-            fieldMap["lastTradeQuantity"] = (snap.lastTradeQuantity == 0 ? "N.A" : std::to_string(snap.lastTradeQuantity));
-            
-            for (size_t i = 0; i < headerToPrint.size(); ++i) {
-                std::cout << fieldMap[headerToPrint[i]];
-                if (i < headerToPrint.size() - 1)
-                    std::cout << ", ";
+            break;
+        case CellKind::Marker:
+            *p++ = 'X';
+            break;
+        case CellKind::AsOf:
+            p = std::to_chars(p, p + kMaxCellBytes, asOf).ptr;
+            break;
+        }
+    }
+    *p++ = '\n';
+    used_ = static_cast<size_t>(p - buffer_.data());
+}
+
+int queryPriceDecimals(const std::vector<std::string> &symbols) {
+    int decimals = 2;
+    for (const auto &symbol : symbols) {
+        const int64_t ticksPerUnit = detectTicksPerUnit(symbol + ".snap");
+        if (ticksPerUnit > 0)
+            decimals = std::max(decimals, priceDecimals(ticksPerUnit));
+    }
+    return decimals;
+}
+
+BarPrinter::BarPrinter(const std::vector<Aggregate> &aggregates, std::ostream &out, OutputFormat format)
+    : aggregates_(aggregates), format_(format), out_(out) {}
+
+BarPrinter::~BarPrinter() {
+    flush();
+}
+
+void BarPrinter::flush() {
+    out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
+
+// Helper: Whether an aggregate is an integer (int64 in binary output).
+static bool integerAggregate(Aggregate aggregate) {
+    return aggregate == Aggregate::Count || aggregate == Aggregate::Volume;
+}
+
+void BarPrinter::printHeader() {
+    if (format_ == OutputFormat::Binary) {
+        const std::string order(1, hostByteOrder());
+        std::vector<std::pair<std::string, std::string>> fields = {
+            {"symbol", "S" + std::to_string(sizeof(Bar::symbol))}, {"start", order + "i8"}};
+        for (Aggregate aggregate : aggregates_)
+            fields.emplace_back(aggregateName(aggregate), order + (integerAggregate(aggregate) ? "i8" : "f8"));
+        buffer_ += binaryResultHeader(fields, sizeof(Bar::symbol) + 8 * (aggregates_.size() + 1));
+        return;
+    }
+    buffer_ += "symbol, start";
+    for (Aggregate aggregate : aggregates_)
+        buffer_ += std::string(", ") + aggregateName(aggregate);
+    buffer_ += '\n';
+}
+
+void BarPrinter::print(const Bar &bar) {
+    if (format_ == OutputFormat::Binary) {
+        buffer_.append(bar.symbol, sizeof(bar.symbol));
+        buffer_.append(reinterpret_cast<const char*>(&bar.start), sizeof(bar.start));
+        for (Aggregate aggregate : aggregates_) {
+            if (integerAggregate(aggregate)) {
+                const int64_t value = (aggregate == Aggregate::Count) ? bar.count : bar.volume;
+                buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            } else {
+                const double value = bar.value(aggregate);
+                buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+        }
+    } else {
+        char cell[64];
+        buffer_.append(bar.symbol, strnlen(bar.symbol, sizeof(bar.symbol)));
+        buffer_ += ", ";
+        buffer_.append(cell, std::to_chars(cell, cell + sizeof(cell), bar.start).ptr);
+        for (Aggregate aggregate : aggregates_) {
+            buffer_ += ", ";
+            if (integerAggregate(aggregate)) {
+                const int64_t value = (aggregate == Aggregate::Count) ? bar.count : bar.volume;
+                buffer_.append(cell, std::to_chars(cell, cell + sizeof(cell), value).ptr);
+                continue;
             }
-            std::cout << "\n";
+            const double value = bar.value(aggregate);
+            if (std::isnan(value))
+                buffer_ += "N.A";
+            else
+                buffer_.append(cell, std::to_chars(cell, cell + sizeof(cell), value, std::chars_format::fixed, 4).ptr);
         }
+        buffer_ += '\n';
     }
+    if (buffer_.size() >= SnapshotPrinter::kBufferBytes)
+        flush();
 }
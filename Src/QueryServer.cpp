@@ -0,0 +1,404 @@
+#include "QueryServer.h"
+#include <iostream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Global mutex to synchronize console output (defined in BookProcessor.cpp).
+extern std::mutex coutMutex;
+
+// Helper: Splits a request argument on a delimiter, dropping empty tokens.
+static std::vector<std::string> splitList(const std::string &s, char delimiter) {
+    std::vector<std::string> tokens;
+    std::stringstream ss(s);
+    std::string token;
+    while (std::getline(ss, token, delimiter)) {
+        if (!token.empty())
+            tokens.push_back(token);
+    }
+    return tokens;
+}
+
+uint32_t QueryServer::handleRequest(const std::string &request, std::string &response) {
+    response.clear();
+    return handleRequest(request, [&response](uint32_t, const std::string &text) {
+        response += text;
+        return true;
+    });
+}
+
+uint32_t QueryServer::handleRequest(const std::string &request, const ResponseWriter &write) {
+    std::istringstream iss(request);
+    std::vector<std::string> args;
+    std::string arg;
+    size_t limit = 0;
+    std::string where;
+    while (iss >> arg) {
+        if (arg.rfind("--limit=", 0) == 0) {
+            try {
+                limit = std::stoul(arg.substr(8));
+            } catch (const std::exception &e) {
+                write(kResponseError, std::string("Error: Invalid limit. ") + e.what() + "\n");
+                return kResponseError;
+            }
+        } else if (arg.rfind("--where=", 0) == 0) {
+            where = arg.substr(8);
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() == 1 && args[0] == "refresh") {
+        std::unique_lock<std::shared_mutex> lock(engineMutex_);
+        engine_.refresh();
+        size_t loaded = engine_.preload();
+        write(kResponseOk, "Refreshed " + std::to_string(loaded) + " symbol(s).\n");
+        return kResponseOk;
+    }
+    if (args.size() < 3 || args.size() > 4) {
+        write(kResponseError,
+              "Error: Expected \"<symbols> <startEpoch> <endEpoch> [<fields>] [--limit=<n>] [--where=<filter>]\""
+              " or \"refresh\".\n");
+        return kResponseError;
+    }
+
+    QueryCriteria criteria;
+    criteria.symbols = (args[0] == "ALL") ? symbols_ : splitList(args[0], ',');
+    try {
+        criteria.startEpoch = std::stoll(args[1]);
+        criteria.endEpoch = std::stoll(args[2]);
+    } catch (const std::exception &e) {
+        write(kResponseError, std::string("Error: Invalid epoch value. ") + e.what() + "\n");
+        return kResponseError;
+    }
+    if (criteria.startEpoch > criteria.endEpoch) {
+        write(kResponseError, "Error: startEpoch is greater than endEpoch.\n");
+        return kResponseError;
+    }
+    if (args.size() == 4) {
+        for (const auto &field : splitList(args[3], ','))
+            criteria.selectedFields.insert(field);
+    }
+    criteria.limit = limit;
+
+    std::ostringstream out;
+    std::ostringstream err;
+    if (!criteria.filter.parse(where, err)) {
+        write(kResponseError, err.str());
+        return kResponseError;
+    }
+    SnapshotPrinter printer(criteria, out, err);
+    printer.setPriceDecimals(queryPriceDecimals(criteria.symbols));
+    if (!printer.printHeader()) {
+        write(kResponseError, err.str());
+        return kResponseError;
+    }
+    // Rows go out in pieces of about kResponseChunkBytes as they are printed;
+    // a failed write (the client went away) stops the query.
+    bool writing = true;
+    {
+        std::shared_lock<std::shared_mutex> lock(engineMutex_);
+        engine_.query(criteria, [&](const Snapshot &snap) {
+            printer.print(snap);
+            // The printer holds up to kBufferBytes itself, so count what it has not written yet.
+            if (static_cast<size_t>(out.tellp()) + printer.buffered() >= kResponseChunkBytes) {
+                printer.flush();
+                writing = write(kResponseOk, out.str());
+                out.str("");
+            }
+            return writing;
+        });
+    }
+    printer.flush();
+    if (writing && out.tellp() > 0)
+        write(kResponseOk, out.str());
+    return kResponseOk;
+}
+
+#ifdef _WIN32
+
+QueryServer::QueryServer(const std::vector<std::string> &symbols, size_t queryThreads)
+    : symbols_(symbols), engine_(symbols, ReaderMode::Mapped, queryThreads), stopping_(false), listenFd_(-1),
+      activeConnections_(0) {}
+
+QueryServer::~QueryServer() {}
+
+bool QueryServer::start(const std::string &socketPath) {
+    std::cerr << "Error: serve mode needs Unix domain sockets, which this build does not support: "
+              << socketPath << std::endl;
+    return false;
+}
+
+void QueryServer::run() {}
+
+void QueryServer::stop() {
+    stopping_ = true;
+}
+
+void QueryServer::serveConnection(int) {}
+
+QueryClient::QueryClient() : fd_(-1) {}
+
+QueryClient::~QueryClient() {}
+
+bool QueryClient::connect(const std::string &) {
+    return false;
+}
+
+bool QueryClient::request(const std::string &, std::string &, uint32_t &) {
+    return false;
+}
+
+void QueryClient::close() {}
+
+#else
+
+static void encodeUint32(uint32_t value, char *out) {
+    for (int i = 0; i < 4; ++i)
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+static void appendUint32(uint32_t value, std::string &out) {
+    char bytes[4];
+    encodeUint32(value, bytes);
+    out.append(bytes, sizeof(bytes));
+}
+
+static uint32_t decodeUint32(const char *in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    return value;
+}
+
+// Helper: Reads exactly n bytes. With a stop flag, waits in short polls so the
+// server can shut down while a client is idle.
+static bool readFull(int fd, char *data, size_t n, const std::atomic<bool> *stopping) {
+    while (n > 0) {
+        if (stopping) {
+            pollfd p = {fd, POLLIN, 0};
+            int ready = poll(&p, 1, QueryServer::kPollMillis);
+            if (stopping->load())
+                return false;
+            if (ready == 0 || (ready < 0 && errno == EINTR))
+                continue;
+            if (ready < 0)
+                return false;
+        }
+        ssize_t got = ::recv(fd, data, n, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        data += got;
+        n -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+static bool writeFull(int fd, const char *data, size_t n) {
+    while (n > 0) {
+        ssize_t sent = ::send(fd, data, n, 0);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        n -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+// Helper: Fills a Unix socket address; false if the path does not fit.
+static bool makeAddress(const std::string &path, sockaddr_un &addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+QueryServer::QueryServer(const std::vector<std::string> &symbols, size_t queryThreads)
+    : symbols_(symbols), engine_(symbols, ReaderMode::Mapped, queryThreads), stopping_(false), listenFd_(-1),
+      activeConnections_(0) {}
+
+QueryServer::~QueryServer() {
+    stop();
+    {
+        std::unique_lock<std::mutex> lock(connectionsMutex_);
+        connectionsDone_.wait(lock, [this]() { return activeConnections_ == 0; });
+    }
+    if (listenFd_ >= 0) {
+        ::close(listenFd_);
+        ::unlink(socketPath_.c_str());
+    }
+}
+
+bool QueryServer::start(const std::string &socketPath) {
+    sockaddr_un addr;
+    if (!makeAddress(socketPath, addr)) {
+        std::cerr << "Error: Invalid socket path: " << socketPath << std::endl;
+        return false;
+    }
+    // A client that disconnects mid-response must not kill the server.
+    std::signal(SIGPIPE, SIG_IGN);
+    {
+        std::unique_lock<std::shared_mutex> lock(engineMutex_);
+        engine_.preload();
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Error: Failed to create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // Replace a stale socket file, but not the socket of a server still running.
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && ::connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+        std::cerr << "Error: Another server is listening on " << socketPath << std::endl;
+        ::close(probe);
+        ::close(fd);
+        return false;
+    }
+    if (probe >= 0 && errno == ECONNREFUSED)
+        ::unlink(socketPath.c_str());
+    if (probe >= 0)
+        ::close(probe);
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        std::cerr << "Error: Failed to listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    listenFd_ = fd;
+    socketPath_ = socketPath;
+    return true;
+}
+
+void QueryServer::run() {
+    while (!stopping_.load()) {
+        pollfd p = {listenFd_, POLLIN, 0};
+        if (poll(&p, 1, kPollMillis) <= 0)
+            continue;
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex_);
+            ++activeConnections_;
+        }
+        // Detached so that short-lived clients do not pile up threads; the
+        // destructor waits for activeConnections_ to drop to zero.
+        std::thread(&QueryServer::serveConnection, this, fd).detach();
+    }
+}
+
+void QueryServer::stop() {
+    stopping_.store(true);
+}
+
+void QueryServer::serveConnection(int fd) {
+    std::string request;
+    std::string frame;
+    char header[4];
+    while (readFull(fd, header, sizeof(header), &stopping_)) {
+        uint32_t length = decodeUint32(header);
+        if (length > kMaxRequestBytes) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Query request of " << length << " bytes rejected." << std::endl;
+            break;
+        }
+        request.resize(length);
+        if (length > 0 && !readFull(fd, &request[0], length, &stopping_))
+            break;
+        // The status goes out with the first piece; each piece is a length-prefixed chunk.
+        bool begun = false;
+        bool sent = true;
+        uint32_t status = handleRequest(request, [&](uint32_t pieceStatus, const std::string &text) {
+            frame.clear();
+            if (!begun)
+                appendUint32(pieceStatus, frame);
+            begun = true;
+            if (text.empty() && frame.empty())
+                return true;
+            if (!text.empty()) {
+                appendUint32(static_cast<uint32_t>(text.size()), frame);
+                frame += text;
+            }
+            sent = writeFull(fd, frame.data(), frame.size());
+            return sent;
+        });
+        if (!sent)
+            break;
+        frame.clear();
+        if (!begun)
+            appendUint32(status, frame);
+        appendUint32(0, frame);
+        if (!writeFull(fd, frame.data(), frame.size()))
+            break;
+    }
+    ::close(fd);
+    std::unique_lock<std::mutex> lock(connectionsMutex_);
+    --activeConnections_;
+    // Notify only once this thread is gone, as the server may be destroyed right after.
+    std::notify_all_at_thread_exit(connectionsDone_, std::move(lock));
+}
+
+QueryClient::QueryClient() : fd_(-1) {}
+
+QueryClient::~QueryClient() {
+    close();
+}
+
+bool QueryClient::connect(const std::string &socketPath) {
+    close();
+    sockaddr_un addr;
+    if (!makeAddress(socketPath, addr))
+        return false;
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0)
+        return false;
+    if (::connect(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool QueryClient::request(const std::string &request, std::string &response, uint32_t &status) {
+    if (fd_ < 0)
+        return false;
+    std::string frame;
+    appendUint32(static_cast<uint32_t>(request.size()), frame);
+    frame += request;
+    char header[4];
+    if (!writeFull(fd_, frame.data(), frame.size()) || !readFull(fd_, header, sizeof(header), nullptr))
+        return false;
+    status = decodeUint32(header);
+    response.clear();
+    while (readFull(fd_, header, sizeof(header), nullptr)) {
+        size_t length = decodeUint32(header);
+        if (length == 0)
+            return true;
+        size_t offset = response.size();
+        response.resize(offset + length);
+        if (!readFull(fd_, &response[offset], length, nullptr))
+            return false;
+    }
+    return false;
+}
+
+void QueryClient::close() {
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "ResumePoint.h"
+#include "BookJournal.h"
+#include "SnapshotCodec.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+std::string resumePointPath(const std::string &inputPath) {
+    const size_t slash = inputPath.find_last_of("/\\");
+    return (slash == std::string::npos ? inputPath : inputPath.substr(slash + 1)) + ".resume";
+}
+
+bool inputFingerprint(const std::string &inputPath, uint64_t bytes, uint64_t &hash) {
+    std::ifstream ifs(inputPath, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open() || static_cast<uint64_t>(ifs.tellg()) < bytes)
+        return false;
+    // The start of the file, then the bytes just before the offset (an appended
+    // log is usually rewritten from the start or cut and regrown at its end).
+    const uint64_t window = std::min<uint64_t>(bytes, kFingerprintBytes);
+    std::vector<char> data(static_cast<size_t>(window));
+    hash = 14695981039346656037ull;
+    for (uint64_t start : {uint64_t(0), bytes - window}) {
+        ifs.seekg(static_cast<std::streamoff>(start), std::ios::beg);
+        if (!ifs.read(data.data(), static_cast<std::streamsize>(data.size())))
+            return false;
+        for (char c : data) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+    }
+    return true;
+}
+
+bool saveResumePoint(const std::string &path, const ResumePoint &point) {
+    std::vector<char> out;
+    out.insert(out.end(), kResumeMagic, kResumeMagic + sizeof(kResumeMagic));
+    appendRaw(out, point.inputOffset);
+    appendRaw(out, point.fingerprint);
+    appendRaw(out, point.lastEpoch);
+    appendRaw(out, static_cast<uint32_t>(point.outputs.size()));
+    appendRaw(out, static_cast<uint32_t>(point.hasBook));
+    for (const auto &output : point.outputs) {
+        appendString(out, output.first);
+        appendRaw(out, output.second);
+    }
+    if (point.hasBook) {
+        appendString(out, point.bookSymbol);
+        appendBookState(point.book, out);
+    }
+    // Write a copy and move it over the old checkpoint, which stays intact until then.
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream ofs(temporary, std::ios::binary | std::ios::trunc);
+        if (!(ofs.write(out.data(), static_cast<std::streamsize>(out.size())) && ofs.flush()))
+            return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+bool loadResumePoint(const std::string &path, ResumePoint &point, std::ostream &err) {
+    point = ResumePoint();
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open())
+        return true;
+    std::vector<char> data(static_cast<size_t>(ifs.tellg()));
+    ifs.seekg(0, std::ios::beg);
+    ifs.read(data.data(), static_cast<std::streamsize>(data.size()));
+    const char *p = data.data() + sizeof(kResumeMagic);
+    const char *end = data.data() + data.size();
+    uint32_t outputs = 0, hasBook = 0;
+    bool valid = ifs && data.size() >= kResumeHeaderBytes &&
+                 std::memcmp(data.data(), kResumeMagic, sizeof(kResumeMagic)) == 0 &&
+                 readRaw(p, end, point.inputOffset) && readRaw(p, end, point.fingerprint) &&
+                 readRaw(p, end, point.lastEpoch) && readRaw(p, end, outputs) && readRaw(p, end, hasBook);
+    for (uint32_t i = 0; valid && i < outputs; ++i) {
+        std::pair<std::string, int64_t> output;
+        valid = readString(p, end, output.first) && readRaw(p, end, output.second) && output.second >= 0;
+        point.outputs.push_back(output);
+    }
+    point.hasBook = hasBook != 0;
+    if (valid && point.hasBook)
+        valid = readString(p, end, point.bookSymbol) &&
+                readBookState(p, static_cast<size_t>(end - p), point.book);
+    if (!valid) {
+        err << "Error: Broken resume checkpoint: " << path << std::endl;
+        point = ResumePoint();
+    }
+    return valid;
+}
+
+bool restoreOutputs(const ResumePoint &point, std::ostream &err) {
+    // Check every file before cutting any, so a refused resume changes nothing.
+    for (const auto &output : point.outputs) {
+        if (existingFileSize(output.first) < output.second) {
+            err << "Error: " << output.first << " is shorter than its resume checkpoint records." << std::endl;
+            return false;
+        }
+    }
+    for (const auto &output : point.outputs) {
+        // A missing file was recorded as empty and stays missing.
+        if (existingFileSize(output.first) == output.second)
+            continue;
+        std::error_code error;
+        std::filesystem::resize_file(output.first, static_cast<uintmax_t>(output.second), error);
+        if (error) {
+            err << "Error: Failed to cut " << output.first << " back to its resume checkpoint: " << error.message()
+                << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,467 @@
+#include "SnapshotCodec.h"
+#include "PriceScale.h"
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+// Record tags.
+static constexpr char kKeyframeTag = 'K';
+static constexpr char kDeltaTag = 'D';
+
+// A snapshot has 11 price slots (5 bids, 5 asks, last trade) and 11 matching
+// quantity slots. Bit i of a delta's change mask is price slot i, bit 11 + i is
+// quantity slot i.
+static constexpr int kSlots = 11;
+// Changed prices are stored as the index of an equal price slot of the previous
+// snapshot (levels usually just shift), or as kLiteralPrice followed by 8 bytes.
+static constexpr uint8_t kLiteralPrice = 0xFF;
+
+static double &priceSlot(Snapshot &snap, int i) {
+    return i < 5 ? snap.bidPrices[i] : i < 10 ? snap.askPrices[i - 5] : snap.lastTradePrice;
+}
+
+static double priceSlot(const Snapshot &snap, int i) {
+    return i < 5 ? snap.bidPrices[i] : i < 10 ? snap.askPrices[i - 5] : snap.lastTradePrice;
+}
+
+static int32_t &quantitySlot(Snapshot &snap, int i) {
+    return i < 5 ? snap.bidQuantities[i] : i < 10 ? snap.askQuantities[i - 5] : snap.lastTradeQuantity;
+}
+
+static int32_t quantitySlot(const Snapshot &snap, int i) {
+    return i < 5 ? snap.bidQuantities[i] : i < 10 ? snap.askQuantities[i - 5] : snap.lastTradeQuantity;
+}
+
+// Prices are compared bit for bit so that the decoded doubles are identical.
+static bool samePrice(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+int64_t existingFileSize(const std::string &path) {
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open())
+        return 0;
+    return static_cast<int64_t>(ifs.tellg());
+}
+
+SnapshotFormat detectSnapshotFormat(const std::string &snapPath) {
+    std::ifstream ifs(snapPath, std::ios::binary);
+    char magic[sizeof(kDeltaMagic)];
+    if (!ifs.read(magic, sizeof(magic)))
+        return SnapshotFormat::Fixed;
+    return detectSnapshotFormat(magic, sizeof(magic));
+}
+
+SnapshotFormat detectSnapshotFormat(const char *data, size_t size) {
+    if (size < sizeof(kDeltaMagic))
+        return SnapshotFormat::Fixed;
+    if (std::memcmp(data, kDeltaMagic, sizeof(kDeltaMagic)) == 0)
+        return SnapshotFormat::Delta;
+    if (std::memcmp(data, kColumnarMagic, sizeof(kColumnarMagic)) == 0)
+        return SnapshotFormat::Columnar;
+    if (std::memcmp(data, kTicksMagic, sizeof(kTicksMagic)) == 0)
+        return SnapshotFormat::Ticks;
+    return SnapshotFormat::Fixed;
+}
+
+int64_t countSnapshotRecords(const char *data, size_t size, bool decodeDeltas) {
+    switch (detectSnapshotFormat(data, size)) {
+    case SnapshotFormat::Ticks:
+        return size < kTicksHeaderBytes ? 0 : static_cast<int64_t>((size - kTicksHeaderBytes) / sizeof(TickSnapshot));
+    case SnapshotFormat::Columnar: {
+        int64_t records = 0;
+        size_t offset = kColumnarHeaderBytes;
+        uint32_t rows;
+        while (offset + kRowGroupHeaderBytes <= size) {
+            std::memcpy(&rows, data + offset, sizeof(rows));
+            if (rowGroupBytes(rows) > size - offset)
+                break;
+            records += rows;
+            offset += rowGroupBytes(rows);
+        }
+        return records;
+    }
+    case SnapshotFormat::Delta: {
+        char symbol[8];
+        if (!decodeDeltas)
+            return -1;
+        if (!readDeltaHeader(data, size, symbol))
+            return 0;
+        DeltaDecoder decoder(symbol);
+        Snapshot snap;
+        const char *p = data + kDeltaHeaderBytes;
+        int64_t records = 0;
+        while (p < data + size && decoder.decode(p, data + size, snap))
+            ++records;
+        return records;
+    }
+    default: {
+        SnapshotLayout layout;
+        const int depth = readSnapshotDepth(data, size);
+        const size_t dataOffset = snapshotDataOffset(depth);
+        if (!snapshotLayout(depth, layout) || size < dataOffset)
+            return 0;
+        return static_cast<int64_t>((size - dataOffset) / layout.recordBytes);
+    }
+    }
+}
+
+bool lastSnapshotEpoch(const char *data, size_t size, int64_t keyframeOffset, int64_t &epoch) {
+    switch (detectSnapshotFormat(data, size)) {
+    case SnapshotFormat::Columnar: {
+        bool found = false;
+        size_t offset = kColumnarHeaderBytes;
+        uint32_t rows;
+        while (offset + kRowGroupHeaderBytes <= size) {
+            std::memcpy(&rows, data + offset, sizeof(rows));
+            if (rowGroupBytes(rows) > size - offset)
+                break;
+            if (rows > 0) {
+                const size_t last = columnOffset(ColEpoch, rows) + (rows - 1) * sizeof(int64_t);
+                std::memcpy(&epoch, data + offset + kRowGroupHeaderBytes + last, sizeof(epoch));
+                found = true;
+            }
+            offset += rowGroupBytes(rows);
+        }
+        return found;
+    }
+    case SnapshotFormat::Delta: {
+        char symbol[8];
+        if (!readDeltaHeader(data, size, symbol))
+            return false;
+        DeltaDecoder decoder(symbol);
+        Snapshot snap;
+        const char *p = data + kDeltaHeaderBytes;
+        if (keyframeOffset > static_cast<int64_t>(kDeltaHeaderBytes) && keyframeOffset < static_cast<int64_t>(size))
+            p = data + keyframeOffset;
+        bool found = false;
+        while (p < data + size && decoder.decode(p, data + size, snap)) {
+            epoch = snap.epoch;
+            found = true;
+        }
+        return found;
+    }
+    default: {
+        // The epoch follows the symbol in every fixed record layout.
+        const int64_t records = countSnapshotRecords(data, size, false);
+        if (records <= 0)
+            return false;
+        size_t last;
+        if (detectSnapshotFormat(data, size) == SnapshotFormat::Ticks) {
+            last = kTicksHeaderBytes + static_cast<size_t>(records - 1) * sizeof(TickSnapshot);
+        } else {
+            SnapshotLayout layout;
+            const int depth = readSnapshotDepth(data, size);
+            snapshotLayout(depth, layout);
+            last = snapshotDataOffset(depth) + static_cast<size_t>(records - 1) * layout.recordBytes;
+        }
+        std::memcpy(&epoch, data + last + offsetof(Snapshot, epoch), sizeof(epoch));
+        return true;
+    }
+    }
+}
+
+void appendDepthHeader(int depth, std::vector<char> &out) {
+    SnapshotLayout layout;
+    snapshotLayout(depth, layout);
+    const uint32_t fields[2] = {static_cast<uint32_t>(depth), static_cast<uint32_t>(layout.recordBytes)};
+    appendRaw(out, kDepthMagic, sizeof(kDepthMagic));
+    appendRaw(out, fields, sizeof(fields));
+}
+
+int readSnapshotDepth(const char *data, size_t size) {
+    if (size < sizeof(kDepthMagic) || std::memcmp(data, kDepthMagic, sizeof(kDepthMagic)) != 0)
+        return kDefaultDepth;
+    uint32_t fields[2];
+    if (size < kDepthHeaderBytes)
+        return 0;
+    std::memcpy(fields, data + sizeof(kDepthMagic), sizeof(fields));
+    SnapshotLayout layout;
+    if (fields[0] == static_cast<uint32_t>(kDefaultDepth) || !snapshotLayout(static_cast<int>(fields[0]), layout) ||
+        layout.recordBytes != fields[1])
+        return 0;
+    return layout.depth;
+}
+
+int detectSnapshotDepth(const std::string &snapPath) {
+    std::ifstream ifs(snapPath, std::ios::binary);
+    char header[kDepthHeaderBytes];
+    ifs.read(header, sizeof(header));
+    return readSnapshotDepth(header, static_cast<size_t>(ifs.gcount()));
+}
+
+void appendTicksHeader(int64_t ticksPerUnit, std::vector<char> &out) {
+    appendRaw(out, kTicksMagic, sizeof(kTicksMagic));
+    appendRaw(out, &ticksPerUnit, sizeof(ticksPerUnit));
+}
+
+int64_t readTicksPerUnit(const char *data, size_t size) {
+    if (size < kTicksHeaderBytes || std::memcmp(data, kTicksMagic, sizeof(kTicksMagic)) != 0)
+        return 0;
+    int64_t ticksPerUnit;
+    std::memcpy(&ticksPerUnit, data + sizeof(kTicksMagic), sizeof(ticksPerUnit));
+    return ticksPerUnit > 0 ? ticksPerUnit : 0;
+}
+
+int64_t detectTicksPerUnit(const std::string &snapPath) {
+    std::ifstream ifs(snapPath, std::ios::binary);
+    char header[kTicksHeaderBytes];
+    ifs.read(header, sizeof(header));
+    return readTicksPerUnit(header, static_cast<size_t>(ifs.gcount()));
+}
+
+// Helper: A price as an int32 tick count.
+static bool toTicks32(double price, int64_t ticksPerUnit, int32_t &out) {
+    int64_t ticks;
+    if (!priceToTicks(price, ticksPerUnit, ticks) || ticks < std::numeric_limits<int32_t>::min() ||
+        ticks > std::numeric_limits<int32_t>::max())
+        return false;
+    out = static_cast<int32_t>(ticks);
+    return true;
+}
+
+bool encodeTicks(const Snapshot &snap, int64_t ticksPerUnit, TickSnapshot &out) {
+    std::memcpy(out.symbol, snap.symbol, sizeof(out.symbol));
+    out.epoch = snap.epoch;
+    for (int i = 0; i < kDefaultDepth; ++i) {
+        if (!toTicks32(snap.bidPrices[i], ticksPerUnit, out.bidTicks[i]) ||
+            !toTicks32(snap.askPrices[i], ticksPerUnit, out.askTicks[i]))
+            return false;
+        out.bidQuantities[i] = snap.bidQuantities[i];
+        out.askQuantities[i] = snap.askQuantities[i];
+    }
+    out.lastTradeQuantity = snap.lastTradeQuantity;
+    return toTicks32(snap.lastTradePrice, ticksPerUnit, out.lastTradeTicks);
+}
+
+void decodeTicks(const TickSnapshot &record, int64_t ticksPerUnit, Snapshot &out) {
+    std::memcpy(out.symbol, record.symbol, sizeof(out.symbol));
+    out.epoch = record.epoch;
+    for (int i = 0; i < kDefaultDepth; ++i) {
+        out.bidPrices[i] = ticksToPrice(record.bidTicks[i], ticksPerUnit);
+        out.bidQuantities[i] = record.bidQuantities[i];
+        out.askPrices[i] = ticksToPrice(record.askTicks[i], ticksPerUnit);
+        out.askQuantities[i] = record.askQuantities[i];
+    }
+    out.lastTradePrice = ticksToPrice(record.lastTradeTicks, ticksPerUnit);
+    out.lastTradeQuantity = record.lastTradeQuantity;
+}
+
+// Helper: Magic followed by the zero-padded symbol.
+static void appendHeader(const char (&magic)[8], const std::string &symbol, std::vector<char> &out) {
+    char name[8] = {};
+    std::strncpy(name, symbol.c_str(), sizeof(name) - 1);
+    appendRaw(out, magic, sizeof(magic));
+    appendRaw(out, name, sizeof(name));
+}
+
+static bool readHeader(const char (&magic)[8], const char *data, size_t size, char (&symbol)[8]) {
+    if (size < sizeof(magic) + sizeof(symbol) || std::memcmp(data, magic, sizeof(magic)) != 0)
+        return false;
+    std::memcpy(symbol, data + sizeof(magic), sizeof(symbol));
+    symbol[sizeof(symbol) - 1] = '\0';
+    return true;
+}
+
+void appendDeltaHeader(const std::string &symbol, std::vector<char> &out) {
+    appendHeader(kDeltaMagic, symbol, out);
+}
+
+bool readDeltaHeader(const char *data, size_t size, char (&symbol)[8]) {
+    return readHeader(kDeltaMagic, data, size, symbol);
+}
+
+void appendColumnarHeader(const std::string &symbol, std::vector<char> &out) {
+    appendHeader(kColumnarMagic, symbol, out);
+}
+
+bool readColumnarHeader(const char *data, size_t size, char (&symbol)[8]) {
+    return readHeader(kColumnarMagic, data, size, symbol);
+}
+
+const char *columnName(int column) {
+    static const char *const names[kSnapshotColumns] = {
+        "epoch",
+        "bid1p", "bid2p", "bid3p", "bid4p", "bid5p",
+        "ask1p", "ask2p", "ask3p", "ask4p", "ask5p",
+        "lastTradePrice",
+        "bid1q", "bid2q", "bid3q", "bid4q", "bid5q",
+        "ask1q", "ask2q", "ask3q", "ask4q", "ask5q",
+        "lastTradeQuantity"
+    };
+    return names[column];
+}
+
+size_t columnWidth(int column) {
+    return column <= ColLastTradePrice ? 8 : 4;
+}
+
+size_t columnOffset(int column, uint32_t rows) {
+    // All 8-byte columns come first, so each of them stays 8-byte aligned.
+    if (column <= ColLastTradePrice)
+        return static_cast<size_t>(column) * 8 * rows;
+    return (static_cast<size_t>(ColLastTradePrice) + 1) * 8 * rows +
+           static_cast<size_t>(column - ColBid1q) * 4 * rows;
+}
+
+size_t rowGroupBytes(uint32_t rows) {
+    size_t payload = columnOffset(kSnapshotColumns, rows);
+    return kRowGroupHeaderBytes + ((payload + 7) & ~static_cast<size_t>(7));
+}
+
+// Helper: Address of the snapshot field stored in a column.
+static const void *columnField(const Snapshot &snap, int column) {
+    if (column == ColEpoch)
+        return &snap.epoch;
+    if (column <= ColBid5p)
+        return &snap.bidPrices[column - ColBid1p];
+    if (column <= ColAsk5p)
+        return &snap.askPrices[column - ColAsk1p];
+    if (column == ColLastTradePrice)
+        return &snap.lastTradePrice;
+    if (column <= ColBid5q)
+        return &snap.bidQuantities[column - ColBid1q];
+    if (column <= ColAsk5q)
+        return &snap.askQuantities[column - ColAsk1q];
+    return &snap.lastTradeQuantity;
+}
+
+size_t columnFieldOffset(int column) {
+    const Snapshot snap = {};
+    return static_cast<size_t>(static_cast<const char*>(columnField(snap, column)) -
+                               reinterpret_cast<const char*>(&snap));
+}
+
+void setColumnValue(Snapshot &snap, int column, const char *value) {
+    std::memcpy(const_cast<void*>(columnField(snap, column)), value, columnWidth(column));
+}
+
+void appendRowGroup(const std::vector<Snapshot> &rows, std::vector<char> &out) {
+    uint32_t count = static_cast<uint32_t>(rows.size());
+    size_t start = out.size();
+    out.resize(start + rowGroupBytes(count), 0);
+    char *group = out.data() + start;
+    std::memcpy(group, &count, sizeof(count));
+    char *payload = group + kRowGroupHeaderBytes;
+    for (int column = 0; column < kSnapshotColumns; ++column) {
+        size_t width = columnWidth(column);
+        char *dest = payload + columnOffset(column, count);
+        for (const auto &snap : rows) {
+            std::memcpy(dest, columnField(snap, column), width);
+            dest += width;
+        }
+    }
+}
+
+DeltaEncoder::DeltaEncoder() : hasKeyframe_(false) {
+    std::memset(&previous_, 0, sizeof(previous_));
+}
+
+void DeltaEncoder::encodeKeyframe(const Snapshot &snap, std::vector<char> &out) {
+    out.push_back(kKeyframeTag);
+    appendRaw(out, &snap.epoch, sizeof(snap.epoch));
+    for (int i = 0; i < kSlots; ++i) {
+        double price = priceSlot(snap, i);
+        appendRaw(out, &price, sizeof(price));
+    }
+    for (int i = 0; i < kSlots; ++i)
+        appendVarint(out, zigzagEncode(quantitySlot(snap, i)));
+    previous_ = snap;
+    hasKeyframe_ = true;
+}
+
+void DeltaEncoder::encodeDelta(const Snapshot &snap, std::vector<char> &out) {
+    uint32_t mask = 0;
+    for (int i = 0; i < kSlots; ++i) {
+        if (!samePrice(priceSlot(snap, i), priceSlot(previous_, i)))
+            mask |= 1u << i;
+        if (quantitySlot(snap, i) != quantitySlot(previous_, i))
+            mask |= 1u << (kSlots + i);
+    }
+    out.push_back(kDeltaTag);
+    appendVarint(out, zigzagEncode(snap.epoch - previous_.epoch));
+    appendVarint(out, mask);
+    for (int i = 0; i < kSlots; ++i) {
+        if ((mask & (1u << i)) == 0)
+            continue;
+        double price = priceSlot(snap, i);
+        uint8_t source = kLiteralPrice;
+        for (int j = 0; j < kSlots; ++j) {
+            if (samePrice(price, priceSlot(previous_, j))) {
+                source = static_cast<uint8_t>(j);
+                break;
+            }
+        }
+        out.push_back(static_cast<char>(source));
+        if (source == kLiteralPrice)
+            appendRaw(out, &price, sizeof(price));
+    }
+    for (int i = 0; i < kSlots; ++i) {
+        if (mask & (1u << (kSlots + i)))
+            appendVarint(out, zigzagEncode(quantitySlot(snap, i)));
+    }
+    previous_ = snap;
+}
+
+DeltaDecoder::DeltaDecoder(const char (&symbol)[8]) : hasKeyframe_(false), lastWasKeyframe_(false) {
+    std::memset(&previous_, 0, sizeof(previous_));
+    std::memcpy(previous_.symbol, symbol, sizeof(previous_.symbol));
+}
+
+bool DeltaDecoder::decode(const char *&p, const char *end, Snapshot &snap) {
+    if (p >= end)
+        return false;
+    const char *cursor = p;
+    Snapshot next = previous_;
+    uint64_t value;
+    char tag = *cursor++;
+    if (tag == kKeyframeTag) {
+        if (!readRaw(cursor, end, &next.epoch, sizeof(next.epoch)))
+            return false;
+        for (int i = 0; i < kSlots; ++i) {
+            if (!readRaw(cursor, end, &priceSlot(next, i), sizeof(double)))
+                return false;
+        }
+        for (int i = 0; i < kSlots; ++i) {
+            if (!readVarint(cursor, end, value))
+                return false;
+            quantitySlot(next, i) = static_cast<int32_t>(zigzagDecode(value));
+        }
+    } else if (tag == kDeltaTag && hasKeyframe_) {
+        uint64_t mask;
+        if (!readVarint(cursor, end, value) || !readVarint(cursor, end, mask))
+            return false;
+        next.epoch = previous_.epoch + zigzagDecode(value);
+        for (int i = 0; i < kSlots; ++i) {
+            if ((mask & (1u << i)) == 0)
+                continue;
+            if (cursor >= end)
+                return false;
+            uint8_t source = static_cast<uint8_t>(*cursor++);
+            if (source == kLiteralPrice) {
+                if (!readRaw(cursor, end, &priceSlot(next, i), sizeof(double)))
+                    return false;
+            } else if (source < kSlots) {
+                priceSlot(next, i) = priceSlot(previous_, source);
+            } else {
+                return false;
+            }
+        }
+        for (int i = 0; i < kSlots; ++i) {
+            if ((mask & (1u << (kSlots + i))) == 0)
+                continue;
+            if (!readVarint(cursor, end, value))
+                return false;
+            quantitySlot(next, i) = static_cast<int32_t>(zigzagDecode(value));
+        }
+    } else {
+        return false;
+    }
+    hasKeyframe_ = true;
+    lastWasKeyframe_ = (tag == kKeyframeTag);
+    previous_ = next;
+    snap = next;
+    p = cursor;
+    return true;
+}
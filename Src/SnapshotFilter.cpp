@@ -0,0 +1,292 @@
+#include "SnapshotFilter.h"
+#include "SnapshotCodec.h"
+#include "ZoneMap.h"
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SNAPSHOT_FILTER_SSE2 1
+#endif
+
+static constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+// Helper: Mask with the low n bits set (n <= 64).
+static uint64_t lowMask(size_t n) {
+    return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+}
+
+static void skipSpaces(const std::string &text, size_t &p) {
+    while (p < text.size() && std::isspace(static_cast<unsigned char>(text[p])))
+        ++p;
+}
+
+// Helper: Reads a word of letters and digits at p.
+static std::string readWord(const std::string &text, size_t &p) {
+    size_t start = p;
+    while (p < text.size() && std::isalnum(static_cast<unsigned char>(text[p])))
+        ++p;
+    return text.substr(start, p - start);
+}
+
+bool SnapshotFilter::parse(const std::string &expression, std::ostream &err) {
+    predicates_.clear();
+    std::vector<Predicate> predicates;
+    auto fail = [&](const std::string &reason) {
+        err << "Error: Invalid filter \"" << expression << "\": " << reason << "." << std::endl;
+        return false;
+    };
+    // Reads a field name into an operand.
+    auto readOperand = [&](size_t &p, Operand &operand, uint32_t &columns) {
+        std::string name = readWord(expression, p);
+        if (name.empty())
+            return fail("expected a field at position " + std::to_string(p));
+        if (name == "epoch" || name == "symbol")
+            return fail("\"" + name + "\" cannot be filtered (use the epoch range and symbol list)");
+        for (int column = ColEpoch + 1; column < kSnapshotColumns; ++column) {
+            if (name == columnName(column)) {
+                operand.offset = static_cast<uint16_t>(columnFieldOffset(column));
+                operand.column = static_cast<uint8_t>(column);
+                operand.price = columnWidth(column) == sizeof(double);
+                columns |= 1u << column;
+                return true;
+            }
+        }
+        return fail("unknown field \"" + name + "\"");
+    };
+
+    size_t p = 0;
+    skipSpaces(expression, p);
+    while (p < expression.size()) {
+        Predicate predicate;
+        if (!readOperand(p, predicate.left, predicate.columns))
+            return false;
+        skipSpaces(expression, p);
+        if (p < expression.size() && (expression[p] == '+' || expression[p] == '-')) {
+            predicate.sign = (expression[p] == '+') ? 1 : -1;
+            ++p;
+            skipSpaces(expression, p);
+            if (!readOperand(p, predicate.right, predicate.columns))
+                return false;
+            skipSpaces(expression, p);
+        }
+        static const std::pair<const char*, Op> ops[] = {
+            {"<=", Op::LessEqual}, {">=", Op::GreaterEqual}, {"==", Op::Equal}, {"!=", Op::NotEqual},
+            {"<", Op::Less}, {">", Op::Greater}};
+        bool found = false;
+        for (const auto &op : ops) {
+            size_t length = std::strlen(op.first);
+            if (expression.compare(p, length, op.first) == 0) {
+                predicate.op = op.second;
+                p += length;
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return fail("expected a comparison operator at position " + std::to_string(p));
+        skipSpaces(expression, p);
+        const char *start = expression.c_str() + p;
+        char *end = nullptr;
+        predicate.value = std::strtod(start, &end);
+        if (end == start || !std::isfinite(predicate.value))
+            return fail("expected a number at position " + std::to_string(p));
+        p += static_cast<size_t>(end - start);
+        predicates.push_back(predicate);
+
+        skipSpaces(expression, p);
+        if (p == expression.size())
+            break;
+        if (expression.compare(p, 2, "&&") == 0) {
+            p += 2;
+        } else if (expression[p] == ',') {
+            ++p;
+        } else {
+            size_t wordEnd = p;
+            if (readWord(expression, wordEnd) != "and")
+                return fail("expected \"&&\", \"and\" or \",\" at position " + std::to_string(p));
+            p = wordEnd;
+        }
+        skipSpaces(expression, p);
+        if (p == expression.size())
+            return fail("expected a comparison after the last \"&&\"");
+    }
+    predicates_ = std::move(predicates);
+    return true;
+}
+
+uint32_t SnapshotFilter::columns() const {
+    uint32_t columns = 0;
+    for (const auto &predicate : predicates_)
+        columns |= predicate.columns;
+    return columns;
+}
+
+// Helper: Copies one field of each row into a column of doubles; a negative
+// price becomes NaN so that every comparison with it is false.
+static void gather(const Snapshot *rows, size_t n, uint16_t offset, bool price, double *out) {
+    const char *field = reinterpret_cast<const char*>(rows) + offset;
+    if (price) {
+        for (size_t i = 0; i < n; ++i, field += sizeof(Snapshot)) {
+            double value;
+            std::memcpy(&value, field, sizeof(value));
+            out[i] = value < 0.0 ? kNaN : value;
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i, field += sizeof(Snapshot)) {
+            int32_t value;
+            std::memcpy(&value, field, sizeof(value));
+            out[i] = static_cast<double>(value);
+        }
+    }
+}
+
+#ifdef SNAPSHOT_FILTER_SSE2
+
+// Kernel: bit i set where x[i] op value, for an even n. The ordered compares
+// are false for NaN; != is masked with an ordered check to match.
+template <SnapshotFilter::Op op>
+static uint64_t compareColumn(const double *x, size_t n, double value) {
+    const __m128d threshold = _mm_set1_pd(value);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < n; i += 2) {
+        const __m128d v = _mm_load_pd(x + i);
+        __m128d hit;
+        if (op == SnapshotFilter::Op::Less)
+            hit = _mm_cmplt_pd(v, threshold);
+        else if (op == SnapshotFilter::Op::LessEqual)
+            hit = _mm_cmple_pd(v, threshold);
+        else if (op == SnapshotFilter::Op::Greater)
+            hit = _mm_cmpgt_pd(v, threshold);
+        else if (op == SnapshotFilter::Op::GreaterEqual)
+            hit = _mm_cmpge_pd(v, threshold);
+        else if (op == SnapshotFilter::Op::Equal)
+            hit = _mm_cmpeq_pd(v, threshold);
+        else
+            hit = _mm_and_pd(_mm_cmpneq_pd(v, threshold), _mm_cmpord_pd(v, v));
+        mask |= static_cast<uint64_t>(_mm_movemask_pd(hit)) << i;
+    }
+    return mask;
+}
+
+#else
+
+// Kernel: bit i set where x[i] op value (NaN compares false, also for !=).
+template <SnapshotFilter::Op op>
+static uint64_t compareColumn(const double *x, size_t n, double value) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const double v = x[i];
+        bool hit;
+        if (op == SnapshotFilter::Op::Less)
+            hit = v < value;
+        else if (op == SnapshotFilter::Op::LessEqual)
+            hit = v <= value;
+        else if (op == SnapshotFilter::Op::Greater)
+            hit = v > value;
+        else if (op == SnapshotFilter::Op::GreaterEqual)
+            hit = v >= value;
+        else if (op == SnapshotFilter::Op::Equal)
+            hit = v == value;
+        else
+            hit = v == v && v != value;
+        mask |= static_cast<uint64_t>(hit) << i;
+    }
+    return mask;
+}
+
+#endif
+
+uint64_t SnapshotFilter::evaluate(const Predicate &predicate, const Snapshot *rows, size_t n) const {
+    // One spare slot so that an odd block pads to whole SSE2 pairs.
+    alignas(16) double x[kBlockRows + 1];
+    gather(rows, n, predicate.left.offset, predicate.left.price, x);
+    if (predicate.sign != 0) {
+        alignas(16) double y[kBlockRows];
+        gather(rows, n, predicate.right.offset, predicate.right.price, y);
+        const double sign = static_cast<double>(predicate.sign);
+        for (size_t i = 0; i < n; ++i)
+            x[i] += sign * y[i];
+    }
+    x[n] = kNaN;
+    const size_t padded = (n + 1) & ~size_t(1);
+    uint64_t mask = 0;
+    switch (predicate.op) {
+    case Op::Less: mask = compareColumn<Op::Less>(x, padded, predicate.value); break;
+    case Op::LessEqual: mask = compareColumn<Op::LessEqual>(x, padded, predicate.value); break;
+    case Op::Greater: mask = compareColumn<Op::Greater>(x, padded, predicate.value); break;
+    case Op::GreaterEqual: mask = compareColumn<Op::GreaterEqual>(x, padded, predicate.value); break;
+    case Op::Equal: mask = compareColumn<Op::Equal>(x, padded, predicate.value); break;
+    case Op::NotEqual: mask = compareColumn<Op::NotEqual>(x, padded, predicate.value); break;
+    }
+    return mask & lowMask(n);
+}
+
+size_t SnapshotFilter::select(const Snapshot *rows, size_t n, uint64_t *masks) const {
+    size_t selected = 0;
+    for (size_t block = 0; block < n; block += kBlockRows) {
+        const size_t count = std::min(kBlockRows, n - block);
+        uint64_t mask = lowMask(count);
+        for (const auto &predicate : predicates_) {
+            if (mask == 0)
+                break;
+            mask &= evaluate(predicate, rows + block, count);
+        }
+        masks[block / kBlockRows] = mask;
+        selected += std::bitset<64>(mask).count();
+    }
+    return selected;
+}
+
+bool SnapshotFilter::matches(const Snapshot &snap) const {
+    uint64_t mask;
+    return select(&snap, 1, &mask) == 1;
+}
+
+bool SnapshotFilter::mayMatch(const ZoneStats &zone) const {
+    for (const auto &predicate : predicates_) {
+        double lo = zone.min[predicate.left.column];
+        double hi = zone.max[predicate.left.column];
+        if (predicate.sign != 0) {
+            const int left = predicate.left.column;
+            const int right = predicate.right.column;
+            const double rightLo = zone.min[right];
+            const double rightHi = zone.max[right];
+            if (predicate.sign < 0 && left == ColAsk1p && right == ColBid1p) {
+                lo = zone.min[kZoneSpread];
+                hi = zone.max[kZoneSpread];
+            } else if (predicate.sign < 0 && left == ColBid1p && right == ColAsk1p) {
+                lo = -zone.max[kZoneSpread];
+                hi = -zone.min[kZoneSpread];
+            } else if (lo > hi || rightLo > rightHi) {
+                return false;  // An operand has no value in the zone.
+            } else if (predicate.sign > 0) {
+                lo += rightLo;
+                hi += rightHi;
+            } else {
+                lo -= rightHi;
+                hi -= rightLo;
+            }
+        }
+        if (lo > hi)
+            return false;  // No row of the zone has a value to compare.
+        const double value = predicate.value;
+        bool possible = true;
+        switch (predicate.op) {
+        case Op::Less: possible = lo < value; break;
+        case Op::LessEqual: possible = lo <= value; break;
+        case Op::Greater: possible = hi > value; break;
+        case Op::GreaterEqual: possible = hi >= value; break;
+        case Op::Equal: possible = lo <= value && value <= hi; break;
+        case Op::NotEqual: possible = !(lo == value && hi == value); break;
+        }
+        if (!possible)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+#include "SnapshotIndex.h"
+#include "SnapshotCodec.h"
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+void appendBlockIndexHeader(uint32_t blockRecords, std::vector<char> &out) {
+    const uint32_t reserved = 0;
+    const char *bytes = reinterpret_cast<const char*>(&blockRecords);
+    out.insert(out.end(), kBlockIndexMagic, kBlockIndexMagic + sizeof(kBlockIndexMagic));
+    out.insert(out.end(), bytes, bytes + sizeof(blockRecords));
+    bytes = reinterpret_cast<const char*>(&reserved);
+    out.insert(out.end(), bytes, bytes + sizeof(reserved));
+}
+
+bool readBlockIndex(const char *data, size_t size, uint32_t &blockRecords, std::vector<int64_t> &fences) {
+    fences.clear();
+    if (size < kBlockIndexHeaderBytes || std::memcmp(data, kBlockIndexMagic, sizeof(kBlockIndexMagic)) != 0)
+        return false;
+    std::memcpy(&blockRecords, data + sizeof(kBlockIndexMagic), sizeof(blockRecords));
+    if (blockRecords == 0)
+        return false;
+    const char *p = data + kBlockIndexHeaderBytes;
+    const char *end = data + size;
+    int64_t fence = 0;
+    uint64_t value;
+    while (p < end) {
+        if (!readVarint(p, end, value))
+            return false;
+        fence += zigzagDecode(value);
+        fences.push_back(fence);
+    }
+    return true;
+}
+
+SnapshotIndex::SnapshotIndex()
+    : size_(0), blockRecords_(0), dataOffset_(0), recordBytes_(static_cast<int64_t>(sizeof(Snapshot))) {}
+
+bool SnapshotIndex::load(const char *data, size_t size) {
+    std::vector<int64_t> epochs;
+    offsets_.clear();
+    blockRecords_ = 0;
+    if (size >= sizeof(kBlockIndexMagic) && std::memcmp(data, kBlockIndexMagic, sizeof(kBlockIndexMagic)) == 0) {
+        if (!readBlockIndex(data, size, blockRecords_, epochs)) {
+            blockRecords_ = 0;
+            build(std::vector<int64_t>());
+            return false;
+        }
+    } else {
+        size_t count = size / sizeof(IndexEntry);
+        epochs.resize(count);
+        offsets_.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            IndexEntry entry;
+            std::memcpy(&entry, data + i * sizeof(IndexEntry), sizeof(entry));
+            epochs[i] = entry.epoch;
+            offsets_[i] = entry.offset;
+        }
+    }
+    build(epochs);
+    return true;
+}
+
+bool SnapshotIndex::readFile(const std::string &path) {
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open())
+        return false;
+    std::vector<char> data(static_cast<size_t>(ifs.tellg()));
+    ifs.seekg(0, std::ios::beg);
+    if (!data.empty() && !ifs.read(data.data(), static_cast<std::streamsize>(data.size())))
+        return false;
+    return load(data.data(), data.size());
+}
+
+void SnapshotIndex::build(const std::vector<int64_t> &epochs) {
+    size_ = epochs.size();
+    eytzinger_.assign(size_ + 1, 0);
+    ranks_.assign(size_ + 1, 0);
+    slots_.assign(size_, 0);
+    size_t next = 0;
+    fill(epochs, next, 1);
+}
+
+// In-order walk of the implicit tree (children of slot k are 2k and 2k + 1)
+// hands out the epochs in ascending order.
+void SnapshotIndex::fill(const std::vector<int64_t> &epochs, size_t &next, size_t slot) {
+    if (slot > size_)
+        return;
+    fill(epochs, next, 2 * slot);
+    eytzinger_[slot] = epochs[next];
+    slots_[next] = static_cast<uint32_t>(slot);
+    ranks_[slot] = static_cast<uint32_t>(next++);
+    fill(epochs, next, 2 * slot + 1);
+}
+
+size_t SnapshotIndex::lowerBound(int64_t epoch) const {
+    size_t slot = 1;
+    while (slot <= size_)
+        slot = 2 * slot + (eytzinger_[slot] < epoch);
+    // The path ends with a run of right turns past the answer; strip them and
+    // the left turn taken at it.
+    while (slot & 1)
+        slot >>= 1;
+    slot >>= 1;
+    return slot == 0 ? size_ : ranks_[slot];
+}
+
+size_t SnapshotIndex::upperBound(int64_t epoch) const {
+    if (epoch == std::numeric_limits<int64_t>::max())
+        return size_;
+    return lowerBound(epoch + 1);
+}
+
+size_t SnapshotIndex::memoryBytes() const {
+    return eytzinger_.capacity() * sizeof(int64_t) + (ranks_.capacity() + slots_.capacity()) * sizeof(uint32_t) +
+           offsets_.capacity() * sizeof(int64_t);
+}
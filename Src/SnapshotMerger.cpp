@@ -0,0 +1,57 @@
+#include "SnapshotMerger.h"
+#include <algorithm>
+#include <utility>
+
+static constexpr size_t kNoRun = static_cast<size_t>(-1);
+
+SnapshotMerger::SnapshotMerger() : last_(kNoRun), limit_(0), returned_(0), started_(false) {}
+
+void SnapshotMerger::add(std::unique_ptr<SnapshotStream> stream) {
+    if (stream)
+        runs_.push_back(Run{std::move(stream), nullptr, nullptr});
+}
+
+void SnapshotMerger::setLimit(size_t limit) {
+    limit_ = limit;
+}
+
+bool SnapshotMerger::refill(Run &run) {
+    return run.stream->nextChunk(run.current, run.end) && run.current != run.end;
+}
+
+bool SnapshotMerger::after(size_t a, size_t b) const {
+    int64_t epochA = runs_[a].current->epoch;
+    int64_t epochB = runs_[b].current->epoch;
+    return epochA > epochB || (epochA == epochB && a > b);
+}
+
+const Snapshot *SnapshotMerger::next() {
+    auto order = [this](size_t a, size_t b) { return after(a, b); };
+    // At the limit, stop without pulling any further chunks.
+    if (limit_ != 0 && returned_ == limit_)
+        return nullptr;
+    if (!started_) {
+        started_ = true;
+        for (size_t i = 0; i < runs_.size(); ++i) {
+            if (refill(runs_[i]))
+                heap_.push_back(i);
+        }
+        std::make_heap(heap_.begin(), heap_.end(), order);
+    } else if (last_ != kNoRun) {
+        // Advance the run returned last time only now, so its chunk outlived the returned pointer.
+        Run &run = runs_[last_];
+        std::pop_heap(heap_.begin(), heap_.end(), order);
+        heap_.pop_back();
+        if (++run.current != run.end || refill(run)) {
+            heap_.push_back(last_);
+            std::push_heap(heap_.begin(), heap_.end(), order);
+        }
+    }
+    if (heap_.empty()) {
+        last_ = kNoRun;
+        return nullptr;
+    }
+    ++returned_;
+    last_ = heap_.front();
+    return runs_[last_].current;
+}
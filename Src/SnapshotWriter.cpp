@@ -0,0 +1,416 @@
+#include "SnapshotWriter.h"
+#include "SnapshotIndex.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+// Global mutex to synchronize console output (defined in BookProcessor.cpp).
+extern std::mutex coutMutex;
+
+SnapshotWriter::SnapshotWriter(const std::string &symbol, size_t bufferBytes)
+    : SnapshotWriter(symbol, StorageOptions(), bufferBytes) {}
+
+SnapshotWriter::SnapshotWriter(const std::string &symbol, const StorageOptions &storage, size_t bufferBytes)
+    : symbol_(symbol), bufferBytes_(bufferBytes), snapOffset_(0), storage_(storage), sinceKeyframe_(0),
+      keyframeEpoch_(0), indexBlockRecords_(storage.indexBlockRecords), records_(0), lastFence_(0),
+      zoneRecords_(storage.zoneRecords), wrongDepthReported_(false), offGridReported_(false), lastEpoch_(0),
+      hasLastEpoch_(false), outOfOrderReported_(false), writing_(false), stopping_(false)
+{
+    snap_.path = symbol + ".snap";
+    idx_.path = symbol + ".idx";
+    zmap_.path = symbol + ".zmap";
+    // Offsets in the index are absolute, so continue from whatever is already on disk.
+    snapOffset_ = existingFileSize(snap_.path);
+    SnapshotLayout layout;
+    if (!snapshotLayout(storage_.depth, layout) ||
+        (storage_.depth != kDefaultDepth && storage_.format != SnapshotFormat::Fixed)) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Snapshot depth " << storage_.depth << " is not supported"
+                  << (storage_.format != SnapshotFormat::Fixed ? " in this format" : "") << ": " << snap_.path
+                  << std::endl;
+    } else if (storage_.format == SnapshotFormat::Ticks && storage_.ticksPerUnit <= 0) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: The ticks format needs a price scale: " << snap_.path << std::endl;
+    } else if (snapOffset_ > 0 && detectSnapshotFormat(snap_.path) != storage_.format) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Existing snapshot file has a different format: " << snap_.path << std::endl;
+    } else if (snapOffset_ > 0 && detectSnapshotDepth(snap_.path) != storage_.depth) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Existing snapshot file has a different depth: " << snap_.path << std::endl;
+    } else if (snapOffset_ > 0 && storage_.format == SnapshotFormat::Ticks &&
+               detectTicksPerUnit(snap_.path) != storage_.ticksPerUnit) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Existing snapshot file has a different price scale: " << snap_.path << std::endl;
+    } else {
+        snap_.ofs.open(snap_.path, std::ios::binary | std::ios::app);
+        idx_.ofs.open(idx_.path, std::ios::binary | std::ios::app);
+        if (!snap_.ofs.is_open() || !idx_.ofs.is_open()) {
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Error: Failed to open snapshot/index files for symbol: " << symbol << std::endl;
+        }
+    }
+    snap_.buffer.reserve(bufferBytes_);
+    idx_.buffer.reserve(bufferBytes_);
+    // Zone statistics cover the default depth's columns only.
+    if (storage_.depth != kDefaultDepth)
+        zoneRecords_ = 0;
+    if (isOpen())
+        openZoneMap();
+    else
+        zoneRecords_ = 0;
+    if (isOpen() && snapOffset_ > 0)
+        openLastEpoch();
+    if ((storage_.depth != kDefaultDepth || storage_.format == SnapshotFormat::Ticks) && snapOffset_ == 0 && isOpen()) {
+        std::vector<char> header;
+        if (storage_.format == SnapshotFormat::Ticks)
+            appendTicksHeader(storage_.ticksPerUnit, header);
+        else
+            appendDepthHeader(storage_.depth, header);
+        append(snap_, header.data(), header.size());
+        snapOffset_ += static_cast<int64_t>(header.size());
+    }
+    if ((storage_.format == SnapshotFormat::Fixed || storage_.format == SnapshotFormat::Ticks) && isOpen())
+        openFixedIndex();
+    if ((storage_.format == SnapshotFormat::Delta || storage_.format == SnapshotFormat::Columnar) && snapOffset_ == 0) {
+        if (storage_.format == SnapshotFormat::Delta)
+            appendDeltaHeader(symbol, record_);
+        else
+            appendColumnarHeader(symbol, record_);
+        append(snap_, record_.data(), record_.size());
+        snapOffset_ += static_cast<int64_t>(record_.size());
+    }
+    flusher_ = std::thread(&SnapshotWriter::flusherLoop, this);
+}
+
+void SnapshotWriter::openFixedIndex() {
+    SnapshotLayout layout;
+    snapshotLayout(storage_.depth, layout);
+    const bool ticks = storage_.format == SnapshotFormat::Ticks;
+    const size_t dataOffset = ticks ? kTicksHeaderBytes : snapshotDataOffset(storage_.depth);
+    const size_t recordBytes = ticks ? sizeof(TickSnapshot) : layout.recordBytes;
+    const int64_t records = std::max<int64_t>(
+        (snapOffset_ - static_cast<int64_t>(dataOffset)) / static_cast<int64_t>(recordBytes), 0);
+    std::ifstream ifs(idx_.path, std::ios::binary | std::ios::ate);
+    std::vector<char> existing(ifs.is_open() ? static_cast<size_t>(ifs.tellg()) : 0);
+    ifs.seekg(0, std::ios::beg);
+    ifs.read(existing.data(), static_cast<std::streamsize>(existing.size()));
+    // Continue the layout already on disk, whatever the options ask for.
+    std::vector<int64_t> fences;
+    bool covered;
+    if (existing.empty()) {
+        covered = records == 0;
+    } else if (readBlockIndex(existing.data(), existing.size(), indexBlockRecords_, fences)) {
+        covered = static_cast<int64_t>(fences.size()) == (records + indexBlockRecords_ - 1) / indexBlockRecords_;
+    } else {
+        indexBlockRecords_ = 0;
+        covered = static_cast<int64_t>(existing.size()) == records * static_cast<int64_t>(sizeof(IndexEntry));
+    }
+    if (covered && !existing.empty()) {
+        records_ = records;
+        lastFence_ = fences.empty() ? 0 : fences.back();
+        return;
+    }
+    if (!covered) {
+        // Fences and entries must line up with the records, so start the index over.
+        idx_.ofs.close();
+        idx_.ofs.open(idx_.path, std::ios::binary | std::ios::trunc);
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Warning: Rebuilding index file " << idx_.path << " from its " << records << " snapshots."
+                  << std::endl;
+    }
+    if (indexBlockRecords_ > 0) {
+        appendBlockIndexHeader(indexBlockRecords_, record_);
+        append(idx_, record_.data(), record_.size());
+    }
+    if (records == 0)
+        return;
+    MappedFile snap(snap_.path);
+    if (!snap.isOpen() || snap.size() < dataOffset + static_cast<size_t>(records) * recordBytes) {
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Failed to read snapshot file: " << snap_.path << std::endl;
+        idx_.ofs.close();
+        return;
+    }
+    // The epoch follows the symbol in every fixed record layout.
+    for (int64_t i = 0; i < records; ++i) {
+        const int64_t offset = static_cast<int64_t>(dataOffset) + i * static_cast<int64_t>(recordBytes);
+        int64_t epoch;
+        std::memcpy(&epoch, snap.data() + offset + offsetof(Snapshot, epoch), sizeof(epoch));
+        indexRecordLocked(epoch, offset);
+    }
+}
+
+void SnapshotWriter::openLastEpoch() {
+    // A delta file only needs decoding from its last keyframe.
+    int64_t keyframeOffset = 0;
+    if (storage_.format == SnapshotFormat::Delta) {
+        const int64_t indexBytes = existingFileSize(idx_.path);
+        IndexEntry entry;
+        std::ifstream ifs(idx_.path, std::ios::binary);
+        if (indexBytes >= static_cast<int64_t>(sizeof(entry)) &&
+            ifs.seekg(indexBytes - static_cast<int64_t>(sizeof(entry))) &&
+            ifs.read(reinterpret_cast<char*>(&entry), sizeof(entry)))
+            keyframeOffset = entry.offset;
+    }
+    MappedFile snap(snap_.path);
+    if (snap.isOpen())
+        hasLastEpoch_ = lastSnapshotEpoch(snap.data(), snap.size(), keyframeOffset, lastEpoch_);
+}
+
+void SnapshotWriter::openZoneMap() {
+    if (snapOffset_ == 0) {
+        // A new snapshot file: replace any zone map left over from an earlier one.
+        if (zoneRecords_ == 0) {
+            std::remove(zmap_.path.c_str());
+            return;
+        }
+        zmap_.ofs.open(zmap_.path, std::ios::binary | std::ios::trunc);
+        std::vector<char> header;
+        appendZoneMapHeader(zoneRecords_, header);
+        append(zmap_, header.data(), header.size());
+    } else {
+        // Continue the zone size already on disk, whatever the options ask for.
+        char header[kZoneMapHeaderBytes];
+        std::ifstream ifs(zmap_.path, std::ios::binary);
+        if (!ifs.read(header, sizeof(header)) || std::memcmp(header, kZoneMapMagic, sizeof(kZoneMapMagic)) != 0) {
+            zoneRecords_ = 0;
+            return;
+        }
+        std::memcpy(&zoneRecords_, header + sizeof(kZoneMapMagic), sizeof(zoneRecords_));
+        if (zoneRecords_ == 0)
+            return;
+        // New zones only line up with the rows if the map already covers every row on disk.
+        const int64_t mapBytes = existingFileSize(zmap_.path);
+        ZoneMap zones;
+        MappedFile snap(snap_.path);
+        if ((mapBytes - static_cast<int64_t>(kZoneMapHeaderBytes)) % static_cast<int64_t>(sizeof(ZoneStats)) != 0 ||
+            !zones.readFile(zmap_.path) ||
+            zones.records() != countSnapshotRecords(snap.data(), snap.size(), true)) {
+            zoneRecords_ = 0;
+            std::remove(zmap_.path.c_str());
+            std::lock_guard<std::mutex> lock(coutMutex);
+            std::cerr << "Warning: Dropping zone map " << zmap_.path << ", which does not cover " << snap_.path
+                      << "." << std::endl;
+            return;
+        }
+        zmap_.ofs.open(zmap_.path, std::ios::binary | std::ios::app);
+    }
+    if (!zmap_.ofs.is_open()) {
+        zoneRecords_ = 0;
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Failed to open zone map file: " << zmap_.path << std::endl;
+    }
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopping_ = true;
+    }
+    queueCv_.notify_all();
+    if (flusher_.joinable())
+        flusher_.join();
+}
+
+bool SnapshotWriter::isOpen() const {
+    return snap_.ofs.is_open() && idx_.ofs.is_open();
+}
+
+void SnapshotWriter::write(const Snapshot &snapshot) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (!acceptsDepthLocked(kDefaultDepth) || !acceptsEpochLocked(snapshot.epoch))
+        return;
+    if (storage_.format == SnapshotFormat::Delta) {
+        record_.clear();
+        bool keyframe = !encoder_.hasKeyframe() ||
+                        (storage_.keyframeRecords > 0 && sinceKeyframe_ >= storage_.keyframeRecords) ||
+                        (storage_.keyframeNanos > 0 && snapshot.epoch - keyframeEpoch_ >= storage_.keyframeNanos);
+        if (keyframe) {
+            IndexEntry entry;
+            entry.epoch = snapshot.epoch;
+            entry.offset = snapOffset_;
+            append(idx_, &entry, sizeof(entry));
+            encoder_.encodeKeyframe(snapshot, record_);
+            sinceKeyframe_ = 0;
+            keyframeEpoch_ = snapshot.epoch;
+        } else {
+            encoder_.encodeDelta(snapshot, record_);
+        }
+        ++sinceKeyframe_;
+        append(snap_, record_.data(), record_.size());
+        snapOffset_ += static_cast<int64_t>(record_.size());
+        noteZoneLocked(snapshot);
+        return;
+    }
+    if (storage_.format == SnapshotFormat::Columnar) {
+        rowGroup_.push_back(snapshot);
+        if (rowGroup_.size() >= std::max<size_t>(storage_.rowGroupRows, 1))
+            appendRowGroupLocked();
+        noteZoneLocked(snapshot);
+        return;
+    }
+    if (storage_.format == SnapshotFormat::Ticks) {
+        TickSnapshot record;
+        if (!encodeTicks(snapshot, storage_.ticksPerUnit, record)) {
+            if (!offGridReported_) {
+                offGridReported_ = true;
+                std::lock_guard<std::mutex> lock(coutMutex);
+                std::cerr << "Error: Snapshot prices do not fit the 1/" << storage_.ticksPerUnit
+                          << " tick grid; skipping such snapshots of " << snap_.path << std::endl;
+            }
+            return;
+        }
+        appendFixedLocked(&record, sizeof(record), snapshot.epoch);
+        noteZoneLocked(snapshot);
+        return;
+    }
+    appendFixedLocked(&snapshot, sizeof(snapshot), snapshot.epoch);
+    noteZoneLocked(snapshot);
+}
+
+bool SnapshotWriter::acceptsDepthLocked(int depth) {
+    if (depth == storage_.depth)
+        return true;
+    if (!wrongDepthReported_) {
+        wrongDepthReported_ = true;
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Depth-" << depth << " snapshots written to a depth-" << storage_.depth
+                  << " file: " << snap_.path << std::endl;
+    }
+    return false;
+}
+
+bool SnapshotWriter::acceptsEpochLocked(int64_t epoch) {
+    if (!hasLastEpoch_ || epoch >= lastEpoch_) {
+        lastEpoch_ = epoch;
+        hasLastEpoch_ = true;
+        return true;
+    }
+    if (!outOfOrderReported_) {
+        outOfOrderReported_ = true;
+        std::lock_guard<std::mutex> lock(coutMutex);
+        std::cerr << "Error: Snapshot at epoch " << epoch << " precedes epoch " << lastEpoch_
+                  << "; skipping out-of-order snapshots of " << snap_.path << std::endl;
+    }
+    return false;
+}
+
+void SnapshotWriter::indexRecordLocked(int64_t epoch, int64_t offset) {
+    if (indexBlockRecords_ == 0) {
+        IndexEntry entry;
+        entry.epoch = epoch;
+        entry.offset = offset;
+        append(idx_, &entry, sizeof(entry));
+    } else if (records_ % indexBlockRecords_ == 0) {
+        record_.clear();
+        appendVarint(record_, zigzagEncode(epoch - lastFence_));
+        append(idx_, record_.data(), record_.size());
+        lastFence_ = epoch;
+    }
+    ++records_;
+}
+
+void SnapshotWriter::appendFixedLocked(const void *record, size_t bytes, int64_t epoch) {
+    indexRecordLocked(epoch, snapOffset_);
+    append(snap_, record, bytes);
+    snapOffset_ += static_cast<int64_t>(bytes);
+}
+
+void SnapshotWriter::noteZoneLocked(const Snapshot &snapshot) {
+    if (zoneRecords_ == 0)
+        return;
+    zone_.add(snapshot);
+    if (zone_.records() >= zoneRecords_)
+        appendZoneLocked();
+}
+
+void SnapshotWriter::appendZoneLocked() {
+    if (zone_.records() == 0)
+        return;
+    const ZoneStats zone = zone_.take();
+    append(zmap_, &zone, sizeof(zone));
+}
+
+void SnapshotWriter::appendRowGroupLocked() {
+    if (rowGroup_.empty())
+        return;
+    IndexEntry entry;
+    entry.epoch = rowGroup_.front().epoch;
+    entry.offset = snapOffset_;
+    append(idx_, &entry, sizeof(entry));
+    record_.clear();
+    appendRowGroup(rowGroup_, record_);
+    append(snap_, record_.data(), record_.size());
+    snapOffset_ += static_cast<int64_t>(record_.size());
+    rowGroup_.clear();
+}
+
+void SnapshotWriter::flush() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    appendRowGroupLocked();
+    appendZoneLocked();
+    submit(snap_);
+    submit(idx_);
+    submit(zmap_);
+    std::unique_lock<std::mutex> queueLock(queueMutex_);
+    queueCv_.wait(queueLock, [this]() { return pending_.empty() && !writing_; });
+}
+
+void SnapshotWriter::append(Stream &stream, const void *data, size_t size) {
+    if (stream.buffer.size() + size > bufferBytes_)
+        submit(stream);
+    const char *bytes = static_cast<const char*>(data);
+    stream.buffer.insert(stream.buffer.end(), bytes, bytes + size);
+}
+
+void SnapshotWriter::submit(Stream &stream) {
+    if (stream.buffer.empty())
+        return;
+    std::vector<char> fresh;
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        // Apply backpressure so a slow disk cannot make staged data grow without bound.
+        queueCv_.wait(lock, [this]() { return pending_.size() < kMaxPendingBuffers; });
+        pending_.push_back(FlushJob{&stream, std::move(stream.buffer)});
+        if (!freeBuffers_.empty()) {
+            fresh = std::move(freeBuffers_.back());
+            freeBuffers_.pop_back();
+        }
+    }
+    queueCv_.notify_all();
+    fresh.clear();
+    fresh.reserve(bufferBytes_);
+    stream.buffer = std::move(fresh);
+}
+
+void SnapshotWriter::flusherLoop() {
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    while (true) {
+        queueCv_.wait(lock, [this]() { return stopping_ || !pending_.empty(); });
+        if (pending_.empty() && stopping_)
+            return;
+        FlushJob job = std::move(pending_.front());
+        pending_.pop_front();
+        writing_ = true;
+        lock.unlock();
+
+        // Files that failed to open were already reported by the constructor.
+        std::ofstream &ofs = job.stream->ofs;
+        if (ofs.is_open() && !(ofs.write(job.data.data(), static_cast<std::streamsize>(job.data.size())) && ofs.flush())) {
+            std::lock_guard<std::mutex> lockOut(coutMutex);
+            std::cerr << "Error writing to file: " << job.stream->path << std::endl;
+            ofs.clear();
+        }
+
+        lock.lock();
+        writing_ = false;
+        job.data.clear();
+        freeBuffers_.push_back(std::move(job.data));
+        queueCv_.notify_all();
+    }
+}
@@ -0,0 +1,131 @@
+#include "ZoneMap.h"
+#include "SnapshotFilter.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+void appendZoneMapHeader(uint32_t zoneRecords, std::vector<char> &out) {
+    const uint32_t reserved = 0;
+    const char *bytes = reinterpret_cast<const char*>(&zoneRecords);
+    out.insert(out.end(), kZoneMapMagic, kZoneMapMagic + sizeof(kZoneMapMagic));
+    out.insert(out.end(), bytes, bytes + sizeof(zoneRecords));
+    bytes = reinterpret_cast<const char*>(&reserved);
+    out.insert(out.end(), bytes, bytes + sizeof(reserved));
+}
+
+ZoneBuilder::ZoneBuilder() {
+    reset();
+}
+
+void ZoneBuilder::reset() {
+    std::memset(&zone_, 0, sizeof(zone_));
+    zone_.firstEpoch = std::numeric_limits<int64_t>::max();
+    zone_.lastEpoch = std::numeric_limits<int64_t>::min();
+    std::fill(zone_.min, zone_.min + kSnapshotColumns, std::numeric_limits<double>::infinity());
+    std::fill(zone_.max, zone_.max + kSnapshotColumns, -std::numeric_limits<double>::infinity());
+}
+
+void ZoneBuilder::add(const Snapshot &snap) {
+    auto note = [this](int column, double value) {
+        zone_.min[column] = std::min(zone_.min[column], value);
+        zone_.max[column] = std::max(zone_.max[column], value);
+    };
+    // A negative price means "no value" and is left out, as in SnapshotFilter.
+    auto notePrice = [&note](int column, double price) {
+        if (price >= 0.0)
+            note(column, price);
+    };
+    zone_.firstEpoch = std::min(zone_.firstEpoch, snap.epoch);
+    zone_.lastEpoch = std::max(zone_.lastEpoch, snap.epoch);
+    for (int level = 0; level < 5; ++level) {
+        notePrice(ColBid1p + level, snap.bidPrices[level]);
+        notePrice(ColAsk1p + level, snap.askPrices[level]);
+        note(ColBid1q + level, snap.bidQuantities[level]);
+        note(ColAsk1q + level, snap.askQuantities[level]);
+    }
+    notePrice(ColLastTradePrice, snap.lastTradePrice);
+    note(ColLastTradeQuantity, snap.lastTradeQuantity);
+    if (snap.bidPrices[0] >= 0.0 && snap.askPrices[0] >= 0.0)
+        note(kZoneSpread, snap.askPrices[0] - snap.bidPrices[0]);
+    ++zone_.records;
+}
+
+ZoneStats ZoneBuilder::take() {
+    ZoneStats zone = zone_;
+    reset();
+    return zone;
+}
+
+bool ZoneMap::load(const char *data, size_t size) {
+    zones_.clear();
+    if (size < kZoneMapHeaderBytes || std::memcmp(data, kZoneMapMagic, sizeof(kZoneMapMagic)) != 0)
+        return false;
+    // A torn last zone (the writer was interrupted) is ignored; its rows count as after the map.
+    const size_t count = (size - kZoneMapHeaderBytes) / sizeof(ZoneStats);
+    std::vector<ZoneStats> zones(count);
+    if (count > 0)
+        std::memcpy(zones.data(), data + kZoneMapHeaderBytes, count * sizeof(ZoneStats));
+    for (size_t i = 0; i < count; ++i) {
+        if (zones[i].records == 0 || zones[i].firstEpoch > zones[i].lastEpoch)
+            return false;
+        // Equal epochs may straddle a boundary, but a zone must not reach back into the previous one.
+        if (i > 0 && zones[i].firstEpoch < zones[i - 1].lastEpoch)
+            return false;
+    }
+    zones_ = std::move(zones);
+    return true;
+}
+
+bool ZoneMap::readFile(const std::string &path) {
+    zones_.clear();
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open())
+        return false;
+    std::vector<char> data(static_cast<size_t>(ifs.tellg()));
+    ifs.seekg(0, std::ios::beg);
+    if (!data.empty() && !ifs.read(data.data(), static_cast<std::streamsize>(data.size())))
+        return false;
+    return load(data.data(), data.size());
+}
+
+int64_t ZoneMap::records() const {
+    int64_t records = 0;
+    for (const ZoneStats &zone : zones_)
+        records += zone.records;
+    return records;
+}
+
+void ZoneMap::matchRecords(int64_t records) {
+    if (records >= 0 && this->records() != records)
+        zones_.clear();
+}
+
+std::vector<std::pair<int64_t, int64_t>> ZoneMap::candidateRanges(const SnapshotFilter &filter, int64_t startEpoch,
+                                                                  int64_t endEpoch) const {
+    std::vector<std::pair<int64_t, int64_t>> ranges;
+    // Adds [from, to]; joins it to the last range when the zone before was read
+    // too, or when they share an epoch (a row must not be read twice).
+    bool previousRead = false;
+    auto addRange = [&](int64_t from, int64_t to) {
+        if (!ranges.empty() && (previousRead || from <= ranges.back().second))
+            ranges.back().second = std::max(ranges.back().second, to);
+        else
+            ranges.emplace_back(from, to);
+    };
+    for (const ZoneStats &zone : zones_) {
+        if (zone.lastEpoch < startEpoch)
+            continue;
+        if (zone.firstEpoch > endEpoch)
+            return ranges;
+        const bool read = filter.mayMatch(zone);
+        if (read)
+            addRange(std::max(zone.firstEpoch, startEpoch), std::min(zone.lastEpoch, endEpoch));
+        previousRead = read;
+    }
+    // Rows past the map: from the last zone's final epoch (rows may repeat it) onwards.
+    const int64_t tail = zones_.empty() ? startEpoch : std::max(zones_.back().lastEpoch, startEpoch);
+    if (tail <= endEpoch)
+        addRange(tail, endEpoch);
+    return ranges;
+}
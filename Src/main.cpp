@@ -1,7 +1,13 @@
 #include "BookProcessor.h"
 #include "QueryEngine.h"
+#include "DepthStore.h"
+#include "QueryServer.h"
 #include "Progress.h"
+#include "BookBenchmark.h"
+#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <csignal>
 #include <iostream>
 #include <thread>
 #include <atomic>
@@ -12,6 +18,10 @@
 #include <iomanip>
 #include <fstream>
 #include <stdexcept>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 using namespace std;
 using namespace std::chrono;
@@ -27,6 +37,236 @@ vector<string> split(const string &s, char delimiter) {
     return tokens;
 }
 
+// Parses the number of a "--name=<n>" option; reports the option and returns false if it is malformed.
+template <typename T>
+bool parseOptionNumber(const string &arg, T &value) {
+    const char *begin = arg.data() + arg.find('=') + 1;
+    const char *end = arg.data() + arg.size();
+    T parsed{};
+    auto result = from_chars(begin, end, parsed);
+    if (begin == end || result.ec != errc() || result.ptr != end) {
+        cerr << "Error: Invalid number in option \"" << arg << "\"" << endl;
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// Parses "--name=value" options for processing mode; returns false on an unknown or malformed option.
+bool parseProcessorOptions(int argc, char* argv[], ProcessorOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--parser=stream")
+            options.parserMode = ParserMode::Stream;
+        else if (arg == "--parser=mmap")
+            options.parserMode = ParserMode::Mapped;
+        else if (arg.rfind("--parse-threads=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.parseThreads))
+                return false;
+        }
+        else if (arg.rfind("--shards=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.shardThreads))
+                return false;
+        }
+        else if (arg == "--book=map")
+            options.bookType = BookType::Map;
+        else if (arg == "--book=ladder")
+            options.bookType = BookType::Ladder;
+        else if (arg == "--order-ids=string")
+            options.orderIdMode = OrderIdMode::String;
+        else if (arg == "--order-ids=int")
+            options.orderIdMode = OrderIdMode::Integer;
+        else if (arg == "--snapshots=all")
+            options.changedSnapshotsOnly = false;
+        else if (arg == "--snapshots=changed")
+            options.changedSnapshotsOnly = true;
+        else if (arg == "--format=fixed")
+            options.storage.format = SnapshotFormat::Fixed;
+        else if (arg == "--format=delta")
+            options.storage.format = SnapshotFormat::Delta;
+        else if (arg == "--format=columnar")
+            options.storage.format = SnapshotFormat::Columnar;
+        else if (arg == "--format=ticks")
+            options.storage.format = SnapshotFormat::Ticks;
+        else if (arg.rfind("--price-ticks=", 0) == 0) {
+            if (!options.priceScales.parse(arg.substr(14), cerr))
+                return false;
+        }
+        else if (arg.rfind("--row-group-rows=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.storage.rowGroupRows))
+                return false;
+        }
+        else if (arg.rfind("--keyframe-records=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.storage.keyframeRecords))
+                return false;
+        }
+        else if (arg.rfind("--keyframe-ns=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.storage.keyframeNanos))
+                return false;
+        }
+        else if (arg.rfind("--index-block=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.storage.indexBlockRecords))
+                return false;
+        }
+        else if (arg.rfind("--zone-records=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.storage.zoneRecords))
+                return false;
+        }
+        else if (arg.rfind("--depth=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.storage.depth))
+                return false;
+        }
+        else if (arg == "--journal")
+            options.journal = true;
+        else if (arg.rfind("--checkpoint-events=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.checkpointEvents))
+                return false;
+        }
+        else if (arg == "--resume")
+            options.resume = true;
+        else if (arg.rfind("--resume-bytes=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.resumeBytes))
+                return false;
+        }
+        else {
+            cerr << "Error: Unknown option \"" << arg << "\"" << endl;
+            return false;
+        }
+    }
+    SnapshotLayout layout;
+    if (!snapshotLayout(options.storage.depth, layout)) {
+        cerr << "Error: --depth must be one of 1, 5, 10, 20." << endl;
+        return false;
+    }
+    if (options.storage.depth != kDefaultDepth && options.storage.format != SnapshotFormat::Fixed) {
+        cerr << "Error: --depth other than " << kDefaultDepth << " needs --format=fixed." << endl;
+        return false;
+    }
+    if (options.storage.format == SnapshotFormat::Ticks && options.priceScales.defaultTicksPerUnit <= 0) {
+        cerr << "Error: --format=ticks needs a default scale for every symbol (--price-ticks=<n>[,<symbol>:<n>,...])."
+             << endl;
+        return false;
+    }
+    if (options.parserMode == ParserMode::Stream && (options.parseThreads > 0 || options.shardThreads > 0)) {
+        cerr << "Error: --parser=stream cannot be combined with --parse-threads or --shards (they use the in-place parser)."
+             << endl;
+        return false;
+    }
+    if (options.resume && options.shardThreads > 0) {
+        cerr << "Error: --resume cannot be combined with --shards." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Options of the query command.
+struct QueryOptions {
+    ReaderMode readerMode = ReaderMode::Mapped;
+    size_t queryThreads = max(thread::hardware_concurrency(), 1u);  ///< Defaults to one per core.
+    size_t limit = 0;
+    OutputFormat format = OutputFormat::Text;
+    string outPath;  ///< Output file; empty for stdout.
+    string where;    ///< Filter expression (see SnapshotFilter); empty for all rows.
+};
+
+// Splits query-mode arguments into positional ones and "--" options; returns
+// false on an unknown option or fewer than minPositional positional arguments.
+bool parseQueryArgs(int argc, char* argv[], vector<string> &positional, QueryOptions &options,
+                    size_t minPositional = 3) {
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--reader=stream")
+            options.readerMode = ReaderMode::Stream;
+        else if (arg == "--reader=mmap")
+            options.readerMode = ReaderMode::Mapped;
+        else if (arg.rfind("--threads=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.queryThreads))
+                return false;
+        }
+        else if (arg.rfind("--limit=", 0) == 0) {
+            if (!parseOptionNumber(arg, options.limit))
+                return false;
+        }
+        else if (arg == "--output=text")
+            options.format = OutputFormat::Text;
+        else if (arg == "--output=binary")
+            options.format = OutputFormat::Binary;
+        else if (arg.rfind("--out=", 0) == 0)
+            options.outPath = arg.substr(6);
+        else if (arg.rfind("--where=", 0) == 0)
+            options.where = arg.substr(8);
+        else if (arg.rfind("--", 0) == 0) {
+            cerr << "Error: Unknown option \"" << arg << "\"" << endl;
+            return false;
+        }
+        else
+            positional.push_back(arg);
+    }
+    return positional.size() >= minPositional;
+}
+
+// Parses the lookup epochs of the asof command: a comma-separated list, or
+// "@<file>" with one epoch per line. Returns them sorted.
+bool parseAsOfEpochs(const string &arg, vector<int64_t> &epochs) {
+    vector<string> values;
+    if (arg.rfind("@", 0) == 0) {
+        ifstream ifs(arg.substr(1));
+        if (!ifs.is_open()) {
+            cerr << "Error: Failed to open epoch file: " << arg.substr(1) << endl;
+            return false;
+        }
+        string line;
+        while (getline(ifs, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+                values.push_back(line);
+        }
+    } else {
+        values = split(arg, ',');
+    }
+    try {
+        for (const auto &value : values) {
+            size_t used = 0;
+            epochs.push_back(stoll(value, &used));
+            if (used != value.size())
+                throw invalid_argument(value);
+        }
+    } catch (const std::exception &e) {
+        cerr << "Error: Invalid epoch value. " << e.what() << endl;
+        return false;
+    }
+    sort(epochs.begin(), epochs.end());
+    return true;
+}
+
+// Opens the output of the query commands: stdout (switched to binary mode
+// where that matters) or the --out file. Returns nullptr on failure.
+ostream *openQueryOutput(const QueryOptions &options, ofstream &outFile) {
+    if (!options.outPath.empty()) {
+        outFile.open(options.outPath, ios::binary | ios::trunc);
+        if (!outFile.is_open()) {
+            cerr << "Error: Failed to open output file: " << options.outPath << endl;
+            return nullptr;
+        }
+        return &outFile;
+    }
+#ifdef _WIN32
+    if (options.format == OutputFormat::Binary)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    return &cout;
+}
+
+// Server of the serve command, stopped by SIGINT/SIGTERM.
+static atomic<QueryServer*> g_server(nullptr);
+
+void stopServer(int) {
+    QueryServer *server = g_server.load();
+    if (server)
+        server->stop();
+}
+
 uint64_t getFileSize(const string &filePath) {
     ifstream ifs(filePath, ios::binary | ios::ate);
     if (!ifs.is_open()) return 0;
@@ -36,9 +276,15 @@ uint64_t getFileSize(const string &filePath) {
 }
 
 int main(int argc, char* argv[]) {
+    vector<string> queryArgs;
+    QueryOptions queryOptions;
     try {
-        // Process raw data mode if no command-line arguments are given.
-        if (argc == 1) {
+        // Process raw data mode if no command (only "--" options) is given.
+        if (argc == 1 || string(argv[1]).rfind("--", 0) == 0) {
+            ProcessorOptions options;
+            if (!parseProcessorOptions(argc, argv, options))
+                return 1;
+
             // List of raw order log files.
             vector<string> files = {"Data/SCH.log", "Data/SCS.log"};
             uint64_t total = 0;
@@ -48,7 +294,7 @@ int main(int argc, char* argv[]) {
             g_totalBytes = total;  // Set total bytes for progress tracking.
 
             // Process the raw data files.
-            BookProcessor processor(files);
+            BookProcessor processor(files, options);
 
             // Start a loading bar thread to display progress.
             atomic<bool> done(false);
@@ -83,9 +329,9 @@ int main(int argc, char* argv[]) {
             cout << "Total processing time: " << duration << " seconds." << endl;
         }
         // Query mode: the first argument is "query".
-        else if (argc >= 5 && string(argv[1]) == "query") {
+        else if (string(argv[1]) == "query" && parseQueryArgs(argc, argv, queryArgs, queryOptions)) {
             // Parse symbols.
-            string symbolsArg = argv[2];
+            string symbolsArg = queryArgs[0];
             vector<string> symbols;
             if (symbolsArg == "ALL")
                 symbols = {"SCH", "SCS"};
@@ -95,8 +341,8 @@ int main(int argc, char* argv[]) {
             // Parse epoch values with error checking.
             int64_t startEpoch = 0, endEpoch = 0;
             try {
-                startEpoch = stoll(argv[3]);
-                endEpoch = stoll(argv[4]);
+                startEpoch = stoll(queryArgs[1]);
+                endEpoch = stoll(queryArgs[2]);
             } catch (const std::exception &e) {
                 cerr << "Error: Invalid epoch value. " << e.what() << endl;
                 return 1;
@@ -104,8 +350,8 @@ int main(int argc, char* argv[]) {
 
             // Parse optional selective fields.
             unordered_set<string> selectedFields;
-            if (argc >= 6) {
-                vector<string> fields = split(argv[5], ',');
+            if (queryArgs.size() >= 4) {
+                vector<string> fields = split(queryArgs[3], ',');
                 for (const auto &f : fields)
                     selectedFields.insert(f);
             }
@@ -116,23 +362,226 @@ int main(int argc, char* argv[]) {
             criteria.endEpoch = endEpoch;
             criteria.symbols = symbols;
             criteria.selectedFields = selectedFields;
+            criteria.limit = queryOptions.limit;
+            if (!criteria.filter.parse(queryOptions.where, cerr))
+                return 1;
+
+            // Files written with --depth are read through the templated depth reader.
+            const int depth = detectQueryDepth(symbols, cerr);
+            if (depth == 0)
+                return 1;
+            if (depth != kDefaultDepth && !queryOptions.where.empty()) {
+                cerr << "Error: --where needs snapshots of depth " << kDefaultDepth << "." << endl;
+                return 1;
+            }
+
+            ofstream outFile;
+            ostream *output = openQueryOutput(queryOptions, outFile);
+            if (!output)
+                return 1;
+            ostream &out = *output;
+
+            // Execute the query, printing each snapshot as it arrives; stop if the output goes away.
+            SnapshotPrinter printer(criteria, out, cerr, queryOptions.format, depth);
+            printer.setPriceDecimals(queryPriceDecimals(symbols));
+            if (printer.printHeader()) {
+                if (depth == kDefaultDepth) {
+                    QueryEngine engine(symbols, queryOptions.readerMode, queryOptions.queryThreads);
+                    engine.query(criteria, [&printer, &out](const Snapshot &snap) {
+                        printer.print(snap);
+                        return static_cast<bool>(out);
+                    });
+                } else {
+                    withDepth(depth, [&](auto d) {
+                        queryDepth<decltype(d)::value>(criteria, [&printer, &out](const auto &snap) {
+                            printer.print(snap);
+                            return static_cast<bool>(out);
+                        }, cerr);
+                    });
+                }
+            }
+            printer.flush();
+            if (!out) {
+                cerr << "Error: Failed to write query output." << endl;
+                return 1;
+            }
+        }
+        // As-of mode: the latest snapshot of each symbol at or before each of many epochs.
+        else if (string(argv[1]) == "asof" && parseQueryArgs(argc, argv, queryArgs, queryOptions, 2)) {
+            if (!queryOptions.where.empty()) {
+                cerr << "Error: --where applies to the query command only." << endl;
+                return 1;
+            }
+            AsOfCriteria criteria;
+            criteria.symbols = (queryArgs[0] == "ALL") ? vector<string>{"SCH", "SCS"} : split(queryArgs[0], ',');
+            if (!parseAsOfEpochs(queryArgs[1], criteria.epochs))
+                return 1;
+            if (queryArgs.size() >= 3) {
+                for (const auto &f : split(queryArgs[2], ','))
+                    criteria.selectedFields.insert(f);
+            }
+
+            ofstream outFile;
+            ostream *output = openQueryOutput(queryOptions, outFile);
+            if (!output)
+                return 1;
+            ostream &out = *output;
 
-            // Execute query and print results.
-            QueryEngine engine(symbols);
-            vector<Snapshot> results = engine.query(criteria);
-            engine.printSnapshots(results, criteria);
+            // The printer only needs the field selection.
+            QueryCriteria fields;
+            fields.selectedFields = criteria.selectedFields;
+            QueryEngine engine(criteria.symbols, queryOptions.readerMode, queryOptions.queryThreads);
+            SnapshotPrinter printer(fields, out, cerr, queryOptions.format);
+            printer.setPriceDecimals(queryPriceDecimals(criteria.symbols));
+            if (printer.printHeader(true)) {
+                size_t printed = 0;
+                engine.asOf(criteria, [&](size_t, size_t time, const Snapshot &snap) {
+                    printer.print(snap, criteria.epochs[time]);
+                    return static_cast<bool>(out) && ++printed != queryOptions.limit;
+                });
+            }
+            printer.flush();
+            if (!out) {
+                cerr << "Error: Failed to write query output." << endl;
+                return 1;
+            }
+        }
+        // Bars mode: time-bucketed aggregates per symbol.
+        else if (string(argv[1]) == "bars" && parseQueryArgs(argc, argv, queryArgs, queryOptions, 4)) {
+            if (!queryOptions.where.empty()) {
+                cerr << "Error: --where applies to the query command only." << endl;
+                return 1;
+            }
+            AggregateCriteria criteria;
+            criteria.symbols = (queryArgs[0] == "ALL") ? vector<string>{"SCH", "SCS"} : split(queryArgs[0], ',');
+            try {
+                criteria.startEpoch = stoll(queryArgs[1]);
+                criteria.endEpoch = stoll(queryArgs[2]);
+                criteria.bucketNanos = stoll(queryArgs[3]);
+            } catch (const std::exception &e) {
+                cerr << "Error: Invalid epoch value. " << e.what() << endl;
+                return 1;
+            }
+            if (!parseAggregates(queryArgs.size() >= 5 ? split(queryArgs[4], ',') : vector<string>(),
+                                 criteria.aggregates, cerr))
+                return 1;
+
+            ofstream outFile;
+            ostream *output = openQueryOutput(queryOptions, outFile);
+            if (!output)
+                return 1;
+            ostream &out = *output;
+
+            QueryEngine engine(criteria.symbols, queryOptions.readerMode, queryOptions.queryThreads);
+            BarPrinter printer(criteria.aggregates, out, queryOptions.format);
+            printer.printHeader();
+            size_t printed = 0;
+            engine.aggregate(criteria, [&](const Bar &bar) {
+                printer.print(bar);
+                return static_cast<bool>(out) && ++printed != queryOptions.limit;
+            });
+            printer.flush();
+            if (!out) {
+                cerr << "Error: Failed to write query output." << endl;
+                return 1;
+            }
+        }
+        // Depth mode: rebuild a symbol's full book at an epoch from its journal.
+        else if (string(argv[1]) == "depth" && argc >= 4) {
+            bool orders = false;
+            for (int i = 4; i < argc; ++i) {
+                if (string(argv[i]) == "--orders") {
+                    orders = true;
+                } else {
+                    cerr << "Error: Unknown option \"" << argv[i] << "\"" << endl;
+                    return 1;
+                }
+            }
+            int64_t epoch = 0;
+            try {
+                epoch = stoll(argv[3]);
+            } catch (const std::exception &e) {
+                cerr << "Error: Invalid epoch value. " << e.what() << endl;
+                return 1;
+            }
+            BookState state;
+            if (!rebuildBook(argv[2], epoch, state, cerr))
+                return 1;
+            printBookState(argv[2], epoch, state, orders, cout);
+        }
+        // Serve mode: keep the snapshot files mapped and answer queries over a Unix domain socket.
+        else if (string(argv[1]) == "serve") {
+            vector<string> symbols = {"SCH", "SCS"};
+            string socketPath = "orderbook.sock";
+            for (int i = 2; i < argc; ++i) {
+                string arg = argv[i];
+                if (arg.rfind("--socket=", 0) == 0)
+                    socketPath = arg.substr(9);
+                else if (arg.rfind("--threads=", 0) == 0) {
+                    if (!parseOptionNumber(arg, queryOptions.queryThreads))
+                        return 1;
+                }
+                else if (arg.rfind("--", 0) == 0) {
+                    cerr << "Error: Unknown option \"" << arg << "\"" << endl;
+                    return 1;
+                }
+                else if (arg != "ALL")
+                    symbols = split(arg, ',');
+            }
+            QueryServer server(symbols, queryOptions.queryThreads);
+            if (!server.start(socketPath))
+                return 1;
+            g_server.store(&server);
+            signal(SIGINT, stopServer);
+            signal(SIGTERM, stopServer);
+            cout << "Serving queries for " << symbols.size() << " symbol(s) on " << socketPath
+                 << " (Ctrl+C to stop)" << endl;
+            server.run();
+            g_server.store(nullptr);
+        }
+        // Benchmark mode: compare the order book implementations on the raw logs.
+        else if (string(argv[1]) == "bench") {
+            vector<string> files = {"Data/SCH.log", "Data/SCS.log"};
+            if (argc >= 3)
+                files = split(argv[2], ',');
+            if (!runBookBenchmark(files, 5))
+                return 1;
         }
         // Print usage information if arguments are incorrect.
         else {
             cout << "Error:\n"
                  << "Correct Usage:\n"
-                 << "  " << argv[0] << "                   // Process raw data\n"
-                 << "  " << argv[0] << " query <symbols> <startEpoch> <endEpoch> [<fields>]\n"
+                 << "  " << argv[0] << " [<options>]       // Process raw data\n"
+                 << "     <options>: --parser=mmap|stream, --parse-threads=<n>, --shards=<n>,\n"
+                 << "                --book=map|ladder, --order-ids=string|int, --snapshots=all|changed,\n"
+                 << "                --format=fixed|delta|columnar|ticks, --keyframe-records=<n>, --keyframe-ns=<ns>,\n"
+                 << "                --row-group-rows=<n>, --index-block=<n>, --zone-records=<n>,\n"
+                 << "                --journal, --checkpoint-events=<n>   // also keep an event log + book checkpoints\n"
+                 << "                --resume, --resume-bytes=<n>   // continue each file from its <file>.resume checkpoint\n"
+                 << "                --depth=1|5|10|20   // levels per side (other than 5: fixed format, query command only)\n"
+                 << "                --price-ticks=<n>|<symbol>:<n>,...   // fixed-point prices, n ticks per unit (100 = 0.01);\n"
+                 << "                                  // refuses off-grid prices; --format=ticks stores int32 ticks\n"
+                 << "  " << argv[0] << " bench [<files>]   // Benchmark order book implementations\n"
+                 << "  " << argv[0] << " serve [<symbols>] [--socket=<path>] [--threads=<n>]   // Answer queries over a Unix domain socket\n"
+                 << "  " << argv[0] << " query <symbols> <startEpoch> <endEpoch> [<fields>] [--reader=mmap|stream]\n"
+                 << "                [--threads=<n>]   // n symbols read in parallel (default: one per core)\n"
+                 << "                [--limit=<n>]     // stop after the first n snapshots\n"
+                 << "                [--output=text|binary] [--out=<file>]   // binary: header + row structs (see QueryEngine.h)\n"
+                 << "                [--where=<filter>]   // e.g. \"ask1p-bid1p>0.05 && bid1q>10\" (see SnapshotFilter.h)\n"
+                 << "  " << argv[0] << " asof <symbols> <epochs> [<fields>] [<query options>]   // Latest snapshot at or\n"
+                 << "                before each epoch; <epochs>: comma-separated list or @<file> (one per line)\n"
+                 << "  " << argv[0] << " bars <symbols> <startEpoch> <endEpoch> <bucketNs> [<aggregates>] [<query options>]\n"
+                 << "                // One row per symbol and time bucket; <aggregates>: comma-separated list from\n"
+                 << "                // count, midOpen, midHigh, midLow, midClose, open, high, low, close,\n"
+                 << "                // volume, vwap, spread, bidDepth, askDepth (default: all)\n"
+                 << "  " << argv[0] << " depth <symbol> <epoch> [--orders]   // Full book at an epoch, rebuilt from the\n"
+                 << "                journal of a --journal run; --orders also lists every resting order\n"
                  << "     <symbols>: comma-separated list (or ALL)\n"
                  << "     <fields>: comma-separated list from:\n"
                  << "         symbol, epoch, bid1p, bid1q, bid2p, bid2q, bid3p, bid3q,\n"
                  << "         bid4p, bid4q, bid5p, bid5q, ask1p, ask1q, ask2p, ask2q,\n"
-                 << "         ask3p, ask3q, ask4p, ask4q, ask5p, ask5q, lastTradePrice, lastTradeQuantity\n";
+                 << "         ask3p, ask3q, ask4p, ask4q, ask5p, ask5q, lastTradePrice, lastTradeQuantity\n"
+                 << "         (bid1p..bid<N>q and ask1p..ask<N>q for files written with --depth=<N>)\n";
         }
     } catch (const std::exception &ex) {
         cerr << "Unexpected error: " << ex.what() << endl;
@@ -8,11 +8,36 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#ifndef _WIN32
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #include "OrderBook.h"
+#include "PriceLadderBook.h"
+#include "OrderTable.h"
 #include "Order.h"
 #include "Snapshot.h"
 #include "QueryEngine.h"
+#include "QueryServer.h"
+#include "SnapshotIndex.h"
+#include "SnapshotMerger.h"
+#include "BarAggregator.h"
+#include "SnapshotFilter.h"
+#include "ZoneMap.h"
+#include "BookJournal.h"
+#include "DepthStore.h"
 #include "BookProcessor.h"
+#include "SnapshotWriter.h"
+#include "LogParser.h"
+#include "PriceScale.h"
 
 using std::cout;
 using std::endl;
@@ -35,6 +60,28 @@ bool compareAskLevel(const Snapshot &snap, int index, double expectedPrice, int
     return (snap.askPrices[index] == expectedPrice && snap.askQuantities[index] == expectedQuantity);
 }
 
+// Helper: Field-wise snapshot equality (ignores struct padding).
+bool sameSnapshot(const Snapshot &a, const Snapshot &b) {
+    if (std::strncmp(a.symbol, b.symbol, sizeof(a.symbol)) != 0 || a.epoch != b.epoch)
+        return false;
+    for (int i = 0; i < 5; ++i) {
+        if (!compareBidLevel(a, i, b.bidPrices[i], b.bidQuantities[i]) ||
+            !compareAskLevel(a, i, b.askPrices[i], b.askQuantities[i]))
+            return false;
+    }
+    return a.lastTradePrice == b.lastTradePrice && a.lastTradeQuantity == b.lastTradeQuantity;
+}
+
+// Helper: Reads every snapshot of a ".snap" file.
+vector<Snapshot> readAllSnapshots(const string &filename) {
+    vector<Snapshot> snaps;
+    std::ifstream ifs(filename, std::ios::binary);
+    Snapshot snap;
+    while (readBinarySnapshot(ifs, snap))
+        snaps.push_back(snap);
+    return snaps;
+}
+
 // Helper: Write a vector of strings to a file.
 void writeToFile(const string &filename, const vector<string> &lines) {
     std::ofstream ofs(filename);
@@ -45,6 +92,12 @@ void writeToFile(const string &filename, const vector<string> &lines) {
     ofs.close();
 }
 
+// Helper: The whole content of a file ("" if it does not exist).
+string readFileBytes(const string &filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    return string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
 // ----------------------------------------------------------------------
 // Helper: Create an Index File from a Snapshot File
 // ----------------------------------------------------------------------
@@ -161,7 +214,197 @@ void testOrderBook() {
             assert(compareBidLevel(snap, i, -1.0, 0));
     }
     
-    cout << "OrderBook tests passed (1/12)!" << endl << endl;
+    cout << "OrderBook tests passed (1/37)!" << endl << endl;
+}
+
+// ----------------------------------------------------------------------
+// PriceLadderBook Tests
+// ----------------------------------------------------------------------
+void testPriceLadderBook() {
+    cout << "Running PriceLadderBook tests..." << endl;
+    
+    // Test 1: Same results as OrderBook for NEW, CANCEL and TRADE.
+    {
+        PriceLadderBook ob("TEST");
+        Order buy1 = {0, "b1", "TEST", OrderSide::BUY, OrderCategory::NEW, 9.6, 4};
+        Order buy2 = {0, "b2", "TEST", OrderSide::BUY, OrderCategory::NEW, 9.5, 6};
+        Order sell1 = {0, "s1", "TEST", OrderSide::SELL, OrderCategory::NEW, 9.7, 5};
+        Order sell2 = {0, "s2", "TEST", OrderSide::SELL, OrderCategory::NEW, 9.7, 10};
+        ob.processOrder(buy1);
+        ob.processOrder(buy2);
+        ob.processOrder(sell1);
+        ob.processOrder(sell2);
+        Snapshot snap = ob.getSnapshot(1);
+        assert(compareBidLevel(snap, 0, 9.6, 4));
+        assert(compareBidLevel(snap, 1, 9.5, 6));
+        assert(compareAskLevel(snap, 0, 9.7, 15));
+        assert(compareAskLevel(snap, 1, -1.0, 0));
+        
+        Order cancelBuy = {1, "b1", "TEST", OrderSide::BUY, OrderCategory::CANCEL, 9.6, 4};
+        Order tradeSell = {2, "s1", "TEST", OrderSide::SELL, OrderCategory::TRADE, 9.7, 4};
+        ob.processOrder(cancelBuy);
+        ob.processOrder(tradeSell);
+        snap = ob.getSnapshot(2);
+        assert(compareBidLevel(snap, 0, 9.5, 6));
+        for (int i = 1; i < 5; ++i)
+            assert(compareBidLevel(snap, i, -1.0, 0));
+        assert(compareAskLevel(snap, 0, 9.7, 11));
+        assert(snap.lastTradePrice == 9.7);
+        assert(snap.lastTradeQuantity == 4);
+    }
+    
+    // Test 2: Prices far apart (beyond the ladder window) and a drifting touch
+    // must match OrderBook level by level.
+    {
+        OrderBook reference("TEST");
+        PriceLadderBook ladder("TEST");
+        // Prices in cents, converted the way the parser would produce them.
+        const int cents[] = {10000, 10001, 9999, 500000, 5, 10050, 250025, 9900, 10002, 1};
+        for (int i = 0; i < 400; ++i) {
+            double price = (cents[i % 10] + i / 10) / 100.0;
+            OrderSide side = (i % 3 == 0) ? OrderSide::SELL : OrderSide::BUY;
+            OrderCategory category = (i % 4 == 3) ? OrderCategory::CANCEL : OrderCategory::NEW;
+            Order order = {i, std::to_string(i % 37), "TEST", side, category, price, 1 + i % 7};
+            reference.processOrder(order);
+            ladder.processOrder(order);
+            assert(sameSnapshot(reference.getSnapshot(i), ladder.getSnapshot(i)));
+        }
+    }
+    
+    // Test 3: A sub-cent price is refused instead of merging into the neighbouring level.
+    {
+        PriceLadderBook ladder("TEST");
+        Order order = {1, "1", "TEST", OrderSide::BUY, OrderCategory::NEW, 100.01, 5};
+        ladder.processOrder(order);
+        const Snapshot before = ladder.getSnapshot(2);
+        order = {2, "2", "TEST", OrderSide::BUY, OrderCategory::NEW, 100.005, 7};
+        ladder.processOrder(order);
+        assert(!ladder.visibleChanged() && sameSnapshot(ladder.getSnapshot(2), before));
+        assert(before.bidPrices[0] == 100.01 && before.bidQuantities[0] == 5 && before.bidPrices[1] == -1.0);
+    }
+    
+    cout << "PriceLadderBook tests passed (2/37)!" << endl << endl;
+}
+
+// ----------------------------------------------------------------------
+// OrderTable and Integer Order ID Tests
+// ----------------------------------------------------------------------
+void testOrderTable() {
+    cout << "Running OrderTable tests..." << endl;
+    
+    // Test 1: Insert, overwrite, find and erase across growth, checked against std::unordered_map.
+    {
+        OrderTable<int> table;
+        unordered_map<uint64_t, int> expected;
+        for (uint64_t i = 0; i < 5000; ++i) {
+            uint64_t id = 7374421476721609047ULL + (i % 1700) * 13;
+            if (i % 5 == 4) {
+                assert(table.erase(id) == (expected.erase(id) == 1));
+            } else {
+                table.insert(id, static_cast<int>(i));
+                expected[id] = static_cast<int>(i);
+            }
+            assert(table.size() == expected.size());
+        }
+        for (const auto &entry : expected) {
+            int *record = table.find(entry.first);
+            assert(record != nullptr && *record == entry.second);
+        }
+        size_t visited = 0;
+        table.forEach([&](uint64_t id, const int &record) {
+            assert(expected.at(id) == record);
+            ++visited;
+        });
+        assert(visited == expected.size());
+        assert(table.find(42) == nullptr);
+        assert(!table.erase(42));
+    }
+    
+    // Test 2: Numeric order ID conversion.
+    {
+        assert(numericOrderId("7374421476721609047") == 7374421476721609047ULL);
+        bool threw = false;
+        try { numericOrderId("b1"); } catch (const std::invalid_argument &) { threw = true; }
+        assert(threw);
+    }
+    
+    // Test 3: Both books give identical snapshots with integer and string order IDs.
+    {
+        OrderBook mapString("TEST");
+        OrderBook mapInteger("TEST", OrderIdMode::Integer);
+        PriceLadderBook ladderInteger("TEST", PriceLadderBook::kDefaultTicksPerUnit, OrderIdMode::Integer);
+        for (int i = 0; i < 600; ++i) {
+            double price = (10000 + (i * 7) % 23) / 100.0;
+            OrderSide side = (i % 2 == 0) ? OrderSide::SELL : OrderSide::BUY;
+            OrderCategory category = (i % 5 == 3) ? OrderCategory::CANCEL
+                                   : (i % 5 == 4) ? OrderCategory::TRADE : OrderCategory::NEW;
+            Order order = {i, std::to_string(1000000000000 + (i % 41)), "TEST", side, category, price, 1 + i % 9};
+            mapString.processOrder(order);
+            mapInteger.processOrder(order);
+            ladderInteger.processOrder(order);
+            assert(sameSnapshot(mapString.getSnapshot(i), mapInteger.getSnapshot(i)));
+            assert(sameSnapshot(mapString.getSnapshot(i), ladderInteger.getSnapshot(i)));
+        }
+    }
+    
+    cout << "OrderTable tests passed (3/37)!" << endl << endl;
+}
+
+// ----------------------------------------------------------------------
+// Visible Change Tracking Tests
+// ----------------------------------------------------------------------
+void testVisibleChangeTracking() {
+    cout << "Running Visible Change Tracking tests..." << endl;
+    
+    // Test 1: Deep levels, unknown IDs and repeated trades do not count as changes.
+    {
+        OrderBook ob("TEST");
+        for (int i = 0; i < 5; ++i) {
+            Order order = {i, "b" + std::to_string(i), "TEST", OrderSide::BUY, OrderCategory::NEW, 10.0 - i, 1};
+            ob.processOrder(order);
+            assert(ob.visibleChanged());
+        }
+        Order deep = {5, "deep", "TEST", OrderSide::BUY, OrderCategory::NEW, 1.0, 3};
+        ob.processOrder(deep);
+        assert(!ob.visibleChanged());
+        Order unknown = {6, "nope", "TEST", OrderSide::SELL, OrderCategory::CANCEL, 11.0, 1};
+        ob.processOrder(unknown);
+        assert(!ob.visibleChanged());
+        Order trade = {7, "nope", "TEST", OrderSide::SELL, OrderCategory::TRADE, 11.0, 1};
+        ob.processOrder(trade);
+        assert(ob.visibleChanged());
+        ob.processOrder(trade);
+        assert(!ob.visibleChanged());
+        // Removing a visible level uncovers the deep one.
+        Order cancel = {8, "b0", "TEST", OrderSide::BUY, OrderCategory::CANCEL, 10.0, 1};
+        ob.processOrder(cancel);
+        assert(ob.visibleChanged());
+        Snapshot snap = ob.getSnapshot(8);
+        assert(compareBidLevel(snap, 4, 1.0, 3));
+    }
+    
+    // Test 2: For both books the flag is set exactly when the snapshot content changes.
+    {
+        OrderBook mapBook("TEST");
+        PriceLadderBook ladderBook("TEST");
+        OrderBookBase *books[] = {&mapBook, &ladderBook};
+        for (OrderBookBase *book : books) {
+            Snapshot previous = book->getSnapshot(-1);
+            for (int i = 0; i < 800; ++i) {
+                double price = (10000 + (i * 37) % 61 - 30) / 100.0;
+                OrderSide side = (price < 100.0) ? OrderSide::BUY : OrderSide::SELL;
+                OrderCategory category = (i % 4 == 3) ? OrderCategory::CANCEL
+                                       : (i % 9 == 5) ? OrderCategory::TRADE : OrderCategory::NEW;
+                Order order = {i, std::to_string(i % 53), "TEST", side, category, price, 1 + i % 4};
+                book->processOrder(order);
+                Snapshot current = book->getSnapshot(-1);
+                assert(book->visibleChanged() == !sameSnapshot(previous, current));
+                previous = current;
+            }
+        }
+    }
+    
+    cout << "Visible Change Tracking tests passed (4/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -218,7 +461,7 @@ void testSnapshotSerialization() {
     for (int i = 0; i < 5; ++i)
         assert(compareAskLevel(snapRead, i, snap.askPrices[i], snap.askQuantities[i]));
     
-    cout << "Snapshot Serialization tests passed (2/12)!" << endl << endl;
+    cout << "Snapshot Serialization tests passed (5/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -274,7 +517,8 @@ void testQueryEngineDefaultOutput() {
     
     std::remove("TEST.snap");
     std::remove("TEST.idx");
-    cout << "QueryEngine Default Output Test passed (3/12)!" << endl << endl;
+    std::remove("TEST.zmap");
+    cout << "QueryEngine Default Output Test passed (6/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -325,7 +569,8 @@ void testQueryEngineSelectiveOutput() {
     
     std::remove("TEST.snap");
     std::remove("TEST.idx");
-    cout << "QueryEngine Selective Output Test passed (4/12)!" << endl << endl;
+    std::remove("TEST.zmap");
+    cout << "QueryEngine Selective Output Test passed (7/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -370,7 +615,8 @@ void testQueryEngineInvalidFields() {
     
     std::remove("TEST.snap");
     std::remove("TEST.idx");
-    cout << "QueryEngine Invalid Fields Test passed (5/12)!" << endl << endl;
+    std::remove("TEST.zmap");
+    cout << "QueryEngine Invalid Fields Test passed (8/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -436,10 +682,12 @@ void testQueryEngineMultiSymbol() {
     // Clean up temporary files.
     std::remove("TEST1.snap");
     std::remove("TEST1.idx");
+    std::remove("TEST1.zmap");
     std::remove("TEST2.snap");
     std::remove("TEST2.idx");
+    std::remove("TEST2.zmap");
     
-    cout << "QueryEngine Multi-Symbol Test passed (6/12)!" << endl << endl;
+    cout << "QueryEngine Multi-Symbol Test passed (9/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -482,7 +730,8 @@ void testQueryEngineNoResults() {
     
     std::remove("TEST.snap");
     std::remove("TEST.idx");
-    cout << "QueryEngine No Results Test passed (7/12)!" << endl << endl;
+    std::remove("TEST.zmap");
+    cout << "QueryEngine No Results Test passed (10/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -529,7 +778,1333 @@ void testIndexFileContent() {
     
     std::remove("IDXTEST.snap");
     std::remove("IDXTEST.idx");
-    cout << "Index File Content Test passed (8/12)!" << endl << endl;
+    std::remove("IDXTEST.zmap");
+    cout << "Index File Content Test passed (11/37)!" << endl << endl;
+}
+
+// ----------------------------------------------------------------------
+// LogParser Test
+// ----------------------------------------------------------------------
+void testLogParser() {
+    cout << "Running LogParser test..." << endl;
+    
+    // Padded, mixed tab/space columns as found in Data/*.log.
+    string line = "1609722840017828773 \t 7374421476721609047\tSCH       SELL NEW                 107.12      20\r";
+    OrderView view;
+    assert(parseOrderView(line.data(), line.data() + line.size(), view));
+    assert(view.epoch == 1609722840017828773LL);
+    assert(view.orderId == "7374421476721609047");
+    assert(view.symbol == "SCH");
+    assert(view.side == OrderSide::SELL);
+    assert(view.category == OrderCategory::NEW);
+    assert(view.price == 107.12);
+    assert(view.quantity == 20);
+    
+    Order order;
+    assignOrder(view, order);
+    assert(order.orderId == "7374421476721609047" && order.symbol == "SCH" && order.quantity == 20);
+    
+    // Integer ID mode converts the ID once and leaves the text empty; other IDs keep their text.
+    assignOrder(view, order, OrderIdMode::Integer);
+    assert(order.orderId.empty() && order.numericId == 7374421476721609047ULL && order.symbol == "SCH");
+    assert(orderIdText(order) == "7374421476721609047");
+    string named = "1609722840017828773 ORD-1 SCH SELL NEW 107.12 20";
+    assert(parseOrderView(named.data(), named.data() + named.size(), view));
+    assignOrder(view, order, OrderIdMode::Integer);
+    assert(order.orderId == "ORD-1" && orderIdText(order) == "ORD-1");
+    
+    // Missing fields, unknown categories and malformed numbers are rejected.
+    vector<string> invalid = {
+        "this is not a valid line",
+        "1609722840017828773 7374421476721609047 SCH SELL",
+        "1609722840017828773 7374421476721609047 SCH SELL MODIFY 107.12 20",
+        "1609722840017828773 7374421476721609047 SCH SELL NEW 107.1x 20"
+    };
+    for (const auto &bad : invalid)
+        assert(!parseOrderView(bad.data(), bad.data() + bad.size(), view));
+    
+    // Line splitting.
+    string text = "a b\n\nc";
+    const char *end = text.data() + text.size();
+    const char *first = findLineEnd(text.data(), end);
+    assert(first == text.data() + 3);
+    assert(findLineEnd(first + 1, end) == first + 1);
+    assert(findLineEnd(first + 2, end) == end);
+    
+    cout << "LogParser test passed (12/37)!" << endl << endl;
+}
+
+// ----------------------------------------------------------------------
+// SnapshotWriter Test
+// ----------------------------------------------------------------------
+void testSnapshotWriter() {
+    cout << "Running SnapshotWriter test..." << endl;
+    
+    std::remove("WRTEST.snap");
+    std::remove("WRTEST.idx");
+    std::remove("WRTEST.zmap");
+    const int count = 50;
+    {
+        // A tiny buffer forces many hand-offs to the background flush thread.
+        StorageOptions perSnapshotIndex;
+        perSnapshotIndex.indexBlockRecords = 0;
+        SnapshotWriter writer("WRTEST", perSnapshotIndex, 3 * sizeof(Snapshot));
+        assert(writer.isOpen());
+        for (int i = 0; i < count; ++i) {
+            Snapshot snap;
+            std::memset(&snap, 0, sizeof(snap));
+            std::strncpy(snap.symbol, "WRTEST", sizeof(snap.symbol) - 1);
+            snap.epoch = 1000 + i;
+            writer.write(snap);
+        }
+    }
+    
+    // Every snapshot and index entry must be on disk, in order, with correct offsets.
+    std::ifstream snapIfs("WRTEST.snap", std::ios::binary);
+    std::ifstream idxIfs("WRTEST.idx", std::ios::binary);
+    assert(snapIfs.is_open() && idxIfs.is_open());
+    for (int i = 0; i < count; ++i) {
+        IndexEntry entry;
+        idxIfs.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+        assert(idxIfs.gcount() == sizeof(entry));
+        assert(entry.epoch == 1000 + i);
+        assert(entry.offset == static_cast<int64_t>(i * sizeof(Snapshot)));
+        Snapshot snap;
+        snapIfs.seekg(entry.offset, std::ios::beg);
+        assert(readBinarySnapshot(snapIfs, snap));
+        assert(snap.epoch == entry.epoch);
+    }
+    Snapshot extra;
+    assert(!readBinarySnapshot(snapIfs, extra));
+    snapIfs.close();
+    idxIfs.close();
+    
+    std::remove("WRTEST.snap");
+    std::remove("WRTEST.idx");
+    std::remove("WRTEST.zmap");
+    cout << "SnapshotWriter test passed (13/37)!" << endl << endl;
+}
+
+// ----------------------------------------------------------------------
+// Snapshot Storage Format Tests
+// ----------------------------------------------------------------------
+
+// Helper: Realistic snapshot stream for "DELTA": one per event, with repeated epochs.
+vector<Snapshot> makeStorageTestSnapshots() {
+    vector<Snapshot> snaps;
+    OrderBook book("DELTA");
+    for (int i = 0; i < 500; ++i) {
+        double price = (10000 + (i * 37) % 61 - 30) / 100.0;
+        OrderSide side = (price < 100.0) ? OrderSide::BUY : OrderSide::SELL;
+        OrderCategory category = (i % 4 == 3) ? OrderCategory::CANCEL
+                               : (i % 9 == 5) ? OrderCategory::TRADE : OrderCategory::NEW;
+        Order order = {i, std::to_string(i % 53), "DELTA", side, category, price, 1 + i % 4};
+        book.processOrder(order);
+        snaps.push_back(book.getSnapshot(1000 + (i / 3) * 100));
+    }
+    return snaps;
+}
+
+// Helper: Writes snapshots for "DELTA" with the given storage options and returns the file sizes.
+std::pair<long, long> writeStorageTestFiles(const vector<Snapshot> &snaps, const StorageOptions &storage) {
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    {
+        SnapshotWriter writer("DELTA", storage, 256);
+        assert(writer.isOpen());
+        for (const auto &snap : snaps)
+            writer.write(snap);
+    }
+    std::ifstream snapIfs("DELTA.snap", std::ios::binary | std::ios::ate);
+    std::ifstream idxIfs("DELTA.idx", std::ios::binary | std::ios::ate);
+    return {static_cast<long>(snapIfs.tellg()), static_cast<long>(idxIfs.tellg())};
+}
+
+void testDeltaSnapshotStorage() {
+    cout << "Running Delta Snapshot Storage test..." << endl;
+    
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    const int64_t ranges[][2] = {{0, 1LL << 62}, {1000, 1000}, {1100, 1500}, {5000, 9000}, {17500, 17600}, {30000, 40000}};
+    vector<vector<Snapshot>> expected;
+    StorageOptions fixed;
+    std::pair<long, long> fixedSizes = writeStorageTestFiles(snaps, fixed);
+    assert(fixedSizes.first == static_cast<long>(snaps.size() * sizeof(Snapshot)));
+    QueryEngine engine({"DELTA"});
+    for (const auto &range : ranges)
+        expected.push_back(engine.query({range[0], range[1], {"DELTA"}, {}}));
+    
+    // Test 1: Keyframe every 7 records; every range query must match the fixed format.
+    {
+        StorageOptions delta;
+        delta.format = SnapshotFormat::Delta;
+        delta.keyframeRecords = 7;
+        delta.keyframeNanos = 0;
+        std::pair<long, long> sizes = writeStorageTestFiles(snaps, delta);
+        assert(detectSnapshotFormat("DELTA.snap") == SnapshotFormat::Delta);
+        assert(sizes.second == static_cast<long>(((snaps.size() + 6) / 7) * sizeof(IndexEntry)));
+        assert(sizes.first * 2 < fixedSizes.first);
+        for (size_t r = 0; r < expected.size(); ++r) {
+            vector<Snapshot> got = engine.query({ranges[r][0], ranges[r][1], {"DELTA"}, {}});
+            assert(got.size() == expected[r].size());
+            for (size_t i = 0; i < got.size(); ++i)
+                assert(sameSnapshot(got[i], expected[r][i]));
+        }
+    }
+    
+    // Test 2: Time-based keyframes only; index epochs are at least keyframeNanos apart.
+    {
+        StorageOptions delta;
+        delta.format = SnapshotFormat::Delta;
+        delta.keyframeRecords = 0;
+        delta.keyframeNanos = 2000;
+        writeStorageTestFiles(snaps, delta);
+        std::ifstream idxIfs("DELTA.idx", std::ios::binary);
+        vector<IndexEntry> keyframes;
+        IndexEntry entry;
+        while (idxIfs.read(reinterpret_cast<char*>(&entry), sizeof(entry)))
+            keyframes.push_back(entry);
+        assert(keyframes.size() == 9);
+        for (size_t i = 1; i < keyframes.size(); ++i)
+            assert(keyframes[i].epoch - keyframes[i - 1].epoch >= 2000 && keyframes[i].offset > keyframes[i - 1].offset);
+        vector<Snapshot> got = engine.query({5000, 9000, {"DELTA"}, {}});
+        assert(got.size() == expected[3].size());
+        for (size_t i = 0; i < got.size(); ++i)
+            assert(sameSnapshot(got[i], expected[3][i]));
+        
+        // Appending in a different format is refused.
+        SnapshotWriter mismatched("DELTA", fixed);
+        assert(!mismatched.isOpen());
+    }
+    
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    cout << "Delta Snapshot Storage test passed (14/37)!" << endl << endl;
+}
+
+void testColumnarSnapshotStorage() {
+    cout << "Running Columnar Snapshot Storage test..." << endl;
+    
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    const int64_t ranges[][2] = {{0, 1LL << 62}, {1000, 1000}, {1100, 1500}, {5000, 9000}, {17500, 17600}, {30000, 40000}};
+    vector<vector<Snapshot>> expected;
+    writeStorageTestFiles(snaps, StorageOptions());
+    QueryEngine engine({"DELTA"});
+    for (const auto &range : ranges)
+        expected.push_back(engine.query({range[0], range[1], {"DELTA"}, {}}));
+    
+    StorageOptions columnar;
+    columnar.format = SnapshotFormat::Columnar;
+    columnar.rowGroupRows = 64;
+    std::pair<long, long> sizes = writeStorageTestFiles(snaps, columnar);
+    assert(detectSnapshotFormat("DELTA.snap") == SnapshotFormat::Columnar);
+    assert(sizes.second == static_cast<long>(((snaps.size() + 63) / 64) * sizeof(IndexEntry)));
+    assert(sizes.first == static_cast<long>(kColumnarHeaderBytes + 7 * rowGroupBytes(64) + rowGroupBytes(500 - 7 * 64)));
+    
+    // Test 1: Full rows match the fixed format for every range.
+    for (size_t r = 0; r < expected.size(); ++r) {
+        vector<Snapshot> got = engine.query({ranges[r][0], ranges[r][1], {"DELTA"}, {}});
+        assert(got.size() == expected[r].size());
+        for (size_t i = 0; i < got.size(); ++i)
+            assert(sameSnapshot(got[i], expected[r][i]));
+    }
+    
+    // Test 2: A projection returns the selected fields and leaves the others zero.
+    vector<Snapshot> got = engine.query({1100, 9000, {"DELTA"}, {"bid1p", "ask2q", "lastTradePrice"}});
+    vector<Snapshot> full = engine.query({1100, 9000, {"DELTA"}, {}});
+    assert(!got.empty() && got.size() == full.size());
+    for (size_t i = 0; i < got.size(); ++i) {
+        assert(std::strcmp(got[i].symbol, "DELTA") == 0 && got[i].epoch == full[i].epoch);
+        assert(got[i].bidPrices[0] == full[i].bidPrices[0]);
+        assert(got[i].askQuantities[1] == full[i].askQuantities[1]);
+        assert(got[i].lastTradePrice == full[i].lastTradePrice);
+        assert(got[i].askPrices[0] == 0.0 && got[i].bidQuantities[0] == 0 && got[i].lastTradeQuantity == 0);
+    }
+    
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    cout << "Columnar Snapshot Storage test passed (15/37)!" << endl << endl;
+}
+
+// Test: The mapped reader returns what the stream reader does and serves fixed files zero-copy.
+void testQueryEngineMapped() {
+    cout << "Running QueryEngine Mapped Reader test..." << endl;
+    
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    const int64_t ranges[][2] = {{0, 1LL << 62}, {1000, 1000}, {1100, 1500}, {5000, 9000}, {30000, 40000}};
+    StorageOptions formats[3];
+    formats[1].format = SnapshotFormat::Delta;
+    formats[1].keyframeRecords = 16;
+    formats[2].format = SnapshotFormat::Columnar;
+    formats[2].rowGroupRows = 64;
+    
+    // Test 1: Same results as the stream reader for every format and range.
+    QueryEngine mapped({"DELTA"}, ReaderMode::Mapped);
+    for (const StorageOptions &storage : formats) {
+        writeStorageTestFiles(snaps, storage);
+        mapped.refresh();
+        QueryEngine stream({"DELTA"});
+        for (const auto &range : ranges) {
+            vector<Snapshot> expected = stream.query({range[0], range[1], {"DELTA"}, {}});
+            vector<Snapshot> got = mapped.query({range[0], range[1], {"DELTA"}, {}});
+            assert(got.size() == expected.size());
+            for (size_t i = 0; i < got.size(); ++i)
+                assert(sameSnapshot(got[i], expected[i]));
+        }
+    }
+    
+    // Test 2: Spans need fixed-format files.
+    SnapshotSpan span;
+    assert(!mapped.mappedSnapshots("DELTA", 0, 1LL << 62, span) && span.empty());
+    
+    // Test 3: After refresh() a rewritten fixed file is served in place, from the same mapping each time.
+    writeStorageTestFiles(snaps, formats[0]);
+    mapped.refresh();
+    assert(mapped.mappedSnapshots("DELTA", 1100, 9000, span));
+    // Epochs are non-decreasing, so the span is the matching run of snaps in write order.
+    vector<Snapshot> expected;
+    for (const auto &snap : snaps) {
+        if (snap.epoch >= 1100 && snap.epoch <= 9000)
+            expected.push_back(snap);
+    }
+    assert(!span.empty() && span.size() == expected.size());
+    for (size_t i = 0; i < span.size(); ++i)
+        assert(sameSnapshot(span[i], expected[i]));
+    SnapshotSpan again;
+    assert(mapped.mappedSnapshots("DELTA", 1100, 9000, again));
+    assert(again.begin() == span.begin() && again.size() == span.size());
+    assert(mapped.mappedSnapshots("DELTA", 1LL << 61, 1LL << 62, span) && span.empty());
+    
+    // Test 4: The stream reader has no spans.
+    QueryEngine stream({"DELTA"});
+    assert(!stream.mappedSnapshots("DELTA", 0, 1LL << 62, span));
+    
+    mapped.refresh();
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    cout << "QueryEngine Mapped Reader test passed (16/37)!" << endl << endl;
+}
+
+// Test: Block index layout, appending, and Eytzinger search against std::lower_bound.
+void testBlockIndex() {
+    cout << "Running Block Index test..." << endl;
+    
+    // Test 1: Searches match std::lower_bound/upper_bound for every size and key, duplicates included.
+    for (size_t n = 0; n < 70; ++n) {
+        vector<IndexEntry> entries(n);
+        for (size_t i = 0; i < n; ++i)
+            entries[i] = {static_cast<int64_t>(10 * (i / 2)), static_cast<int64_t>(i * 100)};
+        SnapshotIndex index;
+        assert(index.load(reinterpret_cast<const char*>(entries.data()), n * sizeof(IndexEntry)));
+        assert(index.size() == n && index.blockRecords() == 0);
+        for (int64_t key = -5; key <= static_cast<int64_t>(5 * n) + 5; ++key) {
+            auto lower = std::lower_bound(entries.begin(), entries.end(), key,
+                                          [](const IndexEntry &e, int64_t k) { return e.epoch < k; });
+            auto upper = std::upper_bound(entries.begin(), entries.end(), key,
+                                          [](int64_t k, const IndexEntry &e) { return k < e.epoch; });
+            assert(index.lowerBound(key) == static_cast<size_t>(lower - entries.begin()));
+            assert(index.upperBound(key) == static_cast<size_t>(upper - entries.begin()));
+        }
+        for (size_t i = 0; i < n; ++i)
+            assert(index.offset(i) == entries[i].offset);
+    }
+    
+    // Test 2: The writer emits a header plus one varint fence per block; offsets follow from the block number.
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    StorageOptions blocks;
+    blocks.indexBlockRecords = 16;
+    std::pair<long, long> sizes = writeStorageTestFiles(snaps, blocks);
+    assert(sizes.first == static_cast<long>(snaps.size() * sizeof(Snapshot)));
+    assert(sizes.second > static_cast<long>(kBlockIndexHeaderBytes));
+    assert(sizes.second < static_cast<long>(kBlockIndexHeaderBytes + 4 * ((snaps.size() + 15) / 16)));
+    SnapshotIndex index;
+    assert(index.readFile("DELTA.idx"));
+    assert(index.blockRecords() == 16 && index.size() == (snaps.size() + 15) / 16);
+    for (size_t block = 0; block < index.size(); ++block) {
+        assert(index.offset(block) == static_cast<int64_t>(block * 16 * sizeof(Snapshot)));
+        assert(index.lowerBound(snaps[block * 16].epoch) <= block);
+    }
+    
+    // Test 3: Appending in two runs produces the same index as one run.
+    std::ifstream onePass("DELTA.idx", std::ios::binary);
+    std::string expectedIdx((std::istreambuf_iterator<char>(onePass)), std::istreambuf_iterator<char>());
+    onePass.close();
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    for (size_t part = 0; part < 2; ++part) {
+        SnapshotWriter writer("DELTA", blocks, 256);
+        for (size_t i = part * 203; i < (part == 0 ? 203 : snaps.size()); ++i)
+            writer.write(snaps[i]);
+    }
+    std::ifstream twoPass("DELTA.idx", std::ios::binary);
+    std::string appendedIdx((std::istreambuf_iterator<char>(twoPass)), std::istreambuf_iterator<char>());
+    twoPass.close();
+    assert(appendedIdx == expectedIdx);
+    
+    // Test 4: Appending after the index was lost or cut short rebuilds it from the records.
+    for (int damage = 0; damage < 2; ++damage) {
+        std::remove("DELTA.snap");
+        std::remove("DELTA.idx");
+        std::remove("DELTA.zmap");
+        {
+            SnapshotWriter writer("DELTA", blocks, 256);
+            for (size_t i = 0; i < 203; ++i)
+                writer.write(snaps[i]);
+        }
+        if (damage == 0)
+            std::remove("DELTA.idx");
+        else
+            writeToFile("DELTA.idx", {});
+        SnapshotWriter writer("DELTA", blocks, 256);
+        for (size_t i = 203; i < snaps.size(); ++i)
+            writer.write(snaps[i]);
+        writer.flush();
+        std::ifstream rebuilt("DELTA.idx", std::ios::binary);
+        std::string rebuiltIdx((std::istreambuf_iterator<char>(rebuilt)), std::istreambuf_iterator<char>());
+        assert(rebuiltIdx == expectedIdx);
+    }
+    
+    // Test 5: Queries over the block index match the per-snapshot index, for both readers.
+    const int64_t ranges[][2] = {{0, 1LL << 62}, {1000, 1000}, {1100, 1500}, {5000, 9000}, {17500, 17600}, {30000, 40000}};
+    StorageOptions perSnapshot;
+    perSnapshot.indexBlockRecords = 0;
+    writeStorageTestFiles(snaps, perSnapshot);
+    vector<vector<Snapshot>> expected;
+    QueryEngine stream({"DELTA"});
+    for (const auto &range : ranges)
+        expected.push_back(stream.query({range[0], range[1], {"DELTA"}, {}}));
+    writeStorageTestFiles(snaps, blocks);
+    QueryEngine mapped({"DELTA"}, ReaderMode::Mapped);
+    for (size_t r = 0; r < expected.size(); ++r) {
+        vector<Snapshot> got = stream.query({ranges[r][0], ranges[r][1], {"DELTA"}, {}});
+        vector<Snapshot> gotMapped = mapped.query({ranges[r][0], ranges[r][1], {"DELTA"}, {}});
+        assert(got.size() == expected[r].size() && gotMapped.size() == expected[r].size());
+        for (size_t i = 0; i < got.size(); ++i)
+            assert(sameSnapshot(got[i], expected[r][i]) && sameSnapshot(gotMapped[i], expected[r][i]));
+    }
+    
+    mapped.refresh();
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    cout << "Block Index test passed (17/37)!" << endl << endl;
+}
+
+// Helper: Stream over a vector, handed out in chunks of a fixed size.
+class VectorSnapshotStream : public SnapshotStream {
+public:
+    VectorSnapshotStream(vector<Snapshot> snaps, size_t chunk, size_t *pulled)
+        : snaps_(std::move(snaps)), chunk_(chunk), next_(0), pulled_(pulled) {}
+
+    bool nextChunk(const Snapshot *&begin, const Snapshot *&end) override {
+        if (next_ >= snaps_.size())
+            return false;
+        begin = snaps_.data() + next_;
+        next_ = std::min(next_ + chunk_, snaps_.size());
+        end = snaps_.data() + next_;
+        ++*pulled_;
+        return true;
+    }
+
+private:
+    vector<Snapshot> snaps_;
+    size_t chunk_;
+    size_t next_;
+    size_t *pulled_;
+};
+
+// Helper: Snapshots of one symbol at the given epochs.
+vector<Snapshot> makeMergerSnapshots(const char *symbol, const vector<int64_t> &epochs) {
+    vector<Snapshot> snaps;
+    for (int64_t epoch : epochs) {
+        Snapshot snap = {};
+        std::strncpy(snap.symbol, symbol, sizeof(snap.symbol) - 1);
+        snap.epoch = epoch;
+        snaps.push_back(snap);
+    }
+    return snaps;
+}
+
+// Test: SnapshotMerger merges epoch-ordered streams incrementally.
+void testSnapshotMerger() {
+    cout << "Running Snapshot Merger test..." << endl;
+    
+    // Test 1: Output is in epoch order, equal epochs in the order the streams were added.
+    size_t pulled = 0;
+    SnapshotMerger merger;
+    merger.add(std::unique_ptr<SnapshotStream>(
+        new VectorSnapshotStream(makeMergerSnapshots("AAA", {1, 3, 3, 7, 9}), 2, &pulled)));
+    merger.add(std::unique_ptr<SnapshotStream>(
+        new VectorSnapshotStream(makeMergerSnapshots("BBB", {}), 2, &pulled)));
+    merger.add(std::unique_ptr<SnapshotStream>(
+        new VectorSnapshotStream(makeMergerSnapshots("CCC", {0, 3, 8, 9, 9, 12}), 1, &pulled)));
+    merger.add(nullptr);
+    const char *expectedSymbols[] = {"CCC", "AAA", "AAA", "AAA", "CCC", "AAA", "CCC", "AAA", "CCC", "CCC", "CCC"};
+    const int64_t expectedEpochs[] = {0, 1, 3, 3, 3, 7, 8, 9, 9, 9, 12};
+    size_t count = 0;
+    while (const Snapshot *snap = merger.next()) {
+        assert(count < 11);
+        assert(std::strcmp(snap->symbol, expectedSymbols[count]) == 0 && snap->epoch == expectedEpochs[count]);
+        ++count;
+    }
+    assert(count == 11);
+    assert(merger.next() == nullptr);
+    
+    // Test 2: The first row needs only the first chunk of each stream.
+    pulled = 0;
+    vector<int64_t> epochs;
+    for (int64_t i = 0; i < 1000; ++i)
+        epochs.push_back(i);
+    SnapshotMerger lazy;
+    lazy.add(std::unique_ptr<SnapshotStream>(new VectorSnapshotStream(makeMergerSnapshots("AAA", epochs), 100, &pulled)));
+    lazy.add(std::unique_ptr<SnapshotStream>(new VectorSnapshotStream(makeMergerSnapshots("BBB", epochs), 100, &pulled)));
+    assert(lazy.next()->epoch == 0);
+    assert(pulled == 2);
+    
+    // Test 3: A limit ends the merge without pulling further chunks.
+    lazy.setLimit(250);
+    count = 1;
+    while (lazy.next())
+        ++count;
+    assert(count == 250 && pulled == 4);
+    
+    // Test 4: QueryEngine::openQuery yields the same rows as query().
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    StorageOptions blocks;
+    blocks.indexBlockRecords = 16;
+    writeStorageTestFiles(snaps, blocks);
+    QueryEngine engine({"DELTA"}, ReaderMode::Mapped);
+    QueryCriteria criteria = {1100, 9000, {"DELTA"}, {}};
+    vector<Snapshot> expected = engine.query(criteria);
+    assert(!expected.empty());
+    SnapshotMerger query = engine.openQuery(criteria);
+    count = 0;
+    while (const Snapshot *snap = query.next()) {
+        assert(count < expected.size() && sameSnapshot(*snap, expected[count]));
+        ++count;
+    }
+    assert(count == expected.size());
+    
+    engine.refresh();
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    cout << "Snapshot Merger test passed (18/37)!" << endl << endl;
+}
+
+// Test: Parallel query() matches the serial one and isolates failing symbols.
+void testQueryEngineParallel() {
+    cout << "Running QueryEngine Parallel test..." << endl;
+    
+    // Six symbols in all three formats, with interleaved and repeated epochs,
+    // plus one symbol without files.
+    vector<Snapshot> base = makeStorageTestSnapshots();
+    const SnapshotFormat formats[] = {SnapshotFormat::Fixed, SnapshotFormat::Delta, SnapshotFormat::Columnar};
+    vector<string> symbols;
+    for (int s = 0; s < 6; ++s) {
+        string symbol = "PAR" + std::to_string(s);
+        symbols.push_back(symbol);
+        StorageOptions storage;
+        storage.format = formats[s % 3];
+        storage.indexBlockRecords = 16;
+        SnapshotWriter writer(symbol, storage, 256);
+        assert(writer.isOpen());
+        for (Snapshot snap : base) {
+            std::memset(snap.symbol, 0, sizeof(snap.symbol));
+            std::strncpy(snap.symbol, symbol.c_str(), sizeof(snap.symbol) - 1);
+            snap.epoch += 50 * (s % 2);
+            writer.write(snap);
+        }
+    }
+    symbols.push_back("MISSING");
+    
+    const int64_t ranges[][2] = {{0, 1LL << 62}, {1100, 1500}, {5000, 9000}, {30000, 40000}};
+    for (ReaderMode mode : {ReaderMode::Stream, ReaderMode::Mapped}) {
+        QueryEngine serial(symbols, mode);
+        QueryEngine parallel(symbols, mode, 4);
+        for (const auto &range : ranges) {
+            QueryCriteria criteria = {range[0], range[1], symbols, {}};
+            vector<Snapshot> expected = serial.query(criteria);
+            vector<Snapshot> got = parallel.query(criteria);
+            assert(got.size() == expected.size());
+            for (size_t i = 0; i < got.size(); ++i)
+                assert(sameSnapshot(got[i], expected[i]));
+        }
+        // Every present symbol contributes all of its rows despite the missing one.
+        vector<Snapshot> all = parallel.query({0, 1LL << 62, symbols, {}});
+        assert(all.size() == 6 * base.size());
+        // Queries from several threads at once share the engine's worker pool.
+        vector<vector<Snapshot>> concurrent(3);
+        vector<std::thread> clients;
+        for (auto &rows : concurrent)
+            clients.emplace_back([&parallel, &symbols, &rows]() { rows = parallel.query({0, 1LL << 62, symbols, {}}); });
+        for (auto &client : clients)
+            client.join();
+        for (const auto &rows : concurrent) {
+            assert(rows.size() == all.size());
+            for (size_t i = 0; i < rows.size(); ++i)
+                assert(sameSnapshot(rows[i], all[i]));
+        }
+        parallel.refresh();
+        serial.refresh();
+    }
+    
+    for (int s = 0; s < 6; ++s) {
+        std::remove(("PAR" + std::to_string(s) + ".snap").c_str());
+        std::remove(("PAR" + std::to_string(s) + ".idx").c_str());
+        std::remove(("PAR" + std::to_string(s) + ".zmap").c_str());
+    }
+    cout << "QueryEngine Parallel test passed (19/37)!" << endl << endl;
+}
+
+// Test: The sink overload of query() streams the same rows, honoring the limit and early stops.
+void testQueryEngineStreaming() {
+    cout << "Running QueryEngine Streaming test..." << endl;
+    
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    StorageOptions blocks;
+    blocks.indexBlockRecords = 16;
+    writeStorageTestFiles(snaps, blocks);
+    for (size_t threads : {1, 4}) {
+        QueryEngine engine({"DELTA", "MISSING"}, ReaderMode::Mapped, threads);
+        QueryCriteria criteria = {1100, 30000, {"DELTA", "MISSING"}, {}};
+        vector<Snapshot> expected = engine.query(criteria);
+        assert(expected.size() > 100);
+        
+        // Test 1: The sink sees exactly the rows query() returns.
+        vector<Snapshot> streamed;
+        size_t delivered = engine.query(criteria, [&streamed](const Snapshot &snap) {
+            streamed.push_back(snap);
+            return true;
+        });
+        assert(delivered == expected.size() && streamed.size() == expected.size());
+        for (size_t i = 0; i < streamed.size(); ++i)
+            assert(sameSnapshot(streamed[i], expected[i]));
+        
+        // Test 2: A limit returns the first rows only, in both overloads.
+        criteria.limit = 7;
+        vector<Snapshot> limited = engine.query(criteria);
+        assert(limited.size() == 7);
+        for (size_t i = 0; i < limited.size(); ++i)
+            assert(sameSnapshot(limited[i], expected[i]));
+        criteria.limit = 0;
+        
+        // Test 3: A sink returning false stops the query.
+        size_t seen = 0;
+        delivered = engine.query(criteria, [&seen](const Snapshot &) { return ++seen < 3; });
+        assert(delivered == 3 && seen == 3);
+        engine.refresh();
+    }
+    
+    // Test 4: SnapshotPrinter prints row by row what printSnapshots prints.
+    QueryEngine engine({"DELTA"});
+    QueryCriteria criteria = {1100, 9000, {"DELTA"}, {"epoch", "bid1p", "ask1q"}};
+    std::ostringstream whole, streamed, err;
+    engine.printSnapshots(engine.query(criteria), criteria, whole, err);
+    SnapshotPrinter printer(criteria, streamed, err);
+    assert(printer.printHeader());
+    engine.query(criteria, [&printer](const Snapshot &snap) {
+        printer.print(snap);
+        return true;
+    });
+    printer.flush();
+    assert(err.str().empty() && streamed.str() == whole.str());
+    SnapshotPrinter invalid({0, 1, {"DELTA"}, {"bid6p"}}, streamed, err);
+    assert(!invalid.printHeader() && err.str().find("Unknown field \"bid6p\"") != string::npos);
+    
+    // Test 5: In every format, appending snapshots older than the file's last
+    // one is refused (an equal epoch is kept), so the file streams in epoch order.
+    StorageOptions delta, columnar;
+    delta.format = SnapshotFormat::Delta;
+    delta.keyframeRecords = 64;
+    columnar.format = SnapshotFormat::Columnar;
+    columnar.rowGroupRows = 64;
+    for (const StorageOptions &storage : {blocks, delta, columnar}) {
+        writeStorageTestFiles(vector<Snapshot>(snaps.begin(), snaps.begin() + 300), storage);
+        {
+            SnapshotWriter writer("DELTA", storage, 256);
+            for (size_t i = 100; i < 200; ++i)
+                writer.write(snaps[i]);
+            writer.write(snaps[299]);
+            writer.write(snaps[300]);
+        }
+        QueryEngine appended({"DELTA"}, ReaderMode::Stream);
+        vector<Snapshot> rows;
+        appended.query({0, 1LL << 62, {"DELTA"}, {}}, [&rows](const Snapshot &snap) {
+            rows.push_back(snap);
+            return true;
+        });
+        assert(rows.size() == 302);
+        for (size_t i = 0; i < 300; ++i)
+            assert(sameSnapshot(rows[i], snaps[i]));
+        assert(sameSnapshot(rows[300], snaps[299]) && sameSnapshot(rows[301], snaps[300]));
+    }
+    
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    cout << "QueryEngine Streaming test passed (20/37)!" << endl << endl;
+}
+
+// Test: Binary output carries a self-describing header and raw row structs.
+void testQueryBinaryOutput() {
+    cout << "Running Query Binary Output test..." << endl;
+    
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    writeStorageTestFiles(snaps, StorageOptions());
+    QueryEngine engine({"DELTA"});
+    
+    // Test 1: Selected fields, in the canonical field order, packed without padding.
+    QueryCriteria criteria = {1100, 9000, {"DELTA"}, {"lastTradeQuantity", "epoch", "ask2p", "symbol"}};
+    vector<Snapshot> expected = engine.query(criteria);
+    std::ostringstream out(std::ios::binary), err;
+    {
+        SnapshotPrinter printer(criteria, out, err, OutputFormat::Binary);
+        assert(printer.printHeader());
+        for (const auto &snap : expected)
+            printer.print(snap);
+    }
+    const string bytes = out.str();
+    assert(err.str().empty());
+    assert(bytes.compare(0, sizeof(kBinaryResultMagic), kBinaryResultMagic, sizeof(kBinaryResultMagic)) == 0);
+    uint32_t headerBytes;
+    std::memcpy(&headerBytes, bytes.data() + 8, sizeof(headerBytes));
+    const size_t dataOffset = 12 + headerBytes;
+    assert(dataOffset % 8 == 0);
+    const string header = bytes.substr(12, headerBytes);
+    assert(header.find("[[\"symbol\", \"S8\"], [\"epoch\", \"<i8\"], [\"ask2p\", \"<f8\"], "
+                       "[\"lastTradeQuantity\", \"<i4\"]]") != string::npos);
+    assert(header.find("\"row_bytes\": 28}") != string::npos);
+    assert(bytes.size() == dataOffset + 28 * expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        const char *row = bytes.data() + dataOffset + 28 * i;
+        int64_t epoch;
+        double ask2p;
+        int32_t quantity;
+        std::memcpy(&epoch, row + 8, sizeof(epoch));
+        std::memcpy(&ask2p, row + 16, sizeof(ask2p));
+        std::memcpy(&quantity, row + 24, sizeof(quantity));
+        assert(std::strncmp(row, "DELTA", 8) == 0 && row[5] == '\0' && row[7] == '\0');
+        assert(epoch == expected[i].epoch && ask2p == expected[i].askPrices[1]);
+        assert(quantity == expected[i].lastTradeQuantity);
+    }
+    
+    // Test 2: Without selected fields every field is written; invalid fields are still rejected.
+    std::ostringstream all(std::ios::binary);
+    {
+        SnapshotPrinter printer({1100, 9000, {"DELTA"}, {}}, all, err, OutputFormat::Binary);
+        assert(printer.printHeader());
+    }
+    assert(all.str().find("\"row_bytes\": 148}") != string::npos && all.str().size() % 8 == 0);
+    SnapshotPrinter invalid({1100, 9000, {"DELTA"}, {"bid6p"}}, all, err, OutputFormat::Binary);
+    assert(!invalid.printHeader());
+    
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+    cout << "Query Binary Output test passed (21/37)!" << endl << endl;
+}
+
+// Test: asOf() answers like the last row of a range query ending at each lookup epoch.
+void testQueryEngineAsOf() {
+    cout << "Running QueryEngine As-Of test..." << endl;
+    
+    // Three symbols, one per format, plus one symbol without files.
+    vector<Snapshot> base = makeStorageTestSnapshots();
+    const SnapshotFormat formats[] = {SnapshotFormat::Fixed, SnapshotFormat::Delta, SnapshotFormat::Columnar};
+    vector<string> symbols;
+    for (int s = 0; s < 3; ++s) {
+        string symbol = "ASOF" + std::to_string(s);
+        symbols.push_back(symbol);
+        StorageOptions storage;
+        storage.format = formats[s];
+        storage.indexBlockRecords = 16;
+        SnapshotWriter writer(symbol, storage, 256);
+        assert(writer.isOpen());
+        for (Snapshot snap : base) {
+            std::memset(snap.symbol, 0, sizeof(snap.symbol));
+            std::strncpy(snap.symbol, symbol.c_str(), sizeof(snap.symbol) - 1);
+            writer.write(snap);
+        }
+    }
+    symbols.push_back("MISSING");
+    
+    // Dense lookups (many per index entry), sparse ones (gaps of many entries),
+    // exact and repeated epochs, and epochs before the first and after the last row.
+    vector<int64_t> dense, sparse = {0, 999, 1000, 1000, 1050, 1200, 9999, 17600, 50000};
+    for (int64_t t = 900; t <= 18000; t += 7)
+        dense.push_back(t);
+    for (ReaderMode mode : {ReaderMode::Stream, ReaderMode::Mapped}) {
+        QueryEngine engine(symbols, mode);
+        for (const auto &epochs : {dense, sparse}) {
+            AsOfCriteria criteria = {epochs, symbols, {}};
+            vector<AsOfMatch> matches = engine.asOf(criteria);
+            size_t next = 0;
+            for (size_t s = 0; s < symbols.size(); ++s) {
+                for (size_t t = 0; t < epochs.size(); ++t) {
+                    vector<Snapshot> upTo = engine.query({0, epochs[t], {symbols[s]}, {}});
+                    if (upTo.empty())
+                        continue;
+                    assert(next < matches.size() && matches[next].symbol == s && matches[next].time == t);
+                    assert(sameSnapshot(matches[next].snapshot, upTo.back()));
+                    ++next;
+                }
+            }
+            assert(next == matches.size());
+        }
+        
+        // A sink returning false stops the lookups.
+        size_t seen = 0;
+        size_t delivered = engine.asOf({dense, symbols, {}}, [&seen](size_t, size_t, const Snapshot &) {
+            return ++seen < 5;
+        });
+        assert(delivered == 5 && seen == 5);
+        engine.refresh();
+    }
+    
+    // The printer puts the lookup epoch first.
+    std::ostringstream out, err;
+    SnapshotPrinter printer({0, 0, {}, {"epoch", "bid1p"}}, out, err);
+    assert(printer.printHeader(true));
+    printer.print(base[0], 1050);
+    printer.flush();
+    assert(out.str().rfind("asOf, epoch, bid1p\n1050, 1000, ", 0) == 0);
+    
+    for (const auto &symbol : symbols) {
+        std::remove((symbol + ".snap").c_str());
+        std::remove((symbol + ".idx").c_str());
+        std::remove((symbol + ".zmap").c_str());
+    }
+    cout << "QueryEngine As-Of test passed (22/37)!" << endl << endl;
+}
+
+// Helper: A one-level snapshot for the aggregation tests (a negative price leaves the side empty).
+Snapshot makeBarSnapshot(int64_t epoch, double bid, int32_t bidQuantity, double ask, int32_t askQuantity,
+                         double tradePrice, int32_t tradeQuantity) {
+    Snapshot snap = {};
+    std::strncpy(snap.symbol, "BARS", sizeof(snap.symbol) - 1);
+    snap.epoch = epoch;
+    for (int i = 0; i < 5; ++i)
+        snap.bidPrices[i] = snap.askPrices[i] = -1.0;
+    snap.bidPrices[0] = bid;
+    snap.bidQuantities[0] = bid < 0 ? 0 : bidQuantity;
+    snap.askPrices[0] = ask;
+    snap.askQuantities[0] = ask < 0 ? 0 : askQuantity;
+    snap.lastTradePrice = tradePrice;
+    snap.lastTradeQuantity = tradeQuantity;
+    return snap;
+}
+
+// Helper: Equal up to rounding, or both NaN.
+bool sameAggregate(double a, double b) {
+    return (std::isnan(a) && std::isnan(b)) || std::fabs(a - b) < 1e-9;
+}
+
+// Test: aggregate() computes per-bucket bars from the snapshots in range.
+void testQueryEngineAggregate() {
+    cout << "Running QueryEngine Aggregate test..." << endl;
+    
+    // The first snapshot (before the range) seeds the book; the one at 90 has
+    // no bids and repeats the last trade; nothing falls in [200, 300).
+    const vector<Snapshot> snaps = {
+        makeBarSnapshot(20, 10.0, 5, 11.0, 7, -1.0, 0),
+        makeBarSnapshot(60, 10.0, 5, 12.0, 7, 11.5, 3),
+        makeBarSnapshot(90, -1.0, 0, 12.0, 7, 11.5, 3),
+        makeBarSnapshot(150, 10.5, 4, 11.0, 2, 11.0, 2),
+        makeBarSnapshot(160, 10.5, 4, 11.0, 2, 11.2, 1),
+        makeBarSnapshot(320, 10.0, 1, 10.8, 1, 11.2, 1)};
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    // start, count, midOpen, midHigh, midLow, midClose, open, high, low, close, volume, vwap, spread, bidDepth, askDepth
+    const double expected[][15] = {
+        {0, 2, 11.0, 11.0, 11.0, 11.0, 11.5, 11.5, 11.5, 11.5, 3, 11.5, 1.75, 4.0, 7.0},
+        {100, 2, 10.75, 10.75, 10.75, 10.75, 11.0, 11.2, 11.0, 11.2, 3, 33.2 / 3, 0.5, 2.0, 4.5},
+        {300, 1, 10.4, 10.4, 10.4, 10.4, nan, nan, nan, nan, 0, nan, 0.68, 2.2, 1.4}};
+    
+    const SnapshotFormat formats[] = {SnapshotFormat::Fixed, SnapshotFormat::Delta, SnapshotFormat::Columnar};
+    vector<string> symbols;
+    for (int s = 0; s < 3; ++s) {
+        string symbol = "BAR" + std::to_string(s);
+        symbols.push_back(symbol);
+        StorageOptions storage;
+        storage.format = formats[s];
+        storage.indexBlockRecords = 2;
+        storage.keyframeRecords = 2;
+        storage.rowGroupRows = 2;
+        SnapshotWriter writer(symbol, storage, 256);
+        assert(writer.isOpen());
+        for (Snapshot snap : snaps) {
+            std::memset(snap.symbol, 0, sizeof(snap.symbol));
+            std::strncpy(snap.symbol, symbol.c_str(), sizeof(snap.symbol) - 1);
+            writer.write(snap);
+        }
+    }
+    symbols.push_back("MISSING");
+    
+    // Test 1: Every format, reader and thread count yields the hand-computed bars.
+    for (ReaderMode mode : {ReaderMode::Stream, ReaderMode::Mapped}) {
+        for (size_t threads : {1, 3}) {
+            QueryEngine engine(symbols, mode, threads);
+            vector<Bar> bars = engine.aggregate({50, 349, symbols, 100, {}});
+            assert(bars.size() == 9);
+            for (size_t i = 0; i < bars.size(); ++i) {
+                const double *row = expected[i % 3];
+                assert(symbols[i / 3] == bars[i].symbol && bars[i].start == static_cast<int64_t>(row[0]));
+                for (size_t a = 0; a < static_cast<size_t>(Aggregate::kCount); ++a)
+                    assert(sameAggregate(bars[i].value(static_cast<Aggregate>(a)), row[a + 1]));
+            }
+            engine.refresh();
+        }
+    }
+    
+    // Test 2: Only the needed columns are read; the selected aggregates still match.
+    {
+        QueryEngine engine({"BAR2"}, ReaderMode::Mapped);
+        vector<Bar> bars = engine.aggregate({50, 349, {"BAR2"}, 100, {Aggregate::Volume, Aggregate::Vwap}});
+        assert(bars.size() == 3 && bars[1].volume == 3 && sameAggregate(bars[1].vwap, 33.2 / 3));
+        assert(engine.aggregate({50, 349, {"BAR2"}, 0, {}}).empty());
+        engine.refresh();
+    }
+    
+    // Test 3: Bars do not depend on how the snapshots are chunked.
+    vector<Snapshot> many = makeStorageTestSnapshots();
+    vector<Bar> whole, single;
+    BarAggregator wholeAggregator(333, 1150, 15000);
+    BarAggregator singleAggregator(333, 1150, 15000);
+    auto inRange = std::partition_point(many.begin(), many.end(), [](const Snapshot &snap) { return snap.epoch < 1150; });
+    auto pastRange = std::partition_point(many.begin(), many.end(), [](const Snapshot &snap) { return snap.epoch <= 15000; });
+    wholeAggregator.seed(*(inRange - 1));
+    singleAggregator.seed(*(inRange - 1));
+    wholeAggregator.add(&*inRange, &*inRange + (pastRange - inRange), whole);
+    for (auto it = inRange; it != pastRange; ++it)
+        singleAggregator.add(&*it, &*it + 1, single);
+    wholeAggregator.finish(whole);
+    singleAggregator.finish(single);
+    assert(whole.size() > 10 && whole.size() == single.size());
+    for (size_t i = 0; i < whole.size(); ++i) {
+        assert(whole[i].start == single[i].start);
+        for (size_t a = 0; a < static_cast<size_t>(Aggregate::kCount); ++a)
+            assert(sameAggregate(whole[i].value(static_cast<Aggregate>(a)), single[i].value(static_cast<Aggregate>(a))));
+    }
+    
+    // Test 4: Names and printing.
+    vector<Aggregate> aggregates;
+    std::ostringstream out, err;
+    assert(!parseAggregates({"vwap", "twap"}, aggregates, err) && err.str().find("\"twap\"") != string::npos);
+    assert(parseAggregates({"count", "vwap", "close"}, aggregates, err) && aggregates.size() == 3);
+    {
+        BarPrinter printer(aggregates, out);
+        printer.printHeader();
+        Bar bar = {};
+        std::strncpy(bar.symbol, "BAR0", sizeof(bar.symbol) - 1);
+        bar.start = 100;
+        bar.count = 2;
+        bar.vwap = 33.2 / 3;
+        bar.close = nan;
+        printer.print(bar);
+    }
+    assert(out.str() == "symbol, start, count, vwap, close\nBAR0, 100, 2, 11.0667, N.A\n");
+    
+    for (const auto &symbol : symbols) {
+        std::remove((symbol + ".snap").c_str());
+        std::remove((symbol + ".idx").c_str());
+        std::remove((symbol + ".zmap").c_str());
+    }
+    cout << "QueryEngine Aggregate test passed (23/37)!" << endl << endl;
+}
+
+// Test: SnapshotFilter parses expressions and QueryEngine applies them during the scan.
+void testSnapshotFilter() {
+    cout << "Running Snapshot Filter test..." << endl;
+    
+    // Test 1: Parsing.
+    SnapshotFilter filter;
+    std::ostringstream err;
+    assert(filter.parse("", err) && filter.empty());
+    assert(filter.parse("ask1p - bid1p > 0.05 && bid1q>10, lastTradeQuantity >= 2 and ask2q != 0", err));
+    assert(!filter.empty() && err.str().empty());
+    assert(filter.columns() == ((1u << ColAsk1p) | (1u << ColBid1p) | (1u << ColBid1q) | (1u << ColLastTradeQuantity) |
+                                (1u << ColAsk2q)));
+    const char *invalid[] = {"bid6p > 1", "epoch > 5", "bid1p >", "bid1p 5", "bid1p > 1 &&", "bid1p > 1 or ask1p < 2",
+                             "bid1p - 3 > 1", "bid1p > nan"};
+    for (const char *expression : invalid) {
+        err.str("");
+        assert(!filter.parse(expression, err) && filter.empty());
+        assert(err.str().find("Invalid filter") != string::npos);
+    }
+    
+    // Test 2: Comparisons with an empty level's price are false, quantities compare as stored.
+    Snapshot oneSided = makeBarSnapshot(1, -1.0, 0, 10.0, 3, -1.0, 0);
+    assert(filter.parse("bid1p != 5", err) && !filter.matches(oneSided));
+    assert(filter.parse("ask1p - bid1p > 0", err) && !filter.matches(oneSided));
+    assert(filter.parse("bid1q == 0, ask1q + bid1q < 4", err) && filter.matches(oneSided));
+    assert(filter.parse("ask1p != 5 and ask1p <= 10", err) && filter.matches(oneSided));
+    
+    // Test 3: Masks over blocks of every size match row-by-row evaluation.
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    assert(filter.parse("ask1p - bid1p >= 0.2, bid1q > 1", err));
+    size_t expectedSelected = 0;
+    for (const auto &snap : snaps)
+        expectedSelected += filter.matches(snap);
+    assert(expectedSelected > 0 && expectedSelected < snaps.size());
+    for (size_t n : {size_t(1), size_t(63), size_t(64), size_t(65), size_t(127), snaps.size()}) {
+        vector<uint64_t> masks((n + 63) / 64);
+        size_t selected = filter.select(snaps.data(), n, masks.data());
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            bool bit = (masks[i / 64] >> (i % 64)) & 1;
+            assert(bit == filter.matches(snaps[i]));
+            count += bit;
+        }
+        assert(selected == count);
+    }
+    
+    // Test 4: Filtered queries return exactly the matching rows, in every
+    // format, reader and thread count, also when the filter reads fields that
+    // are not selected.
+    const SnapshotFormat formats[] = {SnapshotFormat::Fixed, SnapshotFormat::Delta, SnapshotFormat::Columnar};
+    vector<string> symbols;
+    for (int s = 0; s < 3; ++s) {
+        string symbol = "FLT" + std::to_string(s);
+        symbols.push_back(symbol);
+        StorageOptions storage;
+        storage.format = formats[s];
+        storage.indexBlockRecords = 16;
+        SnapshotWriter writer(symbol, storage, 256);
+        assert(writer.isOpen());
+        for (Snapshot snap : snaps) {
+            std::memset(snap.symbol, 0, sizeof(snap.symbol));
+            std::strncpy(snap.symbol, symbol.c_str(), sizeof(snap.symbol) - 1);
+            writer.write(snap);
+        }
+    }
+    for (ReaderMode mode : {ReaderMode::Stream, ReaderMode::Mapped}) {
+        for (size_t threads : {1, 3}) {
+            QueryEngine engine(symbols, mode, threads);
+            QueryCriteria all = {1100, 15000, symbols, {}};
+            QueryCriteria filtered = {1100, 15000, symbols, {"epoch", "ask2p"}};
+            assert(filtered.filter.parse("ask1p - bid1p > 0.05, ask1q <= 3", err));
+            vector<Snapshot> expected;
+            for (const auto &snap : engine.query(all)) {
+                if (filtered.filter.matches(snap))
+                    expected.push_back(snap);
+            }
+            vector<Snapshot> got = engine.query(filtered);
+            assert(expected.size() > 20 && expected.size() < 400 && got.size() == expected.size());
+            for (size_t i = 0; i < got.size(); ++i)
+                assert(got[i].epoch == expected[i].epoch && got[i].askPrices[1] == expected[i].askPrices[1]);
+            filtered.limit = 5;
+            assert(engine.query(filtered).size() == 5);
+            engine.refresh();
+        }
+    }
+    
+    for (const auto &symbol : symbols) {
+        std::remove((symbol + ".snap").c_str());
+        std::remove((symbol + ".idx").c_str());
+        std::remove((symbol + ".zmap").c_str());
+    }
+    cout << "Snapshot Filter test passed (24/37)!" << endl << endl;
+}
+
+// Helper: Removes the files SnapshotWriter writes for a symbol.
+void removeSymbolFiles(const string &symbol) {
+    std::remove((symbol + ".snap").c_str());
+    std::remove((symbol + ".idx").c_str());
+    std::remove((symbol + ".zmap").c_str());
+}
+
+// Test: Zone maps hold per-zone min/max statistics and let filtered queries
+// skip zones without changing their results.
+void testZoneMap() {
+    cout << "Running Zone Map test..." << endl;
+    
+    // Test 1: Statistics leave out missing prices; the spread needs both sides.
+    ZoneBuilder builder;
+    builder.add(makeBarSnapshot(30, 10.0, 4, 10.5, 2, -1.0, 0));
+    builder.add(makeBarSnapshot(10, -1.0, 0, 10.2, 7, 10.1, 3));
+    builder.add(makeBarSnapshot(20, 9.9, 1, 10.4, 5, 10.3, 1));
+    assert(builder.records() == 3);
+    ZoneStats zone = builder.take();
+    assert(builder.records() == 0);
+    assert(zone.records == 3 && zone.firstEpoch == 10 && zone.lastEpoch == 30);
+    assert(zone.min[ColBid1p] == 9.9 && zone.max[ColBid1p] == 10.0);
+    assert(zone.min[ColBid1q] == 0 && zone.max[ColBid1q] == 4);
+    assert(zone.min[ColLastTradePrice] == 10.1 && zone.max[ColLastTradePrice] == 10.3);
+    assert(zone.min[ColBid2p] > zone.max[ColBid2p]);
+    assert(std::fabs(zone.min[kZoneSpread] - 0.5) < 1e-9 && std::fabs(zone.max[kZoneSpread] - 0.5) < 1e-9);
+    
+    // Test 2: mayMatch() rules a zone out only when no row can pass.
+    SnapshotFilter filter;
+    std::ostringstream err;
+    assert(filter.parse("ask1p - bid1p > 0.4", err) && filter.mayMatch(zone));
+    assert(filter.parse("ask1p - bid1p > 0.6", err) && !filter.mayMatch(zone));
+    assert(filter.parse("bid1p - ask1p < -0.6", err) && !filter.mayMatch(zone));
+    assert(filter.parse("bid2p >= 0", err) && !filter.mayMatch(zone));
+    assert(filter.parse("bid2q == 0, lastTradeQuantity != 2", err) && filter.mayMatch(zone));
+    assert(filter.parse("ask1q + bid1q > 10", err) && filter.mayMatch(zone));
+    assert(filter.parse("ask1q + bid1q > 11", err) && !filter.mayMatch(zone));
+    
+    // Test 3: The writer keeps one zone per zoneRecords snapshots (the last one
+    // shorter), in every format, and filtered queries read only candidate zones
+    // yet return the same rows as without the zone map.
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    const SnapshotFormat formats[] = {SnapshotFormat::Fixed, SnapshotFormat::Delta, SnapshotFormat::Columnar};
+    vector<string> symbols;
+    for (int s = 0; s < 3; ++s) {
+        string symbol = "ZMAP" + std::to_string(s);
+        symbols.push_back(symbol);
+        removeSymbolFiles(symbol);
+        StorageOptions storage;
+        storage.format = formats[s];
+        storage.indexBlockRecords = 8;
+        storage.rowGroupRows = 32;
+        storage.keyframeRecords = 16;
+        storage.zoneRecords = 48;
+        SnapshotWriter writer(symbol, storage, 256);
+        assert(writer.isOpen());
+        for (Snapshot snap : snaps) {
+            std::memset(snap.symbol, 0, sizeof(snap.symbol));
+            std::strncpy(snap.symbol, symbol.c_str(), sizeof(snap.symbol) - 1);
+            writer.write(snap);
+        }
+    }
+    const char *expressions[] = {"ask1p - bid1p >= 0.2, bid1q > 1", "ask1p - bid1p > 0.05, ask1q <= 3", "bid1q >= 4"};
+    for (const auto &symbol : symbols) {
+        ZoneMap zones;
+        assert(zones.readFile(symbol + ".zmap") && zones.size() == (snaps.size() + 47) / 48);
+        assert(zones[0].records == 48 && zones[zones.size() - 1].records == snaps.size() % 48);
+        for (const char *expression : expressions) {
+            assert(filter.parse(expression, err));
+            size_t skipped = 0;
+            for (size_t z = 0; z < zones.size(); ++z) {
+                bool anyMatch = false;
+                for (size_t i = z * 48; i < std::min(snaps.size(), (z + 1) * 48); ++i)
+                    anyMatch = anyMatch || filter.matches(snaps[i]);
+                assert(!anyMatch || filter.mayMatch(zones[z]));
+                skipped += !filter.mayMatch(zones[z]);
+            }
+            assert(skipped > 0);
+            auto ranges = zones.candidateRanges(filter, 0, snaps.back().epoch);
+            assert(!ranges.empty());
+            for (size_t r = 1; r < ranges.size(); ++r)
+                assert(ranges[r - 1].second < ranges[r].first);
+        }
+    }
+    for (const char *expression : expressions) {
+        for (ReaderMode mode : {ReaderMode::Stream, ReaderMode::Mapped}) {
+            QueryCriteria criteria = {1100, 15000, symbols, {}};
+            assert(criteria.filter.parse(expression, err));
+            QueryEngine engine(symbols, mode);
+            vector<Snapshot> withZones = engine.query(criteria);
+            for (const auto &symbol : symbols)
+                std::rename((symbol + ".zmap").c_str(), (symbol + ".zsave").c_str());
+            engine.refresh();
+            vector<Snapshot> withoutZones = engine.query(criteria);
+            for (const auto &symbol : symbols)
+                std::rename((symbol + ".zsave").c_str(), (symbol + ".zmap").c_str());
+            assert(!withZones.empty() && withZones.size() == withoutZones.size());
+            for (size_t i = 0; i < withZones.size(); ++i)
+                assert(sameSnapshot(withZones[i], withoutZones[i]));
+        }
+    }
+    
+    // Test 4: Appending continues the zone map in its own zone size; a snapshot
+    // file without one does not get one, as it would miss the earlier records.
+    {
+        StorageOptions storage;
+        storage.indexBlockRecords = 8;
+        storage.zoneRecords = 0;
+        SnapshotWriter writer("ZMAP0", storage, 256);
+        for (Snapshot snap : snaps) {
+            snap.epoch += 100000;
+            writer.write(snap);
+        }
+    }
+    ZoneMap appended;
+    assert(appended.readFile("ZMAP0.zmap") && appended.size() == 2 * ((snaps.size() + 47) / 48));
+    std::remove("ZMAP1.zmap");
+    {
+        StorageOptions storage;
+        storage.format = SnapshotFormat::Delta;
+        SnapshotWriter writer("ZMAP1", storage, 256);
+        writer.write(snaps.back());
+    }
+    std::ifstream missing("ZMAP1.zmap");
+    assert(!missing.is_open());
+    missing.close();
+    
+    // Test 5: A map that does not cover exactly the file's rows (a zone lost to an
+    // interrupted run) is not used by queries, and appending drops it, as it is
+    // when its last zone is torn.
+    const string columnarMap = readFileBytes("ZMAP2.zmap");
+    std::ofstream cut("ZMAP2.zmap", std::ios::binary | std::ios::trunc);
+    cut << columnarMap.substr(0, kZoneMapHeaderBytes) << columnarMap.substr(kZoneMapHeaderBytes + sizeof(ZoneStats));
+    cut.close();
+    for (ReaderMode mode : {ReaderMode::Stream, ReaderMode::Mapped}) {
+        QueryCriteria criteria = {0, 1LL << 62, {"ZMAP2"}, {}};
+        assert(criteria.filter.parse("bid1q >= 0", err));
+        assert(QueryEngine({"ZMAP2"}, mode).query(criteria).size() == snaps.size());
+    }
+    std::ofstream torn("ZMAP0.zmap", std::ios::binary | std::ios::app);
+    torn << "torn";
+    torn.close();
+    for (const char *symbol : {"ZMAP0", "ZMAP2"}) {
+        StorageOptions storage;
+        storage.format = symbol == string("ZMAP0") ? SnapshotFormat::Fixed : SnapshotFormat::Columnar;
+        SnapshotWriter writer(symbol, storage, 256);
+        Snapshot last = snaps.back();
+        last.epoch += 200000;
+        writer.write(last);
+        writer.flush();
+        assert(readFileBytes(string(symbol) + ".zmap").empty());
+    }
+    
+    for (const auto &symbol : symbols)
+        removeSymbolFiles(symbol);
+    cout << "Zone Map test passed (25/37)!" << endl << endl;
+}
+
+// Test: QueryServer answers framed requests exactly like the query command.
+void testQueryServer() {
+    cout << "Running QueryServer test..." << endl;
+#ifndef _WIN32
+    // Two copies, so the whole file prints to more than one response chunk.
+    vector<Snapshot> snaps = makeStorageTestSnapshots();
+    const size_t copy = snaps.size();
+    for (size_t i = 0; i < copy; ++i) {
+        snaps.push_back(snaps[i]);
+        snaps.back().epoch += 100000;
+    }
+    writeStorageTestFiles(snaps, StorageOptions());
+    QueryEngine reference({"DELTA"});
+    auto expectedOutput = [&reference](const QueryCriteria &criteria) {
+        std::ostringstream out, err;
+        reference.printSnapshots(reference.query(criteria), criteria, out, err);
+        return out.str();
+    };
+    const string socketPath = "test_query.sock";
+    {
+        QueryServer server({"DELTA"});
+        assert(server.start(socketPath));
+        std::thread serverThread(&QueryServer::run, &server);
+        
+        // Test 1: Several requests on one connection, with and without fields.
+        QueryClient client;
+        assert(client.connect(socketPath));
+        string response;
+        uint32_t status = kResponseError;
+        assert(client.request("DELTA 1100 9000 bid1p,ask2q,lastTradePrice", response, status));
+        assert(status == kResponseOk);
+        assert(response == expectedOutput({1100, 9000, {"DELTA"}, {"bid1p", "ask2q", "lastTradePrice"}}));
+        assert(client.request("ALL 0 4611686018427387904", response, status));
+        assert(status == kResponseOk && response == expectedOutput({0, 1LL << 62, {"DELTA"}, {}}));
+        assert(client.request("DELTA 0 4611686018427387904 --limit=5", response, status) && status == kResponseOk);
+        QueryCriteria limited = {0, 1LL << 62, {"DELTA"}, {}};
+        limited.limit = 5;
+        assert(response == expectedOutput(limited));
+        assert(client.request("DELTA 0 4611686018427387904 --where=bid1q>2,ask1p-bid1p<0.3", response, status));
+        QueryCriteria filtered = {0, 1LL << 62, {"DELTA"}, {}};
+        assert(filtered.filter.parse("bid1q>2,ask1p-bid1p<0.3", std::cerr));
+        assert(status == kResponseOk && response == expectedOutput(filtered));
+        
+        // Test 2: Bad requests get an error response and leave the connection usable.
+        assert(client.request("DELTA 9000 1100", response, status) && status == kResponseError);
+        assert(client.request("DELTA 1000 2000 bid6p", response, status) && status == kResponseError);
+        assert(response.find("Unknown field \"bid6p\"") != string::npos);
+        assert(client.request("DELTA x 2000", response, status) && status == kResponseError);
+        assert(client.request("", response, status) && status == kResponseError);
+        assert(client.request("DELTA 0 1 --limit=x", response, status) && status == kResponseError);
+        assert(client.request("DELTA 0 1 --where=bid1p>", response, status) && status == kResponseError);
+        assert(response.find("Invalid filter") != string::npos);
+        assert(client.request("DELTA 1000 1000", response, status) && status == kResponseOk);
+        
+        // Test 3: Concurrent clients.
+        string expected = expectedOutput({5000, 9000, {"DELTA"}, {}});
+        vector<std::thread> clients;
+        std::atomic<int> matches(0);
+        for (int t = 0; t < 4; ++t) {
+            clients.emplace_back([&]() {
+                QueryClient own;
+                assert(own.connect(socketPath));
+                string text;
+                uint32_t code;
+                for (int i = 0; i < 20; ++i) {
+                    if (own.request("DELTA 5000 9000", text, code) && code == kResponseOk && text == expected)
+                        ++matches;
+                }
+            });
+        }
+        for (auto &t : clients)
+            t.join();
+        assert(matches == 80);
+        
+        // Test 4: A second server does not take over the socket of a running one.
+        {
+            QueryServer second({"DELTA"});
+            assert(!second.start(socketPath));
+        }
+        assert(client.request("DELTA 1000 1000", response, status) && status == kResponseOk);
+        QueryClient late;
+        assert(late.connect(socketPath));
+        late.close();
+        
+        // Test 5: Query output is sent in pieces of about kResponseChunkBytes.
+        vector<string> pieces;
+        assert(server.handleRequest("DELTA 0 4611686018427387904", [&pieces](uint32_t code, const string &text) {
+            assert(code == kResponseOk);
+            pieces.push_back(text);
+            return true;
+        }) == kResponseOk);
+        string joined;
+        for (const auto &piece : pieces)
+            joined += piece;
+        assert(joined == expectedOutput({0, 1LL << 62, {"DELTA"}, {}}));
+        assert(joined.size() > QueryServer::kResponseChunkBytes && pieces.size() >= 2);
+        for (size_t i = 0; i + 1 < pieces.size(); ++i)
+            assert(pieces[i].size() >= QueryServer::kResponseChunkBytes &&
+                   pieces[i].size() < QueryServer::kResponseChunkBytes + 1024);
+        
+        // Test 6: "refresh" picks up rewritten files.
+        vector<Snapshot> fewer(snaps.begin(), snaps.begin() + 100);
+        writeStorageTestFiles(fewer, StorageOptions());
+        assert(client.request("refresh", response, status) && status == kResponseOk);
+        assert(client.request("DELTA 0 4611686018427387904", response, status) && status == kResponseOk);
+        assert(response == expectedOutput({0, 1LL << 62, {"DELTA"}, {}}));
+        
+        client.close();
+        server.stop();
+        serverThread.join();
+    }
+    // The server removes its socket file.
+    std::ifstream gone(socketPath);
+    assert(!gone.is_open());
+    gone.close();
+    
+    // Test 7: A socket file left behind by a server that is gone is replaced.
+    std::ofstream stale(socketPath);
+    stale.close();
+    {
+        QueryServer server({"DELTA"});
+        assert(server.start(socketPath));
+        std::thread serverThread(&QueryServer::run, &server);
+        QueryClient client;
+        string response;
+        uint32_t status = kResponseError;
+        assert(client.connect(socketPath) && client.request("DELTA 1000 1000", response, status));
+        assert(status == kResponseOk);
+        client.close();
+        server.stop();
+        serverThread.join();
+    }
+    std::remove("DELTA.snap");
+    std::remove("DELTA.idx");
+    std::remove("DELTA.zmap");
+#endif
+    cout << "QueryServer test passed (26/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -554,7 +2129,7 @@ void testBookProcessorEmptyFile() {
     // The file should not exist.
     assert(!snapIfs.is_open());
     std::remove(filename.c_str());
-    cout << "BookProcessor Empty File Test passed (9/12)!" << endl << endl;
+    cout << "BookProcessor Empty File Test passed (27/37)!" << endl << endl;
 }
 
 // Test: BookProcessor with a single valid order.
@@ -572,6 +2147,7 @@ void testBookProcessorSingleOrder() {
     // Remove any previous snapshot/index files.
     std::remove("SINGLE.snap");
     std::remove("SINGLE.idx");
+    std::remove("SINGLE.zmap");
     
     vector<string> files = { filename };
     BookProcessor processor(files);
@@ -598,7 +2174,8 @@ void testBookProcessorSingleOrder() {
     std::remove(filename.c_str());
     std::remove("SINGLE.snap");
     std::remove("SINGLE.idx");
-    cout << "BookProcessor Single Order Test passed (10/12)!" << endl << endl;
+    std::remove("SINGLE.zmap");
+    cout << "BookProcessor Single Order Test passed (28/37)!" << endl << endl;
 }
 
 // Test: BookProcessor with invalid input lines.
@@ -618,6 +2195,7 @@ void testBookProcessorInvalidInput() {
     // Remove any previous snapshot/index files.
     std::remove("INVALID.snap");
     std::remove("INVALID.idx");
+    std::remove("INVALID.zmap");
     
     vector<string> files = { filename };
     BookProcessor processor(files);
@@ -645,7 +2223,968 @@ void testBookProcessorInvalidInput() {
     std::remove(filename.c_str());
     std::remove("INVALID.snap");
     std::remove("INVALID.idx");
-    cout << "BookProcessor Invalid Input Test passed (11/12)!" << endl << endl;
+    std::remove("INVALID.zmap");
+    cout << "BookProcessor Invalid Input Test passed (29/37)!" << endl << endl;
+}
+
+// Test: Pipelined ingestion produces exactly the serial result.
+void testBookProcessorPipeline() {
+    cout << "Running BookProcessor Pipeline Test..." << endl;
+    
+    // Deterministic mix of NEW, CANCEL and TRADE events on a few price levels.
+    vector<string> lines;
+    for (int i = 0; i < 200; ++i) {
+        std::ostringstream oss;
+        const char *side = (i % 2 == 0) ? "BUY" : "SELL";
+        const char *category = (i % 7 == 3) ? "TRADE" : (i % 5 == 4) ? "CANCEL" : "NEW";
+        double price = (i % 2 == 0) ? 100.0 - (i % 6) * 0.5 : 101.0 + (i % 6) * 0.5;
+        oss << (1000 + i) << " \t " << (7000 + (i % 40)) << "\tPIPE      " << side << " " << category
+            << "      " << price << "   " << (1 + i % 9);
+        lines.push_back(oss.str());
+    }
+    lines.push_back("this is not a valid line");
+    writeToFile("pipe.log", lines);
+    
+    std::remove("PIPE.snap");
+    std::remove("PIPE.idx");
+    std::remove("PIPE.zmap");
+    {
+        BookProcessor processor({"pipe.log"});
+        processor.process();
+    }
+    vector<Snapshot> serial = readAllSnapshots("PIPE.snap");
+    assert(serial.size() == 200);
+    
+    std::remove("PIPE.snap");
+    std::remove("PIPE.idx");
+    std::remove("PIPE.zmap");
+    {
+        // Tiny chunks force many chunks through the parallel parse stage.
+        ProcessorOptions options;
+        options.parseThreads = 3;
+        options.chunkBytes = 64;
+        BookProcessor processor({"pipe.log"}, options);
+        processor.process();
+    }
+    vector<Snapshot> pipelined = readAllSnapshots("PIPE.snap");
+    assert(pipelined.size() == serial.size());
+    for (size_t i = 0; i < serial.size(); ++i)
+        assert(sameSnapshot(serial[i], pipelined[i]));
+    
+    std::remove("pipe.log");
+    std::remove("PIPE.snap");
+    std::remove("PIPE.idx");
+    std::remove("PIPE.zmap");
+    cout << "BookProcessor Pipeline Test passed (30/37)!" << endl << endl;
+}
+
+// Test: Changed-only ingestion keeps exactly the snapshots that differ from their predecessor.
+void testBookProcessorChangedSnapshots() {
+    cout << "Running BookProcessor Changed Snapshots Test..." << endl;
+    
+    // A few top levels plus a lot of deep-book noise and unknown cancels.
+    vector<string> lines;
+    for (int i = 0; i < 300; ++i) {
+        std::ostringstream oss;
+        bool deep = (i % 3 != 0);
+        const char *category = (i % 10 == 9) ? "CANCEL" : "NEW";
+        double price = deep ? 50.0 - (i % 40) : 100.0 - (i % 4);
+        oss << (2000 + i) << " " << (i % 10 == 9 ? 999999 : 3000 + i) << " CHG BUY " << category << " "
+            << price << " " << (1 + i % 5);
+        lines.push_back(oss.str());
+    }
+    writeToFile("chg.log", lines);
+    
+    std::remove("CHG.snap");
+    std::remove("CHG.idx");
+    std::remove("CHG.zmap");
+    {
+        BookProcessor processor({"chg.log"});
+        processor.process();
+    }
+    vector<Snapshot> all = readAllSnapshots("CHG.snap");
+    assert(all.size() == lines.size());
+    vector<Snapshot> expected;
+    for (size_t i = 0; i < all.size(); ++i) {
+        Snapshot previous = (i == 0) ? OrderBook("CHG").getSnapshot(all[i].epoch) : all[i - 1];
+        previous.epoch = all[i].epoch;
+        if (!sameSnapshot(previous, all[i]))
+            expected.push_back(all[i]);
+    }
+    assert(expected.size() < all.size() / 2);
+    
+    for (BookType type : {BookType::Map, BookType::Ladder}) {
+        std::remove("CHG.snap");
+        std::remove("CHG.idx");
+        std::remove("CHG.zmap");
+        ProcessorOptions options;
+        options.bookType = type;
+        options.changedSnapshotsOnly = true;
+        {
+            BookProcessor processor({"chg.log"}, options);
+            processor.process();
+        }
+        vector<Snapshot> changed = readAllSnapshots("CHG.snap");
+        assert(changed.size() == expected.size());
+        for (size_t i = 0; i < changed.size(); ++i)
+            assert(sameSnapshot(changed[i], expected[i]));
+    }
+    
+    std::remove("chg.log");
+    std::remove("CHG.snap");
+    std::remove("CHG.idx");
+    std::remove("CHG.zmap");
+    cout << "BookProcessor Changed Snapshots Test passed (32/37)!" << endl << endl;
+}
+
+// Test: Interleaved multi-symbol input is routed to independent per-symbol books.
+void testBookProcessorShardedRouting() {
+    cout << "Running BookProcessor Sharded Routing Test..." << endl;
+    
+    // Two symbols with overlapping prices, interleaved line by line.
+    vector<string> mixed, onlyA, onlyB;
+    for (int i = 0; i < 60; ++i) {
+        bool isA = (i % 3 != 0);
+        std::ostringstream oss;
+        oss << (5000 + i) << " " << (9000 + i % 20) << " " << (isA ? "MIXA" : "MIXB") << " "
+            << ((i % 2) ? "SELL" : "BUY") << " " << ((i % 6 == 5) ? "TRADE" : "NEW") << " "
+            << ((i % 2) ? 51 + i % 4 : 50 - i % 4) << " " << (i % 5 + 1);
+        mixed.push_back(oss.str());
+        (isA ? onlyA : onlyB).push_back(oss.str());
+    }
+    writeToFile("mixa.log", onlyA);
+    writeToFile("mixb.log", onlyB);
+    writeToFile("mix.log", mixed);
+    // The same input split across two files: both symbols continue in the second one.
+    writeToFile("mix1.log", vector<string>(mixed.begin(), mixed.begin() + 30));
+    writeToFile("mix2.log", vector<string>(mixed.begin() + 30, mixed.end()));
+    
+    const char *outputs[] = {"MIXA.snap", "MIXA.idx", "MIXA.zmap", "MIXB.snap", "MIXB.idx", "MIXB.zmap"};
+    for (const char *f : outputs) std::remove(f);
+    {
+        // Reference: one single-symbol file per symbol.
+        BookProcessor processor({"mixa.log", "mixb.log"});
+        processor.process();
+    }
+    vector<Snapshot> expectedA = readAllSnapshots("MIXA.snap");
+    vector<Snapshot> expectedB = readAllSnapshots("MIXB.snap");
+    assert(expectedA.size() == onlyA.size() && expectedB.size() == onlyB.size());
+    
+    for (size_t parseThreads : {0, 2}) {
+        for (const char *f : outputs) std::remove(f);
+        ProcessorOptions options;
+        options.shardThreads = 2;
+        options.parseThreads = parseThreads;
+        options.chunkBytes = 128;
+        {
+            BookProcessor processor({"mix.log"}, options);
+            processor.process();
+        }
+        vector<Snapshot> gotA = readAllSnapshots("MIXA.snap");
+        vector<Snapshot> gotB = readAllSnapshots("MIXB.snap");
+        assert(gotA.size() == expectedA.size() && gotB.size() == expectedB.size());
+        for (size_t i = 0; i < gotA.size(); ++i)
+            assert(sameSnapshot(gotA[i], expectedA[i]));
+        for (size_t i = 0; i < gotB.size(); ++i)
+            assert(sameSnapshot(gotB[i], expectedB[i]));
+        
+        // Files are applied per symbol in input order, whichever file is parsed first.
+        for (const char *f : outputs) std::remove(f);
+        {
+            BookProcessor processor({"mix1.log", "mix2.log"}, options);
+            processor.process();
+        }
+        gotA = readAllSnapshots("MIXA.snap");
+        gotB = readAllSnapshots("MIXB.snap");
+        assert(gotA.size() == expectedA.size() && gotB.size() == expectedB.size());
+        for (size_t i = 0; i < gotA.size(); ++i)
+            assert(sameSnapshot(gotA[i], expectedA[i]));
+        for (size_t i = 0; i < gotB.size(); ++i)
+            assert(sameSnapshot(gotB[i], expectedB[i]));
+    }
+    
+    for (const char *f : outputs) std::remove(f);
+    std::remove("mix.log");
+    std::remove("mix1.log");
+    std::remove("mix2.log");
+    std::remove("mixa.log");
+    std::remove("mixb.log");
+    cout << "BookProcessor Sharded Routing Test passed (31/37)!" << endl << endl;
+}
+
+// Helper: Compares two book states; the resting orders may come in any order.
+bool sameBookState(BookState a, BookState b) {
+    auto byId = [](const BookState::RestingOrder &x, const BookState::RestingOrder &y) { return x.orderId < y.orderId; };
+    std::sort(a.orders.begin(), a.orders.end(), byId);
+    std::sort(b.orders.begin(), b.orders.end(), byId);
+    if (a.orders.size() != b.orders.size() || a.bids != b.bids || a.asks != b.asks ||
+        a.lastTradePrice != b.lastTradePrice || a.lastTradeQuantity != b.lastTradeQuantity)
+        return false;
+    for (size_t i = 0; i < a.orders.size(); ++i) {
+        const auto &x = a.orders[i];
+        const auto &y = b.orders[i];
+        if (x.orderId != y.orderId || x.side != y.side || x.price != y.price || x.quantity != y.quantity)
+            return false;
+    }
+    return true;
+}
+
+// Test: The book journal rebuilds the full book at any epoch from the event
+// log and the nearest checkpoint.
+void testBookJournal() {
+    cout << "Running Book Journal test..." << endl;
+    
+    // Orders over 30 price levels per side, with cancels and trades of earlier orders.
+    vector<Order> orders;
+    for (int i = 0; i < 240; ++i) {
+        Order order;
+        order.epoch = 7000 + i / 2;  // Pairs of events share an epoch.
+        order.symbol = "JRN";
+        order.side = (i % 2) ? OrderSide::SELL : OrderSide::BUY;
+        order.category = OrderCategory::NEW;
+        order.orderId = std::to_string(60000 + i);
+        order.price = (i % 2) ? 50.5 + (i * 7 % 30) * 0.25 : 50.0 - (i * 7 % 30) * 0.25;
+        order.quantity = 1 + i % 9;
+        if (i % 5 == 3 || i % 11 == 10) {
+            const Order &earlier = orders[i - 3];
+            order.side = earlier.side;
+            order.orderId = earlier.orderId;
+            order.price = earlier.price;
+            order.category = (i % 5 == 3) ? OrderCategory::CANCEL : OrderCategory::TRADE;
+            order.quantity = (i % 5 == 3) ? earlier.quantity : 1;
+        }
+        orders.push_back(order);
+    }
+    
+    // Test 1: saveState/loadState carry a book between implementations and ID modes.
+    OrderBook source("JRN");
+    for (size_t i = 0; i < 120; ++i)
+        source.processOrder(orders[i]);
+    BookState saved;
+    source.saveState(saved);
+    assert(saved.bids.size() > 5 && saved.asks.size() > 5 && saved.lastTradePrice > 0);
+    std::unique_ptr<OrderBookBase> copies[] = {
+        makeOrderBook(BookType::Map, "JRN", OrderIdMode::Integer),
+        makeOrderBook(BookType::Ladder, "JRN", OrderIdMode::String),
+        makeOrderBook(BookType::Ladder, "JRN", OrderIdMode::Integer)};
+    for (auto &copy : copies) {
+        copy->processOrder(orders[0]);  // Replaced by loadState.
+        copy->loadState(saved);
+        BookState state;
+        copy->saveState(state);
+        assert(sameBookState(state, saved));
+        assert(sameSnapshot(copy->getSnapshot(1), source.getSnapshot(1)));
+    }
+    OrderBook continued("JRN");
+    continued.loadState(saved);
+    for (size_t i = 120; i < orders.size(); ++i) {
+        source.processOrder(orders[i]);
+        continued.processOrder(orders[i]);
+        for (auto &copy : copies)
+            copy->processOrder(orders[i]);
+    }
+    BookState expectedEnd, state;
+    source.saveState(expectedEnd);
+    continued.saveState(state);
+    assert(sameBookState(state, expectedEnd));
+    for (auto &copy : copies) {
+        copy->saveState(state);
+        assert(sameBookState(state, expectedEnd));
+    }
+    
+    // Test 2: Event and book state records round-trip; truncated records are rejected.
+    vector<char> bytes;
+    int64_t previousEpoch = orders[0].epoch;
+    appendEvent(orders[0], nullptr, bytes);
+    for (size_t i = 1; i < 10; ++i) {
+        appendEvent(orders[i], &previousEpoch, bytes);
+        previousEpoch = orders[i].epoch;
+    }
+    const char *p = bytes.data();
+    previousEpoch = -1;
+    for (size_t i = 0; i < 10; ++i) {
+        Order order;
+        assert(readEvent(p, bytes.data() + bytes.size(), previousEpoch, order));
+        assert(order.epoch == orders[i].epoch && order.orderId == orders[i].orderId &&
+               order.side == orders[i].side && order.category == orders[i].category &&
+               order.price == orders[i].price && order.quantity == orders[i].quantity);
+    }
+    assert(p == bytes.data() + bytes.size());
+    Order numeric = orders[0];
+    numeric.numericId = 18446744073709551615ULL;
+    numeric.orderId.clear();
+    bytes.clear();
+    appendEvent(numeric, nullptr, bytes);
+    p = bytes.data();
+    Order logged;
+    assert(readEvent(p, bytes.data() + bytes.size(), previousEpoch, logged) && logged.orderId == "18446744073709551615");
+    bytes.clear();
+    appendBookState(saved, bytes);
+    assert(readBookState(bytes.data(), bytes.size(), state) && sameBookState(state, saved));
+    assert(!readBookState(bytes.data(), bytes.size() - 1, state));
+    
+    // Test 3: A journaled run rebuilds the book at any epoch: before the first
+    // event, on and between checkpoints, and after the last event.
+    vector<string> lines;
+    for (const auto &order : orders) {
+        std::ostringstream oss;
+        oss << order.epoch << " " << order.orderId << " JRN " << (order.side == OrderSide::BUY ? "BUY" : "SELL")
+            << " " << (order.category == OrderCategory::NEW ? "NEW" : order.category == OrderCategory::CANCEL ? "CANCEL" : "TRADE")
+            << " " << order.price << " " << order.quantity;
+        lines.push_back(oss.str());
+    }
+    writeToFile("jrn.log", lines);
+    for (size_t shards : {0, 1}) {
+        removeSymbolFiles("JRN");
+        std::remove("JRN.events");
+        std::remove("JRN.ckpt");
+        ProcessorOptions options;
+        options.journal = true;
+        options.checkpointEvents = 17;
+        options.shardThreads = shards;
+        options.bookType = shards ? BookType::Ladder : BookType::Map;
+        {
+            BookProcessor processor({"jrn.log"}, options);
+            processor.process();
+        }
+        std::ostringstream err;
+        for (int64_t epoch : {int64_t(6999), int64_t(7000), int64_t(7008), int64_t(7033), int64_t(7050),
+                              int64_t(7119), int64_t(9000)}) {
+            OrderBook direct("JRN");
+            for (const auto &order : orders) {
+                if (order.epoch <= epoch)
+                    direct.processOrder(order);
+            }
+            BookState expected;
+            direct.saveState(expected);
+            size_t replayed = 0;
+            assert(rebuildBook("JRN", epoch, state, err, &replayed));
+            assert(sameBookState(state, expected));
+            assert(replayed <= 18);  // At most the events between two checkpoints (plus a shared epoch).
+        }
+        assert(err.str().empty());
+    }
+    std::ostringstream err;
+    assert(!rebuildBook("NOJRN", 7000, state, err) && !err.str().empty());
+    
+    std::remove("jrn.log");
+    std::remove("JRN.events");
+    std::remove("JRN.ckpt");
+    removeSymbolFiles("JRN");
+    cout << "Book Journal test passed (33/37)!" << endl << endl;
+}
+
+// Helper: True if a snapshot of any depth holds the top levels of a book
+// state, with price -1 and quantity 0 past the last level.
+template <int Depth>
+bool matchesBookState(const BasicSnapshot<Depth> &snap, const BookState &state) {
+    for (int i = 0; i < Depth; ++i) {
+        const bool bid = i < static_cast<int>(state.bids.size());
+        const bool ask = i < static_cast<int>(state.asks.size());
+        if (snap.bidPrices[i] != (bid ? state.bids[i].first : -1.0) ||
+            snap.bidQuantities[i] != (bid ? state.bids[i].second : 0) ||
+            snap.askPrices[i] != (ask ? state.asks[i].first : -1.0) ||
+            snap.askQuantities[i] != (ask ? state.asks[i].second : 0))
+            return false;
+    }
+    return snap.lastTradePrice == state.lastTradePrice && snap.lastTradeQuantity == state.lastTradeQuantity;
+}
+
+// Helper: Compares two snapshots of the same depth field by field.
+template <int Depth>
+bool sameDepthSnapshot(const BasicSnapshot<Depth> &a, const BasicSnapshot<Depth> &b) {
+    if (std::strncmp(a.symbol, b.symbol, sizeof(a.symbol)) != 0 || a.epoch != b.epoch)
+        return false;
+    for (int i = 0; i < Depth; ++i) {
+        if (a.bidPrices[i] != b.bidPrices[i] || a.bidQuantities[i] != b.bidQuantities[i] ||
+            a.askPrices[i] != b.askPrices[i] || a.askQuantities[i] != b.askQuantities[i])
+            return false;
+    }
+    return a.lastTradePrice == b.lastTradePrice && a.lastTradeQuantity == b.lastTradeQuantity;
+}
+
+// Test: Snapshots of 1, 10 and 20 levels per side are taken from both books,
+// written to depth-format files and read back through the templated query path.
+void testSnapshotDepth() {
+    cout << "Running Snapshot Depth test..." << endl;
+    
+    // Test 1: The default depth keeps the on-disk record; layouts follow the depth.
+    assert(sizeof(Snapshot) == 160 && Snapshot::kDepth == kDefaultDepth);
+    SnapshotLayout layout;
+    assert(snapshotLayout(10, layout) && layout.recordBytes == sizeof(BasicSnapshot<10>) &&
+           layout.askQuantities == offsetof(BasicSnapshot<10>, askQuantities));
+    assert(!snapshotLayout(7, layout) && !withDepth(7, [](auto) {}));
+    
+    // Orders over 24 price levels per side, with cancels and trades of earlier orders.
+    vector<Order> orders;
+    for (int i = 0; i < 200; ++i) {
+        Order order;
+        order.epoch = 9000 + i;
+        order.symbol = "DPT";
+        order.side = (i % 2) ? OrderSide::SELL : OrderSide::BUY;
+        order.category = OrderCategory::NEW;
+        order.orderId = std::to_string(80000 + i);
+        order.price = (i % 2) ? 20.5 + (i / 2 * 5 % 24) * 0.5 : 20.0 - (i / 2 * 5 % 24) * 0.5;
+        order.quantity = 1 + i % 7;
+        if (i >= 4 && (i % 5 == 3 || i % 13 == 12)) {
+            const Order &earlier = orders[i - 4];
+            order.side = earlier.side;
+            order.orderId = earlier.orderId;
+            order.price = earlier.price;
+            order.category = (i % 5 == 3) ? OrderCategory::CANCEL : OrderCategory::TRADE;
+            order.quantity = (i % 5 == 3) ? earlier.quantity : 1;
+        }
+        orders.push_back(order);
+    }
+    
+    // Test 2: Both books take snapshots of every depth from their top levels;
+    // at the default depth getDepthSnapshot() is getSnapshot().
+    for (BookType type : {BookType::Map, BookType::Ladder}) {
+        std::unique_ptr<OrderBookBase> book = makeOrderBook(type, "DPT", OrderIdMode::String);
+        BookState state;
+        for (const auto &order : orders) {
+            book->processOrder(order);
+            book->saveState(state);
+            const auto top1 = book->getDepthSnapshot<1>(order.epoch);
+            const auto top10 = book->getDepthSnapshot<10>(order.epoch);
+            const auto top20 = book->getDepthSnapshot<20>(order.epoch);
+            assert(matchesBookState(top1, state) && matchesBookState(top10, state) && matchesBookState(top20, state));
+            assert(top20.epoch == order.epoch && std::strcmp(top20.symbol, "DPT") == 0);
+            assert(sameSnapshot(book->getDepthSnapshot<5>(order.epoch), book->getSnapshot(order.epoch)));
+        }
+        assert(state.bids.size() > 10 && state.asks.size() > 10 && state.lastTradePrice > 0);
+    }
+    
+    // Test 3: visibleChanged() watches the configured depth: it never misses a
+    // change of the depth-1 snapshot and ignores updates below the best level.
+    for (BookType type : {BookType::Map, BookType::Ladder}) {
+        std::unique_ptr<OrderBookBase> top = makeOrderBook(type, "DPT", OrderIdMode::String, 1);
+        std::unique_ptr<OrderBookBase> deep = makeOrderBook(type, "DPT", OrderIdMode::String, 20);
+        assert(top->visibleLevels() == 1 && deep->visibleLevels() == 20);
+        size_t topChanges = 0, deepChanges = 0;
+        BasicSnapshot<1> previous = top->getDepthSnapshot<1>(0);
+        for (const auto &order : orders) {
+            top->processOrder(order);
+            deep->processOrder(order);
+            const BasicSnapshot<1> current = top->getDepthSnapshot<1>(0);
+            if (!sameDepthSnapshot(current, previous))
+                assert(top->visibleChanged());
+            previous = current;
+            topChanges += top->visibleChanged();
+            deepChanges += deep->visibleChanged();
+        }
+        assert(topChanges > 0 && topChanges < deepChanges);
+    }
+    
+    // Test 4: A depth-10 run writes a depth header and one record per order,
+    // which queryDepth() returns in epoch order.
+    vector<string> lines;
+    for (const auto &order : orders) {
+        std::ostringstream oss;
+        oss << order.epoch << " " << order.orderId << " DPT " << (order.side == OrderSide::BUY ? "BUY" : "SELL")
+            << " " << (order.category == OrderCategory::NEW ? "NEW" : order.category == OrderCategory::CANCEL ? "CANCEL" : "TRADE")
+            << " " << order.price << " " << order.quantity;
+        lines.push_back(oss.str());
+    }
+    writeToFile("dpt.log", lines);
+    OrderBook direct("DPT");
+    vector<BasicSnapshot<10>> expected;
+    for (const auto &order : orders) {
+        direct.processOrder(order);
+        expected.push_back(direct.getDepthSnapshot<10>(order.epoch));
+    }
+    for (size_t shards : {0, 1}) {
+        removeSymbolFiles("DPT");
+        ProcessorOptions options;
+        options.storage.depth = 10;
+        options.storage.indexBlockRecords = 16;
+        options.shardThreads = shards;
+        options.bookType = shards ? BookType::Ladder : BookType::Map;
+        {
+            BookProcessor processor({"dpt.log"}, options);
+            processor.process();
+        }
+        assert(detectSnapshotDepth("DPT.snap") == 10);
+        std::ifstream snapFile("DPT.snap", std::ios::binary | std::ios::ate);
+        assert(static_cast<size_t>(snapFile.tellg()) == kDepthHeaderBytes + orders.size() * sizeof(BasicSnapshot<10>));
+        std::ifstream zmapFile("DPT.zmap");
+        assert(!zmapFile.is_open());  // No zone map for other depths.
+        
+        QueryCriteria criteria;
+        criteria.startEpoch = 0;
+        criteria.endEpoch = 100000;
+        criteria.symbols = {"DPT"};
+        vector<BasicSnapshot<10>> results;
+        std::ostringstream err;
+        size_t count = queryDepth<10>(criteria, [&results](const BasicSnapshot<10> &snap) {
+            results.push_back(snap);
+            return true;
+        }, err);
+        assert(count == orders.size() && results.size() == orders.size() && err.str().empty());
+        for (size_t i = 0; i < results.size(); ++i)
+            assert(sameDepthSnapshot(results[i], expected[i]));
+        
+        // An epoch range in the middle of a block, with a limit.
+        criteria.startEpoch = 9037;
+        criteria.endEpoch = 9120;
+        criteria.limit = 50;
+        results.clear();
+        count = queryDepth<10>(criteria, [&results](const BasicSnapshot<10> &snap) {
+            results.push_back(snap);
+            return true;
+        }, err);
+        assert(count == 50 && results.front().epoch == 9037 && results.back().epoch == 9086);
+    }
+    
+    // Test 5: The depth-10 files are printed at their depth and refused
+    // wherever depth-5 snapshots are expected.
+    QueryCriteria criteria;
+    criteria.startEpoch = 9000;
+    criteria.endEpoch = 9000;
+    criteria.symbols = {"DPT"};
+    std::ostringstream out, err;
+    {
+        SnapshotPrinter printer(criteria, out, err, OutputFormat::Text, 10);
+        assert(printer.printHeader());
+        queryDepth<10>(criteria, [&printer](const BasicSnapshot<10> &snap) {
+            printer.print(snap);
+            return true;
+        }, err);
+    }
+    assert(out.str().find("bid10q@bid10p") != string::npos && out.str().find("\nDPT, 9000, ") != string::npos);
+    assert(detectQueryDepth({"DPT"}, err) == 10);
+    for (ReaderMode mode : {ReaderMode::Stream, ReaderMode::Mapped}) {
+        QueryEngine engine({"DPT"}, mode);
+        assert(engine.query(criteria, [](const Snapshot &) { return true; }) == 0);
+    }
+    assert(criteria.filter.parse("bid1q>0", err));
+    assert(queryDepth<10>(criteria, [](const BasicSnapshot<10> &) { return true; }, err) == 0);
+    assert(queryDepth<20>(QueryCriteria{0, 100000, {"DPT"}, {}, 0, SnapshotFilter()},
+                          [](const BasicSnapshot<20> &) { return true; }, err) == 0);
+    
+    // Appending another depth to the files is refused.
+    StorageOptions storage;
+    {
+        SnapshotWriter writer("DPT", storage);
+        assert(!writer.isOpen());
+    }
+    storage.depth = 10;
+    {
+        SnapshotWriter writer("DPT", storage);
+        assert(writer.isOpen());
+        writer.write(direct.getSnapshot(9500));  // Depth 5: refused.
+        writer.write(direct.getDepthSnapshot<10>(9500));
+    }
+    std::ifstream snapFile("DPT.snap", std::ios::binary | std::ios::ate);
+    assert(static_cast<size_t>(snapFile.tellg()) == kDepthHeaderBytes + (orders.size() + 1) * sizeof(BasicSnapshot<10>));
+    snapFile.close();
+    
+    // A record older than the file's last one is refused.
+    {
+        SnapshotWriter writer("DPT", storage);
+        writer.write(direct.getDepthSnapshot<10>(9000));
+    }
+    vector<int64_t> epochs;
+    QueryCriteria all{0, 100000, {"DPT"}, {}, 0, SnapshotFilter()};
+    assert(queryDepth<10>(all, [&epochs](const BasicSnapshot<10> &snap) {
+        epochs.push_back(snap.epoch);
+        return true;
+    }, err) == orders.size() + 1);
+    assert(std::is_sorted(epochs.begin(), epochs.end()) && epochs.back() == 9500);
+    
+    std::remove("dpt.log");
+    removeSymbolFiles("DPT");
+    cout << "Snapshot Depth test passed (34/37)!" << endl << endl;
+}
+
+// Test: Fixed-point prices: books keyed on ticks match the floating-point
+// books and refuse off-grid prices, and the ticks format stores int32 tick
+// prices that every reader turns back into the same snapshots.
+void testFixedPointPrices() {
+    cout << "Running Fixed-Point Prices test..." << endl;
+    
+    // Test 1: Tick conversion recovers the exact count from the parsed decimal.
+    int64_t ticks = 0;
+    assert(priceToTicks(106.99, 100, ticks) && ticks == 10699);
+    assert(priceToTicks(0.1 + 0.2, 10, ticks) && ticks == 3);
+    assert(priceToTicks(-1.0, 100, ticks) && ticks == -100);
+    assert(!priceToTicks(1.005, 100, ticks) && !priceToTicks(106.991, 100, ticks));
+    assert(!priceToTicks(std::numeric_limits<double>::infinity(), 100, ticks) && !priceToTicks(1e15, 100, ticks));
+    assert(priceDecimals(1) == 0 && priceDecimals(100) == 2 && priceDecimals(20) == 2 && priceDecimals(1000) == 3 &&
+           priceDecimals(3) == 9);
+    PriceScales scales;
+    std::ostringstream err;
+    assert(scales.empty() && scales.parse("100,FPY:1000", err) && err.str().empty());
+    assert(!scales.empty() && scales.forSymbol("FPX") == 100 && scales.forSymbol("FPY") == 1000);
+    assert(!PriceScales().parse("FPX:0", err) && !PriceScales().parse(":5", err) && !PriceScales().parse("1,", err));
+    
+    // Orders on the 0.05 grid, with cancels and trades of earlier orders.
+    vector<Order> orders;
+    for (int i = 0; i < 120; ++i) {
+        Order order;
+        order.epoch = 7000 + i;
+        order.symbol = "FPX";
+        order.side = (i % 2) ? OrderSide::SELL : OrderSide::BUY;
+        order.category = OrderCategory::NEW;
+        order.orderId = std::to_string(60000 + i);
+        // The doubles the parser yields for these decimal prices.
+        order.price = ((i % 2) ? 3005 + (i / 2 * 3 % 11) * 5 : 2995 - (i / 2 * 3 % 11) * 5) / 100.0;
+        order.quantity = 1 + i % 6;
+        if (i >= 4 && (i % 5 == 3 || i % 7 == 6)) {
+            const Order &earlier = orders[i - 4];
+            order.side = earlier.side;
+            order.orderId = earlier.orderId;
+            order.price = earlier.price;
+            order.category = (i % 5 == 3) ? OrderCategory::CANCEL : OrderCategory::TRADE;
+            order.quantity = 1;
+        }
+        orders.push_back(order);
+    }
+    
+    // Test 2: Books on the 1/100 grid show the same snapshots and state as the
+    // floating-point books, and refuse an order between two ticks.
+    for (BookType type : {BookType::Map, BookType::Ladder}) {
+        for (OrderIdMode idMode : {OrderIdMode::String, OrderIdMode::Integer}) {
+            std::unique_ptr<OrderBookBase> plain = makeOrderBook(type, "FPX", idMode);
+            std::unique_ptr<OrderBookBase> fixed = makeOrderBook(type, "FPX", idMode, OrderBookBase::kVisibleLevels, 100);
+            BookState plainState, fixedState;
+            for (const auto &order : orders) {
+                plain->processOrder(order);
+                fixed->processOrder(order);
+                assert(sameSnapshot(fixed->getSnapshot(order.epoch), plain->getSnapshot(order.epoch)));
+                assert(fixed->visibleChanged() == plain->visibleChanged());
+            }
+            plain->saveState(plainState);
+            fixed->saveState(fixedState);
+            assert(sameBookState(fixedState, plainState) && fixedState.lastTradePrice > 0);
+            
+            Order offGrid = orders.front();
+            offGrid.orderId = "69999";
+            offGrid.price = 29.955;
+            const Snapshot before = fixed->getSnapshot(8000);
+            fixed->processOrder(offGrid);
+            assert(!fixed->visibleChanged() && sameSnapshot(fixed->getSnapshot(8000), before));
+        }
+    }
+    
+    // Test 3: Floating-point keys order negative prices and merge -0.0 with 0.0.
+    OrderBook signedBook("FPX");
+    for (double price : {-1.5, -0.5, 0.0, -0.0}) {
+        Order order = orders.front();
+        order.orderId = std::to_string(static_cast<int>(price * 10) + 100) + (std::signbit(price) ? "n" : "p");
+        order.price = price;
+        signedBook.processOrder(order);
+    }
+    Snapshot signedSnap = signedBook.getSnapshot(0);
+    assert(signedSnap.bidPrices[0] == 0.0 && signedSnap.bidQuantities[0] == 2 * orders.front().quantity);
+    assert(signedSnap.bidPrices[1] == -0.5 && signedSnap.bidPrices[2] == -1.5 && signedSnap.bidPrices[3] == -1.0);
+    
+    // Test 4: Ticks records hold every snapshot of the grid exactly and refuse
+    // prices off the grid or beyond int32 ticks.
+    OrderBook direct("FPX", OrderIdMode::String, 100);
+    vector<Snapshot> expected;
+    for (const auto &order : orders) {
+        direct.processOrder(order);
+        expected.push_back(direct.getSnapshot(order.epoch));
+    }
+    TickSnapshot record;
+    Snapshot decoded;
+    assert(encodeTicks(expected.back(), 100, record) && record.bidTicks[0] > 0 && record.lastTradeTicks > 0);
+    decodeTicks(record, 100, decoded);
+    assert(sameSnapshot(decoded, expected.back()));
+    Snapshot outside = expected.back();
+    outside.askPrices[4] = 30.001;
+    assert(!encodeTicks(outside, 100, record));
+    outside.askPrices[4] = 3e7;
+    assert(!encodeTicks(outside, 100, record));
+    
+    // Test 5: A ticks-format run stores 104-byte records after the scale header,
+    // and every reader returns the snapshots of the floating-point book.
+    vector<string> lines;
+    for (const auto &order : orders) {
+        std::ostringstream oss;
+        oss << order.epoch << " " << order.orderId << " FPX " << (order.side == OrderSide::BUY ? "BUY" : "SELL")
+            << " " << (order.category == OrderCategory::NEW ? "NEW" : order.category == OrderCategory::CANCEL ? "CANCEL" : "TRADE")
+            << " " << order.price << " " << order.quantity;
+        lines.push_back(oss.str());
+    }
+    writeToFile("fpx.log", lines);
+    {
+        // Without a default scale, no snapshots are written at all.
+        removeSymbolFiles("FPX");
+        ProcessorOptions options;
+        options.storage.format = SnapshotFormat::Ticks;
+        options.priceScales.symbols["FPY"] = 1000;
+        BookProcessor processor({"fpx.log"}, options);
+        processor.process();
+        assert(!std::ifstream("FPX.snap").is_open());
+    }
+    for (uint32_t block : {16u, 0u}) {
+        removeSymbolFiles("FPX");
+        ProcessorOptions options;
+        options.storage.format = SnapshotFormat::Ticks;
+        options.storage.indexBlockRecords = block;
+        options.priceScales = scales;
+        options.bookType = block ? BookType::Map : BookType::Ladder;
+        {
+            BookProcessor processor({"fpx.log"}, options);
+            processor.process();
+        }
+        assert(detectSnapshotFormat("FPX.snap") == SnapshotFormat::Ticks && detectTicksPerUnit("FPX.snap") == 100);
+        std::ifstream snapFile("FPX.snap", std::ios::binary | std::ios::ate);
+        assert(static_cast<size_t>(snapFile.tellg()) == kTicksHeaderBytes + orders.size() * sizeof(TickSnapshot));
+        
+        for (ReaderMode mode : {ReaderMode::Stream, ReaderMode::Mapped}) {
+            QueryEngine engine({"FPX"}, mode);
+            QueryCriteria criteria{0, 100000, {"FPX"}, {}, 0, SnapshotFilter()};
+            vector<Snapshot> results = engine.query(criteria);
+            assert(results.size() == expected.size());
+            for (size_t i = 0; i < results.size(); ++i)
+                assert(sameSnapshot(results[i], expected[i]));
+            
+            // A range in the middle of a block, filtered.
+            criteria.startEpoch = 7021;
+            criteria.endEpoch = 7090;
+            assert(criteria.filter.parse("bid1q>2", err));
+            results = engine.query(criteria);
+            size_t matching = 0;
+            for (size_t i = 21; i <= 90; ++i)
+                matching += expected[i].bidQuantities[0] > 2;
+            assert(matching > 0 && results.size() == matching && results.front().epoch >= 7021);
+            
+            AsOfCriteria asOf;
+            asOf.symbols = {"FPX"};
+            asOf.epochs = {6999, 7003, 7100, 9000};
+            vector<AsOfMatch> matches = engine.asOf(asOf);
+            assert(matches.size() == 3 && sameSnapshot(matches[0].snapshot, expected[3]) &&
+                   sameSnapshot(matches[2].snapshot, expected.back()));
+        }
+    }
+    
+    // Test 6: A finer tick prints more decimals; another scale cannot be appended.
+    StorageOptions storage;
+    storage.format = SnapshotFormat::Ticks;
+    storage.ticksPerUnit = 1000;
+    {
+        SnapshotWriter writer("FPX", storage);
+        assert(!writer.isOpen());
+    }
+    storage.ticksPerUnit = 0;
+    {
+        SnapshotWriter writer("FPY", storage);
+        assert(!writer.isOpen());
+    }
+    storage.ticksPerUnit = 1000;
+    Snapshot fine = expected.back();
+    std::strncpy(fine.symbol, "FPY", sizeof(fine.symbol));
+    fine.bidPrices[0] = 30.125;
+    {
+        SnapshotWriter writer("FPY", storage);
+        assert(writer.isOpen());
+        writer.write(fine);
+    }
+    assert(queryPriceDecimals({"FPX"}) == 2 && queryPriceDecimals({"FPX", "FPY"}) == 3);
+    QueryCriteria printed{0, 100000, {"FPY"}, {"bid1p"}, 0, SnapshotFilter()};
+    std::ostringstream out;
+    {
+        SnapshotPrinter printer(printed, out, err);
+        printer.setPriceDecimals(queryPriceDecimals(printed.symbols));
+        assert(printer.printHeader());
+        QueryEngine engine({"FPY"});
+        engine.query(printed, [&printer](const Snapshot &snap) {
+            printer.print(snap);
+            return true;
+        });
+    }
+    assert(out.str() == "bid1p\n30.125\n");
+    
+    std::remove("fpx.log");
+    removeSymbolFiles("FPX");
+    removeSymbolFiles("FPY");
+    cout << "Fixed-Point Prices test passed (35/37)!" << endl << endl;
+}
+
+// Test: Resumed ingestion picks up each file where its checkpoint left off,
+// cuts back output of an interrupted run, and refuses a rewritten input.
+void testResumableIngestion() {
+    cout << "Running Resumable Ingestion test..." << endl;
+    
+    auto makeLines = [](int count, int64_t shift = 0) {
+        vector<string> lines;
+        for (int i = 0; i < count; ++i) {
+            std::ostringstream oss;
+            const char *side = (i % 2 == 0) ? "BUY" : "SELL";
+            const char *category = (i % 7 == 3) ? "TRADE" : (i % 5 == 4) ? "CANCEL" : "NEW";
+            double price = (i % 2 == 0) ? 100.0 - (i % 6) * 0.5 : 101.0 + (i % 6) * 0.5;
+            oss << (8000 + shift + i) << " " << (9000 + (i % 40)) << " RSM " << side << " " << category << " " << price
+                << " " << (1 + i % 9);
+            lines.push_back(oss.str());
+        }
+        return lines;
+    };
+    const vector<string> lines = makeLines(300);
+    auto writeLines = [](size_t count, const string &tail, const vector<string> &all) {
+        std::ofstream ofs("rsm.log", std::ios::binary);
+        for (size_t i = 0; i < count; ++i)
+            ofs << all[i] << "\n";
+        ofs << tail;
+    };
+    auto cleanUp = []() {
+        std::remove("rsm.log");
+        std::remove("rsm.log.resume");
+        std::remove("RSM.events");
+        std::remove("RSM.ckpt");
+        removeSymbolFiles("RSM");
+    };
+    
+    cleanUp();
+    writeLines(lines.size(), "", lines);
+    {
+        BookProcessor processor({"rsm.log"});
+        processor.process();
+    }
+    const vector<Snapshot> expected = readAllSnapshots("RSM.snap");
+    assert(expected.size() == lines.size());
+    auto matchesFirst = [&expected](size_t count) {
+        vector<Snapshot> got = readAllSnapshots("RSM.snap");
+        if (got.size() != count)
+            return false;
+        for (size_t i = 0; i < count; ++i) {
+            if (!sameSnapshot(got[i], expected[i]))
+                return false;
+        }
+        return true;
+    };
+    
+    ProcessorOptions stream, mapped, pipelined;
+    stream.parserMode = ParserMode::Stream;
+    pipelined.parseThreads = 2;
+    pipelined.chunkBytes = 128;
+    for (ProcessorOptions options : {stream, mapped, pipelined}) {
+        cleanUp();
+        options.resume = true;
+        options.resumeBytes = 500;
+        options.journal = true;
+        options.checkpointEvents = 23;
+        auto run = [&options]() {
+            BookProcessor processor({"rsm.log"}, options);
+            processor.process();
+        };
+        
+        // Test 1: A last line still being written is left for the next run.
+        writeLines(150, lines[150].substr(0, 10), lines);
+        run();
+        assert(matchesFirst(150));
+        const string firstCheckpoint = readFileBytes("rsm.log.resume");
+        assert(!firstCheckpoint.empty());
+        
+        // Test 2: The next run reads only the appended lines; one more adds nothing.
+        writeLines(lines.size(), "", lines);
+        run();
+        assert(matchesFirst(lines.size()));
+        const size_t snapBytes = readFileBytes("RSM.snap").size();
+        run();
+        assert(readFileBytes("RSM.snap").size() == snapBytes);
+        
+        // Test 3: A run that stopped after its outputs passed the checkpoint is
+        // cut back and continued, leaving no duplicates.
+        {
+            std::ofstream ofs("rsm.log.resume", std::ios::binary | std::ios::trunc);
+            ofs << firstCheckpoint;
+        }
+        run();
+        assert(matchesFirst(lines.size()));
+        QueryEngine engine({"RSM"});
+        QueryCriteria criteria{8100, 8199, {"RSM"}, {}, 0, SnapshotFilter()};
+        size_t count = 0;
+        engine.query(criteria, [&count](const Snapshot &) {
+            ++count;
+            return true;
+        });
+        assert(count == 100);
+        
+        // Test 4: The journal of the resumed runs rebuilds the book at any epoch.
+        std::ostringstream err;
+        for (int64_t epoch : {int64_t(8010), int64_t(8149), int64_t(8150), int64_t(8299)}) {
+            OrderBook direct("RSM");
+            for (const auto &line : lines) {
+                OrderView view;
+                assert(parseOrderView(line.data(), line.data() + line.size(), view));
+                Order order;
+                assignOrder(view, order);
+                if (order.epoch <= epoch)
+                    direct.processOrder(order);
+            }
+            BookState expectedState, state;
+            direct.saveState(expectedState);
+            assert(rebuildBook("RSM", epoch, state, err));
+            assert(sameBookState(state, expectedState));
+        }
+        assert(err.str().empty());
+        
+        // Test 5: An input whose processed part changed is refused and left alone.
+        vector<string> rewritten = lines;
+        rewritten[0] = "7999 1 RSM BUY NEW 99 1";
+        writeLines(rewritten.size(), "", rewritten);
+        run();
+        assert(readFileBytes("RSM.snap").size() == snapBytes && matchesFirst(lines.size()));
+    }
+    
+#ifndef _WIN32
+    // Test 6: Output of an earlier run without a checkpoint is kept, and a run
+    // killed before its first periodic checkpoint is cut back to that output.
+    cleanUp();
+    writeLines(40, "", lines);
+    {
+        BookProcessor processor({"rsm.log"});
+        processor.process();
+    }
+    const int64_t earlierBytes = existingFileSize("RSM.snap");
+    // Epochs continue after the earlier run's, as the writer refuses older snapshots.
+    const vector<string> many = makeLines(100000, 40);
+    writeLines(many.size(), "", many);
+    ProcessorOptions options;
+    options.resume = true;
+    cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        BookProcessor processor({"rsm.log"}, options);
+        processor.process();
+        _exit(0);
+    }
+    assert(child > 0);
+    // Kill the run once its first full buffer reached the disk, long before the end of the input.
+    while (existingFileSize("RSM.snap") <= earlierBytes)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    kill(child, SIGKILL);
+    int status = 0;
+    waitpid(child, &status, 0);
+    assert(WIFSIGNALED(status));
+    {
+        BookProcessor processor({"rsm.log"}, options);
+        processor.process();
+    }
+    const vector<Snapshot> got = readAllSnapshots("RSM.snap");
+    assert(got.size() == 40 + many.size());
+    for (size_t i = 0; i < got.size(); ++i)
+        assert(got[i].epoch == static_cast<int64_t>(8000 + i));
+    Snapshot shifted = expected[299];
+    shifted.epoch += 40;
+    assert(sameSnapshot(got[39], expected[39]) && sameSnapshot(got[40 + 299], shifted));
+    
+    // Test 7: The fingerprint also covers the end of a long processed input.
+    vector<string> rewritten = many;
+    rewritten.back().back() = '0';
+    writeLines(rewritten.size(), "", rewritten);
+    {
+        BookProcessor processor({"rsm.log"}, options);
+        processor.process();
+    }
+    assert(readAllSnapshots("RSM.snap").size() == got.size());
+#endif
+    
+    cleanUp();
+    cout << "Resumable Ingestion test passed (36/37)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -686,7 +3225,9 @@ void testProcessAndQueryABB_CDD() {
     std::remove("ABB.snap");
     std::remove("CDD.snap");
     std::remove("ABB.idx");
+    std::remove("ABB.zmap");
     std::remove("CDD.idx");
+    std::remove("CDD.zmap");
     
     vector<string> logFiles = {"ABB.log", "CDD.log"};
     BookProcessor processor(logFiles);
@@ -724,9 +3265,11 @@ void testProcessAndQueryABB_CDD() {
     std::remove("ABB.snap");
     std::remove("CDD.snap");
     std::remove("ABB.idx");
+    std::remove("ABB.zmap");
     std::remove("CDD.idx");
+    std::remove("CDD.zmap");
     
-    cout << "Process and query test for ABB and CDD passed (12/12) (Integration Test)!" << endl << endl;
+    cout << "Process and query test for ABB and CDD passed (37/37) (Integration Test)!" << endl << endl;
 }
 
 // ----------------------------------------------------------------------
@@ -734,6 +3277,9 @@ void testProcessAndQueryABB_CDD() {
 // ----------------------------------------------------------------------
 int main() {
     testOrderBook();
+    testPriceLadderBook();
+    testOrderTable();
+    testVisibleChangeTracking();
     testSnapshotSerialization();
     testQueryEngineDefaultOutput();
     testQueryEngineSelectiveOutput();
@@ -741,11 +3287,33 @@ int main() {
     testQueryEngineMultiSymbol();
     testQueryEngineNoResults();
     testIndexFileContent();
+    testLogParser();
+    testSnapshotWriter();
+    testDeltaSnapshotStorage();
+    testColumnarSnapshotStorage();
+    testQueryEngineMapped();
+    testBlockIndex();
+    testSnapshotMerger();
+    testQueryEngineParallel();
+    testQueryEngineStreaming();
+    testQueryBinaryOutput();
+    testQueryEngineAsOf();
+    testQueryEngineAggregate();
+    testSnapshotFilter();
+    testZoneMap();
+    testQueryServer();
     testBookProcessorEmptyFile();
     testBookProcessorSingleOrder();
     testBookProcessorInvalidInput();
+    testBookProcessorPipeline();
+    testBookProcessorShardedRouting();
+    testBookProcessorChangedSnapshots();
+    testBookJournal();
+    testSnapshotDepth();
+    testFixedPointPrices();
+    testResumableIngestion();
     testProcessAndQueryABB_CDD();
     
-    cout << "All tests (12/12) passed successfully :)" << endl;
+    cout << "All tests (37/37) passed successfully :)" << endl;
     return 0;
 }
@@ -1,4 +1,7 @@
 import logging
+import os
+import socket
+import struct
 import subprocess
 import time
 from flask import Flask, render_template, request, jsonify
@@ -13,6 +16,34 @@ logging.basicConfig(
 )
 
 BINARY = "../orderbook"
+# Socket of a running "orderbook serve"; queries go there when it exists.
+SERVER_SOCKET = "../orderbook.sock"
+
+
+def recv_exact(sock, size):
+    data = b""
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError("query server closed the connection")
+        data += chunk
+    return data
+
+
+def query_server(args):
+    """Sends one framed request to the query server; returns (ok, text)."""
+    payload = " ".join(args).encode()
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(SERVER_SOCKET)
+        sock.sendall(struct.pack("<I", len(payload)) + payload)
+        (status,) = struct.unpack("<I", recv_exact(sock, 4))
+        chunks = []
+        while True:
+            (length,) = struct.unpack("<I", recv_exact(sock, 4))
+            if length == 0:
+                break
+            chunks.append(recv_exact(sock, length))
+        return status == 0, b"".join(chunks).decode()
 
 @app.route("/")
 def index():
@@ -67,13 +98,28 @@ def run_command():
         ts2    = request.form["end_ts"]
         fields = request.form["fields"].strip()
 
-        query_cmd = [BINARY, "query", syms, ts1, ts2]
+        query_args = [syms, ts1, ts2]
         if fields:
-            query_cmd.append(fields)
-
-        # log and time via run_and_log
-        proc, elapsed = run_and_log(query_cmd, cwd="..", capture_output=True, text=True)
-        elapsed_ms = elapsed * 1000
+            query_args.append(fields)
+
+        proc = None
+        if hasattr(socket, "AF_UNIX") and os.path.exists(SERVER_SOCKET):
+            app.logger.info("🚀 Querying server> %s", " ".join(query_args))
+            start = time.monotonic()
+            try:
+                ok, text = query_server(query_args)
+            except OSError as e:
+                # A stale socket file or a server that went away: run the query command instead.
+                app.logger.warning("⚠️  Query server unavailable (%s)", e)
+            else:
+                elapsed_ms = (time.monotonic() - start) * 1000
+                app.logger.info("%s Finished in %.3f ms", "✅" if ok else "❌", elapsed_ms)
+                proc = subprocess.CompletedProcess(query_args, 0 if ok else 1,
+                                                   stdout=text if ok else "", stderr="" if ok else text)
+        if proc is None:
+            # log and time via run_and_log
+            proc, elapsed = run_and_log([BINARY, "query"] + query_args, cwd="..", capture_output=True, text=True)
+            elapsed_ms = elapsed * 1000
 
     # Combine stdout/stderr for return
     output = proc.stdout or ""